@@ -78,7 +78,9 @@
 /*
 /*	bounce_template_expand() expands the body text of the
 /*	specified template and writes the result to the specified
-/*	stream.
+/*	stream. The expansion depends on main.cf parameters only,
+/*	and is therefore saved for use with later notifications.
+/*	It is discarded when the template is reset or overridden.
 /*
 /*	bounce_template_dump() dumps the specified template to the
 /*	specified stream.
@@ -232,10 +234,21 @@ BOUNCE_TEMPLATE *bounce_template_create(const BOUNCE_TEMPLATE *prototype)
     return (tp);
 }
 
+/* bounce_template_forget - discard saved expansion */
+
+static void bounce_template_forget(BOUNCE_TEMPLATE *tp)
+{
+    if (tp->expansion) {
+	argv_free(tp->expansion);
+	tp->expansion = 0;
+    }
+}
+
 /* bounce_template_free - destroy one template */
 
 void    bounce_template_free(BOUNCE_TEMPLATE *tp)
 {
+    bounce_template_forget(tp);
     if (tp->buffer) {
 	myfree(tp->buffer);
 	myfree((void *) tp->origin);
@@ -247,6 +260,7 @@ void    bounce_template_free(BOUNCE_TEMPLATE *tp)
 
 static void bounce_template_reset(BOUNCE_TEMPLATE *tp)
 {
+    bounce_template_forget(tp);
     myfree(tp->buffer);
     myfree((void *) tp->origin);
     *tp = *(tp->prototype);
@@ -263,6 +277,7 @@ void    bounce_template_load(BOUNCE_TEMPLATE *tp, const char *origin,
      */
     if (tp->buffer)
 	bounce_template_reset(tp);
+    bounce_template_forget(tp);
 
     /*
      * Postpone the work of template parsing until it is really needed. Most
@@ -498,25 +513,39 @@ void    bounce_template_headers(BOUNCE_XP_PRN_FN out_fn, VSTREAM *fp,
 void    bounce_template_expand(BOUNCE_XP_PUT_FN out_fn, VSTREAM *fp,
 			               BOUNCE_TEMPLATE *tp)
 {
-    VSTRING *buf = vstring_alloc(100);
+    VSTRING *buf;
     const char **cpp;
+    char  **line;
     int     stat;
 
     if (tp->flags & BOUNCE_TMPL_FLAG_NEW_BUFFER)
 	bounce_template_parse_buffer(tp);
 
-    for (cpp = tp->message_text; *cpp; cpp++) {
-	stat = mac_expand(buf, *cpp, MAC_EXP_FLAG_PRINTABLE, (char *) 0,
-			  bounce_template_lookup, (void *) tp);
-	if (stat & MAC_PARSE_ERROR)
-	    msg_fatal("%s: bad $name syntax in %s template: %s",
-		      tp->origin, tp->class, *cpp);
-	if (stat & MAC_PARSE_UNDEF)
-	    msg_fatal("%s: undefined $name in %s template: %s",
-		      tp->origin, tp->class, *cpp);
-	out_fn(fp, STR(buf));
+    /*
+     * All $name values come from main.cf, so the expansion is the same for
+     * every notification that this process sends. After a mail outage, a
+     * bounce process may send hundreds of delay notices in a row; expand the
+     * template only for the first one.
+     */
+    if (tp->expansion == 0) {
+	buf = vstring_alloc(100);
+	tp->expansion = argv_alloc(20);
+	for (cpp = tp->message_text; *cpp; cpp++) {
+	    stat = mac_expand(buf, *cpp, MAC_EXP_FLAG_PRINTABLE, (char *) 0,
+			      bounce_template_lookup, (void *) tp);
+	    if (stat & MAC_PARSE_ERROR)
+		msg_fatal("%s: bad $name syntax in %s template: %s",
+			  tp->origin, tp->class, *cpp);
+	    if (stat & MAC_PARSE_UNDEF)
+		msg_fatal("%s: undefined $name in %s template: %s",
+			  tp->origin, tp->class, *cpp);
+	    argv_add(tp->expansion, STR(buf), (char *) 0);
+	}
+	argv_terminate(tp->expansion);
+	vstring_free(buf);
     }
-    vstring_free(buf);
+    for (line = tp->expansion->argv; *line; line++)
+	out_fn(fp, *line);
 }
 
 /* bounce_template_dump - dump template to stream */
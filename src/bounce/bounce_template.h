@@ -15,6 +15,7 @@
   * Utility library.
   */
 #include <vstream.h>
+#include <argv.h>
 
  /*
   * Structure of a single bounce template. Each template is manipulated by
@@ -33,6 +34,7 @@ typedef struct BOUNCE_TEMPLATE {
     const char **message_text;		/* message text (configurable) */
     const struct BOUNCE_TEMPLATE *prototype;	/* defaults */
     char   *buffer;			/* ripped text */
+    ARGV   *expansion;			/* expanded message text */
 } BOUNCE_TEMPLATE;
 
 #define BOUNCE_TMPL_FLAG_NEW_BUFFER	(1<<0)
@@ -559,6 +559,12 @@ static void cleanup_service(VSTREAM *src, char *unused_service, char **argv)
      * Finish this message, and report the result status to the client.
      */
     status = cleanup_flush(state);		/* in case state is modified */
+    if (status == CLEANUP_STAT_OK) {
+	STATS_INC(cleanup_stats_msgs);
+	STATS_ADD(cleanup_stats_bytes, state->cont_length);
+    } else {
+	STATS_INC(cleanup_stats_rejects);
+    }
     attr_print(src, ATTR_FLAG_NONE,
 	       SEND_ATTR_INT(MAIL_ATTR_STATUS, status),
 	       SEND_ATTR_STR(MAIL_ATTR_WHY,
@@ -20,6 +20,7 @@
 #include <vstream.h>
 #include <argv.h>
 #include <nvtable.h>
+#include <stats.h>
 
  /*
   * Global library.
@@ -193,6 +194,13 @@ extern MILTERS *cleanup_milters;
   */
 extern int cleanup_ext_prop_mask;
 
+ /*
+  * Performance counters.
+  */
+extern STATS_CELL *cleanup_stats_msgs;
+extern STATS_CELL *cleanup_stats_bytes;
+extern STATS_CELL *cleanup_stats_rejects;
+
  /*
   * Saved queue file names, so the files can be removed in case of a fatal
   * run-time error.
@@ -274,6 +274,13 @@ VSTRING *cleanup_strip_chars;
   */
 int     cleanup_ext_prop_mask;
 
+ /*
+  * Performance counters.
+  */
+STATS_CELL *cleanup_stats_msgs;
+STATS_CELL *cleanup_stats_bytes;
+STATS_CELL *cleanup_stats_rejects;
+
  /*
   * Milter support.
   */
@@ -476,4 +483,11 @@ void    cleanup_post_jail(char *unused_name, char **unused_argv)
 				NAME_CODE_FLAG_NONE, var_hfrom_format)) < 0)
 	msg_fatal("invalid setting: %s = %s",
 		  VAR_HFROM_FORMAT, var_hfrom_format);
+
+    /*
+     * Performance counters. See "postfix stats".
+     */
+    cleanup_stats_msgs = stats_counter("cleanup_messages_total");
+    cleanup_stats_bytes = stats_counter("cleanup_message_bytes_total");
+    cleanup_stats_rejects = stats_counter("cleanup_messages_not_queued_total");
 }
@@ -7,6 +7,9 @@
 /* .fi
 /*	\fBfsstone\fR [\fB-cr\fR] [\fB-s \fIsize\fR]
 /*		\fImsg_count files_per_dir\fR
+/*
+/*	\fBfsstone\fR \fB-m\fR [\fB-b \fIbatch\fR] [\fB-s \fIsize\fR]
+/*		\fImsg_count files_per_dir\fR
 /* DESCRIPTION
 /*	The \fBfsstone\fR command measures the cost of creating, renaming
 /*	and deleting queue files versus appending messages to existing
@@ -16,9 +19,24 @@
 /*	and arranges for at most \fIfiles_per_dir\fR simultaneous files
 /*	in the same directory.
 /*
+/*	With the \fB-m\fR option, the program instead simulates maildir
+/*	delivery: it creates each file in the \fBtmp\fR subdirectory,
+/*	flushes it to stable storage, links it into the \fBnew\fR
+/*	subdirectory, and removes the \fBtmp\fR file. The subdirectories
+/*	are created when they do not exist.
+/*
 /*	Options:
+/* .IP "\fB-b \fIbatch\fR"
+/*	With \fB-m\fR, write up to \fIbatch\fR files before flushing
+/*	them to stable storage as a group with \fBfsync_batch\fR(3),
+/*	as done by the \fBvirtual\fR(8) delivery agent with
+/*	"\fBvirtual_maildir_sync_batch_limit\fR > 1". The default
+/*	is 1 (flush each file separately).
 /* .IP \fB-c\fR
 /*	Create and delete files.
+/* .IP \fB-m\fR
+/*	Simulate maildir delivery (incompatible with \fB-c\fR and
+/*	\fB-r\fR).
 /* .IP \fB-r\fR
 /*	Rename files twice (requires \fB-c\fR).
 /* .IP \fB-s \fIsize\fR
@@ -49,12 +67,17 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 
 /* Utility library. */
 
 #include <msg.h>
 #include <msg_vstream.h>
+#include <mymalloc.h>
+#include <fsync_batch.h>
 
 /* Global directory. */
 
@@ -149,11 +172,76 @@ static void remove_silent(int seq)
     (void) remove(path);
 }
 
+/* maildir_write - create a little maildir tmp/ file, don't flush */
+
+static int maildir_write(int seqno, int size)
+{
+    char    path[BUFSIZ];
+    char    buf[1024];
+    int     fd;
+    int     i;
+
+    sprintf(path, "tmp/%06d", seqno);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600)) < 0)
+	msg_fatal("open %s: %m", path);
+    memset(buf, 'x', sizeof(buf));
+    for (i = 0; i < size; i++)
+	if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+	    msg_fatal("write %s: %m", path);
+    return (fd);
+}
+
+/* maildir_commit - flush maildir tmp/ files, and move them into new/ */
+
+static void maildir_commit(int first, int *fds, int count, int max_file)
+{
+    char    tmp_path[BUFSIZ];
+    char    new_path[BUFSIZ];
+    int    *errs;
+    int     i;
+
+    errs = (int *) mymalloc(sizeof(*errs) * count);
+    if (fsync_batch(fds, errs, count) > 0)
+	for (i = 0; i < count; i++)
+	    if (errs[i] != 0) {
+		errno = errs[i];
+		msg_fatal("fsync: %m");
+	    }
+    for (i = 0; i < count; i++) {
+	if (close(fds[i]) < 0)
+	    msg_fatal("close: %m");
+	sprintf(tmp_path, "tmp/%06d", first + i);
+	sprintf(new_path, "new/%06d", (first + i) % max_file);
+	if (unlink(new_path) < 0 && errno != ENOENT)
+	    msg_fatal("remove %s: %m", new_path);
+	if (link(tmp_path, new_path) < 0)
+	    msg_fatal("link %s to %s: %m", tmp_path, new_path);
+	if (unlink(tmp_path) < 0)
+	    msg_fatal("remove %s: %m", tmp_path);
+    }
+    myfree((void *) errs);
+}
+
+/* maildir_clean - remove maildir directory fillers */
+
+static void maildir_clean(int max_file)
+{
+    char    path[BUFSIZ];
+    int     seq;
+
+    for (seq = 0; seq < max_file; seq++) {
+	sprintf(path, "new/%06d", seq);
+	(void) remove(path);
+    }
+}
+
 /* usage - explain */
 
 static void usage(char *myname)
 {
-    msg_fatal("usage: %s [-cr] [-s size] messages directory_entries", myname);
+    msg_fatal("usage: %s [-cr] [-s size] messages directory_entries\n"
+	      "       %s -m [-b batch] [-s size] messages directory_entries",
+	      myname, myname);
 }
 
 MAIL_VERSION_STAMP_DECLARE;
@@ -165,6 +253,10 @@ int     main(int argc, char **argv)
     struct timeval start, end;
     int     do_rename = 0;
     int     do_create = 0;
+    int     do_maildir = 0;
+    int     batch = 1;
+    int    *fds;
+    int     count;
     int     seq;
     int     ch;
     int     size = 2;
@@ -175,11 +267,18 @@ int     main(int argc, char **argv)
     MAIL_VERSION_STAMP_ALLOCATE;
 
     msg_vstream_init(argv[0], VSTREAM_ERR);
-    while ((ch = GETOPT(argc, argv, "crs:")) != EOF) {
+    while ((ch = GETOPT(argc, argv, "b:cmrs:")) != EOF) {
 	switch (ch) {
+	case 'b':
+	    if ((batch = atoi(optarg)) <= 0)
+		usage(argv[0]);
+	    break;
 	case 'c':
 	    do_create++;
 	    break;
+	case 'm':
+	    do_maildir++;
+	    break;
 	case 'r':
 	    do_rename++;
 	    break;
@@ -192,13 +291,41 @@ int     main(int argc, char **argv)
 	}
     }
 
-    if (argc - optind != 2 || (do_rename && !do_create))
+    if (argc - optind != 2 || (do_rename && !do_create)
+	|| (do_maildir && do_create))
 	usage(argv[0]);
     if ((op_count = atoi(argv[optind])) <= 0)
 	usage(argv[0]);
     if ((max_file = atoi(argv[optind + 1])) <= 0)
 	usage(argv[0]);
 
+    /*
+     * Simulate maildir delivery, optionally flushing files as a group.
+     */
+    if (do_maildir) {
+	if ((mkdir("tmp", 0700) < 0 && errno != EEXIST)
+	    || (mkdir("new", 0700) < 0 && errno != EEXIST))
+	    msg_fatal("create maildir subdirectory: %m");
+	fds = (int *) mymalloc(sizeof(*fds) * batch);
+	GETTIMEOFDAY(&start);
+	for (seq = 0; seq < op_count; seq += count) {
+	    for (count = 0; count < batch && seq + count < op_count; count++)
+		fds[count] = maildir_write(seq + count, size);
+	    maildir_commit(seq, fds, count, max_file);
+	}
+	GETTIMEOFDAY(&end);
+	if (end.tv_usec < start.tv_usec) {
+	    end.tv_sec--;
+	    end.tv_usec += 1000000;
+	}
+	printf("elapsed time: %ld.%06ld\n",
+	       (long) (end.tv_sec - start.tv_sec),
+	       (long) (end.tv_usec - start.tv_usec));
+	maildir_clean(max_file);
+	myfree((void *) fds);
+	return (0);
+    }
+
     /*
      * Populate the directory with little files.
      */
@@ -38,10 +38,18 @@
 /*	DELIVER_REQUEST *deliver_request_read(stream)
 /*	VSTREAM *stream;
 /*
+/*	DELIVER_REQUEST *deliver_request_read_more(stream)
+/*	VSTREAM *stream;
+/*
 /*	void	deliver_request_done(stream, request, status)
 /*	VSTREAM *stream;
 /*	DELIVER_REQUEST *request;
 /*	int	status;
+/*
+/*	DELIVER_REQUEST *deliver_request_next(stream, request, status)
+/*	VSTREAM *stream;
+/*	DELIVER_REQUEST *request;
+/*	int	status;
 /* DESCRIPTION
 /*	This module implements the delivery agent side of the `queue manager
 /*	to delivery agent' protocol. In this game, the queue manager is
@@ -50,7 +58,13 @@
 /*	deliver_request_read() reads a client message delivery request,
 /*	opens the queue file, and acquires a shared lock.
 /*	A null result means that the client sent bad information or that
-/*	it went away unexpectedly.
+/*	it went away unexpectedly, or that no request arrived within
+/*	$ipc_timeout seconds.
+/*
+/*	deliver_request_read_more() is like deliver_request_read(),
+/*	but also tells the client that the delivery agent may ask
+/*	for more work with deliver_request_next(). Only a client
+/*	that receives this announcement will set DEL_REQ_FLAG_MORE.
 /*
 /*	The \fBflags\fR structure member is the bit-wise OR of zero or more
 /*	of the following:
@@ -65,6 +79,9 @@
 /* .IP \fBDEL_REQ_FLAG_BOUNCE\fR
 /*	Delete bounced recipients from the queue file. Currently,
 /*	this flag is non-functional.
+/* .IP \fBDEL_REQ_FLAG_MORE\fR
+/*	The client accepts a request for more work in the final
+/*	delivery status report; see deliver_request_next() below.
 /* .PP
 /*	The \fBDEL_REQ_FLAG_DEFLT\fR constant provides a convenient shorthand
 /*	for the most common case: delete successful and bounced recipients.
@@ -78,6 +95,16 @@
 /*	closes the queue file,
 /*	and destroys the DELIVER_REQUEST structure. The result is
 /*	non-zero when the status could not be reported to the client.
+/*
+/*	deliver_request_next() is like deliver_request_done(), but
+/*	also tells the client that the delivery agent is willing to
+/*	handle another delivery request over the same stream. It
+/*	must be called only for a request with DEL_REQ_FLAG_MORE.
+/*	The result is the next delivery request, or a null pointer
+/*	when the client has no more work, when it sent bad information,
+/*	when it went away, or when no request arrived within
+/*	$ipc_timeout seconds. The next request may be for a different
+/*	destination than the previous one.
 /* DIAGNOSTICS
 /*	Warnings: bad data sent by the client. Fatal errors: out of
 /*	memory, queue file open errors.
@@ -113,6 +140,7 @@
 
 /* Global library. */
 
+#include "mail_params.h"
 #include "mail_queue.h"
 #include "mail_proto.h"
 #include "mail_open_ok.h"
@@ -124,7 +152,7 @@
 
 /* deliver_request_initial - send initial status code */
 
-static int deliver_request_initial(VSTREAM *stream)
+static int deliver_request_initial(VSTREAM *stream, int more)
 {
     int     err;
 
@@ -133,12 +161,18 @@ static int deliver_request_initial(VSTREAM *stream)
      * to handle service requests. Thus, a delivery agent process must send
      * something to inform the queue manager that it is ready to receive a
      * delivery request; otherwise the queue manager could block in write().
+     * 
+     * A delivery agent that supports deliver_request_next() says so here.
      */
     if (msg_verbose)
 	msg_info("deliver_request_initial: send initial status");
-    attr_print(stream, ATTR_FLAG_NONE,
+    attr_print(stream, more ? ATTR_FLAG_MORE : ATTR_FLAG_NONE,
 	       SEND_ATTR_INT(MAIL_ATTR_STATUS, 0),
 	       ATTR_TYPE_END);
+    if (more)
+	attr_print(stream, ATTR_FLAG_NONE,
+		   SEND_ATTR_INT(MAIL_ATTR_MORE, 1),
+		   ATTR_TYPE_END);
     if ((err = vstream_fflush(stream)) != 0)
 	if (msg_verbose)
 	    msg_warn("send initial status: %m");
@@ -148,7 +182,7 @@ static int deliver_request_initial(VSTREAM *stream)
 /* deliver_request_final - send final delivery request status */
 
 static int deliver_request_final(VSTREAM *stream, DELIVER_REQUEST *request,
-				         int status)
+				         int status, int more)
 {
     DSN    *hop_status;
     int     err;
@@ -164,14 +198,25 @@ static int deliver_request_final(VSTREAM *stream, DELIVER_REQUEST *request,
     if (msg_verbose)
 	msg_info("deliver_request_final: send: \"%s\" %d",
 		 hop_status->reason, status);
-    attr_print(stream, ATTR_FLAG_NONE,
+    attr_print(stream, more ? ATTR_FLAG_MORE : ATTR_FLAG_NONE,
 	       SEND_ATTR_FUNC(dsn_print, (void *) hop_status),
 	       SEND_ATTR_INT(MAIL_ATTR_STATUS, status),
 	       ATTR_TYPE_END);
+    if (more)
+	attr_print(stream, ATTR_FLAG_NONE,
+		   SEND_ATTR_INT(MAIL_ATTR_MORE, 1),
+		   ATTR_TYPE_END);
     if ((err = vstream_fflush(stream)) != 0)
 	if (msg_verbose)
 	    msg_warn("send final status: %m");
 
+    /*
+     * Don't wait for the receiver to close the connection when we asked for
+     * more work. See deliver_request_next().
+     */
+    if (more)
+	return (err);
+
     /*
      * With some UNIX systems, stream sockets lose data when you close them
      * immediately after writing to them. That is not how sockets are
@@ -434,24 +479,38 @@ static void deliver_request_free(DELIVER_REQUEST *request)
     myfree((void *) request);
 }
 
-/* deliver_request_read - create and read delivery request */
+/* deliver_request_wait - wait for delivery request */
 
-DELIVER_REQUEST *deliver_request_read(VSTREAM *stream)
+static int deliver_request_wait(VSTREAM *stream)
 {
-    DELIVER_REQUEST *request;
 
     /*
-     * Tell the queue manager that we are ready for this request.
+     * Be prepared for the queue manager to change its mind after contacting
+     * us. This can happen when a transport or host goes bad. Don't wait
+     * forever when the queue manager keeps the connection open but sends
+     * nothing.
      */
-    if (deliver_request_initial(stream) != 0)
-	return (0);
+    if (read_wait(vstream_fileno(stream), var_ipc_timeout) < 0) {
+	msg_warn("timeout waiting for delivery request");
+	return (-1);
+    }
+    if (peekfd(vstream_fileno(stream)) <= 0)
+	return (-1);
+    return (0);
+}
+
+/* deliver_request_read_common - create and read delivery request */
+
+static DELIVER_REQUEST *deliver_request_read_common(VSTREAM *stream, int more)
+{
+    DELIVER_REQUEST *request;
 
     /*
-     * Be prepared for the queue manager to change its mind after contacting
-     * us. This can happen when a transport or host goes bad.
+     * Tell the queue manager that we are ready for this request.
      */
-    (void) read_wait(vstream_fileno(stream), -1);
-    if (peekfd(vstream_fileno(stream)) <= 0)
+    if (deliver_request_initial(stream, more) != 0)
+	return (0);
+    if (deliver_request_wait(stream) < 0)
 	return (0);
 
     /*
@@ -467,13 +526,55 @@ DELIVER_REQUEST *deliver_request_read(VSTREAM *stream)
     return (request);
 }
 
+/* deliver_request_read - create and read delivery request */
+
+DELIVER_REQUEST *deliver_request_read(VSTREAM *stream)
+{
+    return (deliver_request_read_common(stream, 0));
+}
+
+/* deliver_request_read_more - create and read delivery request */
+
+DELIVER_REQUEST *deliver_request_read_more(VSTREAM *stream)
+{
+    return (deliver_request_read_common(stream, 1));
+}
+
 /* deliver_request_done - finish delivery request */
 
 int     deliver_request_done(VSTREAM *stream, DELIVER_REQUEST *request, int status)
 {
     int     err;
 
-    err = deliver_request_final(stream, request, status);
+    err = deliver_request_final(stream, request, status, 0);
     deliver_request_free(request);
     return (err);
 }
+
+/* deliver_request_next - finish delivery request, ask for more */
+
+DELIVER_REQUEST *deliver_request_next(VSTREAM *stream,
+				              DELIVER_REQUEST *request,
+				              int status)
+{
+    int     err;
+
+    if ((request->flags & DEL_REQ_FLAG_MORE) == 0)
+	msg_panic("deliver_request_next: client does not support more work");
+    err = deliver_request_final(stream, request, status, 1);
+    deliver_request_free(request);
+    if (err != 0)
+	return (0);
+
+    /*
+     * The queue manager either sends another request, or disconnects.
+     */
+    if (deliver_request_wait(stream) < 0)
+	return (0);
+    request = deliver_request_alloc();
+    if (deliver_request_get(stream, request) < 0) {
+	deliver_request_done(stream, request, XXX_DEFER_STATUS);
+	request = 0;
+    }
+    return (request);
+}
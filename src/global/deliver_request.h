@@ -74,6 +74,7 @@ typedef struct DELIVER_REQUEST {
 #define DEL_REQ_FLAG_CONN_LOAD	(1<<11)	/* Consult opportunistic cache */
 #define DEL_REQ_FLAG_CONN_STORE	(1<<12)	/* Update opportunistic cache */
 #define DEL_REQ_FLAG_REC_DLY_SENT	(1<<13)	/* Record delayed delivery */
+#define DEL_REQ_FLAG_MORE	(1<<14)	/* Client accepts "more" reply */
 
  /*
   * Cache Load and Store as value or mask. Use explicit _MASK for multi-bit
@@ -126,7 +127,9 @@ typedef struct DELIVER_REQUEST {
 
 typedef struct VSTREAM _deliver_vstream_;
 extern DELIVER_REQUEST *deliver_request_read(_deliver_vstream_ *);
+extern DELIVER_REQUEST *deliver_request_read_more(_deliver_vstream_ *);
 extern int deliver_request_done(_deliver_vstream_ *, DELIVER_REQUEST *, int);
+extern DELIVER_REQUEST *deliver_request_next(_deliver_vstream_ *, DELIVER_REQUEST *, int);
 
 /* LICENSE
 /* .ad
@@ -14,12 +14,75 @@
 /*	MAI_SERVPORT_STR *smtp_client_port,
 /*	MAI_HOSTADDR_STR *smtp_server_addr,
 /*	MAI_SERVPORT_STR *smtp_server_port;
+/*
+/*	const char *haproxy_srvr_parse_buf(buf, len, non_proxy,
+/*			smtp_client_addr, smtp_client_port,
+/*			smtp_server_addr, smtp_server_port, tlv)
+/*	const char *buf;
+/*	ssize_t	*len;
+/*	int	*non_proxy;
+/*	MAI_HOSTADDR_STR *smtp_client_addr,
+/*	MAI_SERVPORT_STR *smtp_client_port,
+/*	MAI_HOSTADDR_STR *smtp_server_addr,
+/*	MAI_SERVPORT_STR *smtp_server_port;
+/*	HAPROXY_SRVR_TLV **tlv;
+/*
+/*	const char *haproxy_srvr_receive(fd, pending, non_proxy,
+/*			smtp_client_addr, smtp_client_port,
+/*			smtp_server_addr, smtp_server_port, tlv)
+/*	int	fd;
+/*	VSTRING	*pending;
+/*	int	*non_proxy;
+/*	MAI_HOSTADDR_STR *smtp_client_addr,
+/*	MAI_SERVPORT_STR *smtp_client_port,
+/*	MAI_HOSTADDR_STR *smtp_server_addr,
+/*	MAI_SERVPORT_STR *smtp_server_port;
+/*	HAPROXY_SRVR_TLV **tlv;
+/*
+/*	void	haproxy_srvr_tlv_free(tlv)
+/*	HAPROXY_SRVR_TLV *tlv;
+/*
+/*	int	HAPROXY_SRVR_INCOMPLETE(err)
+/*	const char *err;
 /* DESCRIPTION
 /*	haproxy_srvr_parse() parses a haproxy line. The result is
 /*	null in case of success, a pointer to text (with the error
 /*	type) in case of error. If both IPv6 and IPv4 support are
 /*	enabled, IPV4_IN_IPV6 address syntax (::ffff:1.2.3.4) is
 /*	converted to IPV4 syntax.
+/*
+/*	haproxy_srvr_parse_buf() parses a haproxy version 1 line
+/*	or a haproxy version 2 binary header at the start of the
+/*	specified buffer. On input, the len argument specifies the
+/*	amount of data in the buffer. Upon success, the result is
+/*	null, and the len argument is updated with the header length.
+/*	The non_proxy argument is set to non-zero when a version 2
+/*	header has the LOCAL command (for example, a health check);
+/*	the caller should then use the real connection endpoints,
+/*	and the address and port arguments are not updated. When
+/*	the tlv argument is not null, it receives a pointer to the
+/*	information from version 2 TLVs, or a null pointer; destroy
+/*	the result with haproxy_srvr_tlv_free(). When the buffer
+/*	holds only the start of a header, the result is a value for
+/*	which HAPROXY_SRVR_INCOMPLETE() is true.
+/*
+/*	haproxy_srvr_receive() receives a haproxy header from the
+/*	specified file descriptor, without reading past the end of
+/*	the header. In the common case it makes one recv(MSG_PEEK)
+/*	call and one read() call, independent of the header length.
+/*	The pending argument must be empty before the first call
+/*	for a connection. When HAPROXY_SRVR_INCOMPLETE() is true
+/*	for the result, the data received so far is kept in pending,
+/*	and the call should be repeated when more data is available.
+/*	Upon success, pending contains the header; in case of error,
+/*	pending contains the data that was examined. The other
+/*	arguments and results are as with haproxy_srvr_parse_buf().
+/*
+/*	The version 2 TLVs that are made available are ALPN,
+/*	authority (server name), unique ID, and from the SSL TLV,
+/*	the TLS protocol version, cipher name, and client certificate
+/*	CN. Non-printable characters are replaced with '?'. Other
+/*	TLVs are skipped.
 /* LICENSE
 /* .ad
 /* .fi
@@ -34,7 +97,12 @@
 /* System library. */
 
 #include <sys_defs.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
 #include <stdarg.h>
+#include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -50,6 +118,7 @@
 #include <stringops.h>
 #include <mymalloc.h>
 #include <inet_proto.h>
+#include <hex_code.h>
 
 /* Global library. */
 
@@ -59,6 +128,40 @@
 
 static INET_PROTO_INFO *proto_info;
 
+const char haproxy_srvr_incomplete[] = "incomplete protocol header";
+
+ /*
+  * Protocol version 2 header layout, and the TLVs that we care about.
+  */
+#define HAPROXY_V1_SIG		"PROXY "
+#define HAPROXY_V1_SIG_LEN	(sizeof(HAPROXY_V1_SIG) - 1)
+#define HAPROXY_V2_SIG		"\r\n\r\n\0\r\nQUIT\n"
+#define HAPROXY_V2_SIG_LEN	12
+#define HAPROXY_V2_HDR_LEN	16
+
+#define HAPROXY_V2_VERSION	0x20
+#define HAPROXY_V2_CMD_LOCAL	0x00
+#define HAPROXY_V2_CMD_PROXY	0x01
+#define HAPROXY_V2_FAM_TCP4	0x11
+#define HAPROXY_V2_FAM_TCP6	0x21
+
+#define PP2_TYPE_ALPN		0x01
+#define PP2_TYPE_AUTHORITY	0x02
+#define PP2_TYPE_UNIQUE_ID	0x05
+#define PP2_TYPE_SSL		0x20
+#define PP2_SUBTYPE_SSL_VERSION	0x21
+#define PP2_SUBTYPE_SSL_CN	0x22
+#define PP2_SUBTYPE_SSL_CIPHER	0x23
+
+#define PP2_CLIENT_SSL		0x01
+#define PP2_CLIENT_CERT_CONN	0x02
+#define PP2_CLIENT_CERT_SESS	0x04
+
+#define HAPROXY_GET16(cp)	(((cp)[0] << 8) | (cp)[1])
+#define HAPROXY_GET32(cp) \
+	(((unsigned long) (cp)[0] << 24) | ((cp)[1] << 16) \
+	 | ((cp)[2] << 8) | (cp)[3])
+
 /* haproxy_srvr_parse_lit - extract and validate string literal */
 
 static int haproxy_srvr_parse_lit(const char *str,...)
@@ -195,3 +298,524 @@ const char *haproxy_srvr_parse(const char *str,
     myfree(saved_str);
     return (err);
 }
+
+/* haproxy_srvr_tlv_str - save printable copy of TLV value */
+
+static char *haproxy_srvr_tlv_str(char **dst, const unsigned char *val,
+				          ssize_t len)
+{
+    if (*dst)
+	myfree(*dst);
+    *dst = mystrndup((const char *) val, len);
+    return (printable(*dst, '?'));
+}
+
+/* haproxy_srvr_parse_tlv - parse version 2 TLVs */
+
+static const char *haproxy_srvr_parse_tlv(const unsigned char *cp,
+					          const unsigned char *end,
+					          HAPROXY_SRVR_TLV *tlv,
+					          int nested)
+{
+    const unsigned char *val;
+    ssize_t len;
+    int     type;
+    int     client;
+    VSTRING *hex;
+
+    while (cp < end) {
+	if (end - cp < 3)
+	    return ("malformed TLV");
+	type = cp[0];
+	len = HAPROXY_GET16(cp + 1);
+	val = cp + 3;
+	if (len > end - val)
+	    return ("malformed TLV");
+	cp = val + len;
+	if (msg_verbose)
+	    msg_info("haproxy_srvr_parse: TLV type=0x%02x len=%ld",
+		     type, (long) len);
+
+	switch (nested ? type : type | 0x100) {
+	case PP2_TYPE_ALPN | 0x100:
+	    haproxy_srvr_tlv_str(&tlv->alpn, val, len);
+	    break;
+	case PP2_TYPE_AUTHORITY | 0x100:
+	    haproxy_srvr_tlv_str(&tlv->authority, val, len);
+	    break;
+	case PP2_TYPE_UNIQUE_ID | 0x100:
+	    if (tlv->unique_id)
+		myfree(tlv->unique_id);
+	    hex = hex_encode(vstring_alloc(2 * len + 1),
+			     (const char *) val, len);
+	    tlv->unique_id = vstring_export(hex);
+	    break;
+	case PP2_TYPE_SSL | 0x100:
+	    if (len < 5)
+		return ("malformed SSL TLV");
+	    client = val[0];
+	    if (client & PP2_CLIENT_SSL)
+		tlv->flags |= HAPROXY_TLV_FLAG_TLS;
+	    if (client & (PP2_CLIENT_CERT_CONN | PP2_CLIENT_CERT_SESS)) {
+		tlv->flags |= HAPROXY_TLV_FLAG_TLS_CERT;
+		if (HAPROXY_GET32(val + 1) == 0)
+		    tlv->flags |= HAPROXY_TLV_FLAG_TLS_VERIFIED;
+	    }
+	    if (haproxy_srvr_parse_tlv(val + 5, val + len, tlv, 1) != 0)
+		return ("malformed SSL TLV");
+	    break;
+	case PP2_SUBTYPE_SSL_VERSION:
+	    haproxy_srvr_tlv_str(&tlv->tls_version, val, len);
+	    break;
+	case PP2_SUBTYPE_SSL_CN:
+	    haproxy_srvr_tlv_str(&tlv->tls_peer_cn, val, len);
+	    break;
+	case PP2_SUBTYPE_SSL_CIPHER:
+	    haproxy_srvr_tlv_str(&tlv->tls_cipher, val, len);
+	    break;
+	default:
+	    break;
+	}
+    }
+    return (0);
+}
+
+/* haproxy_srvr_parse_v2_addr - convert binary address and port */
+
+static int haproxy_srvr_parse_v2_addr(int addr_family,
+				              const unsigned char *addr,
+				              const unsigned char *port,
+				              MAI_HOSTADDR_STR *addr_str,
+				              MAI_SERVPORT_STR *port_str)
+{
+    if (inet_ntop(addr_family, addr, addr_str->buf,
+		  sizeof(addr_str->buf)) == 0)
+	return (-1);
+#ifdef AF_INET6
+    if (addr_family == AF_INET6
+	&& strncasecmp("::ffff:", addr_str->buf, 7) == 0
+	&& strchr((char *) proto_info->sa_family_list, AF_INET) != 0)
+	memmove(addr_str->buf, addr_str->buf + 7,
+		strlen(addr_str->buf) + 1 - 7);
+#endif
+    sprintf(port_str->buf, "%u", (unsigned) HAPROXY_GET16(port));
+    return (0);
+}
+
+/* haproxy_srvr_parse_v2 - parse version 2 binary header */
+
+static const char *haproxy_srvr_parse_v2(const unsigned char *buf,
+					         ssize_t len,
+					         int *non_proxy,
+				        MAI_HOSTADDR_STR *smtp_client_addr,
+				        MAI_SERVPORT_STR *smtp_client_port,
+				        MAI_HOSTADDR_STR *smtp_server_addr,
+				        MAI_SERVPORT_STR *smtp_server_port,
+					         HAPROXY_SRVR_TLV **tlvp)
+{
+    const unsigned char *cp = buf + HAPROXY_V2_HDR_LEN;
+    const unsigned char *end = buf + len;
+    const char *err;
+    HAPROXY_SRVR_TLV *tlv;
+
+    if (msg_verbose)
+	msg_info("haproxy_srvr_parse: v2 cmd=0x%02x fam=0x%02x len=%ld",
+		 buf[12], buf[13], (long) len);
+
+    if ((buf[12] & 0xf0) != HAPROXY_V2_VERSION)
+	return ("unsupported protocol version");
+    switch (buf[12] & 0x0f) {
+    case HAPROXY_V2_CMD_LOCAL:
+	*non_proxy = 1;
+	return (0);
+    case HAPROXY_V2_CMD_PROXY:
+	break;
+    default:
+	return ("unsupported command");
+    }
+
+    /*
+     * XXX As with version 1 "UNKNOWN", we don't accept the "UNSPEC" address
+     * family or non-TCP transports, because those would sidestep
+     * address-based access control mechanisms.
+     */
+    switch (buf[13]) {
+    case HAPROXY_V2_FAM_TCP4:
+	if (strchr((char *) proto_info->sa_family_list, AF_INET) == 0)
+	    return ("unsupported protocol type");
+	if (end - cp < 12)
+	    return ("short address block");
+	if (haproxy_srvr_parse_v2_addr(AF_INET, cp, cp + 8,
+				 smtp_client_addr, smtp_client_port) < 0
+	    || haproxy_srvr_parse_v2_addr(AF_INET, cp + 4, cp + 10,
+				 smtp_server_addr, smtp_server_port) < 0)
+	    return ("unexpected address");
+	cp += 12;
+	break;
+#ifdef AF_INET6
+    case HAPROXY_V2_FAM_TCP6:
+	if (strchr((char *) proto_info->sa_family_list, AF_INET6) == 0)
+	    return ("unsupported protocol type");
+	if (end - cp < 36)
+	    return ("short address block");
+	if (haproxy_srvr_parse_v2_addr(AF_INET6, cp, cp + 32,
+				 smtp_client_addr, smtp_client_port) < 0
+	    || haproxy_srvr_parse_v2_addr(AF_INET6, cp + 16, cp + 34,
+				 smtp_server_addr, smtp_server_port) < 0)
+	    return ("unexpected address");
+	cp += 36;
+	break;
+#endif
+    default:
+	return ("unsupported protocol type");
+    }
+
+    /*
+     * The TLVs follow the address block.
+     */
+    if (tlvp == 0 || cp >= end)
+	return (0);
+    tlv = (HAPROXY_SRVR_TLV *) mymalloc(sizeof(*tlv));
+    tlv->flags = 0;
+    tlv->alpn = tlv->authority = tlv->unique_id = 0;
+    tlv->tls_version = tlv->tls_cipher = tlv->tls_peer_cn = 0;
+    if ((err = haproxy_srvr_parse_tlv(cp, end, tlv, 0)) != 0) {
+	haproxy_srvr_tlv_free(tlv);
+	return (err);
+    }
+    *tlvp = tlv;
+    return (0);
+}
+
+/* haproxy_srvr_parse_buf - parse version 1 or 2 header in buffer */
+
+const char *haproxy_srvr_parse_buf(const char *buf, ssize_t *len,
+				           int *non_proxy,
+				           MAI_HOSTADDR_STR *smtp_client_addr,
+				           MAI_SERVPORT_STR *smtp_client_port,
+				           MAI_HOSTADDR_STR *smtp_server_addr,
+				           MAI_SERVPORT_STR *smtp_server_port,
+				           HAPROXY_SRVR_TLV **tlvp)
+{
+    const unsigned char *ubuf = (const unsigned char *) buf;
+    char    line[HAPROXY_MAX_LEN + 1];
+    ssize_t avail = *len;
+    ssize_t hdr_len;
+    const char *nl;
+    const char *err;
+
+    if (proto_info == 0)
+	proto_info = inet_proto_info();
+    *non_proxy = 0;
+    if (tlvp)
+	*tlvp = 0;
+
+    /*
+     * Version 2: fixed-size header with a length field.
+     */
+    if (avail > 0 && buf[0] == HAPROXY_V2_SIG[0]) {
+	if (memcmp(buf, HAPROXY_V2_SIG,
+		   avail < HAPROXY_V2_SIG_LEN ? avail : HAPROXY_V2_SIG_LEN))
+	    return ("unexpected protocol header");
+	if (avail < HAPROXY_V2_HDR_LEN)
+	    return (haproxy_srvr_incomplete);
+	hdr_len = HAPROXY_V2_HDR_LEN + HAPROXY_GET16(ubuf + 14);
+	if (hdr_len > HAPROXY_V2_MAX_LEN)
+	    return ("header too long");
+	if (avail < hdr_len)
+	    return (haproxy_srvr_incomplete);
+	if ((err = haproxy_srvr_parse_v2(ubuf, hdr_len, non_proxy,
+					 smtp_client_addr, smtp_client_port,
+					 smtp_server_addr, smtp_server_port,
+					 tlvp)) == 0)
+	    *len = hdr_len;
+	return (err);
+    }
+
+    /*
+     * Version 1: text line.
+     */
+    if (memcmp(buf, HAPROXY_V1_SIG,
+	       avail < HAPROXY_V1_SIG_LEN ? avail : HAPROXY_V1_SIG_LEN))
+	return ("unexpected protocol header");
+    if ((nl = memchr(buf, '\n', avail < HAPROXY_MAX_LEN ?
+		     avail : HAPROXY_MAX_LEN)) == 0)
+	return (avail < HAPROXY_MAX_LEN ?
+		haproxy_srvr_incomplete : "line too long");
+    hdr_len = nl - buf + 1;
+    memcpy(line, buf, hdr_len);
+    line[hdr_len] = 0;
+    if ((err = haproxy_srvr_parse(line, smtp_client_addr, smtp_client_port,
+			      smtp_server_addr, smtp_server_port)) == 0)
+	*len = hdr_len;
+    return (err);
+}
+
+/* haproxy_srvr_receive - receive and parse header */
+
+const char *haproxy_srvr_receive(int fd, VSTRING *pending, int *non_proxy,
+				         MAI_HOSTADDR_STR *smtp_client_addr,
+				         MAI_SERVPORT_STR *smtp_client_port,
+				         MAI_HOSTADDR_STR *smtp_server_addr,
+				         MAI_SERVPORT_STR *smtp_server_port,
+				         HAPROXY_SRVR_TLV **tlvp)
+{
+    char    read_buf[HAPROXY_V2_MAX_LEN];
+    ssize_t have = VSTRING_LEN(pending);
+    ssize_t peek_len;
+    ssize_t len;
+    ssize_t need;
+    const char *err;
+
+    /*
+     * Look at the data without consuming it, so that we never read past the
+     * end of the header. That would break the TLS wrappermode handshake and
+     * the postscreen(8) pregreet test.
+     */
+    if (have >= (ssize_t) sizeof(read_buf))
+	return ("header too long");
+    if ((peek_len = recv(fd, read_buf, sizeof(read_buf) - have,
+			 MSG_PEEK)) < 0)
+	return ("read error");
+    if (peek_len == 0)
+	return ("lost connection");
+    vstring_memcat(pending, read_buf, peek_len);
+    VSTRING_TERMINATE(pending);
+    len = VSTRING_LEN(pending);
+    err = haproxy_srvr_parse_buf(vstring_str(pending), &len, non_proxy,
+				 smtp_client_addr, smtp_client_port,
+				 smtp_server_addr, smtp_server_port, tlvp);
+
+    /*
+     * Consume the header, or the partial header that we have seen so far.
+     */
+    if (err == 0)
+	need = len - have;
+    else if (HAPROXY_SRVR_INCOMPLETE(err))
+	need = peek_len;
+    else
+	return (err);
+    if (read(fd, read_buf, need) != need) {
+	if (err == 0 && tlvp && *tlvp) {
+	    haproxy_srvr_tlv_free(*tlvp);
+	    *tlvp = 0;
+	}
+	return ("read error");
+    }
+    if (err == 0)
+	vstring_truncate(pending, len);
+    return (err);
+}
+
+/* haproxy_srvr_tlv_free - destroy TLV information */
+
+void    haproxy_srvr_tlv_free(HAPROXY_SRVR_TLV *tlv)
+{
+    if (tlv->alpn)
+	myfree(tlv->alpn);
+    if (tlv->authority)
+	myfree(tlv->authority);
+    if (tlv->unique_id)
+	myfree(tlv->unique_id);
+    if (tlv->tls_version)
+	myfree(tlv->tls_version);
+    if (tlv->tls_cipher)
+	myfree(tlv->tls_cipher);
+    if (tlv->tls_peer_cn)
+	myfree(tlv->tls_peer_cn);
+    myfree((void *) tlv);
+}
+
+#ifdef TEST
+
+ /*
+  * Test program to exercise haproxy_srvr_parse_buf() with version 1 and
+  * version 2 headers, including the TLV walker. Each test case is a binary
+  * buffer; the result is formatted as text and compared with the expected
+  * text.
+  */
+#include <msg_vstream.h>
+
+#define STR	vstring_str
+#define LEN(x)	(sizeof(x) - 1)
+
+ /*
+  * Version 2 building blocks. Hex escapes are terminated with a string
+  * break, so that the next character is not taken as a hex digit.
+  */
+#define V2_SIG		"\r\n\r\n\0\r\nQUIT\n"
+#define V2_PROXY4	V2_SIG "\x21\x11"
+#define V2_ADDR4	"\x01\x02\x03\x04" "\x04\x03\x02\x01" "\x00\x7b" "\x01\x41"
+#define V2_ADDR4_RES	"client=[1.2.3.4]:123 server=[4.3.2.1]:321"
+
+#define V2_TLV_ALPN	"\x01\x00\x04" "smtp"
+#define V2_TLV_AUTH	"\x02\x00\x0e" "mx.example.com"
+#define V2_TLV_UID	"\x05\x00\x03" "\x01\x02\xff"
+#define V2_TLV_SSL	"\x20\x00\x28" "\x01" "\x00\x00\x00\x00" \
+			"\x21\x00\x07" "TLSv1.3" \
+			"\x23\x00\x16" "TLS_AES_256_GCM_SHA384"
+
+typedef struct TEST_CASE {
+    const char *label;			/* identifies test case */
+    const char *data;			/* input buffer */
+    ssize_t data_len;			/* input length */
+    const char *want;			/* expected result */
+} TEST_CASE;
+
+#define CASE(label, data, want) { label, data, LEN(data), want }
+
+static const TEST_CASE test_cases[] = {
+    CASE("v1 proxy",
+	 "PROXY TCP4 1.2.3.4 4.3.2.1 123 321\r\nEHLO",
+	 V2_ADDR4_RES " len=36"),
+    CASE("v1 partial signature", "PRO",
+	 "error: incomplete protocol header"),
+    CASE("v1 partial line", "PROXY TCP4 1.2.3.4",
+	 "error: incomplete protocol header"),
+    CASE("v1 bad address", "PROXY TCP4 1.2.3 4.3.2.1 123 321\r\n",
+	 "error: unexpected client address syntax"),
+    CASE("v2 partial signature", "\r\n\r\n",
+	 "error: incomplete protocol header"),
+    CASE("v2 partial header", V2_PROXY4,
+	 "error: incomplete protocol header"),
+    CASE("v2 truncated address block",
+	 V2_PROXY4 "\x00\x0c" "\x01\x02\x03\x04",
+	 "error: incomplete protocol header"),
+    CASE("v2 short address block",
+	 V2_PROXY4 "\x00\x04" "\x01\x02\x03\x04",
+	 "error: short address block"),
+    CASE("v2 header too long", V2_PROXY4 "\xff\xff",
+	 "error: header too long"),
+    CASE("v2 bad version", V2_SIG "\x11\x11" "\x00\x0c" V2_ADDR4,
+	 "error: unsupported protocol version"),
+    CASE("v2 bad command", V2_SIG "\x22\x11" "\x00\x0c" V2_ADDR4,
+	 "error: unsupported command"),
+    CASE("v2 unix socket", V2_SIG "\x21\x31" "\x00\x00",
+	 "error: unsupported protocol type"),
+    CASE("v2 local", V2_SIG "\x20\x00" "\x00\x00" "EHLO",
+	 "local len=16"),
+    CASE("v2 proxy", V2_PROXY4 "\x00\x0c" V2_ADDR4 "EHLO",
+	 V2_ADDR4_RES " len=28"),
+    CASE("v2 TLVs",
+	 V2_PROXY4 "\x00\x55" V2_ADDR4
+	 V2_TLV_ALPN V2_TLV_AUTH V2_TLV_UID V2_TLV_SSL "EHLO",
+	 V2_ADDR4_RES " len=101 flags=0x1 alpn=smtp"
+	 " authority=mx.example.com unique_id=0102FF"
+	 " tls_version=TLSv1.3 tls_cipher=TLS_AES_256_GCM_SHA384"),
+    CASE("v2 unknown TLV",
+	 V2_PROXY4 "\x00\x10" V2_ADDR4 "\x04\x00\x01" "x",
+	 V2_ADDR4_RES " len=32 flags=0x0"),
+    CASE("v2 non-printable TLV",
+	 V2_PROXY4 "\x00\x12" V2_ADDR4 "\x02\x00\x03" "a\n" "b",
+	 V2_ADDR4_RES " len=34 flags=0x0 authority=a?b"),
+    CASE("v2 verified client certificate",
+	 V2_PROXY4 "\x00\x1b" V2_ADDR4
+	 "\x20\x00\x0c" "\x07" "\x00\x00\x00\x00" "\x22\x00\x04" "bob" "\n",
+	 V2_ADDR4_RES " len=43 flags=0x7 tls_peer_cn=bob?"),
+    CASE("v2 truncated TLV",
+	 V2_PROXY4 "\x00\x0e" V2_ADDR4 "\x01\x00",
+	 "error: malformed TLV"),
+    CASE("v2 overlong TLV",
+	 V2_PROXY4 "\x00\x12" V2_ADDR4 "\x01\x00\x09" "abc",
+	 "error: malformed TLV"),
+    CASE("v2 overlong TLV after good TLV",
+	 V2_PROXY4 "\x00\x16" V2_ADDR4 V2_TLV_ALPN "\x02\xff\xff",
+	 "error: malformed TLV"),
+    CASE("v2 short SSL TLV",
+	 V2_PROXY4 "\x00\x11" V2_ADDR4 "\x20\x00\x02" "\x01\x00",
+	 "error: malformed SSL TLV"),
+    CASE("v2 truncated SSL sub-TLV",
+	 V2_PROXY4 "\x00\x16" V2_ADDR4
+	 "\x20\x00\x07" "\x01" "\x00\x00\x00\x00" "\x21\x00",
+	 "error: malformed SSL TLV"),
+    CASE("v2 overlong SSL sub-TLV",
+	 V2_PROXY4 "\x00\x17" V2_ADDR4
+	 "\x20\x00\x08" "\x01" "\x00\x00\x00\x00" "\x21\x00\x09",
+	 "error: malformed SSL TLV"),
+    0,
+};
+
+/* format_result - format parser result as text */
+
+static void format_result(VSTRING *buf, const char *err, ssize_t len,
+			          int non_proxy,
+			          MAI_HOSTADDR_STR *client_addr,
+			          MAI_SERVPORT_STR *client_port,
+			          MAI_HOSTADDR_STR *server_addr,
+			          MAI_SERVPORT_STR *server_port,
+			          HAPROXY_SRVR_TLV *tlv)
+{
+    if (err != 0) {
+	vstring_sprintf(buf, "error: %s", err);
+	return;
+    }
+    if (non_proxy) {
+	vstring_sprintf(buf, "local len=%ld", (long) len);
+	return;
+    }
+    vstring_sprintf(buf, "client=[%s]:%s server=[%s]:%s len=%ld",
+		    client_addr->buf, client_port->buf,
+		    server_addr->buf, server_port->buf, (long) len);
+    if (tlv == 0)
+	return;
+    vstring_sprintf_append(buf, " flags=0x%x", tlv->flags);
+#define APPEND_TLV(name) do { \
+	if (tlv->name) \
+	    vstring_sprintf_append(buf, " %s=%s", #name, tlv->name); \
+    } while (0)
+    APPEND_TLV(alpn);
+    APPEND_TLV(authority);
+    APPEND_TLV(unique_id);
+    APPEND_TLV(tls_version);
+    APPEND_TLV(tls_cipher);
+    APPEND_TLV(tls_peer_cn);
+}
+
+int     main(int argc, char **argv)
+{
+    const TEST_CASE *tp;
+    VSTRING *res = vstring_alloc(100);
+    MAI_HOSTADDR_STR client_addr;
+    MAI_SERVPORT_STR client_port;
+    MAI_HOSTADDR_STR server_addr;
+    MAI_SERVPORT_STR server_port;
+    HAPROXY_SRVR_TLV *tlv;
+    const char *err;
+    ssize_t len;
+    int     non_proxy;
+    int     fail = 0;
+    char   *data;
+
+    msg_vstream_init(argv[0], VSTREAM_ERR);
+    proto_info = inet_proto_init(argv[0], INET_PROTO_NAME_ALL);
+
+    for (tp = test_cases; tp->label != 0; tp++) {
+
+	/*
+	 * Copy the input, so that out-of-bounds reads show up under
+	 * valgrind.
+	 */
+	data = mymalloc(tp->data_len);
+	memcpy(data, tp->data, tp->data_len);
+	len = tp->data_len;
+	err = haproxy_srvr_parse_buf(data, &len, &non_proxy,
+				     &client_addr, &client_port,
+				     &server_addr, &server_port, &tlv);
+	format_result(res, err, len, non_proxy, &client_addr, &client_port,
+		      &server_addr, &server_port, tlv);
+	if (strcmp(STR(res), tp->want) != 0) {
+	    msg_warn("test \"%s\": got \"%s\", want \"%s\"",
+		     tp->label, STR(res), tp->want);
+	    fail = 1;
+	} else {
+	    msg_info("test \"%s\": pass", tp->label);
+	}
+	if (tlv)
+	    haproxy_srvr_tlv_free(tlv);
+	myfree(data);
+    }
+    vstring_free(res);
+    exit(fail);
+}
+
+#endif
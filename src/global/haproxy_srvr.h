@@ -14,17 +14,49 @@
  /*
   * Utility library.
   */
+#include <vstring.h>
 #include <myaddrinfo.h>
 
+ /*
+  * Optional information from haproxy version 2 TLVs.
+  */
+typedef struct HAPROXY_SRVR_TLV {
+    int     flags;			/* see below */
+    char   *alpn;			/* application protocol */
+    char   *authority;			/* server name from client */
+    char   *unique_id;			/* connection ID, hex-encoded */
+    char   *tls_version;		/* TLS protocol version */
+    char   *tls_cipher;			/* TLS cipher name */
+    char   *tls_peer_cn;		/* client certificate CN */
+} HAPROXY_SRVR_TLV;
+
+#define HAPROXY_TLV_FLAG_TLS		(1<<0)	/* client used TLS */
+#define HAPROXY_TLV_FLAG_TLS_CERT	(1<<1)	/* client sent certificate */
+#define HAPROXY_TLV_FLAG_TLS_VERIFIED	(1<<2)	/* certificate verified */
+
  /*
   * External interface.
   */
 extern const char *haproxy_srvr_parse(const char *,
 			             MAI_HOSTADDR_STR *, MAI_SERVPORT_STR *,
 			            MAI_HOSTADDR_STR *, MAI_SERVPORT_STR *);
+extern const char *haproxy_srvr_parse_buf(const char *, ssize_t *, int *,
+			             MAI_HOSTADDR_STR *, MAI_SERVPORT_STR *,
+			             MAI_HOSTADDR_STR *, MAI_SERVPORT_STR *,
+					          HAPROXY_SRVR_TLV **);
+extern const char *haproxy_srvr_receive(int, VSTRING *, int *,
+			             MAI_HOSTADDR_STR *, MAI_SERVPORT_STR *,
+			             MAI_HOSTADDR_STR *, MAI_SERVPORT_STR *,
+					        HAPROXY_SRVR_TLV **);
+extern void haproxy_srvr_tlv_free(HAPROXY_SRVR_TLV *);
+
+extern const char haproxy_srvr_incomplete[];
+
+#define HAPROXY_SRVR_INCOMPLETE(err)	((err) == haproxy_srvr_incomplete)
 
 #define HAPROXY_PROTO_NAME	"haproxy"
 #define HAPROXY_MAX_LEN		(256 + 2)
+#define HAPROXY_V2_MAX_LEN	2048
 
 #ifndef DO_GRIPE
 #define DO_GRIPE 	1
@@ -34,6 +34,7 @@
 /*	int	var_use_limit;
 /*	int	var_idle_limit;
 /*	int	var_event_drain;
+/*	int	var_event_stall;
 /*	int	var_bundle_rcpt;
 /*	char	*var_procname;
 /*	char	*var_servname;
@@ -150,6 +151,7 @@
 /*	char	*var_maillog_file_pfxs;
 /*	char	*var_maillog_file_comp;
 /*	char	*var_maillog_file_stamp;
+/*	int	var_maillog_ring_size;
 /*	char	*var_postlog_service;
 /* DESCRIPTION
 /*	This module (actually the associated include file) defines
@@ -253,6 +255,7 @@ char   *var_queue_dir;
 char   *var_shlib_dir;
 int     var_use_limit;
 int     var_event_drain;
+int     var_event_stall;
 int     var_idle_limit;
 int     var_bundle_rcpt;
 char   *var_procname;
@@ -358,6 +361,7 @@ char	*var_maillog_file;
 char	*var_maillog_file_pfxs;
 char	*var_maillog_file_comp;
 char	*var_maillog_file_stamp;
+int	var_maillog_ring_size;
 char	*var_postlog_service;
 
 const char null_format_string[1] = "";
@@ -671,6 +675,7 @@ void    mail_params_init()
 {
     static const CONFIG_INT_TABLE first_int_defaults[] = {
 	VAR_COMPAT_LEVEL, DEF_COMPAT_LEVEL, &var_compat_level, 0, 0,
+	VAR_MAILLOG_RING_SIZE, DEF_MAILLOG_RING_SIZE, &var_maillog_ring_size, 0, 0,
 	0,
     };
     static const CONFIG_STR_TABLE first_str_defaults[] = {
@@ -783,6 +788,7 @@ void    mail_params_init()
 	VAR_MIME_BOUND_LEN, DEF_MIME_BOUND_LEN, &var_mime_bound_len, 1, 0,
 	VAR_DELAY_MAX_RES, DEF_DELAY_MAX_RES, &var_delay_max_res, MIN_DELAY_MAX_RES, MAX_DELAY_MAX_RES,
 	VAR_INET_WINDOW, DEF_INET_WINDOW, &var_inet_windowsize, 0, 0,
+	VAR_EVENT_STALL, DEF_EVENT_STALL, &var_event_stall, 0, 0,
 	0,
     };
     static const CONFIG_LONG_TABLE long_defaults[] = {
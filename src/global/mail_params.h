@@ -907,6 +907,13 @@ extern int var_throttle_time;
 #define DEF_MASTER_DISABLE	""
 extern char *var_master_disable;
 
+ /*
+  * Master: performance counter segment size, in processes.
+  */
+#define VAR_STATS_SLOTS		"stats_process_limit"
+#define DEF_STATS_SLOTS		1000
+extern int var_stats_slots;
+
  /*
   * Any subsystem: default maximum number of clients serviced before a mail
   * subsystem terminates (except queue manager).
@@ -931,6 +938,14 @@ extern int var_idle_limit;
 #define DEF_EVENT_DRAIN		"100s"
 extern int var_event_drain;
 
+ /*
+  * Any subsystem: event loop stall threshold in milliseconds. A non-zero
+  * value turns on the event loop profiler.
+  */
+#define VAR_EVENT_STALL		"event_stall_threshold"
+#define DEF_EVENT_STALL		0
+extern int var_event_stall;
+
  /*
   * Any subsystem: default amount of time a mail subsystem keeps an internal
   * IPC connection before closing it because it is idle for too much time.
@@ -1028,6 +1043,18 @@ extern int var_smtp_reuse_count;
 #define DEF_LMTP_REUSE_TIME	"300s"
 extern int var_smtp_reuse_time;
 
+#define VAR_SMTP_DREQ_LIMIT	"smtp_delivery_request_limit"
+#define DEF_SMTP_DREQ_LIMIT	100
+#define VAR_LMTP_DREQ_LIMIT	"lmtp_delivery_request_limit"
+#define DEF_LMTP_DREQ_LIMIT	100
+extern int var_smtp_dreq_limit;
+
+#define VAR_SMTP_TIMES_STATS	"smtp_delivery_timing_statistics"
+#define DEF_SMTP_TIMES_STATS	0
+#define VAR_LMTP_TIMES_STATS	"lmtp_delivery_timing_statistics"
+#define DEF_LMTP_TIMES_STATS	0
+extern bool var_smtp_times_stats;
+
 #define VAR_SMTP_CACHE_DEST	"smtp_connection_cache_destinations"
 #define DEF_SMTP_CACHE_DEST	""
 #define VAR_LMTP_CACHE_DEST	"lmtp_connection_cache_destinations"
@@ -1200,6 +1227,18 @@ extern bool var_smtp_defer_mxaddr;
 #define DEF_SMTP_SEND_XFORWARD	0
 extern bool var_smtp_send_xforward;
 
+#define VAR_SMTP_USE_BDAT	"smtp_use_bdat_command"
+#define DEF_SMTP_USE_BDAT	0
+#define VAR_LMTP_USE_BDAT	"lmtp_use_bdat_command"
+#define DEF_LMTP_USE_BDAT	0
+extern bool var_smtp_use_bdat;
+
+#define VAR_SMTP_BDAT_CHUNK	"smtp_bdat_chunk_size"
+#define DEF_SMTP_BDAT_CHUNK	131072
+#define VAR_LMTP_BDAT_CHUNK	"lmtp_bdat_chunk_size"
+#define DEF_LMTP_BDAT_CHUNK	131072
+extern int var_smtp_bdat_chunk;
+
 #define VAR_SMTP_GENERIC_MAPS	"smtp_generic_maps"
 #define DEF_SMTP_GENERIC_MAPS	""
 #define VAR_LMTP_GENERIC_MAPS	"lmtp_generic_maps"
@@ -2580,6 +2619,10 @@ extern char *var_virt_mailbox_base;
 #define DEF_VIRT_MAILBOX_LIMIT		(5 * DEF_MESSAGE_LIMIT)
 extern long var_virt_mailbox_limit;
 
+#define VAR_VIRT_MAILDIR_BATCH		"virtual_maildir_sync_batch_limit"
+#define DEF_VIRT_MAILDIR_BATCH		1
+extern int var_virt_maildir_batch;
+
 #define VAR_VIRT_MAILBOX_LOCK		"virtual_mailbox_lock"
 #define DEF_VIRT_MAILBOX_LOCK		"fcntl, dotlock"
 extern char *var_virt_mailbox_lock;
@@ -2611,6 +2654,14 @@ extern int var_qmqpd_timeout;
 #define DEF_QMTPD_ERR_SLEEP		"1s"
 extern int var_qmqpd_err_sleep;
 
+#define VAR_QMQPD_MEM_LIMIT		"qmqpd_content_memory_limit"
+#define DEF_QMQPD_MEM_LIMIT		1048576
+extern int var_qmqpd_mem_limit;
+
+#define VAR_QMQPD_MULTI_MSG		"qmqpd_multi_message_enable"
+#define DEF_QMQPD_MULTI_MSG		0
+extern bool var_qmqpd_multi_msg;
+
  /*
   * VERP, more DJB intellectual cross-pollination. However, we prefer + as
   * the default recipient delimiter.
@@ -2747,6 +2798,17 @@ extern bool var_resolve_nulldom;
 #define DEF_RESOLVE_NUM_DOM		0
 extern bool var_resolve_num_dom;
 
+ /*
+  * trivial-rewrite(8) address resolver result cache.
+  */
+#define VAR_RESOLVE_CACHE_SIZE		"resolve_cache_size"
+#define DEF_RESOLVE_CACHE_SIZE		1000
+extern int var_resolve_cache_size;
+
+#define VAR_RESOLVE_CACHE_TTL		"resolve_cache_ttl"
+#define DEF_RESOLVE_CACHE_TTL		"10s"
+extern int var_resolve_cache_ttl;
+
  /*
   * Service names. The transport (TCP, FIFO or UNIX-domain) type is frozen
   * because you cannot simply mix them, and accessibility (private/public) is
@@ -2766,10 +2828,26 @@ extern char *var_cleanup_service;
 #define DEF_DEFER_SERVICE		MAIL_SERVICE_DEFER
 extern char *var_defer_service;
 
+#define VAR_PICKUP_CONC			"pickup_cleanup_concurrency"
+#define DEF_PICKUP_CONC			1
+extern int var_pickup_conc;
+
+#define VAR_PICKUP_INOTIFY		"pickup_inotify_enable"
+#define DEF_PICKUP_INOTIFY		1
+extern bool var_pickup_inotify;
+
 #define VAR_PICKUP_SERVICE		"pickup_service_name"
 #define DEF_PICKUP_SERVICE		MAIL_SERVICE_PICKUP
 extern char *var_pickup_service;
 
+#define VAR_POSTDROPD_SERVICE		"postdropd_service_name"
+#define DEF_POSTDROPD_SERVICE		MAIL_SERVICE_POSTDROPD
+extern char *var_postdropd_service;
+
+#define VAR_POSTDROP_DIRECT		"postdrop_direct_submission"
+#define DEF_POSTDROP_DIRECT		0
+extern bool var_postdrop_direct;
+
 #define VAR_QUEUE_SERVICE		"queue_service_name"
 #define DEF_QUEUE_SERVICE		MAIL_SERVICE_QUEUE
 extern char *var_queue_service;
@@ -2811,6 +2889,10 @@ extern int var_scache_ttl_lim;
 #define DEF_SCACHE_STAT_TIME		"600s"
 extern int var_scache_stat_time;
 
+#define VAR_SCACHE_TIMES_LIMIT		"connection_cache_timing_limit"
+#define DEF_SCACHE_TIMES_LIMIT		1000
+extern int var_scache_times_limit;
+
 #define VAR_VRFY_PEND_LIMIT		"address_verify_pending_request_limit"
 #define DEF_VRFY_PEND_LIMIT		(DEF_QMGR_ACT_LIMIT / 4)
 extern int var_vrfy_pend_limit;
@@ -2850,6 +2932,10 @@ extern bool var_verify_neg_cache;
 #define DEF_VERIFY_SCAN_CACHE		"12h"
 extern int var_verify_scan_cache;
 
+#define VAR_VERIFY_SCAN_BUDGET		"address_verify_cache_cleanup_budget"
+#define DEF_VERIFY_SCAN_BUDGET		10
+extern int var_verify_scan_budget;
+
 #define VAR_VERIFY_SENDER		"address_verify_sender"
 #define DEF_VERIFY_SENDER		"$" VAR_DOUBLE_BOUNCE
 extern char *var_verify_sender;
@@ -3614,6 +3700,22 @@ extern int var_psc_cache_ret;
 #define DEF_PSC_CACHE_SCAN	"12h"
 extern int var_psc_cache_scan;
 
+#define VAR_PSC_CACHE_BUDGET	"postscreen_cache_cleanup_budget"
+#define DEF_PSC_CACHE_BUDGET	10
+extern int var_psc_cache_budget;
+
+#define VAR_PSC_SHED_LEVELS	"postscreen_shed_levels"
+#define DEF_PSC_SHED_LEVELS	"60, 80, 95"
+extern char *var_psc_shed_levels;
+
+#define VAR_PSC_SHED_LAG_LIMIT	"postscreen_shed_lag_limit"
+#define DEF_PSC_SHED_LAG_LIMIT	200
+extern int var_psc_shed_lag_limit;
+
+#define VAR_PSC_SHED_GREET_WAIT	"postscreen_shed_greet_wait"
+#define DEF_PSC_SHED_GREET_WAIT	"1s"
+extern int var_psc_shed_greet_wait;
+
 #define VAR_PSC_GREET_WAIT	"postscreen_greet_wait"
 #define DEF_PSC_GREET_WAIT	"${stress?{2}:{6}}s"
 extern int var_psc_greet_wait;
@@ -4040,6 +4142,10 @@ extern char *var_smtpd_uproxy_proto;
 #define DEF_SMTPD_UPROXY_TMOUT	"5s"
 extern int var_smtpd_uproxy_tmout;
 
+#define VAR_SMTPD_UPROXY_TLS	"smtpd_upstream_proxy_tls_termination"
+#define DEF_SMTPD_UPROXY_TLS	0
+extern bool var_smtpd_uproxy_tls;
+
  /*
   * Postfix sendmail command compatibility features.
   */
@@ -4075,6 +4181,17 @@ extern char *var_smtp_dsn_filter;
 #define DEF_PIPE_DSN_FILTER		"$" VAR_DSN_FILTER
 extern char *var_pipe_dsn_filter;
 
+ /*
+  * pipe(8) persistent coprocess.
+  */
+#define VAR_PIPE_COPROC_MAX_USE		"pipe_coprocess_max_use"
+#define DEF_PIPE_COPROC_MAX_USE		100
+extern int var_pipe_coproc_max_use;
+
+#define VAR_PIPE_COPROC_IDLE		"pipe_coprocess_idle_timeout"
+#define DEF_PIPE_COPROC_IDLE		"60s"
+extern int var_pipe_coproc_idle;
+
 #define VAR_VIRT_DSN_FILTER		"virtual_delivery_status_filter"
 #define DEF_VIRT_DSN_FILTER		"$" VAR_DSN_FILTER
 extern char *var_virt_dsn_filter;
@@ -4177,6 +4294,14 @@ extern char *var_maillog_file_pfxs;
 #define DEF_MAILLOG_FILE_COMP	"gzip"
 extern char *var_maillog_file_comp;
 
+#define VAR_MAILLOG_JSON_FILE	"maillog_json_file"
+#define DEF_MAILLOG_JSON_FILE	""
+extern char *var_maillog_json_file;
+
+#define VAR_MAILLOG_RING_SIZE	"maillog_ring_size"
+#define DEF_MAILLOG_RING_SIZE	0
+extern int var_maillog_ring_size;
+
 #define VAR_MAILLOG_FILE_STAMP	"maillog_file_rotate_suffix"
 #define DEF_MAILLOG_FILE_STAMP	"%Y%M%d-%H%M%S"
 extern char *var_maillog_file_stamp;
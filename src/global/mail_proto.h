@@ -61,6 +61,7 @@
 #define MAIL_SERVICE_DNSBLOG	"dnsblog"
 #define MAIL_SERVICE_TLSPROXY	"tlsproxy"
 #define MAIL_SERVICE_POSTLOG	"postlog"
+#define MAIL_SERVICE_POSTDROPD	"postdropd"
 
  /*
   * Mail source classes. Used to specify policy decisions for content
@@ -96,6 +97,12 @@
 #define MAIL_CLASS_PUBLIC	"public"
 #define MAIL_CLASS_PRIVATE	"private"
 
+ /*
+  * Shared-memory logfile record rings, one per process, drained by
+  * postlogd(8).
+  */
+#define MAIL_CLASS_LOGRING	"logring"
+
  /*
   * Generic triggers.
   */
@@ -109,6 +116,11 @@
 #define QMGR_REQ_FLUSH_DEAD	'F'	/* flush dead xport/site */
 #define QMGR_REQ_SCAN_ALL	'A'	/* ignore time stamps */
 
+ /*
+  * Local submission service requests.
+  */
+#define POSTDROPD_REQ_SUBMIT	"submit"	/* one message follows */
+
  /*
   * Functional interface.
   */
@@ -125,6 +137,7 @@ extern char *mail_pathname(const char *, const char *);
 #define MAIL_ATTR_REQ		"request"
 #define MAIL_ATTR_NREQ		"nrequest"
 #define MAIL_ATTR_STATUS	"status"
+#define MAIL_ATTR_MORE		"more"
 
 #define MAIL_ATTR_FLAGS		"flags"
 #define MAIL_ATTR_QUEUE		"queue_name"
@@ -225,6 +238,10 @@ extern char *mail_pathname(const char *, const char *);
 #define MAIL_ATTR_ACT_SERVER_ADDR "server_address"	/* server address */
 #define MAIL_ATTR_ACT_SERVER_PORT "server_port"	/* server TCP port */
 
+#define MAIL_ATTR_PROXY_ALPN	"proxy_alpn"	/* haproxy v2 ALPN */
+#define MAIL_ATTR_PROXY_AUTHORITY "proxy_authority"	/* haproxy v2 SNI */
+#define MAIL_ATTR_PROXY_UNIQUE_ID "proxy_unique_id"	/* haproxy v2 ID */
+
 #define MAIL_ATTR_PROTO_STATE	"protocol_state"	/* MAIL/RCPT/... */
 #define MAIL_ATTR_ORG_NONE	"unknown"	/* origin unknown */
 #define MAIL_ATTR_ORG_LOCAL	"local"	/* local submission */
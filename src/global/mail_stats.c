@@ -0,0 +1,297 @@
+/*++
+/* NAME
+/*	mail_stats 3
+/* SUMMARY
+/*	Postfix performance counters
+/* SYNOPSIS
+/*	#include <mail_stats.h>
+/*
+/*	const char *mail_stats_path(void)
+/*
+/*	void	mail_stats_init(service)
+/*	const char *service;
+/*
+/*	void	mail_stats_print(fp, seg, flags)
+/*	VSTREAM	*fp;
+/*	STATS_SEG *seg;
+/*	int	flags;
+/* DESCRIPTION
+/*	This module glues the stats(3) counter registry to Postfix.
+/*	The master(8) daemon creates the shared counter segment in
+/*	the file $queue_directory/pid/master.stats, and Postfix daemon
+/*	processes update their own counters in that segment.
+/*
+/*	mail_stats_path() returns the pathname of the counter segment.
+/*	The result is overwritten with each call.
+/*
+/*	mail_stats_init() attaches the calling process to the counter
+/*	segment, labeled with the specified master.cf service name.
+/*	This must be called before the process gives up privileges.
+/*	Nothing happens when the segment does not exist. Counters
+/*	that are registered after a failed attach are private to
+/*	the process.
+/*
+/*	mail_stats_print() adds up the counters of all processes
+/*	with the same service name, and writes the result to the
+/*	specified stream. Specify MAIL_STATS_FLAG_NONE for "service
+/*	name value" lines, or MAIL_STATS_FLAG_PROMETHEUS for the
+/*	Prometheus text exposition format. In the latter, each
+/*	metric name gets a "postfix_" prefix and a "service" label.
+/* DIAGNOSTICS
+/*	mail_stats_init() logs a warning when the segment has no
+/*	free slot.
+/* SEE ALSO
+/*	stats(3), shared-memory counter and histogram registry
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Utility library. */
+
+#include <htable.h>
+#include <msg.h>
+#include <mymalloc.h>
+#include <stringops.h>
+#include <vstring.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <mail_stats.h>
+
+ /*
+  * Aggregated metric.
+  */
+typedef struct {
+    char   *label;			/* service name */
+    char   *name;			/* metric name */
+    int     type;			/* STATS_TYPE_XXX */
+    STATS_CELL cells[STATS_HIST_CELLS];
+} MAIL_STATS_SUM;
+
+#define STR(x)	vstring_str(x)
+
+/* mail_stats_path - segment pathname */
+
+const char *mail_stats_path(void)
+{
+    static VSTRING *path;
+
+    if (path == 0)
+	path = vstring_alloc(100);
+    vstring_sprintf(path, "%s/%s", var_queue_dir, MAIL_STATS_FILE);
+    return (STR(path));
+}
+
+/* mail_stats_init - attach to counter segment */
+
+void    mail_stats_init(const char *service)
+{
+    if (stats_attach(mail_stats_path(), service) < 0) {
+	if (errno == ENOSPC)
+	    msg_warn("no free performance counter slot for service %s;"
+		     " increase %s and restart Postfix",
+		     service, VAR_STATS_SLOTS);
+	else if (msg_verbose)
+	    msg_info("open %s: %m", mail_stats_path());
+    }
+}
+
+/* mail_stats_add - add one process's metric to the totals */
+
+static void mail_stats_add(const char *label, const char *name, int type,
+			           const STATS_CELL *cells, void *context)
+{
+    HTABLE *table = (HTABLE *) context;
+    MAIL_STATS_SUM *sum;
+    char   *key;
+    int     ncells;
+    int     n;
+
+    key = concatenate(name, "\t", label, (char *) 0);
+    if ((sum = (MAIL_STATS_SUM *) htable_find(table, key)) == 0) {
+	sum = (MAIL_STATS_SUM *) mymalloc(sizeof(*sum));
+	sum->label = mystrdup(label);
+	sum->name = mystrdup(name);
+	sum->type = type;
+	memset((void *) sum->cells, 0, sizeof(sum->cells));
+	htable_enter(table, key, (void *) sum);
+    }
+    myfree(key);
+    if (sum->type != type)
+	return;
+    ncells = (type == STATS_TYPE_HISTOGRAM ? STATS_HIST_CELLS : 1);
+    for (n = 0; n < ncells; n++)
+	sum->cells[n] += cells[n];
+}
+
+/* mail_stats_free - destroy aggregated metric */
+
+static void mail_stats_free(void *ptr)
+{
+    MAIL_STATS_SUM *sum = (MAIL_STATS_SUM *) ptr;
+
+    myfree(sum->label);
+    myfree(sum->name);
+    myfree((void *) sum);
+}
+
+/* mail_stats_compare - sort by metric name, then by service */
+
+static int mail_stats_compare(const void *a, const void *b)
+{
+    const char *ka = (*(HTABLE_INFO **) a)->key;
+    const char *kb = (*(HTABLE_INFO **) b)->key;
+    size_t  la = strcspn(ka, "{\t");
+    size_t  lb = strcspn(kb, "{\t");
+    int     diff;
+
+    /* Keep all metrics with the same base name together. */
+    if ((diff = strncmp(ka, kb, la < lb ? la : lb)) != 0)
+	return (diff);
+    if (la != lb)
+	return (la < lb ? -1 : 1);
+    return (strcmp(ka, kb));
+}
+
+/* mail_stats_bound - histogram bucket upper bound as text */
+
+static const char *mail_stats_bound(VSTRING *buf, int bucket)
+{
+    if (bucket >= STATS_HIST_BUCKETS - 1)
+	return ("+Inf");
+    vstring_sprintf(buf, "%lu", 1UL << bucket);
+    return (STR(buf));
+}
+
+/* mail_stats_quantile - approximate histogram quantile */
+
+static const char *mail_stats_quantile(VSTRING *buf, const STATS_CELL *cells,
+				               int percent)
+{
+    return (mail_stats_bound(buf, stats_quantile(cells, percent)));
+}
+
+/* mail_stats_print_text - one aggregated metric, plain text */
+
+static void mail_stats_print_text(VSTREAM *fp, MAIL_STATS_SUM *sum,
+				          VSTRING *buf)
+{
+    const STATS_CELL *cells = sum->cells;
+
+    if (sum->type == STATS_TYPE_HISTOGRAM) {
+	vstream_fprintf(fp, "%s %s count=%lu sum=%lu",
+			sum->label, sum->name, STATS_HIST_COUNT(cells),
+			STATS_HIST_SUM(cells));
+	if (STATS_HIST_COUNT(cells) > 0) {
+	    vstream_fprintf(fp, " p50<=%s",
+			    mail_stats_quantile(buf, cells, 50));
+	    vstream_fprintf(fp, " p90<=%s",
+			    mail_stats_quantile(buf, cells, 90));
+	    vstream_fprintf(fp, " p99<=%s",
+			    mail_stats_quantile(buf, cells, 99));
+	}
+	VSTREAM_PUTC('\n', fp);
+    } else {
+	vstream_fprintf(fp, "%s %s %lu\n", sum->label, sum->name, cells[0]);
+    }
+}
+
+/* mail_stats_print_prom - one aggregated metric, Prometheus format */
+
+static void mail_stats_print_prom(VSTREAM *fp, MAIL_STATS_SUM *sum,
+				          VSTRING *base, VSTRING *buf)
+{
+    VSTRING *labels = vstring_alloc(100);
+    const STATS_CELL *cells = sum->cells;
+    const char *cp;
+    const char *extra;
+    unsigned long total;
+    int     n;
+
+    /*
+     * Split name{label="value"} into the base name and its labels, and emit
+     * the TYPE line once per base name.
+     */
+    if ((extra = strchr(sum->name, '{')) != 0) {
+	vstring_strncpy(buf, sum->name, extra - sum->name);
+	extra += 1;
+    } else {
+	vstring_strcpy(buf, sum->name);
+    }
+    if (strcmp(STR(base), STR(buf)) != 0) {
+	vstring_strcpy(base, STR(buf));
+	vstream_fprintf(fp, "# TYPE postfix_%s %s\n", STR(base),
+			sum->type == STATS_TYPE_COUNTER ? "counter" :
+			sum->type == STATS_TYPE_GAUGE ? "gauge" : "histogram");
+    }
+    vstring_strcpy(labels, "service=\"");
+    for (cp = sum->label; *cp; cp++) {
+	if (*cp == '"' || *cp == '\\')
+	    VSTRING_ADDCH(labels, '\\');
+	VSTRING_ADDCH(labels, *cp);
+    }
+    VSTRING_ADDCH(labels, '"');
+    if (extra != 0 && *extra != '}') {
+	VSTRING_ADDCH(labels, ',');
+	vstring_strncat(labels, extra, strcspn(extra, "}"));
+    }
+    VSTRING_TERMINATE(labels);
+
+    if (sum->type == STATS_TYPE_HISTOGRAM) {
+	for (total = 0, n = 0; n < STATS_HIST_BUCKETS; n++) {
+	    total += STATS_HIST_BUCKET(cells, n);
+	    vstream_fprintf(fp, "postfix_%s_bucket{%s,le=\"%s\"} %lu\n",
+			    STR(base), STR(labels),
+			    mail_stats_bound(buf, n), total);
+	}
+	vstream_fprintf(fp, "postfix_%s_sum{%s} %lu\n",
+			STR(base), STR(labels), STATS_HIST_SUM(cells));
+	vstream_fprintf(fp, "postfix_%s_count{%s} %lu\n",
+			STR(base), STR(labels), STATS_HIST_COUNT(cells));
+    } else {
+	vstream_fprintf(fp, "postfix_%s{%s} %lu\n",
+			STR(base), STR(labels), cells[0]);
+    }
+    vstring_free(labels);
+}
+
+/* mail_stats_print - aggregate and print counters */
+
+void    mail_stats_print(VSTREAM *fp, STATS_SEG *seg, int flags)
+{
+    HTABLE *table = htable_create(100);
+    HTABLE_INFO **list;
+    HTABLE_INFO **ht;
+    VSTRING *base = vstring_alloc(100);
+    VSTRING *buf = vstring_alloc(100);
+
+    stats_seg_walk(seg, mail_stats_add, (void *) table);
+    list = htable_list(table);
+    qsort((void *) list, table->used, sizeof(*list), mail_stats_compare);
+    for (ht = list; *ht; ht++) {
+	if (flags & MAIL_STATS_FLAG_PROMETHEUS)
+	    mail_stats_print_prom(fp, (MAIL_STATS_SUM *) ht[0]->value,
+				  base, buf);
+	else
+	    mail_stats_print_text(fp, (MAIL_STATS_SUM *) ht[0]->value, buf);
+    }
+    myfree((void *) list);
+    htable_free(table, mail_stats_free);
+    vstring_free(base);
+    vstring_free(buf);
+}
@@ -0,0 +1,43 @@
+#ifndef _MAIL_STATS_H_INCLUDED_
+#define _MAIL_STATS_H_INCLUDED_
+
+/*++
+/* NAME
+/*	mail_stats 3h
+/* SUMMARY
+/*	Postfix performance counters
+/* SYNOPSIS
+/*	#include <mail_stats.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * Utility library.
+  */
+#include <vstream.h>
+#include <stats.h>
+
+ /*
+  * External interface.
+  */
+#define MAIL_STATS_FILE		"pid/master.stats"
+
+extern const char *mail_stats_path(void);
+extern void mail_stats_init(const char *);
+extern void mail_stats_print(VSTREAM *, STATS_SEG *, int);
+
+#define MAIL_STATS_FLAG_NONE		0
+#define MAIL_STATS_FLAG_PROMETHEUS	(1<<0)
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+#endif
@@ -36,6 +36,14 @@
 /*	if logging to the internal postlog service is enabled, but
 /*	the postlog service is unavailable. If the fallback fails,
 /*	die with a fatal error.
+/* .IP MAILLOG_CLIENT_FLAG_RING
+/*	When logging to the internal postlog service is enabled,
+/*	and "maillog_ring_size" is not zero, append logfile records
+/*	to a shared-memory ring that postlogd(8) drains, instead
+/*	of sending one datagram per record. The ring is created as
+/*	"$queue_directory/logring/\fIpid\fR". This is intended for
+/*	daemon processes, not for programs that run as root or as
+/*	an unprivileged user outside the mail system.
 /* .RE
 /* ENVIRONMENT
 /* .ad
@@ -62,6 +70,9 @@
 /*	The internet hostname of this mail system.
 /* .IP "postlog_service_name (postlog)"
 /*	The name of the internal postlog logging service.
+/* .IP "maillog_ring_size (0)"
+/*	The size of the shared-memory logfile record ring, or zero
+/*	to send one datagram per logfile record.
 /* SEE ALSO
 /*	msg_syslog(3)   syslog client
 /*	msg_logger(3)   internal logger
@@ -81,7 +92,9 @@
   * System library.
   */
 #include <sys_defs.h>
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
  /*
   * Utility library.
@@ -89,6 +102,7 @@
 #include <argv.h>
 #include <logwriter.h>
 #include <msg_logger.h>
+#include <msg_ring.h>
 #include <msg_syslog.h>
 #include <safe.h>
 #include <stringops.h>
@@ -110,6 +124,7 @@
   * Application-specific.
   */
 static int maillog_client_flags;
+static MSG_RING *maillog_client_ring;
 
 #define POSTLOG_SERVICE_ENV	"POSTLOG_SERVICE"
 #define POSTLOG_HOSTNAME_ENV	"POSTLOG_HOSTNAME"
@@ -135,6 +150,52 @@ static void maillog_client_logwriter_fallback(const char *text)
     }
 }
 
+/* maillog_client_ring_update - create or remove record ring */
+
+static void maillog_client_ring_update(int flags)
+{
+    char    pid_buf[50];
+    char   *path;
+    int     want_ring;
+
+    /*
+     * The ring can be used only after configuration parameters are
+     * initialized, and only by the process that created it. The ring file
+     * is owned by the mail_owner, so that postlogd(8) can drain and remove
+     * it.
+     */
+    want_ring = ((flags & MAILLOG_CLIENT_FLAG_RING) != 0
+		 && var_maillog_file != 0 && *var_maillog_file != 0
+		 && var_maillog_ring_size > 0);
+    if (maillog_client_ring != 0
+	&& (want_ring == 0 || msg_ring_pid(maillog_client_ring) != getpid())) {
+	msg_logger_control(CA_MSG_LOGGER_CTL_RING((MSG_RING *) 0),
+			   CA_MSG_LOGGER_CTL_END);
+	msg_ring_free(maillog_client_ring);
+	maillog_client_ring = 0;
+    }
+    if (want_ring == 0 || maillog_client_ring != 0)
+	return;
+    (void) sprintf(pid_buf, "%ld", (long) getpid());
+    path = concatenate(var_queue_dir, "/", MAIL_CLASS_LOGRING, "/",
+		       pid_buf, (char *) 0);
+    if ((maillog_client_ring = msg_ring_create(path,
+					       var_maillog_ring_size)) == 0) {
+	msg_warn("cannot create logfile record ring %s: %m", path);
+    } else if (geteuid() == 0
+	       && fchown(msg_ring_fd(maillog_client_ring),
+			 var_owner_uid, var_owner_gid) < 0) {
+	msg_warn("cannot change ownership of %s: %m", path);
+	msg_ring_free(maillog_client_ring);
+	maillog_client_ring = 0;
+	(void) unlink(path);
+    } else {
+	msg_logger_control(CA_MSG_LOGGER_CTL_RING(maillog_client_ring),
+			   CA_MSG_LOGGER_CTL_END);
+    }
+    myfree(path);
+}
+
 /* maillog_client_init - set up syslog or internal log client */
 
 void    maillog_client_init(const char *progname, int flags)
@@ -241,6 +302,7 @@ void    maillog_client_init(const char *progname, int flags)
 			(flags & MAILLOG_CLIENT_FLAG_LOGWRITER_FALLBACK) ?
 			maillog_client_logwriter_fallback :
 			(MSG_LOGGER_FALLBACK_FN) 0);
+	maillog_client_ring_update(flags);
 
 	/*
 	 * Export or update the exported postlog service pathname and the
@@ -272,6 +334,7 @@ void    maillog_client_init(const char *progname, int flags)
      * process.
      */
     else {
+	maillog_client_ring_update(MAILLOG_CLIENT_FLAG_NONE);
 	msg_logger_control(CA_MSG_LOGGER_CTL_DISABLE, CA_MSG_LOGGER_CTL_END);
 	if ((import_service_path && unsetenv(POSTLOG_SERVICE_ENV))
 	    || (import_hostname && unsetenv(POSTLOG_HOSTNAME_ENV)))
@@ -16,6 +16,7 @@
   */
 #define MAILLOG_CLIENT_FLAG_NONE		(0)
 #define MAILLOG_CLIENT_FLAG_LOGWRITER_FALLBACK	(1<<0)
+#define MAILLOG_CLIENT_FLAG_RING		(1<<1)
 
 extern void maillog_client_init(const char *, int);
 
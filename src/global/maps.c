@@ -51,6 +51,11 @@
 /*	maps_free() releases storage claimed by maps_create()
 /*	and conveniently returns a null pointer.
 /*
+/*	The number of table lookups and the number of successful
+/*	table lookups are maintained as stats(3) counters named
+/*	dict_lookups_total{maps="\fItitle\fR"} and
+/*	dict_hits_total{maps="\fItitle\fR"}.
+/*
 /*	Arguments:
 /* .IP title
 /*	String used for diagnostics. Typically one specifies the
@@ -110,6 +115,7 @@
 #include <dict.h>
 #include <stringops.h>
 #include <split_at.h>
+#include <vstring.h>
 
 /* Global library. */
 
@@ -137,6 +143,7 @@ MAPS   *maps_create(const char *title, const char *map_names, int dict_flags)
     maps->title = mystrdup(title);
     maps->argv = argv_alloc(2);
     maps->error = 0;
+    maps->lookups = maps->hits = 0;
 
     /*
      * For each specified type:name pair, either register a new dictionary,
@@ -161,6 +168,16 @@ MAPS   *maps_create(const char *title, const char *map_names, int dict_flags)
 	    argv_add(maps->argv, vstring_str(map_type_name_flags), ARGV_END);
 	}
 	myfree(temp);
+
+	/*
+	 * Performance counters.
+	 */
+	vstring_sprintf(map_type_name_flags,
+			"dict_lookups_total{maps=\"%s\"}", title);
+	maps->lookups = stats_counter(vstring_str(map_type_name_flags));
+	vstring_sprintf(map_type_name_flags,
+			"dict_hits_total{maps=\"%s\"}", title);
+	maps->hits = stats_counter(vstring_str(map_type_name_flags));
 	vstring_free(map_type_name_flags);
     }
     return (maps);
@@ -192,7 +209,9 @@ const char *maps_find(MAPS *maps, const char *name, int flags)
 	    msg_panic("%s: dictionary not found: %s", myname, *map_name);
 	if (flags != 0 && (dict->flags & flags) == 0)
 	    continue;
+	STATS_INC(maps->lookups);
 	if ((expansion = dict_get(dict, name)) != 0) {
+	    STATS_INC(maps->hits);
 	    if (*expansion == 0) {
 		msg_warn("%s lookup of %s returns an empty string result",
 			 maps->title, name);
@@ -249,7 +268,9 @@ const char *maps_file_find(MAPS *maps, const char *name, int flags)
 		      myname, maps->title);
 	if (flags != 0 && (dict->flags & flags) == 0)
 	    continue;
+	STATS_INC(maps->lookups);
 	if ((expansion = dict_get(dict, name)) != 0) {
+	    STATS_INC(maps->hits);
 	    if (*expansion == 0) {
 		msg_warn("%s lookup of %s returns an empty string result",
 			 maps->title, name);
@@ -15,6 +15,7 @@
   * Utility library.
   */
 #include <dict.h>
+#include <stats.h>
 
  /*
   * Dictionary name storage. We're borrowing from the argv(3) module.
@@ -23,6 +24,8 @@ typedef struct MAPS {
     char   *title;
     struct ARGV *argv;
     int     error;			/* last request only */
+    STATS_CELL *lookups;		/* table lookups */
+    STATS_CELL *hits;			/* successful table lookups */
 } MAPS;
 
 extern MAPS *maps_create(const char *, const char *, int);
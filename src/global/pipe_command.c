@@ -21,6 +21,10 @@
 /*	unavailable, the delivery status is taken from the command
 /*	exit status as per <sysexits.h>.
 /*
+/*	With CA_PIPE_CMD_COPROC_ATTR, the command is instead run as
+/*	a coprocess that stays alive after delivery, and that receives
+/*	one message after another. See COPROCESS PROTOCOL below.
+/*
 /*	Arguments:
 /* .IP src
 /*	An open message queue file, positioned at the start of the actual
@@ -92,7 +96,43 @@
 /*	The shell to use when executing the command specified with
 /*	CA_PIPE_CMD_COMMAND. This shell is invoked regardless of the
 /*	command content.
+/* .IP "CA_PIPE_CMD_COPROC_ATTR(char **)"
+/*	Run the command as a persistent coprocess, and send it the
+/*	specified null-terminated list of name, value, name, value,
+/*	... envelope attributes before each message. A running
+/*	coprocess is reused when the command, privileges, directories
+/*	and environment (CA_PIPE_CMD_ENV and CA_PIPE_CMD_EXPORT)
+/*	are the same as with the previous call; otherwise it is
+/*	terminated, and a new one is started.
+/* .IP "CA_PIPE_CMD_COPROC_MAX_USE(int)"
+/*	The number of messages that a coprocess receives before it
+/*	is terminated. The default is 1.
+/* .IP "CA_PIPE_CMD_COPROC_MAX_IDLE(int)"
+/*	The amount of time that a coprocess may wait for the next
+/*	message before it is terminated. This requires an event(3)
+/*	loop. Specify 0 to disable.
 /* .RE
+/* COPROCESS PROTOCOL
+/* .ad
+/* .fi
+/*	Each request starts with one \fIname\fB=\fIvalue\fR line
+/*	per envelope attribute. Carriage-return and newline characters
+/*	in attribute values are replaced by space. An empty line
+/*	ends the attributes. This is followed by the message content
+/*	as with pipe_command(), with "\fB.\fR" prepended to lines
+/*	that begin with "\fB.\fR", and with a line that contains
+/*	only "\fB.\fR" at the end. All lines are terminated with
+/*	the CA_PIPE_CMD_EOL value.
+/*
+/*	The coprocess replies with a line "\fBstatus=\fIcode\fR",
+/*	where \fIcode\fR is zero for success, or a <sysexits.h>
+/*	status code. Any output before that line is handled as
+/*	command output with pipe_command(). When the coprocess
+/*	terminates before it sends a status line, its exit status
+/*	is used instead.
+/*
+/*	The coprocess is terminated when it does not reply within
+/*	the time limit, or when the message could not be sent.
 /* DIAGNOSTICS
 /*	Panic: interface violations (for example, a zero-valued
 /*	user ID or group ID, or a missing command).
@@ -135,32 +175,27 @@
 #include <stdarg.h>
 #include <fcntl.h>
 #include <stdlib.h>
-#ifdef USE_PATHS_H
-#include <paths.h>
-#endif
-#include <syslog.h>
+#include <string.h>
 
 /* Utility library. */
 
 #include <msg.h>
 #include <vstream.h>
-#include <msg_vstream.h>
 #include <vstring.h>
 #include <stringops.h>
 #include <iostuff.h>
 #include <timed_wait.h>
-#include <set_ugid.h>
 #include <set_eugid.h>
 #include <argv.h>
-#include <chroot_uid.h>
+#include <exec_spawn.h>
+#include <events.h>
+#include <vstring_vstream.h>
 
 /* Global library. */
 
 #include <mail_params.h>
 #include <mail_copy.h>
-#include <clean_env.h>
 #include <pipe_command.h>
-#include <exec_command.h>
 #include <sys_exits.h>
 #include <dsn_util.h>
 #include <dsn_buf.h>
@@ -182,11 +217,36 @@ struct pipe_args {
     char   *shell;			/* command shell */
     char   *cwd;			/* preferred working directory */
     char   *chroot;			/* root directory */
+    char  **coproc_attr;		/* coprocess envelope */
+    int     coproc_max_use;		/* coprocess lifetime */
+    int     coproc_max_idle;		/* coprocess idle time */
 };
 
 static int pipe_command_timeout;	/* command has timed out */
 static int pipe_command_maxtime;	/* available time to complete */
 
+ /*
+  * The persistent coprocess, if any.
+  */
+typedef struct {
+    pid_t   pid;			/* process ID or zero */
+    VSTREAM *in;			/* command input */
+    VSTREAM *out;			/* command output */
+    VSTRING *key;			/* command, privileges, etc. */
+    uid_t   uid;			/* privileges */
+    gid_t   gid;			/* privileges */
+    int     count;			/* messages delivered */
+} PIPE_COPROC;
+
+static PIPE_COPROC pipe_coproc;
+
+#define PIPE_COPROC_STATUS	"status="	/* reply prefix */
+#define PIPE_COPROC_EXIT_TIME	10	/* time to terminate */
+
+static void pipe_coproc_idle(int, void *);
+
+#define STR(x)	vstring_str(x)
+
 /* get_pipe_args - capture the variadic argument list */
 
 static void get_pipe_args(struct pipe_args * args, va_list ap)
@@ -211,6 +271,9 @@ static void get_pipe_args(struct pipe_args * args, va_list ap)
     args->shell = 0;
     args->cwd = 0;
     args->chroot = 0;
+    args->coproc_attr = 0;
+    args->coproc_max_use = 1;
+    args->coproc_max_idle = 0;
 
     pipe_command_maxtime = -1;
 
@@ -268,6 +331,15 @@ static void get_pipe_args(struct pipe_args * args, va_list ap)
 	case PIPE_CMD_CHROOT:
 	    args->chroot = va_arg(ap, char *);
 	    break;
+	case PIPE_CMD_COPROC_ATTR:
+	    args->coproc_attr = va_arg(ap, char **);
+	    break;
+	case PIPE_CMD_COPROC_MAX_USE:
+	    args->coproc_max_use = va_arg(ap, int);
+	    break;
+	case PIPE_CMD_COPROC_MAX_IDLE:
+	    args->coproc_max_idle = va_arg(ap, int);
+	    break;
 	default:
 	    msg_panic("%s: unknown key: %d", myname, key);
 	}
@@ -280,6 +352,8 @@ static void get_pipe_args(struct pipe_args * args, va_list ap)
 	msg_panic("%s: privileged gid", myname);
     if (pipe_command_maxtime < 0)
 	msg_panic("%s: missing or invalid PIPE_CMD_TIME_LIMIT", myname);
+    if (args->coproc_attr && args->argv == 0)
+	msg_panic("%s: PIPE_CMD_COPROC_ATTR requires PIPE_CMD_ARGV", myname);
 }
 
 /* pipe_command_write - write to command with time limit */
@@ -369,19 +443,394 @@ static int pipe_command_wait_or_kill(pid_t pid, WAIT_STATUS_T *statusp, int sig,
     return (n);
 }
 
-/* pipe_child_cleanup - child fatal error handler */
+/* pipe_command_exit - evaluate non-zero command exit status */
 
-static void pipe_child_cleanup(void)
+static int pipe_command_exit(DSN_BUF *why, const char *command, int status,
+			             const char *log_buf, ssize_t log_len)
 {
+    DSN_SPLIT dp;
+    const SYS_EXITS_DETAIL *sp;
+
+    /* Use "D.S.N text" command output. XXX What diagnostic code? */
+    if (dsn_valid(log_buf) > 0) {
+	dsn_split(&dp, "5.3.0", log_buf);
+	dsb_unix(why, DSN_STATUS(dp.dsn), dp.text, "%s", dp.text);
+	return (DSN_CLASS(dp.dsn) == '4' ?
+		PIPE_STAT_DEFER : PIPE_STAT_BOUNCE);
+    }
+    /* Use <sysexits.h> compatible exit status. */
+    else if (SYS_EXITS_CODE(status)) {
+	sp = sys_exits_detail(status);
+	dsb_unix(why, sp->dsn,
+		 log_len ? log_buf : sp->text, "%s%s%s", sp->text,
+		 log_len ? ". Command output: " : "", log_buf);
+	return (sp->dsn[0] == '4' ?
+		PIPE_STAT_DEFER : PIPE_STAT_BOUNCE);
+    }
 
     /*
-     * WARNING: don't place code here. This code may run as mail_owner, as
-     * root, or as the user/group specified with the "user" attribute. The
-     * only safe action is to terminate.
-     * 
-     * Future proofing. If you need exit() here then you broke Postfix.
+     * No "D.S.N text" or <sysexits.h> compatible status. Fake it.
+     */
+    else {
+	sp = sys_exits_detail(status);
+	dsb_unix(why, sp->dsn,
+		 log_len ? log_buf : sp->text,
+		 "Command died with status %d: \"%s\"%s%s",
+		 status, command,
+		 log_len ? ". Command output: " : "", log_buf);
+	return (PIPE_STAT_BOUNCE);
+    }
+}
+
+/* pipe_command_spawn - start command */
+
+static pid_t pipe_command_spawn(struct pipe_args * args, int *cmd_in_pipe,
+				        int *cmd_out_pipe)
+{
+    EXEC_SPAWN *sp;
+    pid_t   pid;
+    int     saved_errno;
+
+    /*
+     * Run the command in a separate process group so that the parent can
+     * kill not just the command but also its offspring. Setup errors are
+     * reported as command output, and result in EX_TEMPFAIL. The chroot
+     * happens before privileges are dropped, and requires the real user ID
+     * of root.
+     */
+    sp = exec_spawn_create(args->argv, args->command, args->shell,
+			   args->export, args->env);
+    sp->uid = args->uid;
+    sp->gid = args->gid;
+    sp->chroot = args->chroot;
+    sp->cwd = args->cwd;
+    sp->stdin_fd = cmd_in_pipe[0];
+    sp->stdout_fd = sp->stderr_fd = cmd_out_pipe[1];
+    sp->fail_status = EX_TEMPFAIL;
+    sp->flags |= EXEC_SPAWN_FLAG_STDERR;
+
+    /*
+     * Our ends of the pipes must not leak into the command.
+     */
+    close_on_exec(cmd_in_pipe[1], CLOSE_ON_EXEC);
+    close_on_exec(cmd_out_pipe[0], CLOSE_ON_EXEC);
+    pid = exec_spawn(sp);
+    saved_errno = errno;
+    exec_spawn_free(sp);
+    errno = saved_errno;
+    return (pid);
+}
+
+/* pipe_coproc_close - release coprocess resources */
+
+static void pipe_coproc_close(void)
+{
+    event_cancel_timer(pipe_coproc_idle, (void *) 0);
+    (void) vstream_fclose(pipe_coproc.in);
+    (void) vstream_fclose(pipe_coproc.out);
+}
+
+/* pipe_coproc_stop - terminate coprocess */
+
+static int pipe_coproc_stop(int sig, WAIT_STATUS_T *statusp)
+{
+    WAIT_STATUS_T wait_status;
+    int     n;
+
+    /*
+     * Closing the input stream asks the coprocess to terminate. Kill it when
+     * it does not go away in a reasonable amount of time.
+     */
+    if (statusp == 0)
+	statusp = &wait_status;
+    pipe_coproc_close();
+    if (sig)
+	kill_command(pipe_coproc.pid, sig, pipe_coproc.uid, pipe_coproc.gid);
+    if ((n = timed_waitpid(pipe_coproc.pid, statusp, 0,
+			   PIPE_COPROC_EXIT_TIME)) < 0 && errno == ETIMEDOUT) {
+	kill_command(pipe_coproc.pid, SIGKILL,
+		     pipe_coproc.uid, pipe_coproc.gid);
+	n = waitpid(pipe_coproc.pid, statusp, 0);
+    }
+    if (n < 0)
+	msg_fatal("wait: %m");
+    if (msg_verbose)
+	msg_info("coprocess %lu terminated after %d messages",
+		 (unsigned long) pipe_coproc.pid, pipe_coproc.count);
+    pipe_coproc.pid = 0;
+    return (n);
+}
+
+/* pipe_coproc_idle - terminate idle coprocess */
+
+static void pipe_coproc_idle(int unused_event, void *unused_context)
+{
+    (void) pipe_coproc_stop(0, (WAIT_STATUS_T *) 0);
+}
+
+/* pipe_coproc_key_list - append counted list to command identity */
+
+static void pipe_coproc_key_list(VSTRING *key, const char *label,
+				         char **list)
+{
+    char  **cpp;
+
+    /*
+     * The element count keeps adjacent lists apart, and distinguishes a
+     * null list (for example, export everything) from an empty one.
+     */
+    vstring_memcat(key, "", 1);
+    if (list == 0) {
+	vstring_sprintf_append(key, "%s:-", label);
+	return;
+    }
+    for (cpp = list; *cpp; cpp++)
+	 /* void */ ;
+    vstring_sprintf_append(key, "%s:%ld", label, (long) (cpp - list));
+    for (cpp = list; *cpp; cpp++) {
+	vstring_memcat(key, "", 1);
+	vstring_strcat(key, *cpp);
+    }
+}
+
+/* pipe_coproc_key - command identity */
+
+static void pipe_coproc_key(VSTRING *key, struct pipe_args * args)
+{
+    vstring_sprintf(key, "%lu:%lu", (unsigned long) args->uid,
+		    (unsigned long) args->gid);
+    vstring_memcat(key, "", 1);
+    vstring_strcat(key, args->chroot ? args->chroot : "");
+    vstring_memcat(key, "", 1);
+    vstring_strcat(key, args->cwd ? args->cwd : "");
+    pipe_coproc_key_list(key, "argv", args->argv);
+    pipe_coproc_key_list(key, "env", args->env);
+    pipe_coproc_key_list(key, "export", args->export);
+}
+
+/* pipe_coproc_start - start coprocess */
+
+static int pipe_coproc_start(struct pipe_args * args, DSN_BUF *why)
+{
+    const char *myname = "pipe_coproc_start";
+    int     cmd_in_pipe[2];
+    int     cmd_out_pipe[2];
+    pid_t   pid;
+
+    /*
+     * Unlike with a one-shot command, the output is read while the
+     * coprocess is running, so the output pipe is not made non-blocking.
+     */
+    if (pipe(cmd_in_pipe) < 0 || pipe(cmd_out_pipe) < 0)
+	msg_fatal("%s: pipe: %m", myname);
+
+    switch (pid = pipe_command_spawn(args, cmd_in_pipe, cmd_out_pipe)) {
+    case -1:
+	msg_warn("fork: %m");
+	dsb_unix(why, "4.3.0", sys_exits_detail(EX_OSERR)->text,
+		 "Delivery failed: %m");
+	close(cmd_in_pipe[0]);
+	close(cmd_in_pipe[1]);
+	close(cmd_out_pipe[0]);
+	close(cmd_out_pipe[1]);
+	return (-1);
+    default:
+	close(cmd_in_pipe[0]);
+	close(cmd_out_pipe[1]);
+	pipe_coproc.pid = pid;
+	pipe_coproc.in = vstream_fdopen(cmd_in_pipe[1], O_WRONLY);
+	pipe_coproc.out = vstream_fdopen(cmd_out_pipe[0], O_RDONLY);
+	vstream_control(pipe_coproc.in,
+			CA_VSTREAM_CTL_WRITE_FN(pipe_command_write),
+			CA_VSTREAM_CTL_END);
+	vstream_control(pipe_coproc.out,
+			CA_VSTREAM_CTL_READ_FN(pipe_command_read),
+			CA_VSTREAM_CTL_END);
+	pipe_coproc.uid = args->uid;
+	pipe_coproc.gid = args->gid;
+	pipe_coproc.count = 0;
+	if (msg_verbose)
+	    msg_info("%s: coprocess %lu: %s", myname, (unsigned long) pid,
+		     args->command);
+	return (0);
+    }
+}
+
+/* pipe_command_coproc - deliver message to coprocess */
+
+static int pipe_command_coproc(VSTREAM *src, DSN_BUF *why,
+			               struct pipe_args * args)
+{
+    VSTRING *key = vstring_alloc(100);
+    VSTRING *line;
+    VSTREAM *body;
+    char    log_buf[VSTREAM_BUFSIZE + 1];
+    ssize_t log_len = 0;
+    ssize_t len;
+    int     write_status;
+    int     write_errno;
+    int     status = -1;
+    int     fd;
+    char  **cpp;
+    WAIT_STATUS_T wait_status;
+
+    /*
+     * Reuse the running coprocess when it was started for the same command
+     * with the same privileges. Otherwise, start a new one.
+     */
+    pipe_coproc_key(key, args);
+    if (pipe_coproc.pid != 0
+	&& waitpid(pipe_coproc.pid, &wait_status, WNOHANG) == pipe_coproc.pid) {
+	msg_warn("coprocess %s: terminated while idle", args->command);
+	pipe_coproc_close();
+	pipe_coproc.pid = 0;
+    }
+    if (pipe_coproc.pid != 0
+	&& (VSTRING_LEN(key) != VSTRING_LEN(pipe_coproc.key)
+	    || memcmp(STR(key), STR(pipe_coproc.key), VSTRING_LEN(key)) != 0))
+	(void) pipe_coproc_stop(0, (WAIT_STATUS_T *) 0);
+    if (pipe_coproc.pid == 0) {
+	if (pipe_coproc_start(args, why) < 0) {
+	    vstring_free(key);
+	    return (PIPE_STAT_DEFER);
+	}
+	if (pipe_coproc.key)
+	    vstring_free(pipe_coproc.key);
+	pipe_coproc.key = key;
+    } else {
+	vstring_free(key);
+    }
+    event_cancel_timer(pipe_coproc_idle, (void *) 0);
+    pipe_command_timeout = 0;
+
+    /*
+     * Send the envelope attributes and the message. mail_copy() closes its
+     * output stream, so give it a stream of its own.
+     */
+    line = vstring_alloc(100);
+    for (cpp = args->coproc_attr; cpp[0] && cpp[1]; cpp += 2) {
+	vstring_strcpy(line, cpp[1]);
+	translit(STR(line), "\r\n", "  ");
+	vstream_fprintf(pipe_coproc.in, "%s=%s%s", cpp[0], STR(line),
+			args->eol);
+    }
+    vstream_fputs(args->eol, pipe_coproc.in);
+    if (vstream_fflush(pipe_coproc.in) != 0) {
+	write_status = MAIL_COPY_STAT_WRITE;
+	write_errno = errno;
+    } else {
+	if ((fd = dup(vstream_fileno(pipe_coproc.in))) < 0)
+	    msg_fatal("dup: %m");
+	close_on_exec(fd, CLOSE_ON_EXEC);
+	body = vstream_fdopen(fd, O_WRONLY);
+	vstream_control(body,
+			CA_VSTREAM_CTL_WRITE_FN(pipe_command_write),
+			CA_VSTREAM_CTL_END);
+	write_status = mail_copy(args->sender, args->orig_rcpt,
+				 args->delivered, src, body,
+				 args->flags | MAIL_COPY_DOT,
+				 args->eol, why);
+	write_errno = errno;
+	if (write_status == 0) {
+	    vstream_fprintf(pipe_coproc.in, ".%s", args->eol);
+	    if (vstream_fflush(pipe_coproc.in) != 0) {
+		write_status = MAIL_COPY_STAT_WRITE;
+		write_errno = errno;
+	    }
+	}
+    }
+
+    /*
+     * Read the reply. Keep a limited amount of output that precedes the
+     * status line, for inclusion in a bounce message.
+     */
+    log_buf[0] = 0;
+    if (write_status == 0) {
+	while (vstring_get_nonl_bound(line, pipe_coproc.out,
+				      VSTREAM_BUFSIZE) != VSTREAM_EOF) {
+	    if (strncmp(STR(line), PIPE_COPROC_STATUS,
+			sizeof(PIPE_COPROC_STATUS) - 1) == 0) {
+		if (!alldig(STR(line) + sizeof(PIPE_COPROC_STATUS) - 1)) {
+		    msg_warn("coprocess %s: malformed reply: %.100s",
+			     args->command, STR(line));
+		    status = EX_PROTOCOL;
+		    pipe_coproc.count = args->coproc_max_use;
+		} else {
+		    status = atoi(STR(line) + sizeof(PIPE_COPROC_STATUS) - 1);
+		}
+		break;
+	    }
+	    if (log_len > 0 && log_len < sizeof(log_buf) - 1)
+		log_buf[log_len++] = ' ';
+	    len = sizeof(log_buf) - 1 - log_len;
+	    if (len > VSTRING_LEN(line))
+		len = VSTRING_LEN(line);
+	    memcpy(log_buf + log_len, STR(line), len);
+	    log_len += len;
+	    log_buf[log_len] = 0;
+	}
+    }
+    vstring_free(line);
+    translit(log_buf, "\t\n", "  ");
+    printable(log_buf, '_');
+
+    /*
+     * The coprocess replied. Keep it for the next message, unless it has
+     * delivered enough messages.
+     */
+    if (status >= 0) {
+	if (++pipe_coproc.count >= args->coproc_max_use)
+	    (void) pipe_coproc_stop(0, (WAIT_STATUS_T *) 0);
+	else if (args->coproc_max_idle > 0)
+	    event_request_timer(pipe_coproc_idle, (void *) 0,
+				args->coproc_max_idle);
+	if (status != 0)
+	    return (pipe_command_exit(why, args->command, status,
+				      log_buf, log_len));
+	vstring_strcpy(why->reason, log_buf);
+	return (PIPE_STAT_OK);
+    }
+
+    /*
+     * No reply. The coprocess exceeded the time limit, the queue file is
+     * corrupt, or the coprocess went away. Make sure that the coprocess
+     * does not deliver a partial message, and handle its termination as
+     * with a one-shot command.
      */
-    _exit(EX_TEMPFAIL);
+    (void) pipe_coproc_stop((pipe_command_timeout
+			     || (write_status & MAIL_COPY_STAT_CORRUPT)) ?
+			    SIGKILL : 0, &wait_status);
+    if (pipe_command_timeout) {
+	dsb_unix(why, "5.3.0", log_len ?
+		 log_buf : sys_exits_detail(EX_SOFTWARE)->text,
+		 "Command time limit exceeded: \"%s\"%s%s",
+		 args->command,
+		 log_len ? ". Command output: " : "", log_buf);
+	return (PIPE_STAT_BOUNCE);
+    }
+    if (write_status & MAIL_COPY_STAT_CORRUPT)
+	return (PIPE_STAT_CORRUPT);
+    if (!NORMAL_EXIT_STATUS(wait_status)) {
+	if (WIFSIGNALED(wait_status)) {
+	    dsb_unix(why, "4.3.0", log_len ?
+		     log_buf : sys_exits_detail(EX_SOFTWARE)->text,
+		     "Command died with signal %d: \"%s\"%s%s",
+		     WTERMSIG(wait_status), args->command,
+		     log_len ? ". Command output: " : "", log_buf);
+	    return (PIPE_STAT_DEFER);
+	}
+	return (pipe_command_exit(why, args->command,
+				  WEXITSTATUS(wait_status),
+				  log_buf, log_len));
+    } else if (write_status && write_errno != EPIPE) {
+	vstring_prepend(why->reason, "Command failed: ",
+			sizeof("Command failed: ") - 1);
+	vstring_sprintf_append(why->reason, ": \"%s\"", args->command);
+	return (PIPE_STAT_BOUNCE);
+    } else {
+	vstring_strcpy(why->reason, log_buf);
+	return (PIPE_STAT_OK);
+    }
 }
 
 /* pipe_command - execute command with extreme prejudice */
@@ -401,10 +850,6 @@ int     pipe_command(VSTREAM *src, DSN_BUF *why,...)
     int     cmd_in_pipe[2];
     int     cmd_out_pipe[2];
     struct pipe_args args;
-    char  **cpp;
-    ARGV   *argv;
-    DSN_SPLIT dp;
-    const SYS_EXITS_DETAIL *sp;
 
     /*
      * Process the variadic argument list. This also does sanity checks on
@@ -420,6 +865,12 @@ int     pipe_command(VSTREAM *src, DSN_BUF *why,...)
     if (args.command == 0)
 	args.command = args.argv[0];
 
+    /*
+     * Deliver to a persistent coprocess.
+     */
+    if (args.coproc_attr)
+	return (pipe_command_coproc(src, why, &args));
+
     /*
      * Set up pipes that connect us to the command input and output streams.
      * We're using a rather disgusting hack to capture command output: set
@@ -450,7 +901,7 @@ int     pipe_command(VSTREAM *src, DSN_BUF *why,...)
      * on exec flag). If we cannot run the command now, try again some time
      * later.
      */
-    switch (pid = fork()) {
+    switch (pid = pipe_command_spawn(&args, cmd_in_pipe, cmd_out_pipe)) {
 
 	/*
 	 * Error. Instead of trying again right now, back off, give the
@@ -462,101 +913,6 @@ int     pipe_command(VSTREAM *src, DSN_BUF *why,...)
 		 "Delivery failed: %m");
 	return (PIPE_STAT_DEFER);
 
-	/*
-	 * Child. Run the child in a separate process group so that the
-	 * parent can kill not just the child but also its offspring.
-	 * 
-	 * Redirect fatal exits to our own fatal exit handler (never leave the
-	 * parent's handler enabled :-) so we can replace random exit status
-	 * codes by EX_TEMPFAIL.
-	 */
-    case 0:
-	(void) msg_cleanup(pipe_child_cleanup);
-
-	/*
-	 * In order to chroot it is necessary to switch euid back to root.
-	 * Right after chroot we call set_ugid() so all privileges will be
-	 * dropped again.
-	 * 
-	 * XXX For consistency we use chroot_uid() to change root+current
-	 * directory. However, we must not use chroot_uid() to change process
-	 * privileges (assuming a version that accepts numeric privileges).
-	 * That would create a maintenance problem, because we would have two
-	 * different code paths to set the external command's privileges.
-	 */
-	if (args.chroot) {
-	    seteuid(0);
-	    chroot_uid(args.chroot, (char *) 0);
-	}
-
-	/*
-	 * XXX If we put code before the set_ugid() call, then the code that
-	 * changes root directory must switch back to the mail_owner UID,
-	 * otherwise we'd be running with root privileges.
-	 */
-	set_ugid(args.uid, args.gid);
-	if (setsid() < 0)
-	    msg_warn("setsid failed: %m");
-
-	/*
-	 * Pipe plumbing.
-	 */
-	close(cmd_in_pipe[1]);
-	close(cmd_out_pipe[0]);
-	if (DUP2(cmd_in_pipe[0], STDIN_FILENO) < 0
-	    || DUP2(cmd_out_pipe[1], STDOUT_FILENO) < 0
-	    || DUP2(cmd_out_pipe[1], STDERR_FILENO) < 0)
-	    msg_fatal("%s: dup2: %m", myname);
-	close(cmd_in_pipe[0]);
-	close(cmd_out_pipe[1]);
-
-	/*
-	 * Working directory plumbing.
-	 */
-	if (args.cwd && chdir(args.cwd) < 0)
-	    msg_fatal("cannot change directory to \"%s\" for uid=%lu gid=%lu: %m",
-		      args.cwd, (unsigned long) args.uid,
-		      (unsigned long) args.gid);
-
-	/*
-	 * Environment plumbing. Always reset the command search path. XXX
-	 * That should probably be done by clean_env().
-	 */
-	if (args.export)
-	    clean_env(args.export);
-	if (setenv("PATH", _PATH_DEFPATH, 1))
-	    msg_fatal("%s: setenv: %m", myname);
-	if (args.env)
-	    for (cpp = args.env; *cpp; cpp += 2)
-		if (setenv(cpp[0], cpp[1], 1))
-		    msg_fatal("setenv: %m");
-
-	/*
-	 * Process plumbing. If possible, avoid running a shell.
-	 * 
-	 * As a safety for buggy libraries, we close the syslog socket.
-	 * Otherwise we could leak a file descriptor that was created by a
-	 * privileged process.
-	 * 
-	 * XXX To avoid losing fatal error messages we open a VSTREAM and
-	 * capture the output in the parent process.
-	 */
-	closelog();
-	msg_vstream_init(var_procname, VSTREAM_ERR);
-	if (args.argv) {
-	    execvp(args.argv[0], args.argv);
-	    msg_fatal("%s: execvp %s: %m", myname, args.argv[0]);
-	} else if (args.shell && *args.shell) {
-	    argv = argv_split(args.shell, CHARS_SPACE);
-	    argv_add(argv, args.command, (char *) 0);
-	    argv_terminate(argv);
-	    execvp(argv->argv[0], argv->argv);
-	    msg_fatal("%s: execvp %s: %m", myname, argv->argv[0]);
-	} else {
-	    exec_command(args.command);
-	}
-	/* NOTREACHED */
-
 	/*
 	 * Parent.
 	 */
@@ -638,35 +994,9 @@ int     pipe_command(VSTREAM *src, DSN_BUF *why,...)
 			 log_len ? ". Command output: " : "", log_buf);
 		return (PIPE_STAT_DEFER);
 	    }
-	    /* Use "D.S.N text" command output. XXX What diagnostic code? */
-	    else if (dsn_valid(log_buf) > 0) {
-		dsn_split(&dp, "5.3.0", log_buf);
-		dsb_unix(why, DSN_STATUS(dp.dsn), dp.text, "%s", dp.text);
-		return (DSN_CLASS(dp.dsn) == '4' ?
-			PIPE_STAT_DEFER : PIPE_STAT_BOUNCE);
-	    }
-	    /* Use <sysexits.h> compatible exit status. */
-	    else if (SYS_EXITS_CODE(WEXITSTATUS(wait_status))) {
-		sp = sys_exits_detail(WEXITSTATUS(wait_status));
-		dsb_unix(why, sp->dsn,
-			 log_len ? log_buf : sp->text, "%s%s%s", sp->text,
-			 log_len ? ". Command output: " : "", log_buf);
-		return (sp->dsn[0] == '4' ?
-			PIPE_STAT_DEFER : PIPE_STAT_BOUNCE);
-	    }
-
-	    /*
-	     * No "D.S.N text" or <sysexits.h> compatible status. Fake it.
-	     */
-	    else {
-		sp = sys_exits_detail(WEXITSTATUS(wait_status));
-		dsb_unix(why, sp->dsn,
-			 log_len ? log_buf : sp->text,
-			 "Command died with status %d: \"%s\"%s%s",
-			 WEXITSTATUS(wait_status), args.command,
-			 log_len ? ". Command output: " : "", log_buf);
-		return (PIPE_STAT_BOUNCE);
-	    }
+	    return (pipe_command_exit(why, args.command,
+				      WEXITSTATUS(wait_status),
+				      log_buf, log_len));
 	} else if (write_status &
 		   MAIL_COPY_STAT_CORRUPT) {
 	    return (PIPE_STAT_CORRUPT);
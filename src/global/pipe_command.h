@@ -43,6 +43,9 @@
 #define PIPE_CMD_ORIG_RCPT	13	/* mail_copy() original recipient */
 #define PIPE_CMD_CWD		14	/* working directory */
 #define PIPE_CMD_CHROOT		15	/* chroot() before exec() */
+#define PIPE_CMD_COPROC_ATTR	16	/* coprocess envelope */
+#define PIPE_CMD_COPROC_MAX_USE	17	/* coprocess lifetime */
+#define PIPE_CMD_COPROC_MAX_IDLE 18	/* coprocess idle time */
 
  /*
   * Safer API: type-checked arguments, external use.
@@ -63,6 +66,9 @@
 #define CA_PIPE_CMD_ORIG_RCPT(v) PIPE_CMD_ORIG_RCPT, CHECK_CPTR(PIPE_CMD, char, (v))
 #define CA_PIPE_CMD_CWD(v)	PIPE_CMD_CWD, CHECK_CPTR(PIPE_CMD, char, (v))
 #define CA_PIPE_CMD_CHROOT(v)	PIPE_CMD_CHROOT, CHECK_CPTR(PIPE_CMD, char, (v))
+#define CA_PIPE_CMD_COPROC_ATTR(v) PIPE_CMD_COPROC_ATTR, CHECK_PPTR(PIPE_CMD, char, (v))
+#define CA_PIPE_CMD_COPROC_MAX_USE(v) PIPE_CMD_COPROC_MAX_USE, CHECK_VAL(PIPE_CMD, int, (v))
+#define CA_PIPE_CMD_COPROC_MAX_IDLE(v) PIPE_CMD_COPROC_MAX_IDLE, CHECK_VAL(PIPE_CMD, int, (v))
 
 CHECK_VAL_HELPER_DCL(PIPE_CMD, uid_t);
 CHECK_VAL_HELPER_DCL(PIPE_CMD, int);
@@ -138,6 +138,8 @@ extern SCACHE *scache_multi_create(void);
 #define SCACHE_REQ_SAVE_ENDP	"save_endp"
 #define SCACHE_REQ_FIND_DEST	"find_dest"
 #define SCACHE_REQ_SAVE_DEST	"save_dest"
+#define SCACHE_REQ_SAVE_TIMES	"save_times"
+#define SCACHE_REQ_LIST_TIMES	"list_times"
 
  /*
   * Session cache server status codes.
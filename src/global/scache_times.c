@@ -0,0 +1,396 @@
+/*++
+/* NAME
+/*	scache_times 3
+/* SUMMARY
+/*	per-destination delivery phase timings
+/* SYNOPSIS
+/*	#include <scache_times.h>
+/*
+/*	const char *scache_phase_names[SCACHE_PHASE_COUNT];
+/*
+/*	void	scache_times_init(times)
+/*	SCACHE_TIMES *times;
+/*
+/*	void	scache_times_add(times, sample)
+/*	SCACHE_TIMES *times;
+/*	const long *sample;
+/*
+/*	char	*scache_times_sample_export(buf, sample)
+/*	VSTRING	*buf;
+/*	const long *sample;
+/*
+/*	int	scache_times_sample_import(str, sample)
+/*	const char *str;
+/*	long	*sample;
+/*
+/*	char	*scache_times_export(buf, times)
+/*	VSTRING	*buf;
+/*	const SCACHE_TIMES *times;
+/*
+/*	int	scache_times_import(str, times)
+/*	const char *str;
+/*	SCACHE_TIMES *times;
+/*
+/*	SCACHE_TIMES_CLNT *scache_times_clnt_create(server, timeout,
+/*					idle_limit, ttl_limit)
+/*	const char *server;
+/*	int	timeout;
+/*	int	idle_limit;
+/*	int	ttl_limit;
+/*
+/*	void	scache_times_clnt_save(client, dest, sample)
+/*	SCACHE_TIMES_CLNT *client;
+/*	const char *dest;
+/*	const long *sample;
+/*
+/*	int	scache_times_clnt_list(client, flags, action, context)
+/*	SCACHE_TIMES_CLNT *client;
+/*	int	flags;
+/*	void	(*action)(const char *dest, const SCACHE_TIMES *times,
+/*				void *context);
+/*	void	*context;
+/*
+/*	void	scache_times_clnt_free(client)
+/*	SCACHE_TIMES_CLNT *client;
+/* DESCRIPTION
+/*	This module maintains per-destination delivery phase timing
+/*	statistics, and implements the client side of the scache(8)
+/*	protocol requests that aggregate and report them.
+/*
+/*	A sample is an array of SCACHE_PHASE_COUNT elapsed times in
+/*	microseconds, one for each delivery phase; a negative time
+/*	means that a phase did not happen (for example, there is
+/*	no connection setup when a cached connection is reused).
+/*	scache_phase_names[] gives a short name for each phase.
+/*
+/*	scache_times_init() resets the specified aggregate.
+/*
+/*	scache_times_add() adds a sample to an aggregate.
+/*
+/*	scache_times_sample_export() and scache_times_export()
+/*	serialize a sample or aggregate into the specified buffer,
+/*	and return the buffer content.
+/*
+/*	scache_times_sample_import() and scache_times_import() do
+/*	the reverse, and return -1 in case of a malformed input.
+/*
+/*	scache_times_clnt_create() creates a client for the named
+/*	session cache service.
+/*
+/*	scache_times_clnt_save() reports one sample for the named
+/*	destination. After repeated communication errors, the client
+/*	gives up with a warning, and ignores further requests.
+/*
+/*	scache_times_clnt_list() calls the action function for each
+/*	destination that the server has statistics for.
+/*	Specify SCACHE_TIMES_FLAG_RESET to discard the server's
+/*	statistics after listing. The result is -1 in case of
+/*	error.
+/*
+/*	scache_times_clnt_free() destroys a client.
+/*
+/*	Arguments:
+/* .IP server
+/*	The session cache service name.
+/* .IP timeout
+/*	Time limit for connect, send or receive operations.
+/* .IP idle_limit
+/*	Idle time after which the client disconnects.
+/* .IP ttl_limit
+/*	Upper bound on the time that a connection is allowed to persist.
+/* DIAGNOSTICS
+/*	Fatal error: memory allocation problem;
+/*	warning: communication error.
+/* SEE ALSO
+/*	scache(8), session cache server
+/*	scache_clnt(3), session cache manager client
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <vstring.h>
+#include <vstream.h>
+#include <auto_clnt.h>
+#include <stringops.h>
+
+/* Global library. */
+
+#include <mail_proto.h>
+#include <scache.h>
+#include <scache_times.h>
+
+ /*
+  * Phase names, in SCACHE_PHASE_XXX order.
+  */
+const char *scache_phase_names[SCACHE_PHASE_COUNT] = {
+    "dns", "conn", "banner", "tls", "helo", "envelope", "data",
+};
+
+ /*
+  * SCACHE_TIMES_CLNT is a thin wrapper around the session cache service
+  * endpoint.
+  */
+struct SCACHE_TIMES_CLNT {
+    AUTO_CLNT *auto_clnt;		/* client endpoint */
+};
+
+#define STR(x)	vstring_str(x)
+
+#define SCACHE_TIMES_MAX_TRIES	2
+
+/* scache_times_init - reset aggregate */
+
+void    scache_times_init(SCACHE_TIMES *times)
+{
+    SCACHE_PHASE_STAT *sp;
+
+    times->deliveries = 0;
+    for (sp = times->phase; sp < times->phase + SCACHE_PHASE_COUNT; sp++) {
+	sp->count = 0;
+	sp->total = 0;
+	sp->max = 0;
+    }
+}
+
+/* scache_times_add - add sample to aggregate */
+
+void    scache_times_add(SCACHE_TIMES *times, const long *sample)
+{
+    SCACHE_PHASE_STAT *sp;
+    int     n;
+
+    times->deliveries += 1;
+    for (n = 0; n < SCACHE_PHASE_COUNT; n++) {
+	if (sample[n] < 0)
+	    continue;
+	sp = times->phase + n;
+	sp->count += 1;
+	sp->total += sample[n];
+	if (sample[n] > sp->max)
+	    sp->max = sample[n];
+    }
+}
+
+/* scache_times_sample_export - serialize sample */
+
+char   *scache_times_sample_export(VSTRING *buf, const long *sample)
+{
+    int     n;
+
+    VSTRING_RESET(buf);
+    for (n = 0; n < SCACHE_PHASE_COUNT; n++)
+	vstring_sprintf_append(buf, n ? " %ld" : "%ld", sample[n]);
+    VSTRING_TERMINATE(buf);
+    return (STR(buf));
+}
+
+/* scache_times_sample_import - deserialize sample */
+
+int     scache_times_sample_import(const char *str, long *sample)
+{
+    char   *end;
+    int     n;
+
+    for (n = 0; n < SCACHE_PHASE_COUNT; n++) {
+	errno = 0;
+	sample[n] = strtol(str, &end, 10);
+	if (end == str || errno != 0)
+	    return (-1);
+	str = end;
+    }
+    return (*str == 0 ? 0 : -1);
+}
+
+/* scache_times_export - serialize aggregate */
+
+char   *scache_times_export(VSTRING *buf, const SCACHE_TIMES *times)
+{
+    const SCACHE_PHASE_STAT *sp;
+
+    vstring_sprintf(buf, "%ld", times->deliveries);
+    for (sp = times->phase; sp < times->phase + SCACHE_PHASE_COUNT; sp++)
+	vstring_sprintf_append(buf, " %ld %.0f %ld",
+			       sp->count, sp->total, sp->max);
+    return (STR(buf));
+}
+
+/* scache_times_import - deserialize aggregate */
+
+int     scache_times_import(const char *str, SCACHE_TIMES *times)
+{
+    SCACHE_PHASE_STAT *sp;
+    char   *end;
+
+#define PARSE_NUMBER(dst, func) do { \
+	errno = 0; \
+	(dst) = func(str, &end, 10); \
+	if (end == str || errno != 0) \
+	    return (-1); \
+	str = end; \
+    } while (0)
+
+#define strtod_ignore_base(s, e, b) strtod((s), (e))
+
+    PARSE_NUMBER(times->deliveries, strtol);
+    for (sp = times->phase; sp < times->phase + SCACHE_PHASE_COUNT; sp++) {
+	PARSE_NUMBER(sp->count, strtol);
+	PARSE_NUMBER(sp->total, strtod_ignore_base);
+	PARSE_NUMBER(sp->max, strtol);
+    }
+    return (*str == 0 ? 0 : -1);
+}
+
+/* scache_times_clnt_save - report one sample */
+
+void    scache_times_clnt_save(SCACHE_TIMES_CLNT *tp, const char *dest,
+			               const long *sample)
+{
+    static VSTRING *buf;
+    VSTREAM *stream;
+    int     status;
+    int     tries;
+
+    if (buf == 0)
+	buf = vstring_alloc(100);
+    scache_times_sample_export(buf, sample);
+
+    /*
+     * Unlike connection cache requests, this is not worth a delay when the
+     * server is unavailable. Try once more with a fresh connection, then
+     * give up.
+     */
+    for (tries = 0; tp->auto_clnt != 0; tries++) {
+	if ((stream = auto_clnt_access(tp->auto_clnt)) != 0) {
+	    errno = 0;
+	    if (attr_print(stream, ATTR_FLAG_NONE,
+			SEND_ATTR_STR(MAIL_ATTR_REQ, SCACHE_REQ_SAVE_TIMES),
+			   SEND_ATTR_STR(MAIL_ATTR_LABEL, dest),
+			   SEND_ATTR_STR(MAIL_ATTR_PROP, STR(buf)),
+			   ATTR_TYPE_END) != 0
+		|| vstream_fflush(stream)
+		|| attr_scan(stream, ATTR_FLAG_STRICT,
+			     RECV_ATTR_INT(MAIL_ATTR_STATUS, &status),
+			     ATTR_TYPE_END) != 1) {
+		if (msg_verbose || tries > 0
+		    || (errno && errno != EPIPE && errno != ENOENT))
+		    msg_warn("problem talking to service %s: %m",
+			     VSTREAM_PATH(stream));
+	    } else {
+		if (msg_verbose && status != SCACHE_STAT_OK)
+		    msg_warn("%s: timing update failed with status %d",
+			     dest, status);
+		return;
+	    }
+	}
+	if (tries >= SCACHE_TIMES_MAX_TRIES - 1) {
+	    msg_warn("disabling delivery timing statistics");
+	    auto_clnt_free(tp->auto_clnt);
+	    tp->auto_clnt = 0;
+	    return;
+	}
+	auto_clnt_recover(tp->auto_clnt);
+    }
+}
+
+/* scache_times_clnt_list - list per-destination statistics */
+
+int     scache_times_clnt_list(SCACHE_TIMES_CLNT *tp, int flags,
+			               SCACHE_TIMES_WALK_FN action,
+			               void *context)
+{
+    VSTRING *label;
+    VSTRING *prop;
+    VSTREAM *stream;
+    SCACHE_TIMES times;
+    int     status;
+    int     ret = -1;
+
+    if (tp->auto_clnt == 0 || (stream = auto_clnt_access(tp->auto_clnt)) == 0)
+	return (-1);
+
+    /*
+     * The server sends one reply per destination, followed by a reply with
+     * an empty destination.
+     */
+    label = vstring_alloc(100);
+    prop = vstring_alloc(100);
+    if (attr_print(stream, ATTR_FLAG_NONE,
+		   SEND_ATTR_STR(MAIL_ATTR_REQ, SCACHE_REQ_LIST_TIMES),
+		   SEND_ATTR_INT(MAIL_ATTR_FLAGS, flags),
+		   ATTR_TYPE_END) != 0
+	|| vstream_fflush(stream) != 0) {
+	msg_warn("problem talking to service %s: %m", VSTREAM_PATH(stream));
+    } else {
+	for (;;) {
+	    if (attr_scan(stream, ATTR_FLAG_STRICT,
+			  RECV_ATTR_INT(MAIL_ATTR_STATUS, &status),
+			  RECV_ATTR_STR(MAIL_ATTR_LABEL, label),
+			  RECV_ATTR_STR(MAIL_ATTR_PROP, prop),
+			  ATTR_TYPE_END) != 3) {
+		msg_warn("problem talking to service %s: %m",
+			 VSTREAM_PATH(stream));
+		break;
+	    }
+	    if (status != SCACHE_STAT_OK) {
+		msg_warn("timing statistics request failed with status %d",
+			 status);
+		break;
+	    }
+	    if (VSTRING_LEN(label) == 0) {
+		ret = 0;
+		break;
+	    }
+	    if (scache_times_import(STR(prop), &times) < 0) {
+		msg_warn("malformed statistics for %s: %s",
+			 STR(label), STR(prop));
+		continue;
+	    }
+	    action(STR(label), &times, context);
+	}
+    }
+    vstring_free(label);
+    vstring_free(prop);
+    return (ret);
+}
+
+/* scache_times_clnt_free - destroy client */
+
+void    scache_times_clnt_free(SCACHE_TIMES_CLNT *tp)
+{
+    if (tp->auto_clnt)
+	auto_clnt_free(tp->auto_clnt);
+    myfree((void *) tp);
+}
+
+/* scache_times_clnt_create - initialize */
+
+SCACHE_TIMES_CLNT *scache_times_clnt_create(const char *server, int timeout,
+					            int idle_limit,
+					            int ttl_limit)
+{
+    SCACHE_TIMES_CLNT *tp = (SCACHE_TIMES_CLNT *) mymalloc(sizeof(*tp));
+    char   *service;
+
+    service = concatenate("local:private/", server, (char *) 0);
+    tp->auto_clnt = auto_clnt_create(service, timeout, idle_limit, ttl_limit);
+    myfree(service);
+    return (tp);
+}
@@ -0,0 +1,79 @@
+#ifndef _SCACHE_TIMES_H_INCLUDED_
+#define _SCACHE_TIMES_H_INCLUDED_
+
+/*++
+/* NAME
+/*	scache_times 3h
+/* SUMMARY
+/*	per-destination delivery phase timings
+/* SYNOPSIS
+/*	#include <scache_times.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * Utility library.
+  */
+#include <vstring.h>
+
+ /*
+  * Delivery phases. The order is part of the scache(8) protocol.
+  */
+#define SCACHE_PHASE_DNS	0	/* address lookup */
+#define SCACHE_PHASE_CONN	1	/* connection setup */
+#define SCACHE_PHASE_BANNER	2	/* server greeting */
+#define SCACHE_PHASE_TLS	3	/* TLS handshake */
+#define SCACHE_PHASE_HELO	4	/* EHLO, HELO or LHLO */
+#define SCACHE_PHASE_ENVELOPE	5	/* MAIL FROM and RCPT TO */
+#define SCACHE_PHASE_DATA	6	/* message content */
+#define SCACHE_PHASE_COUNT	7
+
+extern const char *scache_phase_names[SCACHE_PHASE_COUNT];
+
+ /*
+  * Per-phase aggregate. Times are in microseconds.
+  */
+typedef struct {
+    long    count;			/* nr of samples */
+    double  total;			/* sum of samples */
+    long    max;			/* largest sample */
+} SCACHE_PHASE_STAT;
+
+typedef struct {
+    long    deliveries;			/* nr of delivery requests */
+    SCACHE_PHASE_STAT phase[SCACHE_PHASE_COUNT];
+} SCACHE_TIMES;
+
+extern void scache_times_init(SCACHE_TIMES *);
+extern void scache_times_add(SCACHE_TIMES *, const long *);
+extern char *scache_times_sample_export(VSTRING *, const long *);
+extern int scache_times_sample_import(const char *, long *);
+extern char *scache_times_export(VSTRING *, const SCACHE_TIMES *);
+extern int scache_times_import(const char *, SCACHE_TIMES *);
+
+ /*
+  * Client interface.
+  */
+typedef struct SCACHE_TIMES_CLNT SCACHE_TIMES_CLNT;
+typedef void (*SCACHE_TIMES_WALK_FN) (const char *, const SCACHE_TIMES *, void *);
+
+extern SCACHE_TIMES_CLNT *scache_times_clnt_create(const char *, int, int, int);
+extern void scache_times_clnt_save(SCACHE_TIMES_CLNT *, const char *, const long *);
+extern int scache_times_clnt_list(SCACHE_TIMES_CLNT *, int, SCACHE_TIMES_WALK_FN, void *);
+extern void scache_times_clnt_free(SCACHE_TIMES_CLNT *);
+
+#define SCACHE_TIMES_FLAG_NONE	0
+#define SCACHE_TIMES_FLAG_RESET	(1<<0)	/* reset after listing */
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+#endif
@@ -25,6 +25,13 @@
 /*
 /*	tok822_free() releases the memory used for the specified token
 /*	and conveniently returns a null pointer value.
+/*
+/*	Token structures and their string buffers are not returned
+/*	to the system, but are kept on free lists for reuse by
+/*	tok822_alloc(). A process that parses many addresses of
+/*	similar shape therefore stops calling malloc() once the free
+/*	lists are primed. The free lists are bounded in length, and
+/*	unusually large string buffers are not kept.
 /* LICENSE
 /* .ad
 /* .fi
@@ -50,6 +57,30 @@
 
 #include "tok822.h"
 
+ /*
+  * Free lists, linked via the next field. String-valued tokens keep their
+  * string buffer, so that reuse costs no memory allocation at all.
+  */
+static TOK822 *tok822_free_bare;	/* tokens without string */
+static TOK822 *tok822_free_str;		/* tokens with string */
+static int tok822_free_bare_count;
+static int tok822_free_str_count;
+
+#define TOK822_FREE_LIMIT	1000	/* max tokens per free list */
+#define TOK822_FREE_STR_SIZE	256	/* max string buffer size kept */
+
+#define TOK822_POP(list, count, tp) do { \
+	(tp) = (list); \
+	(list) = (tp)->next; \
+	(count) -= 1; \
+    } while (0)
+
+#define TOK822_PUSH(list, count, tp) do { \
+	(tp)->next = (list); \
+	(list) = (tp); \
+	(count) += 1; \
+    } while (0)
+
 /* tok822_alloc - allocate and initialize token */
 
 TOK822 *tok822_alloc(int type, const char *strval)
@@ -59,12 +90,31 @@ TOK822 *tok822_alloc(int type, const char *strval)
 #define CONTAINER_TOKEN(x) \
 	((x) == TOK822_ADDR || (x) == TOK822_STARTGRP)
 
-    tp = (TOK822 *) mymalloc(sizeof(*tp));
+    if (type < TOK822_MINTOK || CONTAINER_TOKEN(type)) {
+	if (tok822_free_bare != 0) {
+	    TOK822_POP(tok822_free_bare, tok822_free_bare_count, tp);
+	} else {
+	    tp = (TOK822 *) mymalloc(sizeof(*tp));
+	    tp->vstr = 0;
+	}
+    } else if (tok822_free_str != 0) {
+	TOK822_POP(tok822_free_str, tok822_free_str_count, tp);
+	if (strval == 0)
+	    VSTRING_RESET(tp->vstr);
+	else
+	    vstring_strcpy(tp->vstr, strval);
+	VSTRING_TERMINATE(tp->vstr);
+    } else {
+	if (tok822_free_bare != 0) {
+	    TOK822_POP(tok822_free_bare, tok822_free_bare_count, tp);
+	} else {
+	    tp = (TOK822 *) mymalloc(sizeof(*tp));
+	}
+	tp->vstr = (strval == 0 ? vstring_alloc(10) :
+		  vstring_strcpy(vstring_alloc(strlen(strval) + 1), strval));
+    }
     tp->type = type;
     tp->next = tp->prev = tp->head = tp->tail = tp->owner = 0;
-    tp->vstr = (type < TOK822_MINTOK || CONTAINER_TOKEN(type) ? 0 :
-		strval == 0 ? vstring_alloc(10) :
-		vstring_strcpy(vstring_alloc(strlen(strval) + 1), strval));
     return (tp);
 }
 
@@ -72,8 +122,19 @@ TOK822 *tok822_alloc(int type, const char *strval)
 
 TOK822 *tok822_free(TOK822 *tp)
 {
-    if (tp->vstr)
+    if (tp->vstr != 0) {
+	if (tok822_free_str_count < TOK822_FREE_LIMIT
+	    && tp->vstr->vbuf.len <= TOK822_FREE_STR_SIZE) {
+	    TOK822_PUSH(tok822_free_str, tok822_free_str_count, tp);
+	    return (0);
+	}
 	vstring_free(tp->vstr);
+	tp->vstr = 0;
+    }
+    if (tok822_free_bare_count < TOK822_FREE_LIMIT) {
+	TOK822_PUSH(tok822_free_bare, tok822_free_bare_count, tp);
+	return (0);
+    }
     myfree((void *) tp);
     return (0);
 }
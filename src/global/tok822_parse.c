@@ -53,7 +53,9 @@
 /*	tok822_parse() converts the external-form address list in
 /*	\fIstr\fR to the corresponding token tree. The parser is permissive
 /*	and will not throw away information that it does not understand.
-/*	The parser adds missing commas between addresses.
+/*	The parser adds missing commas between addresses. A single
+/*	address without comments, phrase, route or group syntax is
+/*	converted without running the full parser.
 /*
 /*	tok822_parse_limit() implements tok822_parse(), which is a macro.
 /*	The \fIlimit\fR argument is either zero or an upper bound on the
@@ -153,6 +155,27 @@
 
 #define COLLECT_SKIP_LAST(t,s,c,cond) { COLLECT(t,s,c,cond); if (*s) s++; }
 
+ /*
+  * Character classes, so that the tokenizer can find the end of an atom
+  * without calling strchr() for every character.
+  */
+static unsigned char tok822_ctype[256];
+
+#define TOK822_CT_SPACE	(1<<0)		/* space, tab, cr, lf */
+#define TOK822_CT_OP	(1<<1)		/* operator */
+#define TOK822_CT_QUOTE	(1<<2)		/* atom needs quoting */
+#define TOK822_CT_STOP	(1<<3)		/* null, backslash */
+
+#define TOK822_CT_ATOM_END (TOK822_CT_SPACE | TOK822_CT_OP | TOK822_CT_STOP)
+
+#define IS_TOK822_CT(ch, mask) (tok822_ctype[(unsigned char) (ch)] & (mask))
+
+ /*
+  * The test program turns off the tok822_parse() fast path, to compare its
+  * result with that of the full parser.
+  */
+static int tok822_fast_path = 1;
+
  /*
   * Not quite as complex. The parser depends heavily on it.
   */
@@ -187,6 +210,7 @@ static const char *tok822_comment(TOK822 *, const char *);
 static TOK822 *tok822_group(int, TOK822 *, TOK822 *, int);
 static void tok822_copy_quoted(VSTRING *, char *, char *);
 static int tok822_append_space(TOK822 *);
+static void tok822_ctype_init(void);
 
 #define DO_WORD		(1<<0)		/* finding a word is ok here */
 #define DO_GROUP	(1<<1)		/* doing an address group */
@@ -431,6 +455,11 @@ TOK822 *tok822_scan_limit(const char *str, TOK822 **tailp, int tok_count_limit)
     TOK822 *tp;
     int     ch;
     int     tok_count = 0;
+    const char *start;
+    int     quote;
+
+    if (tok822_ctype[0] == 0)
+	tok822_ctype_init();
 
     /*
      * XXX 2822 new feature: Section 4.1 allows "." to appear in a phrase (to
@@ -451,13 +480,30 @@ TOK822 *tok822_scan_limit(const char *str, TOK822 **tailp, int tok_count_limit)
 	} else if (ch == '"') {
 	    tp = tok822_alloc(TOK822_QSTRING, (char *) 0);
 	    COLLECT_SKIP_LAST(tp, str, ch, ch != '"');
-	} else if (ch != '\\' && strchr(tok822_opchar, ch)) {
+	} else if (ch != '\\' && IS_TOK822_CT(ch, TOK822_CT_OP)) {
 	    tp = tok822_alloc(ch, (char *) 0);
 	} else {
 	    tp = tok822_alloc(TOK822_ATOM, (char *) 0);
 	    str -= 1;				/* \ may be first */
-	    COLLECT(tp, str, ch, !IS_SPACE_TAB_CR_LF(ch) && !strchr(tok822_opchar, ch));
-	    tok822_quote_atom(tp);
+
+	    /*
+	     * Copy plain text in one go. Fall back to character-by-character
+	     * collection only after a backslash.
+	     */
+	    for (quote = 0, start = str;
+		 !IS_TOK822_CT(ch = *(unsigned char *) str, TOK822_CT_ATOM_END);
+		 str++)
+		quote |= tok822_ctype[ch];
+	    vstring_memcat(tp->vstr, start, str - start);
+	    if (ch == '\\') {
+		COLLECT(tp, str, ch,
+			!IS_TOK822_CT(ch, TOK822_CT_SPACE | TOK822_CT_OP));
+		tok822_quote_atom(tp);
+	    } else {
+		VSTRING_TERMINATE(tp->vstr);
+		if (quote & TOK822_CT_QUOTE)
+		    tp->type = TOK822_QSTRING;
+	    }
 	}
 	if (head == 0) {
 	    head = tail = tp;
@@ -495,6 +541,30 @@ TOK822 *tok822_parse_limit(const char *str, int tok_count_limit)
     if ((first_token = tok822_scan_limit(str, &last_token, tok_count_limit)) == 0)
 	return (0);
 
+    /*
+     * Fast path for the common case of a single address without comments,
+     * <route>, named group, or address list. The parser below would put the
+     * entire token list under one address node; do that here, and save the
+     * sentinel tokens and the right-to-left pass.
+     */
+#define WORD_TOKEN(x) \
+    ((x)->type == TOK822_ATOM || (x)->type == TOK822_QSTRING \
+     || (x)->type == TOK822_DOMLIT)
+
+    if (tok822_fast_path) {
+	for (tp = first_token; tp != 0; tp = tp->next) {
+	    if (tp->type == TOK822_COMMENT || tp->type == ','
+		|| tp->type == ';' || tp->type == '>'
+		|| (WORD_TOKEN(tp) && tp->next != 0 && WORD_TOKEN(tp->next)))
+		break;
+	}
+	if (tp == 0) {
+	    tp = tok822_alloc(TOK822_ADDR, (char *) 0);
+	    tok822_sub_append(tp, first_token);
+	    return (tp);
+	}
+    }
+
     /*
      * For convenience, sandwich the token list between two sentinel tokens.
      */
@@ -574,14 +644,33 @@ static void tok822_quote_atom(TOK822 *tp)
      * (and still passing it on as 8-bit data) we leave 8-bit data alone.
      */
     for (cp = vstring_str(tp->vstr); (ch = *(unsigned char *) cp) != 0; cp++) {
-	if ( /* !ISASCII(ch) || */ ch == ' '
-	    || ISCNTRL(ch) || strchr(tok822_opchar, ch)) {
+	if (IS_TOK822_CT(ch, TOK822_CT_QUOTE)) {
 	    tp->type = TOK822_QSTRING;
 	    break;
 	}
     }
 }
 
+/* tok822_ctype_init - initialize character class table */
+
+static void tok822_ctype_init(void)
+{
+    int     ch;
+
+    for (ch = 1; ch < 256; ch++) {
+	if (IS_SPACE_TAB_CR_LF(ch))
+	    tok822_ctype[ch] |= TOK822_CT_SPACE;
+	if (strchr(tok822_opchar, ch))
+	    tok822_ctype[ch] |= TOK822_CT_OP;
+	/* See tok822_quote_atom(). */
+	if ( /* !ISASCII(ch) || */ ch == ' '
+	    || ISCNTRL(ch) || strchr(tok822_opchar, ch))
+	    tok822_ctype[ch] |= TOK822_CT_QUOTE;
+    }
+    tok822_ctype['\\'] |= TOK822_CT_STOP;
+    tok822_ctype[0] = TOK822_CT_STOP;
+}
+
 /* tok822_comment - tokenize comment */
 
 static const char *tok822_comment(TOK822 *tp, const char *str)
@@ -655,9 +744,15 @@ TOK822 *tok822_scan_addr(const char *addr)
 
 #ifdef TEST
 
+#include <sys/time.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <vstream.h>
 #include <readlline.h>
+#include <argv.h>
+#include <myrand.h>
+#include <mymalloc.h>
+#include <msg_vstream.h>
 
 /* tok822_print - display token */
 
@@ -685,14 +780,217 @@ static void tok822_print(TOK822 *list, int indent)
     }
 }
 
-int     main(int unused_argc, char **unused_argv)
+#define TEST_TOKEN_LIMIT 20
+
+/* tok822_dump - format token tree for comparison */
+
+static void tok822_dump(VSTRING *buf, TOK822 *list)
+{
+    TOK822 *tp;
+
+    for (tp = list; tp; tp = tp->next) {
+	if (tp->type == TOK822_ADDR) {
+	    vstring_strcat(buf, "{");
+	    tok822_dump(buf, tp->head);
+	    vstring_strcat(buf, "}");
+	} else if (tp->type < TOK822_MINTOK) {
+	    vstring_sprintf_append(buf, "%c", tp->type);
+	} else {
+	    vstring_sprintf_append(buf, "[%d:%s]", tp->type,
+				   tp->vstr ? vstring_str(tp->vstr) : "");
+	}
+    }
+}
+
+/* tok822_parse_dump - parse and format, with or without fast path */
+
+static void tok822_parse_dump(VSTRING *buf, VSTRING *vp, const char *str,
+			              int limit, int fast_path)
 {
-    VSTRING *vp = vstring_alloc(100);
     TOK822 *list;
-    VSTRING *buf = vstring_alloc(100);
 
-#define TEST_TOKEN_LIMIT 20
+    tok822_fast_path = fast_path;
+    list = tok822_parse_limit(str, limit);
+    VSTRING_RESET(buf);
+    tok822_dump(buf, list);
+    vstring_sprintf_append(buf, "|%s",
+		vstring_str(tok822_internalize(vp, list, TOK822_STR_DEFL)));
+    vstring_sprintf_append(buf, "|%s",
+		       vstring_str(tok822_externalize(vp, list,
+		     TOK822_STR_DEFL | TOK822_STR_LINE | TOK822_STR_TRNC)));
+    tok822_free_tree(list);
+    tok822_fast_path = 1;
+}
 
+ /*
+  * Fuzzer: mutate the inputs from tok822_parse.in, and verify that the
+  * fast path produces the same parse tree and string forms as the full
+  * parser. Run under valgrind or with -fsanitize=address to find memory
+  * errors:
+  * 
+  * tok822_parse -f [-n count] [-s seed] <tok822_parse.in
+  */
+static const char *fuzz_fragments[] = {
+    "a", "b.c", "@", "<", ">", ",", ";", ":", ".", "\"", "\\", "(", ")",
+    "[", "]", " ", "\t", "\r\n ", "x\\ y", "\"q s\"", "(c)",
+    "[1.2.3.4]", "user", "example.com", "\200\377", "\001",
+};
+
+#define FUZZ_FRAGMENT() \
+    fuzz_fragments[myrand() % (sizeof(fuzz_fragments) / sizeof(*fuzz_fragments))]
+
+static void tok822_fuzz(ARGV *inputs, int count)
+{
+    VSTRING *input = vstring_alloc(100);
+    VSTRING *slow = vstring_alloc(100);
+    VSTRING *fast = vstring_alloc(100);
+    VSTRING *vp = vstring_alloc(100);
+    const char *seed;
+    const char *frag;
+    ssize_t len;
+    ssize_t pos;
+    int     limit;
+    int     n;
+    int     m;
+
+    for (n = 0; n < count; n++) {
+	seed = inputs->argc ? inputs->argv[myrand() % inputs->argc] : "";
+	vstring_strcpy(input, seed);
+	for (m = 1 + myrand() % 4; m > 0; m--) {
+	    len = VSTRING_LEN(input);
+	    pos = len ? myrand() % (len + 1) : 0;
+	    switch (myrand() % 3) {
+	    case 0:				/* insert fragment */
+		frag = FUZZ_FRAGMENT();
+		if (pos < len)
+		    vstring_insert(input, pos, frag, strlen(frag));
+		else
+		    vstring_strcat(input, frag);
+		break;
+	    case 1:				/* delete span */
+		if (pos < len) {
+		    memmove(vstring_str(input) + pos,
+			    vstring_str(input) + pos + 1, len - pos - 1);
+		    vstring_truncate(input, len - 1);
+		}
+		break;
+	    case 2:				/* replace byte */
+		if (pos < len)
+		    vstring_str(input)[pos] = 1 + myrand() % 255;
+		break;
+	    }
+	}
+	VSTRING_TERMINATE(input);
+	limit = (n & 1) ? TEST_TOKEN_LIMIT : 0;
+	tok822_parse_dump(slow, vp, vstring_str(input), limit, 0);
+	tok822_parse_dump(fast, vp, vstring_str(input), limit, 1);
+	if (strcmp(vstring_str(slow), vstring_str(fast)) != 0)
+	    msg_fatal("input \"%s\": full parser \"%s\", fast path \"%s\"",
+		      vstring_str(input), vstring_str(slow), vstring_str(fast));
+    }
+    vstream_printf("%d inputs, no differences\n", count);
+    vstream_fflush(VSTREAM_OUT);
+    vstring_free(input);
+    vstring_free(slow);
+    vstring_free(fast);
+    vstring_free(vp);
+}
+
+/* bench_elapsed - seconds since start */
+
+static double bench_elapsed(struct timeval *start)
+{
+    struct timeval now;
+
+    GETTIMEOFDAY(&now);
+    return (now.tv_sec - start->tv_sec
+	    + (now.tv_usec - start->tv_usec) / 1000000.0);
+}
+
+ /*
+  * Benchmark: parse, externalize and destroy each input from
+  * tok822_parse.in, as cleanup(8) does for address headers, with and
+  * without the fast path:
+  * 
+  * tok822_parse -b [-n count] <tok822_parse.in
+  */
+static void tok822_bench(ARGV *inputs, int count)
+{
+    VSTRING *vp = vstring_alloc(100);
+    struct timeval start;
+    TOK822 *list;
+    double  elapsed;
+    int     fast_path;
+    int     n;
+    char  **cpp;
+
+    for (fast_path = 0; fast_path < 2; fast_path++) {
+	tok822_fast_path = fast_path;
+	GETTIMEOFDAY(&start);
+	for (n = 0; n < count; n++) {
+	    for (cpp = inputs->argv; *cpp; cpp++) {
+		list = tok822_parse(*cpp);
+		tok822_externalize(vp, list, TOK822_STR_DEFL);
+		tok822_free_tree(list);
+	    }
+	}
+	elapsed = bench_elapsed(&start);
+	vstream_printf("fast path %s: %d x %ld inputs, %.3fs, %.0f parses/s\n",
+		       fast_path ? "on" : "off", count, (long) inputs->argc,
+		       elapsed, elapsed > 0 ?
+		       count * (double) inputs->argc / elapsed : 0);
+	vstream_fflush(VSTREAM_OUT);
+    }
+    tok822_fast_path = 1;
+    vstring_free(vp);
+}
+
+int     main(int argc, char **argv)
+{
+    VSTRING *vp = vstring_alloc(100);
+    TOK822 *list;
+    VSTRING *buf = vstring_alloc(100);
+    ARGV   *inputs;
+    int     ch;
+    int     mode = 0;
+    int     count = 0;
+
+    while ((ch = GETOPT(argc, argv, "bfn:s:")) > 0) {
+	switch (ch) {
+	case 'b':
+	case 'f':
+	    mode = ch;
+	    break;
+	case 'n':
+	    if ((count = atoi(optarg)) <= 0)
+		msg_fatal("bad count: %s", optarg);
+	    break;
+	case 's':
+	    mysrand(atoi(optarg));
+	    break;
+	default:
+	    msg_fatal("usage: %s [-b | -f] [-n count] [-s seed]", argv[0]);
+	}
+    }
+    if (mode != 0) {
+	msg_vstream_init(argv[0], VSTREAM_ERR);
+	inputs = argv_alloc(50);
+	while (readlline(buf, VSTREAM_IN, (int *) 0)) {
+	    while (VSTRING_LEN(buf) > 0 && vstring_end(buf)[-1] == '\n') {
+		vstring_end(buf)[-1] = 0;
+		vstring_truncate(buf, VSTRING_LEN(buf) - 1);
+	    }
+	    argv_add(inputs, vstring_str(buf), (char *) 0);
+	}
+	if (mode == 'b')
+	    tok822_bench(inputs, count ? count : 10000);
+	else
+	    tok822_fuzz(inputs, count ? count : 100000);
+	argv_free(inputs);
+	vstring_free(vp);
+	vstring_free(buf);
+	return (0);
+    }
     while (readlline(buf, VSTREAM_IN, (int *) 0)) {
 	while (VSTRING_LEN(buf) > 0 && vstring_end(buf)[-1] == '\n') {
 	    vstring_end(buf)[-1] = 0;
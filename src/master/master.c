@@ -527,6 +527,12 @@ int     main(int argc, char **argv)
     vstring_free(lock_path);
     vstring_free(data_lock_path);
 
+    /*
+     * Create the performance counter segment before any child process is
+     * started.
+     */
+    master_stats_init();
+
     /*
      * Optionally start the debugger on ourself.
      */
@@ -186,6 +186,12 @@ extern void master_spawn(MASTER_SERV *);
 extern void master_reap_child(void);
 extern void master_delete_children(MASTER_SERV *);
 
+ /*
+  * master_stats.c
+  */
+extern void master_stats_init(void);
+extern void master_stats_retire(MASTER_PID);
+
  /*
   * master_flow.c
   */
@@ -341,6 +341,7 @@ void    master_reap_child(void)
 		master_throttle(serv);
 	    }
 	}
+	master_stats_retire(pid);
 	master_delete_child(proc);
     }
 }
@@ -0,0 +1,81 @@
+/*++
+/* NAME
+/*	master_stats 3
+/* SUMMARY
+/*	Postfix master - performance counter segment
+/* SYNOPSIS
+/*	#include "master.h"
+/*
+/*	void	master_stats_init()
+/*
+/*	void	master_stats_retire(pid)
+/*	MASTER_PID pid;
+/* DESCRIPTION
+/*	master_stats_init() creates the performance counter segment
+/*	that Postfix daemon processes attach to, with room for
+/*	$stats_process_limit processes. When that limit is zero,
+/*	master_stats_init() removes a segment that was left behind
+/*	by an earlier master process.
+/*
+/*	master_stats_retire() adds the counters of a terminated
+/*	child process to the totals for its service, and makes its
+/*	slot available to a new process.
+/* DIAGNOSTICS
+/*	Problems are logged as warnings; they don't stop the master.
+/* SEE ALSO
+/*	mail_stats(3), Postfix performance counters
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <errno.h>
+#include <unistd.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <stats.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <mail_stats.h>
+
+/* Application-specific. */
+
+#include "master.h"
+
+static STATS_SEG *master_stats_seg;
+
+/* master_stats_init - create counter segment */
+
+void    master_stats_init(void)
+{
+    const char *path = mail_stats_path();
+
+    if (var_stats_slots <= 0) {
+	if (unlink(path) < 0 && errno != ENOENT)
+	    msg_warn("remove %s: %m", path);
+    } else if ((master_stats_seg = stats_seg_create(path,
+						    var_stats_slots)) == 0) {
+	msg_warn("create %s: %m -- performance counters are disabled", path);
+    }
+}
+
+/* master_stats_retire - fold terminated process into service totals */
+
+void    master_stats_retire(MASTER_PID pid)
+{
+    if (master_stats_seg != 0)
+	stats_seg_retire(master_stats_seg, (long) pid);
+}
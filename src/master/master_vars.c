@@ -49,6 +49,7 @@
 char   *var_inet_protocols;
 int     var_throttle_time;
 char   *var_master_disable;
+int     var_stats_slots;
 
 /* master_vars_init - initialize from global Postfix configuration file */
 
@@ -59,6 +60,10 @@ void    master_vars_init(void)
 	VAR_MASTER_DISABLE, DEF_MASTER_DISABLE, &var_master_disable, 0, 0,
 	0,
     };
+    static const CONFIG_INT_TABLE int_table[] = {
+	VAR_STATS_SLOTS, DEF_STATS_SLOTS, &var_stats_slots, 0, 0,
+	0,
+    };
     static const CONFIG_TIME_TABLE time_table[] = {
 	VAR_THROTTLE_TIME, DEF_THROTTLE_TIME, &var_throttle_time, 1, 0,
 	0,
@@ -73,6 +78,10 @@ void    master_vars_init(void)
 	/* XXX Add inet_interfaces here after this code is burned in. */
 	0,
     };
+    static MASTER_INT_WATCH int_watch_table[] = {
+	VAR_STATS_SLOTS, &var_stats_slots, 0, 0, 0,
+	0,
+    };
 
     /*
      * Flush existing main.cf settings, so that we handle deleted main.cf
@@ -82,6 +91,7 @@ void    master_vars_init(void)
     set_mail_conf_str(VAR_PROCNAME, var_procname);
     mail_conf_read();
     get_mail_conf_str_table(str_table);
+    get_mail_conf_int_table(int_table);
     get_mail_conf_time_table(time_table);
     path = concatenate(var_config_dir, "/", MASTER_CONF_FILE, (void *) 0);
     fset_master_ent(path);
@@ -91,4 +101,5 @@ void    master_vars_init(void)
      * Look for parameter changes that require special attention.
      */
     master_str_watch(str_watch_table);
+    master_int_watch(int_watch_table);
 }
@@ -228,6 +228,7 @@
 #include <mail_version.h>
 #include <bounce.h>
 #include <maillog_client.h>
+#include <mail_stats.h>
 
 /* Process manager. */
 
@@ -685,7 +686,22 @@ NORETURN multi_server_main(int argc, char **argv, MULTI_SERVER_FN service,...)
      * non-default program name or logging destination.
      */
     mail_params_init();
-    maillog_client_init(mail_task(var_procname), MAILLOG_CLIENT_FLAG_NONE);
+    maillog_client_init(mail_task(var_procname), MAILLOG_CLIENT_FLAG_RING);
+
+    /*
+     * Claim a performance counter slot while we still have privileges.
+     * master(8) frees the slot when it reaps this process, so stand-alone
+     * processes must not claim one.
+     */
+    if (daemon_mode && stream == 0)
+	mail_stats_init(service_name);
+
+    /*
+     * Optionally, time the event loop and its call-backs. The histograms
+     * go into the counter slot that we may have claimed above.
+     */
+    if (var_event_stall > 0)
+	event_profile(var_event_stall);
 
     /*
      * Register higher-level dictionaries and initialize the support for
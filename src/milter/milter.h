@@ -182,6 +182,10 @@ extern void milter_free(MILTERS *);
 #define S8_MAC_DAEMON_ADDR	"{daemon_addr}"
 #define S8_MAC_DAEMON_PORT	"{daemon_port}"
 
+#define S8_MAC_PROXY_ALPN	"{proxy_alpn}"
+#define S8_MAC_PROXY_AUTHORITY	"{proxy_authority}"
+#define S8_MAC_PROXY_UNIQUE_ID	"{proxy_unique_id}"
+
 #define S8_MAC_TLS_VERSION	"{tls_version}"
 #define S8_MAC_CIPHER		"{cipher}"
 #define S8_MAC_CIPHER_BITS	"{cipher_bits}"
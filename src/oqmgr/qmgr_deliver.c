@@ -105,10 +105,14 @@ static int qmgr_deliver_initial_reply(VSTREAM *stream)
 {
     int     stat;
 
+    /*
+     * Skip the optional "more" announcement; this queue manager sends only
+     * one delivery request per connection.
+     */
     if (peekfd(vstream_fileno(stream)) < 0) {
 	msg_warn("%s: premature disconnect", VSTREAM_PATH(stream));
 	return (DELIVER_STAT_CRASH);
-    } else if (attr_scan(stream, ATTR_FLAG_STRICT,
+    } else if (attr_scan(stream, ATTR_FLAG_MISSING,
 			 RECV_ATTR_INT(MAIL_ATTR_STATUS, &stat),
 			 ATTR_TYPE_END) != 1) {
 	msg_warn("%s: malformed response", VSTREAM_PATH(stream));
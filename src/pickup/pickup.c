@@ -12,6 +12,12 @@
 /*	Ill-formatted files are deleted without notifying the originator.
 /*	This program expects to be run from the \fBmaster\fR(8) process
 /*	manager.
+/*
+/*	On systems with \fBinotify\fR(7) support, the \fBpickup\fR(8)
+/*	daemon also watches the \fBmaildrop\fR directory, and picks up
+/*	each file as soon as it is complete, without scanning the
+/*	directory. The directory is still scanned upon wakeup from the
+/*	\fBmaster\fR(8) daemon, but at most once per minute.
 /* STANDARDS
 /* .ad
 /* .fi
@@ -52,6 +58,17 @@
 /* .IP "\fBreceive_override_options (empty)\fR"
 /*	Enable or disable recipient validation, built-in content
 /*	filtering, or address mapping.
+/* RESOURCE AND RATE CONTROLS
+/* .ad
+/* .fi
+/*	Available in Postfix version 3.5 and later:
+/* .IP "\fBpickup_cleanup_concurrency (1)\fR"
+/*	The maximal number of messages that the \fBpickup\fR(8) daemon
+/*	feeds into different \fBcleanup\fR(8) processes before it waits
+/*	for their completion status.
+/* .IP "\fBpickup_inotify_enable (yes)\fR"
+/*	On systems with \fBinotify\fR(7) support, pick up each
+/*	\fBmaildrop\fR file as soon as it is complete.
 /* MISCELLANEOUS CONTROLS
 /* .ad
 /* .fi
@@ -122,6 +139,10 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
+#include <limits.h>
+#ifdef HAS_INOTIFY
+#include <sys/inotify.h>
+#endif
 
 /* Utility library. */
 
@@ -133,6 +154,8 @@
 #include <safe_open.h>
 #include <watchdog.h>
 #include <stringops.h>
+#include <iostuff.h>
+#include <events.h>
 
 /* Global library. */
 
@@ -160,6 +183,8 @@
 
 char   *var_filter_xport;
 char   *var_input_transp;
+int     var_pickup_conc;
+bool    var_pickup_inotify;
 
  /*
   * Structure to bundle a bunch of information about a queue file.
@@ -169,15 +194,38 @@ typedef struct {
     struct stat st;			/* queue file status */
     char   *path;			/* name for open/remove */
     char   *sender;			/* sender address */
+    VSTREAM *cleanup;			/* completion status pending */
 } PICKUP_INFO;
 
  /*
   * What action should be taken after attempting to deliver a message: remove
   * the file from the maildrop, or leave it alone. The latter is also used
-  * for files that are still being written to.
+  * for files that are still being written to. A message that was sent to
+  * the cleanup service may still be waiting for its completion status.
   */
 #define REMOVE_MESSAGE_FILE	1
 #define KEEP_MESSAGE_FILE	2
+#define PENDING_MESSAGE_FILE	3
+
+ /*
+  * Messages whose completion status is pending. Each uses a different
+  * cleanup process, so that these can work in parallel.
+  */
+static PICKUP_INFO *pickup_pending;
+static int pickup_pending_count;
+
+ /*
+  * With inotify(7), we pick up files as they arrive. We still scan the
+  * maildrop directory upon wakeup, but less often, to find files that
+  * arrived while no pickup process was watching.
+  */
+#define PICKUP_SCAN_INTERVAL	60
+
+#ifdef HAS_INOTIFY
+static int pickup_inotify_fd = -1;
+
+#endif
+static time_t pickup_last_scan;
 
  /*
   * Transparency: before mail is queued, do we allow address mapping,
@@ -401,28 +449,44 @@ static int pickup_copy(VSTREAM *qfile, VSTREAM *cleanup,
 	return (status);
 
     /*
-     * There are no errors. Send the end-of-data marker, and get the cleanup
-     * service completion status. XXX Since the pickup service is unable to
-     * bounce, the cleanup service can report only soft errors here.
+     * There are no errors. Send the end-of-data marker. The cleanup service
+     * completion status is collected later, so that we can feed other
+     * messages to other cleanup processes in the mean time.
      */
     rec_fputs(cleanup, REC_TYPE_END, "");
-    if (attr_scan(cleanup, ATTR_FLAG_MISSING,
-		  RECV_ATTR_INT(MAIL_ATTR_STATUS, &status),
-		  RECV_ATTR_STR(MAIL_ATTR_WHY, buf),
-		  ATTR_TYPE_END) != 2)
+    if (vstream_fflush(cleanup) != 0)
 	return (cleanup_service_error(info, CLEANUP_STAT_WRITE));
+    return (PENDING_MESSAGE_FILE);
+}
+
+/* pickup_status - get cleanup service completion status */
+
+static int pickup_status(PICKUP_INFO *info)
+{
+    VSTRING *buf = vstring_alloc(100);
+    int     status;
 
     /*
      * Depending on the cleanup service completion status, delete the message
      * file, or try again later. Bounces are dealt with by the cleanup
      * service itself. The master process wakes up the cleanup service every
-     * now and then.
+     * now and then. XXX Since the pickup service is unable to bounce, the
+     * cleanup service can report only soft errors here.
      */
-    if (status) {
-	return (cleanup_service_error_reason(info, status, vstring_str(buf)));
+    if (attr_scan(info->cleanup, ATTR_FLAG_MISSING,
+		  RECV_ATTR_INT(MAIL_ATTR_STATUS, &status),
+		  RECV_ATTR_STR(MAIL_ATTR_WHY, buf),
+		  ATTR_TYPE_END) != 2) {
+	status = cleanup_service_error(info, CLEANUP_STAT_WRITE);
+    } else if (status) {
+	status = cleanup_service_error_reason(info, status, vstring_str(buf));
     } else {
-	return (REMOVE_MESSAGE_FILE);
+	status = REMOVE_MESSAGE_FILE;
     }
+    (void) vstream_fclose(info->cleanup);
+    info->cleanup = 0;
+    vstring_free(buf);
+    return (status);
 }
 
 /* pickup_file - initialize for file copy and cleanup */
@@ -493,7 +557,10 @@ static int pickup_file(PICKUP_INFO *info)
 	status = pickup_copy(qfile, cleanup, info, buf);
     }
     vstream_fclose(qfile);
-    vstream_fclose(cleanup);
+    if (status == PENDING_MESSAGE_FILE)
+	info->cleanup = cleanup;
+    else
+	vstream_fclose(cleanup);
     vstring_free(buf);
     return (status);
 }
@@ -505,6 +572,7 @@ static void pickup_init(PICKUP_INFO *info)
     info->id = 0;
     info->path = 0;
     info->sender = 0;
+    info->cleanup = 0;
 }
 
 /* pickup_free - wipe info structure */
@@ -516,56 +584,193 @@ static void pickup_free(PICKUP_INFO *info)
     SAFE_FREE(info->id);
     SAFE_FREE(info->path);
     SAFE_FREE(info->sender);
+    if (info->cleanup)
+	(void) vstream_fclose(info->cleanup);
 }
 
-/* pickup_service - service client */
+/* pickup_done - finish a message, and remove it from the maildrop */
 
-static void pickup_service(char *unused_buf, ssize_t unused_len,
-			           char *unused_service, char **argv)
+static int pickup_done(PICKUP_INFO *info, int status)
 {
-    SCAN_DIR *scan;
-    char   *queue_name;
-    PICKUP_INFO info;
+    int     removed = 0;
+
+    if (status == PENDING_MESSAGE_FILE)
+	status = pickup_status(info);
+    if (status == REMOVE_MESSAGE_FILE) {
+	if (REMOVE(info->path))
+	    msg_warn("remove %s: %m", info->path);
+	else
+	    removed = 1;
+    }
+    pickup_free(info);
+    return (removed);
+}
+
+/* pickup_drain - wait for pending messages */
+
+static int pickup_drain(int keep)
+{
+    int     file_count = 0;
+
+    /*
+     * Finish the oldest message first; its cleanup process has had the most
+     * time to complete.
+     */
+    while (pickup_pending_count > keep) {
+	file_count += pickup_done(pickup_pending, PENDING_MESSAGE_FILE);
+	pickup_pending_count -= 1;
+	memmove((void *) pickup_pending, (void *) (pickup_pending + 1),
+		sizeof(*pickup_pending) * pickup_pending_count);
+    }
+    return (file_count);
+}
+
+/* pickup_submit - feed one maildrop file into the cleanup service */
+
+static int pickup_submit(char *queue_name, const char *id)
+{
+    PICKUP_INFO *info = pickup_pending + pickup_pending_count;
     const char *path;
-    char   *id;
-    int     file_count;
+    int     status;
+    int     n;
+
+    if (mail_open_ok(queue_name, id, &info->st, &path) != MAIL_OPEN_YES)
+	return (0);
 
     /*
-     * Sanity check. This service takes no command-line arguments.
+     * With inotify, we may be told about a file that is still in progress.
      */
-    if (argv[0])
-	msg_fatal("unexpected command-line argument: %s", argv[0]);
+    for (n = 0; n < pickup_pending_count; n++)
+	if (strcmp(pickup_pending[n].path, path) == 0)
+	    return (0);
+
+    /*
+     * When we find a file, stroke the watchdog so that it will not bark
+     * while some application is keeping us busy by injecting lots of mail
+     * into the maildrop directory.
+     */
+    pickup_init(info);
+    info->path = mystrdup(path);
+    watchdog_pat();
+    if ((status = pickup_file(info)) != PENDING_MESSAGE_FILE)
+	return (pickup_done(info, status));
+    pickup_pending_count += 1;
+    return (pickup_drain(var_pickup_conc - 1));
+}
+
+/* pickup_scan - feed all maildrop files into the cleanup service */
+
+static void pickup_scan(void)
+{
+    SCAN_DIR *scan;
+    char   *queue_name;
+    char   *id;
+    int     file_count;
 
     /*
      * Skip over things that we don't want to open, such as files that are
      * still being written, or garbage. Leave it up to the sysadmin to remove
      * garbage. Keep scanning the queue directory until we stop removing
      * files from it.
-     * 
-     * When we find a file, stroke the watchdog so that it will not bark while
-     * some application is keeping us busy by injecting lots of mail into the
-     * maildrop directory.
      */
     queue_name = MAIL_QUEUE_MAILDROP;		/* XXX should be a list */
     do {
 	file_count = 0;
 	scan = scan_dir_open(queue_name);
-	while ((id = scan_dir_next(scan)) != 0) {
-	    if (mail_open_ok(queue_name, id, &info.st, &path) == MAIL_OPEN_YES) {
-		pickup_init(&info);
-		info.path = mystrdup(path);
-		watchdog_pat();
-		if (pickup_file(&info) == REMOVE_MESSAGE_FILE) {
-		    if (REMOVE(info.path))
-			msg_warn("remove %s: %m", info.path);
-		    else
-			file_count++;
-		}
-		pickup_free(&info);
-	    }
-	}
+	while ((id = scan_dir_next(scan)) != 0)
+	    file_count += pickup_submit(queue_name, id);
+	file_count += pickup_drain(0);
 	scan_dir_close(scan);
     } while (file_count);
+    pickup_last_scan = time((time_t *) 0);
+}
+
+#ifdef HAS_INOTIFY
+
+/* pickup_inotify_event - pick up files as they arrive */
+
+static void pickup_inotify_event(int unused_event, void *unused_context)
+{
+    union {
+	struct inotify_event align;
+	char    data[sizeof(struct inotify_event) * 64 + NAME_MAX + 1];
+    }       buf;
+    struct inotify_event *ev;
+    ssize_t len;
+    char   *cp;
+    int     need_scan = 0;
+
+    /*
+     * Each complete maildrop file is reported after it is closed or after
+     * it is renamed into place. If we lose track, fall back to scanning.
+     */
+    if ((len = read(pickup_inotify_fd, buf.data, sizeof(buf.data))) < 0) {
+	if (errno == EAGAIN || errno == EINTR)
+	    return;
+	msg_warn("read inotify events: %m -- falling back to directory scans");
+	event_disable_readwrite(pickup_inotify_fd);
+	(void) close(pickup_inotify_fd);
+	pickup_inotify_fd = -1;
+	return;
+    }
+    for (cp = buf.data; cp < buf.data + len; cp += sizeof(*ev) + ev->len) {
+	ev = (struct inotify_event *) cp;
+	if (ev->mask & IN_Q_OVERFLOW)
+	    need_scan = 1;
+	else if (ev->len > 0)
+	    (void) pickup_submit(MAIL_QUEUE_MAILDROP, ev->name);
+    }
+    (void) pickup_drain(0);
+    if (need_scan)
+	pickup_scan();
+}
+
+/* pickup_inotify_init - watch the maildrop directory */
+
+static void pickup_inotify_init(void)
+{
+    if ((pickup_inotify_fd = inotify_init()) < 0) {
+	msg_warn("inotify_init: %m -- using directory scans only");
+	return;
+    }
+    if (inotify_add_watch(pickup_inotify_fd, MAIL_QUEUE_MAILDROP,
+			  IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+	msg_warn("inotify_add_watch %s: %m -- using directory scans only",
+		 MAIL_QUEUE_MAILDROP);
+	(void) close(pickup_inotify_fd);
+	pickup_inotify_fd = -1;
+	return;
+    }
+    non_blocking(pickup_inotify_fd, NON_BLOCKING);
+    close_on_exec(pickup_inotify_fd, CLOSE_ON_EXEC);
+    event_enable_read(pickup_inotify_fd, pickup_inotify_event, (void *) 0);
+}
+
+#endif
+
+/* pickup_service - service client */
+
+static void pickup_service(char *unused_buf, ssize_t unused_len,
+			           char *unused_service, char **argv)
+{
+
+    /*
+     * Sanity check. This service takes no command-line arguments.
+     */
+    if (argv[0])
+	msg_fatal("unexpected command-line argument: %s", argv[0]);
+
+    /*
+     * While inotify is watching the maildrop directory, a wakeup from
+     * postdrop(1) is redundant. Scan only once in a while, to pick up files
+     * that arrived while no pickup process was watching.
+     */
+#ifdef HAS_INOTIFY
+    if (pickup_inotify_fd >= 0
+	&& time((time_t *) 0) < pickup_last_scan + PICKUP_SCAN_INTERVAL)
+	return;
+#endif
+    pickup_scan();
 }
 
 /* post_jail_init - drop privileges */
@@ -585,6 +790,20 @@ static void post_jail_init(char *unused_name, char **unused_argv)
      */
     pickup_input_transp_mask =
 	input_transp_mask(VAR_INPUT_TRANSP, var_input_transp);
+
+    /*
+     * Messages whose cleanup service completion status is pending.
+     */
+    pickup_pending = (PICKUP_INFO *)
+	mymalloc(sizeof(*pickup_pending) * var_pickup_conc);
+
+    /*
+     * Pick up maildrop files as they arrive.
+     */
+#ifdef HAS_INOTIFY
+    if (var_pickup_inotify)
+	pickup_inotify_init();
+#endif
 }
 
 MAIL_VERSION_STAMP_DECLARE;
@@ -593,11 +812,19 @@ MAIL_VERSION_STAMP_DECLARE;
 
 int     main(int argc, char **argv)
 {
+    static const CONFIG_INT_TABLE int_table[] = {
+	VAR_PICKUP_CONC, DEF_PICKUP_CONC, &var_pickup_conc, 1, 0,
+	0,
+    };
     static const CONFIG_STR_TABLE str_table[] = {
 	VAR_FILTER_XPORT, DEF_FILTER_XPORT, &var_filter_xport, 0, 0,
 	VAR_INPUT_TRANSP, DEF_INPUT_TRANSP, &var_input_transp, 0, 0,
 	0,
     };
+    static const CONFIG_BOOL_TABLE bool_table[] = {
+	VAR_PICKUP_INOTIFY, DEF_PICKUP_INOTIFY, &var_pickup_inotify,
+	0,
+    };
 
     /*
      * Fingerprint executables and core dumps.
@@ -616,7 +843,9 @@ int     main(int argc, char **argv)
      * submissions.
      */
     trigger_server_main(argc, argv, pickup_service,
+			CA_MAIL_SERVER_INT_TABLE(int_table),
 			CA_MAIL_SERVER_STR_TABLE(str_table),
+			CA_MAIL_SERVER_BOOL_TABLE(bool_table),
 			CA_MAIL_SERVER_POST_INIT(post_jail_init),
 			CA_MAIL_SERVER_SOLITARY,
 			CA_MAIL_SERVER_WATCHDOG(&var_daemon_timeout),
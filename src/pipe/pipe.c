@@ -39,6 +39,49 @@
 /*	in the Postfix \fBmain.cf\fR file, where \fItransport\fR
 /*	is the name in the first column of the Postfix \fBmaster.cf\fR
 /*	entry for the pipe-based delivery transport.
+/* COPROCESS DELIVERY
+/* .ad
+/* .fi
+/*	By default, the \fBpipe\fR(8) daemon executes a new external
+/*	command for each delivery request. With the \fBcoprocess=yes\fR
+/*	command attribute, the command is started once, and receives
+/*	one message after the other through its standard input. This
+/*	avoids the cost of process creation and program initialization
+/*	for each message.
+/*
+/*	Each \fBpipe\fR(8) process has at most one coprocess, so
+/*	that the number of coprocesses for a transport is limited by
+/*	the \fBmaster.cf\fR process limit. A coprocess is terminated
+/*	after it has handled $pipe_coprocess_max_use messages,
+/*	after $pipe_coprocess_idle_timeout seconds without work,
+/*	when the \fBpipe\fR(8) process terminates, and when the
+/*	expanded command line changes. The latter means that a
+/*	command line with per-message macros such as \fB$sender\fR
+/*	or \fB$recipient\fR defeats the purpose of a coprocess.
+/*	Instead, the coprocess receives this information with each
+/*	message, as follows.
+/*
+/*	For each message, the coprocess receives a block of
+/*	\fIname\fB=\fIvalue\fR lines with the \fBsender\fR,
+/*	\fBnexthop\fR, \fBsize\fR, \fBqueue_id\fR, \fBclient_address\fR,
+/*	\fBclient_hostname\fR, \fBclient_port\fR, \fBclient_protocol\fR,
+/*	\fBclient_helo\fR, \fBsasl_method\fR, \fBsasl_username\fR
+/*	and \fBsasl_sender\fR attributes, followed by an
+/*	\fBoriginal_recipient\fR and \fBrecipient\fR attribute for
+/*	each recipient, and an empty line. Then follows the message
+/*	content with lines starting with "\fB.\fR" escaped as
+/*	"\fB..\fR", and a line with only "\fB.\fR". Each line
+/*	ends in the \fBeol\fR attribute value.
+/*
+/*	The coprocess replies with a line "\fBstatus=\fInumber\fR",
+/*	where \fInumber\fR is zero for success, or a \fB<sysexits.h>\fR
+/*	exit status. Output that precedes the status line is handled
+/*	as the output of a command that terminates. When the
+/*	coprocess terminates instead of replying, the \fBpipe\fR(8)
+/*	daemon uses the exit status as it would for a command that
+/*	was started for one delivery request.
+/* .sp
+/*	This feature is available as of Postfix 3.5.
 /* COMMAND ATTRIBUTE SYNTAX
 /* .ad
 /* .fi
@@ -52,6 +95,11 @@
 /*	directive. Delivery is deferred in case of failure.
 /* .sp
 /*	This feature is available as of Postfix 2.3.
+/* .IP "\fBcoprocess=\fIyes\fR | \fIno\fR (optional, default: \fIno\fR)"
+/*	Deliver multiple messages to the same external command
+/*	process, as described under COPROCESS DELIVERY above.
+/* .sp
+/*	This feature is available as of Postfix 3.5.
 /* .IP "\fBdirectory=\fIpathname\fR (optional)"
 /*	Change to the named directory before executing the external command.
 /*	The directory must be accessible for the user specified with the
@@ -427,6 +475,14 @@
 /*	aliasing or with canonical mapping).
 /* .IP "\fBservice_name (read-only)\fR"
 /*	The master.cf service name of a Postfix daemon process.
+/* .PP
+/*	Available in Postfix version 3.5 and later:
+/* .IP "\fBpipe_coprocess_max_use (100)\fR"
+/*	The maximal number of messages that a \fBpipe\fR(8) coprocess
+/*	will handle before it is terminated.
+/* .IP "\fBpipe_coprocess_idle_timeout (60s)\fR"
+/*	The amount of time that a \fBpipe\fR(8) coprocess may wait
+/*	for a message before it is terminated.
 /* SEE ALSO
 /*	qmgr(8), queue manager
 /*	bounce(8), delivery status reports
@@ -575,6 +631,8 @@ int     var_command_maxtime;		/* You can now leave this here. */
   * Other main.cf parameters.
   */
 char   *var_pipe_dsn_filter;
+int     var_pipe_coproc_max_use;
+int     var_pipe_coproc_idle;
 
  /*
   * For convenience. Instead of passing around lists of parameters, bundle
@@ -601,6 +659,7 @@ typedef struct {
     VSTRING *eol;			/* output record delimiter */
     VSTRING *null_sender;		/* null sender expansion */
     off_t   size_limit;			/* max size in bytes we will accept */
+    int     coproc;			/* persistent command */
 } PIPE_ATTR;
 
  /*
@@ -871,6 +930,7 @@ static void get_service_attr(PIPE_ATTR *attr, char **argv)
     attr->eol = vstring_strcpy(vstring_alloc(1), "\n");
     attr->null_sender = vstring_strcpy(vstring_alloc(1), MAIL_ADDR_MAIL_DAEMON);
     attr->size_limit = 0;
+    attr->coproc = 0;
 
     /*
      * Iterate over the command-line attribute list.
@@ -980,6 +1040,19 @@ static void get_service_attr(PIPE_ATTR *attr, char **argv)
 		msg_fatal("%s: bad size= value: %s", myname, size);
 	}
 
+	/*
+	 * coprocess=yes|no
+	 */
+	else if (strncasecmp("coprocess=", *argv, sizeof("coprocess=") - 1) == 0) {
+	    cp = *argv + sizeof("coprocess=") - 1;
+	    if (strcasecmp(cp, CONFIG_BOOL_YES) == 0)
+		attr->coproc = 1;
+	    else if (strcasecmp(cp, CONFIG_BOOL_NO) == 0)
+		attr->coproc = 0;
+	    else
+		msg_fatal("%s: bad coprocess= value: %s", myname, cp);
+	}
+
 	/*
 	 * argv=command...
 	 */
@@ -1021,9 +1094,9 @@ static void get_service_attr(PIPE_ATTR *attr, char **argv)
      * Give the poor tester a clue of what is going on.
      */
     if (msg_verbose)
-	msg_info("%s: uid %ld, gid %ld, flags %d, size %ld",
+	msg_info("%s: uid %ld, gid %ld, flags %d, size %ld, coprocess %d",
 		 myname, (long) attr->uid, (long) attr->gid,
-		 attr->flags, (long) attr->size_limit);
+		 attr->flags, (long) attr->size_limit, attr->coproc);
 }
 
 /* eval_command_status - do something with command completion status */
@@ -1099,6 +1172,42 @@ static int eval_command_status(int command_status, char *service,
     return (result);
 }
 
+/* coproc_envelope - envelope attributes for coprocess */
+
+static ARGV *coproc_envelope(DELIVER_REQUEST *request, const char *sender)
+{
+    ARGV   *attr = argv_alloc(40);
+    VSTRING *size = vstring_alloc(10);
+    RECIPIENT *rcpt;
+    int     n;
+
+    vstring_sprintf(size, "%ld", (long) request->data_size);
+    argv_add(attr,
+	     PIPE_DICT_SENDER, sender,
+	     PIPE_DICT_NEXTHOP, request->nexthop,
+	     PIPE_DICT_SIZE, STR(size),
+	     PIPE_DICT_QUEUE_ID, request->queue_id,
+	     PIPE_DICT_CLIENT_ADDR, request->client_addr,
+	     PIPE_DICT_CLIENT_NAME, request->client_name,
+	     PIPE_DICT_CLIENT_PORT, request->client_port,
+	     PIPE_DICT_CLIENT_PROTO, request->client_proto,
+	     PIPE_DICT_CLIENT_HELO, request->client_helo,
+	     PIPE_DICT_SASL_METHOD, request->sasl_method,
+	     PIPE_DICT_SASL_USERNAME, request->sasl_username,
+	     PIPE_DICT_SASL_SENDER, request->sasl_sender,
+	     (char *) 0);
+    for (n = 0; n < request->rcpt_list.len; n++) {
+	rcpt = request->rcpt_list.info + n;
+	argv_add(attr,
+		 PIPE_DICT_ORIG_RCPT, rcpt->orig_addr,
+		 PIPE_DICT_RCPT, rcpt->address,
+		 (char *) 0);
+    }
+    argv_terminate(attr);
+    vstring_free(size);
+    return (attr);
+}
+
 /* deliver_message - deliver message with extreme prejudice */
 
 static int deliver_message(DELIVER_REQUEST *request, char *service, char **argv)
@@ -1110,6 +1219,7 @@ static int deliver_message(DELIVER_REQUEST *request, char *service, char **argv)
     DSN_BUF *why = dsb_create();
     VSTRING *buf;
     ARGV   *expanded_argv = 0;
+    ARGV   *coproc_attr = 0;
     int     deliver_status;
     int     command_status;
     ARGV   *export_env;
@@ -1118,6 +1228,7 @@ static int deliver_message(DELIVER_REQUEST *request, char *service, char **argv)
 #define DELIVER_MSG_CLEANUP() { \
 	dsb_free(why); \
 	if (expanded_argv) argv_free(expanded_argv); \
+	if (coproc_attr) argv_free(coproc_attr); \
     }
 
     if (msg_verbose)
@@ -1285,6 +1396,13 @@ static int deliver_message(DELIVER_REQUEST *request, char *service, char **argv)
     }
     export_env = mail_parm_split(VAR_EXPORT_ENVIRON, var_export_environ);
 
+    /*
+     * A coprocess receives the envelope with each message, instead of on
+     * the command line.
+     */
+    if (attr.coproc)
+	coproc_attr = coproc_envelope(request, sender);
+
     command_status = pipe_command(request->fp, why,
 				  CA_PIPE_CMD_UID(attr.uid),
 				  CA_PIPE_CMD_GID(attr.gid),
@@ -1298,6 +1416,9 @@ static int deliver_message(DELIVER_REQUEST *request, char *service, char **argv)
 				  CA_PIPE_CMD_CHROOT(attr.chroot_dir),
 			CA_PIPE_CMD_ORIG_RCPT(rcpt_list->info[0].orig_addr),
 			  CA_PIPE_CMD_DELIVERED(rcpt_list->info[0].address),
+		   CA_PIPE_CMD_COPROC_ATTR(coproc_attr ? coproc_attr->argv : 0),
+			 CA_PIPE_CMD_COPROC_MAX_USE(var_pipe_coproc_max_use),
+			     CA_PIPE_CMD_COPROC_MAX_IDLE(var_pipe_coproc_idle),
 				  CA_PIPE_CMD_END);
     argv_free(export_env);
 
@@ -1365,8 +1486,13 @@ MAIL_VERSION_STAMP_DECLARE;
 
 int     main(int argc, char **argv)
 {
+    static const CONFIG_INT_TABLE int_table[] = {
+	VAR_PIPE_COPROC_MAX_USE, DEF_PIPE_COPROC_MAX_USE, &var_pipe_coproc_max_use, 1, 0,
+	0,
+    };
     static const CONFIG_TIME_TABLE time_table[] = {
 	VAR_COMMAND_MAXTIME, DEF_COMMAND_MAXTIME, &var_command_maxtime, 1, 0,
+	VAR_PIPE_COPROC_IDLE, DEF_PIPE_COPROC_IDLE, &var_pipe_coproc_idle, 0, 0,
 	0,
     };
     static const CONFIG_STR_TABLE str_table[] = {
@@ -1380,6 +1506,7 @@ int     main(int argc, char **argv)
     MAIL_VERSION_STAMP_ALLOCATE;
 
     single_server_main(argc, argv, pipe_service,
+		       CA_MAIL_SERVER_INT_TABLE(int_table),
 		       CA_MAIL_SERVER_TIME_TABLE(time_table),
 		       CA_MAIL_SERVER_STR_TABLE(str_table),
 		       CA_MAIL_SERVER_PRE_INIT(pre_init),
@@ -6,7 +6,7 @@
 /* SYNOPSIS
 /* .fi
 /*	\fBpostalias\fR [\fB-Nfinoprsuvw\fR] [\fB-c \fIconfig_dir\fR]
-/*	[\fB-d \fIkey\fR] [\fB-q \fIkey\fR]
+/*	[\fB-d \fIkey\fR] [\fB-P \fIconcurrency\fR] [\fB-q \fIkey\fR]
 /*		[\fIfile_type\fR:]\fIfile_name\fR ...
 /* DESCRIPTION
 /*	The \fBpostalias\fR(1) command creates or queries one or more Postfix
@@ -74,6 +74,14 @@
 /*	Do not inherit the file access permissions from the input file
 /*	when creating a new file.  Instead, create a new file with default
 /*	access permissions (mode 0644).
+/* .IP "\fB-P \fIconcurrency\fR"
+/*	With "\fB-q -\fR", perform up to \fIconcurrency\fR queries
+/*	in parallel, each in its own process. The results are written
+/*	in the same order as the input keys, followed by a per-table
+/*	report of lookup counts and latency on the standard error
+/*	stream. See \fBpostmap\fR(1) for details.
+/* .sp
+/*	This feature is available in Postfix 3.5 and later.
 /* .IP "\fB-q \fIkey\fR"
 /*	Search the specified maps for \fIkey\fR and write the first value
 /*	found to the standard output stream. The exit status is zero
@@ -235,6 +243,7 @@
 
 #include <sys_defs.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -255,6 +264,8 @@
 #include <set_eugid.h>
 #include <warn_stat.h>
 #include <clean_env.h>
+#include <stats.h>
+#include <work_pool.h>
 
 /* Global library. */
 
@@ -278,6 +289,23 @@
 #define POSTALIAS_FLAG_SAVE_PERM	(1<<1)	/* copy access permission
 						 * from source */
 
+ /*
+  * Parallel queries with "-q -" and "-P concurrency", as with postmap(1).
+  */
+typedef struct {
+    DICT  **dicts;			/* map handles */
+    char  **maps;			/* map names */
+    int     map_count;			/* yes, indeed */
+    int     dict_flags;			/* query flags */
+    VSTRING *times;			/* per-map lookup times */
+} POSTALIAS_POOL_STATE;
+
+typedef struct {
+    STATS_CELL cells[STATS_HIST_CELLS];	/* latency histogram */
+    unsigned long found;		/* lookups with result */
+    unsigned long max;			/* worst latency */
+} POSTALIAS_LATENCY;
+
 /* postalias - create or update alias database */
 
 static void postalias(char *map_type, char *path_name, int postalias_flags,
@@ -550,6 +578,176 @@ static int postalias_queries(VSTREAM *in, char **maps, const int map_count,
     return (found);
 }
 
+/* postalias_pool_lookup - look up one key in a worker process */
+
+static void postalias_pool_lookup(VSTRING *key, VSTRING *reply, void *context)
+{
+    POSTALIAS_POOL_STATE *state = (POSTALIAS_POOL_STATE *) context;
+    DICT  **dicts = state->dicts;
+    struct timeval start;
+    struct timeval done;
+    const char *map_name;
+    const char *value = 0;
+    int     n;
+
+    VSTRING_RESET(state->times);
+    for (n = 0; n < state->map_count; n++) {
+	if (dicts[n] == 0)
+	    dicts[n] = ((map_name = split_at(state->maps[n], ':')) != 0 ?
+			dict_open3(state->maps[n], map_name, O_RDONLY,
+				   state->dict_flags) :
+			dict_open3(var_db_type, state->maps[n], O_RDONLY,
+				   state->dict_flags));
+	GETTIMEOFDAY(&start);
+	value = dict_get(dicts[n], STR(key));
+	GETTIMEOFDAY(&done);
+	vstring_sprintf_append(state->times, " %ld",
+			       (long) (done.tv_sec - start.tv_sec) * 1000000
+			       + (done.tv_usec - start.tv_usec));
+	if (value != 0) {
+	    if (*value == 0) {
+		msg_warn("table %s:%s: key %s: empty string result is not allowed",
+			 dicts[n]->type, dicts[n]->name, STR(key));
+		msg_warn("table %s:%s should return NO RESULT in case of NOT FOUND",
+			 dicts[n]->type, dicts[n]->name);
+	    }
+	    break;
+	}
+	if (dicts[n]->error)
+	    msg_fatal("table %s:%s: query error: %m",
+		      dicts[n]->type, dicts[n]->name);
+    }
+    vstring_sprintf(reply, "%d%s\n%s\n%s", value != 0 ? n : -1,
+		    STR(state->times), STR(key), value != 0 ? value : "");
+}
+
+/* postalias_pool_result - print one worker reply, update statistics */
+
+static int postalias_pool_result(VSTRING *reply, POSTALIAS_LATENCY *latency,
+				         const int map_count)
+{
+    char   *cp = STR(reply);
+    char   *key;
+    char   *value;
+    unsigned long usec;
+    int     which;
+    int     n;
+
+    if ((key = strchr(cp, '\n')) == 0 || (value = strchr(key + 1, '\n')) == 0)
+	msg_panic("postalias_pool_result: malformed reply");
+    *key++ = 0;
+    *value++ = 0;
+    which = atoi(cp);
+    for (n = 0; n < map_count && (cp = strchr(cp, ' ')) != 0; n++) {
+	usec = strtoul(++cp, (char **) 0, 10);
+	stats_observe(latency[n].cells, usec);
+	if (usec > latency[n].max)
+	    latency[n].max = usec;
+    }
+    if (which < 0 || which >= map_count)
+	return (0);
+    latency[which].found += 1;
+    vstream_printf("%s:	%s\n", key, value);
+    return (1);
+}
+
+/* postalias_pool_report - log per-map latency statistics */
+
+static void postalias_pool_report(char **maps, POSTALIAS_LATENCY *latency,
+				          const int map_count)
+{
+    static const int percents[] = {50, 90, 99, 0};
+    VSTRING *buf = vstring_alloc(100);
+    const STATS_CELL *cells;
+    const int *pp;
+    int     bucket;
+    int     n;
+
+    for (n = 0; n < map_count; n++) {
+	cells = latency[n].cells;
+	if (STATS_HIST_COUNT(cells) == 0)
+	    continue;
+	vstring_sprintf(buf, "table %s: %lu lookups, %lu found, avg %luus",
+			maps[n], STATS_HIST_COUNT(cells), latency[n].found,
+			STATS_HIST_SUM(cells) / STATS_HIST_COUNT(cells));
+	for (pp = percents; *pp; pp++) {
+	    bucket = stats_quantile(cells, *pp);
+	    if (bucket < STATS_HIST_BUCKETS - 1)
+		vstring_sprintf_append(buf, ", p%d<=%luus", *pp, 1UL << bucket);
+	    else
+		vstring_sprintf_append(buf, ", p%d>%luus", *pp,
+				       1UL << (bucket - 1));
+	}
+	vstring_sprintf_append(buf, ", max %luus", latency[n].max);
+	msg_info("%s", STR(buf));
+    }
+    vstring_free(buf);
+}
+
+/* postalias_pool_queries - apply multiple requests from stdin in parallel */
+
+static int postalias_pool_queries(VSTREAM *in, char **maps,
+				          const int map_count,
+				          const int dict_flags,
+				          const int concurrency)
+{
+    POSTALIAS_POOL_STATE state;
+    POSTALIAS_LATENCY *latency;
+    WORK_POOL *pool;
+    VSTRING *keybuf = vstring_alloc(100);
+    VSTRING *reply = vstring_alloc(100);
+    int     found = 0;
+    int     n;
+
+    /*
+     * Sanity check.
+     */
+    if (map_count <= 0)
+	msg_panic("postalias_pool_queries: bad map count");
+
+    /*
+     * Prepare to open maps lazily in the worker processes.
+     */
+    state.dicts = (DICT **) mymalloc(sizeof(*state.dicts) * map_count);
+    for (n = 0; n < map_count; n++)
+	state.dicts[n] = 0;
+    state.maps = maps;
+    state.map_count = map_count;
+    state.dict_flags = dict_flags;
+    state.times = vstring_alloc(100);
+    latency = (POSTALIAS_LATENCY *) mymalloc(sizeof(*latency) * map_count);
+    memset((void *) latency, 0, sizeof(*latency) * map_count);
+
+    /*
+     * Keep all workers busy, and print results in the order of the input.
+     */
+    pool = work_pool_create(concurrency, postalias_pool_lookup,
+			    (void *) &state);
+    while (vstring_get_nonl(keybuf, in) != VSTREAM_EOF) {
+	if (work_pool_full(pool) && work_pool_reply(pool, reply))
+	    found |= postalias_pool_result(reply, latency, map_count);
+	work_pool_request(pool, STR(keybuf), LEN(keybuf));
+    }
+    while (work_pool_reply(pool, reply))
+	found |= postalias_pool_result(reply, latency, map_count);
+    work_pool_free(pool);
+
+    if (found)
+	vstream_fflush(VSTREAM_OUT);
+    postalias_pool_report(maps, latency, map_count);
+
+    /*
+     * Cleanup.
+     */
+    myfree((void *) state.dicts);
+    vstring_free(state.times);
+    myfree((void *) latency);
+    vstring_free(keybuf);
+    vstring_free(reply);
+
+    return (found);
+}
+
 /* postalias_query - query a map and print the result to stdout */
 
 static int postalias_query(const char *map_type, const char *map_name,
@@ -690,7 +888,7 @@ static void postalias_seq(const char *map_type, const char *map_name,
 
 static NORETURN usage(char *myname)
 {
-    msg_fatal("usage: %s [-Nfinoprsuvw] [-c config_dir] [-d key] [-q key] [map_type:]file...",
+    msg_fatal("usage: %s [-Nfinoprsuvw] [-c config_dir] [-d key] [-P concurrency] [-q key] [map_type:]file...",
 	      myname);
 }
 
@@ -711,6 +909,7 @@ int     main(int argc, char **argv)
     char   *delkey = 0;
     int     sequence = 0;
     int     found;
+    int     concurrency = 0;
     ARGV   *import_env;
 
     /*
@@ -757,7 +956,7 @@ int     main(int argc, char **argv)
     /*
      * Parse JCL.
      */
-    while ((ch = GETOPT(argc, argv, "Nc:d:finopq:rsuvw")) > 0) {
+    while ((ch = GETOPT(argc, argv, "Nc:d:finopP:q:rsuvw")) > 0) {
 	switch (ch) {
 	default:
 	    usage(argv[0]);
@@ -791,6 +990,10 @@ int     main(int argc, char **argv)
 	case 'p':
 	    postalias_flags &= ~POSTALIAS_FLAG_SAVE_PERM;
 	    break;
+	case 'P':
+	    if ((concurrency = atoi(optarg)) <= 0)
+		msg_fatal("bad concurrency: %s", optarg);
+	    break;
 	case 'q':
 	    if (sequence || query || delkey)
 		msg_fatal("specify only one of -s -q or -d");
@@ -825,6 +1028,8 @@ int     main(int argc, char **argv)
     /* Re-evaluate mail_task() after reading main.cf. */
     maillog_client_init(mail_task(argv[0]), MAILLOG_CLIENT_FLAG_NONE);
     mail_dict_init();
+    if (concurrency > 0 && (query == 0 || strcmp(query, "-") != 0))
+	msg_fatal("specify -P only with \"-q -\"");
 
     /*
      * Use the map type specified by the user, or fall back to a default
@@ -851,6 +1056,11 @@ int     main(int argc, char **argv)
     } else if (query) {				/* query map(s) */
 	if (optind + 1 > argc)
 	    usage(argv[0]);
+	if (strcmp(query, "-") == 0 && concurrency > 0)
+	    exit(postalias_pool_queries(VSTREAM_IN, argv + optind,
+					argc - optind,
+					dict_flags | DICT_FLAG_LOCK,
+					concurrency) == 0);
 	if (strcmp(query, "-") == 0)
 	    exit(postalias_queries(VSTREAM_IN, argv + optind, argc - optind,
 				   dict_flags | DICT_FLAG_LOCK) == 0);
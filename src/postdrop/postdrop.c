@@ -9,6 +9,12 @@
 /*	The \fBpostdrop\fR(1) command creates a file in the \fBmaildrop\fR
 /*	directory and copies its standard input to the file.
 /*
+/*	Optionally, the \fBpostdrop\fR(1) command instead passes its
+/*	standard input to the \fBpostdropd\fR(8) local submission
+/*	server, which pipes the message directly into the \fBcleanup\fR(8)
+/*	daemon. When that server is unavailable, the message is
+/*	written to the \fBmaildrop\fR directory as usual.
+/*
 /*	Options:
 /* .IP "\fB-c \fIconfig_dir\fR"
 /*	The \fBmain.cf\fR configuration file is in the named directory
@@ -82,10 +88,18 @@
 /* .IP "\fBauthorized_submit_users (static:anyone)\fR"
 /*	List of users who are authorized to submit mail with the \fBsendmail\fR(1)
 /*	command (and with the privileged \fBpostdrop\fR(1) helper command).
+/* .PP
+/*	Available in Postfix version 3.5 and later:
+/* .IP "\fBpostdrop_direct_submission (no)\fR"
+/*	Submit mail through the \fBpostdropd\fR(8) local submission
+/*	server instead of the \fBmaildrop\fR queue.
+/* .IP "\fBpostdropd_service_name (postdropd)\fR"
+/*	The name of the \fBpostdropd\fR(8) local submission service.
 /* FILES
 /*	/var/spool/postfix/maildrop, maildrop queue
 /* SEE ALSO
 /*	sendmail(1), compatibility interface
+/*	postdropd(8), local submission server
 /*	postconf(5), configuration parameters
 /*	postlogd(8), Postfix logging
 /*	syslogd(8), system logging
@@ -168,8 +182,20 @@
   */
 char   *var_submit_acl;
 
+ /*
+  * Local submission service.
+  */
+bool    var_postdrop_direct;
+char   *var_postdropd_service;
+
 static const CONFIG_STR_TABLE str_table[] = {
     VAR_SUBMIT_ACL, DEF_SUBMIT_ACL, &var_submit_acl, 0, 0,
+    VAR_POSTDROPD_SERVICE, DEF_POSTDROPD_SERVICE, &var_postdropd_service, 1, 0,
+    0,
+};
+
+static const CONFIG_BOOL_TABLE bool_table[] = {
+    VAR_POSTDROP_DIRECT, DEF_POSTDROP_DIRECT, &var_postdrop_direct,
     0,
 };
 
@@ -222,6 +248,85 @@ static void postdrop_cleanup(void)
 
 MAIL_VERSION_STAMP_DECLARE;
 
+/* postdrop_direct - submit through the local submission server */
+
+static int postdrop_direct(VSTREAM *server, uid_t uid)
+{
+    VSTRING *buf = vstring_alloc(100);
+    VSTRING *why;
+    int     rec_type;
+    int     status;
+
+    /*
+     * Request a queue ID. If the server does not play along, then nothing
+     * has been read from stdin yet, and the caller can still fall back to
+     * the maildrop queue.
+     */
+    vstream_control(server,
+		    CA_VSTREAM_CTL_PATH(var_postdropd_service),
+		    CA_VSTREAM_CTL_TIMEOUT(var_ipc_timeout),
+		    CA_VSTREAM_CTL_END);
+    if (attr_print(server, ATTR_FLAG_NONE,
+		   SEND_ATTR_STR(MAIL_ATTR_REQ, POSTDROPD_REQ_SUBMIT),
+		   ATTR_TYPE_END) != 0
+	|| vstream_fflush(server) != 0
+	|| attr_scan(server, ATTR_FLAG_STRICT,
+		     RECV_ATTR_STR(MAIL_ATTR_QUEUEID, buf),
+		     ATTR_TYPE_END) != 1) {
+	(void) vstream_fclose(server);
+	vstring_free(buf);
+	return (-1);
+    }
+    attr_print(VSTREAM_OUT, ATTR_FLAG_NONE,
+	       SEND_ATTR_STR(MAIL_ATTR_QUEUEID, vstring_str(buf)),
+	       ATTR_TYPE_END);
+    vstream_fflush(VSTREAM_OUT);
+
+    /*
+     * Copy stdin to the server. The server applies the same format checks
+     * as we do when writing to the maildrop queue, so we just look for the
+     * end of the message. If the input is incomplete, hang up; the server
+     * will discard the partial message. If the server goes away, slurp up
+     * the input before reporting the error, so that the client won't give
+     * up after detecting SIGPIPE.
+     */
+    vstream_control(VSTREAM_IN, CA_VSTREAM_CTL_PATH("stdin"), CA_VSTREAM_CTL_END);
+    do {
+	/* Don't allow PTR records. */
+	rec_type = rec_get_raw(VSTREAM_IN, buf, var_line_limit, REC_FLAG_NONE);
+	if (rec_type == REC_TYPE_EOF)		/* request cancelled */
+	    exit(0);
+	if (rec_type == REC_TYPE_ERROR)
+	    msg_fatal("uid=%ld: malformed input", (long) uid);
+	if (REC_PUT_BUF(server, rec_type, buf) < 0) {
+	    while ((rec_type = rec_get_raw(VSTREAM_IN, buf, var_line_limit,
+					   REC_FLAG_NONE)) != REC_TYPE_END
+		   && rec_type != REC_TYPE_EOF)
+		if (rec_type == REC_TYPE_ERROR)
+		    msg_fatal("uid=%ld: malformed input", (long) uid);
+	    break;
+	}
+    } while (rec_type != REC_TYPE_END);
+
+    /*
+     * Relay the completion status to the caller and terminate.
+     */
+    why = vstring_alloc(100);
+    if (vstream_fflush(server) != 0
+	|| attr_scan(server, ATTR_FLAG_MISSING,
+		     RECV_ATTR_INT(MAIL_ATTR_STATUS, &status),
+		     RECV_ATTR_STR(MAIL_ATTR_WHY, why),
+		     ATTR_TYPE_END) != 2)
+	msg_fatal("uid=%ld: lost connection with %s service",
+		  (long) uid, var_postdropd_service);
+    attr_print(VSTREAM_OUT, ATTR_FLAG_NONE,
+	       SEND_ATTR_INT(MAIL_ATTR_STATUS, status),
+	       SEND_ATTR_STR(MAIL_ATTR_WHY, vstring_str(why)),
+	       ATTR_TYPE_END);
+    vstream_fflush(VSTREAM_OUT);
+    exit(status);
+}
+
 /* main - the main program */
 
 int     main(int argc, char **argv)
@@ -249,6 +354,7 @@ int     main(int argc, char **argv)
     int     from_count = 0;
     int     rcpt_count = 0;
     int     validate_input = 1;
+    VSTREAM *server;
 
     /*
      * Fingerprint executables and core dumps.
@@ -314,6 +420,7 @@ int     main(int argc, char **argv)
     /* Re-evaluate mail_task() after reading main.cf. */
     maillog_client_init(mail_task("postdrop"), MAILLOG_CLIENT_FLAG_NONE);
     get_mail_conf_str_table(str_table);
+    get_mail_conf_bool_table(bool_table);
 
     /*
      * Mail submission access control. Should this be in the user-land gate,
@@ -367,6 +474,23 @@ int     main(int argc, char **argv)
 
     /* End of initializations. */
 
+    /*
+     * Bypass the maildrop queue if so configured. If the local submission
+     * server is unavailable, fall back to the maildrop queue. The server
+     * does its own access control, based on our real user ID.
+     * 
+     * Every local submission would report an unavailable server, so this is
+     * not logged as a warning. Mail is still delivered, and a persistent
+     * problem shows up as maildrop queue files and pickup(8) activity.
+     */
+    if (var_postdrop_direct) {
+	if ((server = mail_connect(MAIL_CLASS_PUBLIC, var_postdropd_service,
+				   BLOCKING)) == 0
+	    || postdrop_direct(server, uid) < 0)
+	    msg_info("%s service is unavailable -- using the %s queue",
+		     var_postdropd_service, MAIL_QUEUE_MAILDROP);
+    }
+
     /*
      * Don't trust the caller's time information.
      */
@@ -0,0 +1,511 @@
+/*++
+/* NAME
+/*	postdropd 8
+/* SUMMARY
+/*	Postfix local mail submission server
+/* SYNOPSIS
+/*	\fBpostdropd\fR [generic Postfix daemon options]
+/* DESCRIPTION
+/*	The \fBpostdropd\fR(8) server receives locally submitted mail
+/*	from the \fBpostdrop\fR(1) command, and pipes each message
+/*	through the \fBcleanup\fR(8) daemon directly into the
+/*	\fBincoming\fR queue. This avoids writing a \fBmaildrop\fR
+/*	queue file that the \fBpickup\fR(8) daemon would have to
+/*	read back later. The program expects to be run from the
+/*	\fBmaster\fR(8) process manager.
+/*
+/*	The server speaks the same record protocol that the
+/*	\fBsendmail\fR(1) command uses to talk to \fBpostdrop\fR(1),
+/*	preceded by a "submit" request for each message. A client
+/*	may send any number of messages over one connection, and
+/*	may send the next request before it has received the
+/*	reply for the previous message. For each message, the
+/*	server replies with the queue ID and, after the end-of-message
+/*	record, with the completion status.
+/*
+/*	The server applies the same input restrictions as
+/*	\fBpostdrop\fR(1) and adds the same information as the
+/*	\fBpickup\fR(8) daemon: arrival time, content filter, and a
+/*	Received: message header with the numerical user ID of the
+/*	submitting process.
+/* SECURITY
+/* .ad
+/* .fi
+/*	The \fBpostdropd\fR(8) server is moderately security-sensitive.
+/*	It receives data from local users, but only through the
+/*	set-gid \fBpostdrop\fR(1) command. The user ID of the client
+/*	is obtained from the kernel, and is checked against the
+/*	\fBauthorized_submit_users\fR access list. The server runs
+/*	at fixed low privilege; it must not be run chrooted, because
+/*	it needs to look up user names.
+/* DIAGNOSTICS
+/*	Problems and transactions are logged to \fBsyslogd\fR(8)
+/*	or \fBpostlogd\fR(8).
+/* BUGS
+/*	The server needs an operating system that reports the
+/*	credentials of a UNIX-domain socket peer (SO_PEERCRED or
+/*	getpeereid()). Elsewhere it refuses all connections, and
+/*	\fBpostdrop\fR(1) falls back to the \fBmaildrop\fR queue.
+/* CONFIGURATION PARAMETERS
+/* .ad
+/* .fi
+/*	Changes to \fBmain.cf\fR are picked up automatically, as
+/*	\fBpostdropd\fR(8) processes run for only a limited amount
+/*	of time. Use the command "\fBpostfix reload\fR" to speed up
+/*	a change.
+/*
+/*	The text below provides only a parameter summary. See
+/*	\fBpostconf\fR(5) for more details including examples.
+/* CONTENT INSPECTION CONTROLS
+/* .ad
+/* .fi
+/* .IP "\fBcontent_filter (empty)\fR"
+/*	After the message is queued, send the entire message to the
+/*	specified \fItransport:destination\fR.
+/* .IP "\fBreceive_override_options (empty)\fR"
+/*	Enable or disable recipient validation, built-in content
+/*	filtering, or address mapping.
+/* RESOURCE AND RATE CONTROLS
+/* .ad
+/* .fi
+/* .IP "\fBline_length_limit (2048)\fR"
+/*	Upon input, long lines are chopped up into pieces of at most
+/*	this length; upon delivery, long lines are reconstructed.
+/* .IP "\fBipc_timeout (3600s)\fR"
+/*	The time limit for sending or receiving information over an internal
+/*	communication channel.
+/* MISCELLANEOUS CONTROLS
+/* .ad
+/* .fi
+/* .IP "\fBauthorized_submit_users (static:anyone)\fR"
+/*	List of users who are authorized to submit mail with the \fBsendmail\fR(1)
+/*	command (and with the privileged \fBpostdrop\fR(1) helper command).
+/* .IP "\fBcleanup_service_name (cleanup)\fR"
+/*	The name of the \fBcleanup\fR(8) service.
+/* .IP "\fBconfig_directory (see 'postconf -d' output)\fR"
+/*	The default location of the Postfix main.cf and master.cf
+/*	configuration files.
+/* .IP "\fBdaemon_timeout (18000s)\fR"
+/*	How much time a Postfix daemon process may take to handle a
+/*	request before it is terminated by a built-in watchdog timer.
+/* .IP "\fBmax_idle (100s)\fR"
+/*	The maximum amount of time that an idle Postfix daemon process waits
+/*	for an incoming connection before terminating voluntarily.
+/* .IP "\fBmax_use (100)\fR"
+/*	The maximal number of incoming connections that a Postfix daemon
+/*	process will service before terminating voluntarily.
+/* .IP "\fBmyhostname (see 'postconf -d' output)\fR"
+/*	The internet hostname of this mail system.
+/* .IP "\fBprocess_id (read-only)\fR"
+/*	The process ID of a Postfix command or daemon process.
+/* .IP "\fBprocess_name (read-only)\fR"
+/*	The process name of a Postfix command or daemon process.
+/* .IP "\fBqueue_directory (see 'postconf -d' output)\fR"
+/*	The location of the Postfix top-level queue directory.
+/* .IP "\fBsyslog_facility (mail)\fR"
+/*	The syslog facility of Postfix logging.
+/* .IP "\fBsyslog_name (see 'postconf -d' output)\fR"
+/*	A prefix that is prepended to the process name in syslog
+/*	records, so that, for example, "smtpd" becomes "prefix/smtpd".
+/* SEE ALSO
+/*	postdrop(1), mail posting agent
+/*	pickup(8), local mail pickup
+/*	cleanup(8), message canonicalization
+/*	postconf(5), configuration parameters
+/*	master(5), generic daemon options
+/*	master(8), process manager
+/*	postlogd(8), Postfix logging
+/*	syslogd(8), system logging
+/* README FILES
+/* .ad
+/* .fi
+/*	Use "\fBpostconf readme_directory\fR" or
+/*	"\fBpostconf html_directory\fR" to locate this information.
+/* .na
+/* .nf
+/*	OVERVIEW, overview of Postfix programs and configuration
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* HISTORY
+/* .ad
+/* .fi
+/*	The postdropd service was introduced with Postfix version 3.5.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <string.h>
+#include <stdlib.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <vstring.h>
+#include <vstream.h>
+#include <stringops.h>
+#include <unix_peer_cred.h>
+#include <watchdog.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <mail_version.h>
+#include <mail_proto.h>
+#include <record.h>
+#include <rec_type.h>
+#include <rec_attr_map.h>
+#include <cleanup_user.h>
+#include <mail_date.h>
+#include <user_acl.h>
+#include <input_transp.h>
+#include <smtputf8.h>
+#include <lex_822.h>
+
+/* Single server skeleton. */
+
+#include <mail_server.h>
+
+/* Application-specific. */
+
+ /*
+  * Tunable parameters.
+  */
+char   *var_submit_acl;
+char   *var_filter_xport;
+char   *var_input_transp;
+
+ /*
+  * Per-message status that is not a cleanup(8) completion status: the
+  * client went away in the middle of a message, or sent garbage. Either way,
+  * the session is over.
+  */
+#define POSTDROPD_STAT_ABORT	(-1)
+
+static int postdropd_input_transp_mask;
+
+/* postdropd_attr - filter one attribute record */
+
+static void postdropd_attr(VSTREAM *cleanup, uid_t uid, char *buf)
+{
+    const char *error_text;
+    char   *attr_name;
+    char   *attr_value;
+
+    /*
+     * Limit the attribute types that users may specify. This is the same
+     * list as with postdrop(1).
+     */
+    if ((error_text = split_nameval(buf, &attr_name, &attr_value)) != 0) {
+	msg_warn("uid=%ld: ignoring malformed record: %s: %.200s",
+		 (long) uid, error_text, buf);
+	return;
+    }
+#define STREQ(x,y) (strcmp(x,y) == 0)
+
+    if ((STREQ(attr_name, MAIL_ATTR_ENCODING)
+	 && (STREQ(attr_value, MAIL_ATTR_ENC_7BIT)
+	     || STREQ(attr_value, MAIL_ATTR_ENC_8BIT)
+	     || STREQ(attr_value, MAIL_ATTR_ENC_NONE)))
+	|| STREQ(attr_name, MAIL_ATTR_DSN_ENVID)
+	|| STREQ(attr_name, MAIL_ATTR_DSN_NOTIFY)
+	|| rec_attr_map(attr_name)
+	|| (STREQ(attr_name, MAIL_ATTR_RWR_CONTEXT)
+	    && (STREQ(attr_value, MAIL_ATTR_RWR_LOCAL)
+		|| STREQ(attr_value, MAIL_ATTR_RWR_REMOTE)))
+	|| STREQ(attr_name, MAIL_ATTR_TRACE_FLAGS)) {	/* XXX */
+	rec_fprintf(cleanup, REC_TYPE_ATTR, "%s=%s", attr_name, attr_value);
+    } else {
+	msg_warn("uid=%ld: ignoring attribute record: %.200s=%.200s",
+		 (long) uid, attr_name, attr_value);
+    }
+}
+
+/* postdropd_copy - copy one message from client to cleanup server */
+
+static int postdropd_copy(VSTREAM *client, VSTREAM *cleanup, uid_t uid,
+			          const char *queue_id, VSTRING *buf)
+{
+    static char *segment_info[] = {
+	REC_TYPE_POST_ENVELOPE, REC_TYPE_POST_CONTENT, REC_TYPE_POST_EXTRACT, ""
+    };
+    char  **expected = segment_info;
+    struct timeval start;
+    int     rec_type;
+    int     from_count = 0;
+    int     rcpt_count = 0;
+    int     check_first = 0;
+    int     status = 0;
+
+    /*
+     * Don't trust the caller's time information. Add the content inspection
+     * transport. See also pickup(8).
+     */
+    GETTIMEOFDAY(&start);
+    rec_fprintf(cleanup, REC_TYPE_TIME, REC_TYPE_TIME_FORMAT,
+		REC_TYPE_TIME_ARG(start));
+    if (*var_filter_xport)
+	rec_fprintf(cleanup, REC_TYPE_FILT, "%s", var_filter_xport);
+
+    /*
+     * Copy the client input to the cleanup server. The format checks are
+     * those of postdrop(1); the additions are those of pickup(8). After a
+     * cleanup server write error, slurp up the rest of the message before
+     * responding to the client.
+     */
+    for (;;) {
+	/* Don't allow PTR records. */
+	rec_type = rec_get_raw(client, buf, var_line_limit, REC_FLAG_NONE);
+	if (rec_type == REC_TYPE_EOF)		/* request cancelled */
+	    return (POSTDROPD_STAT_ABORT);
+	if (rec_type == REC_TYPE_ERROR) {
+	    msg_warn("uid=%ld: malformed input", (long) uid);
+	    return (POSTDROPD_STAT_ABORT);
+	}
+	if (strchr(*expected, rec_type) == 0) {
+	    msg_warn("uid=%ld: unexpected record type: %d", (long) uid, rec_type);
+	    return (POSTDROPD_STAT_ABORT);
+	}
+	if (rec_type == **expected)
+	    expected++;
+	if (rec_type == REC_TYPE_END)
+	    break;
+	if (status != 0)
+	    continue;
+	if (rec_type == REC_TYPE_TIME)
+	    continue;
+	if (rec_type == REC_TYPE_FROM && from_count++ == 0)
+	    msg_info("%s: uid=%ld from=<%s>", queue_id, (long) uid,
+		     vstring_str(buf));
+	if (rec_type == REC_TYPE_RCPT)
+	    rcpt_count++;
+	if (rec_type == REC_TYPE_ATTR) {
+	    postdropd_attr(cleanup, uid, vstring_str(buf));
+	    continue;
+	}
+
+	/*
+	 * XXX Force an empty record when the message content begins with
+	 * whitespace, so that it won't be considered as being part of our own
+	 * Received: header. See also pickup(8).
+	 */
+	if (check_first
+	    && (rec_type == REC_TYPE_NORM || rec_type == REC_TYPE_CONT)) {
+	    check_first = 0;
+	    if (VSTRING_LEN(buf) > 0 && IS_SPACE_TAB(vstring_str(buf)[0]))
+		rec_put(cleanup, REC_TYPE_NORM, "", 0);
+	} else if (rec_type == REC_TYPE_XTRA) {
+	    check_first = 0;
+	}
+	if (REC_PUT_BUF(cleanup, rec_type, buf) < 0) {
+	    status = CLEANUP_STAT_WRITE;
+	    continue;
+	}
+
+	/*
+	 * Prepend a Received: header to the message contents. For tracing
+	 * purposes, include the client's user ID, without revealing the login
+	 * name.
+	 */
+	if (rec_type == REC_TYPE_MESG) {
+	    rec_fprintf(cleanup, REC_TYPE_NORM,
+			"Received: by %s (%s, from userid %ld)",
+			var_myhostname, var_mail_name, (long) uid);
+	    rec_fprintf(cleanup, REC_TYPE_NORM, "\tid %s; %s", queue_id,
+			mail_date(start.tv_sec));
+	    check_first = 1;
+	}
+    }
+
+    /*
+     * Require at least one sender and one recipient, like postdrop(1). If
+     * the cleanup server sees no end-of-message record, it discards the
+     * message.
+     */
+    if (status == 0 && (from_count == 0 || rcpt_count == 0))
+	status = CLEANUP_STAT_BAD;
+    else if (status == 0
+	     && (rec_fputs(cleanup, REC_TYPE_END, "") < 0
+		 || vstream_fflush(cleanup) != 0))
+	status = CLEANUP_STAT_WRITE;
+    return (status);
+}
+
+/* postdropd_message - receive one message */
+
+static int postdropd_message(VSTREAM *client, uid_t uid, VSTRING *buf,
+			             VSTRING *why)
+{
+    VSTREAM *cleanup;
+    VSTRING *queue_id = vstring_alloc(20);
+    int     cleanup_flags;
+    int     status;
+
+    /*
+     * Contact the cleanup service and read the queue ID that it has
+     * allocated. Unlike pickup(8), we don't ask the cleanup server to bounce
+     * bad mail: there is a client that waits for the completion status.
+     */
+    cleanup_flags = input_transp_cleanup(CLEANUP_FLAG_MASK_EXTERNAL,
+					 postdropd_input_transp_mask)
+	| smtputf8_autodetect(MAIL_SRC_MASK_SENDMAIL);
+    cleanup = mail_connect_wait(MAIL_CLASS_PUBLIC, var_cleanup_service);
+    if (attr_scan(cleanup, ATTR_FLAG_STRICT,
+		  RECV_ATTR_STR(MAIL_ATTR_QUEUEID, queue_id),
+		  ATTR_TYPE_END) != 1
+	|| attr_print(cleanup, ATTR_FLAG_NONE,
+		      SEND_ATTR_INT(MAIL_ATTR_FLAGS, cleanup_flags),
+		      ATTR_TYPE_END) != 0) {
+	msg_warn("uid=%ld: %s service is not available",
+		 (long) uid, var_cleanup_service);
+	(void) vstream_fclose(cleanup);
+	vstring_free(queue_id);
+	return (POSTDROPD_STAT_ABORT);
+    }
+
+    /*
+     * Send the queue ID to the client, and copy the message.
+     */
+    attr_print(client, ATTR_FLAG_NONE,
+	       SEND_ATTR_STR(MAIL_ATTR_QUEUEID, vstring_str(queue_id)),
+	       ATTR_TYPE_END);
+    if (vstream_fflush(client) != 0) {
+	status = POSTDROPD_STAT_ABORT;
+    } else if ((status = postdropd_copy(client, cleanup, uid,
+					vstring_str(queue_id), buf)) == 0) {
+
+	/*
+	 * Collect the cleanup service completion status.
+	 */
+	if (attr_scan(cleanup, ATTR_FLAG_MISSING,
+		      RECV_ATTR_INT(MAIL_ATTR_STATUS, &status),
+		      RECV_ATTR_STR(MAIL_ATTR_WHY, why),
+		      ATTR_TYPE_END) != 2)
+	    status = CLEANUP_STAT_WRITE;
+    }
+    if (status != 0 && status != POSTDROPD_STAT_ABORT)
+	msg_info("%s: uid=%ld: %s", vstring_str(queue_id), (long) uid,
+		 VSTRING_LEN(why) > 0 ? vstring_str(why) :
+		 cleanup_strerror(status));
+    (void) vstream_fclose(cleanup);
+    vstring_free(queue_id);
+    return (status);
+}
+
+/* postdropd_service - service one client */
+
+static void postdropd_service(VSTREAM *client, char *unused_service,
+			              char **argv)
+{
+    VSTRING *request = vstring_alloc(10);
+    VSTRING *buf;
+    VSTRING *why;
+    const char *errstr;
+    uid_t   uid;
+    int     status;
+    int     count = 0;
+
+    /*
+     * Sanity check. This service takes no command-line arguments.
+     */
+    if (argv[0])
+	msg_fatal("unexpected command-line argument: %s", argv[0]);
+
+    /*
+     * Mail submission access control. Unlike postdrop(1), we get the user ID
+     * from the kernel instead of from the process credentials.
+     */
+    if (unix_peer_cred(vstream_fileno(client), &uid, (gid_t *) 0) < 0) {
+	msg_warn("cannot obtain client credentials: %m");
+	vstring_free(request);
+	return;
+    }
+    if ((errstr = check_user_acl_byuid(VAR_SUBMIT_ACL, var_submit_acl,
+				       uid)) != 0) {
+	msg_warn("User %s(%ld) is not allowed to submit mail",
+		 errstr, (long) uid);
+	vstring_free(request);
+	return;
+    }
+
+    /*
+     * Receive messages until the client hangs up. The client may pipeline
+     * requests; each reply is flushed as soon as it is complete.
+     */
+    vstream_control(client,
+		    CA_VSTREAM_CTL_PATH("client"),
+		    CA_VSTREAM_CTL_TIMEOUT(var_ipc_timeout),
+		    CA_VSTREAM_CTL_END);
+    buf = vstring_alloc(100);
+    why = vstring_alloc(100);
+    while (attr_scan(client, ATTR_FLAG_STRICT,
+		     RECV_ATTR_STR(MAIL_ATTR_REQ, request),
+		     ATTR_TYPE_END) == 1) {
+	if (strcmp(vstring_str(request), POSTDROPD_REQ_SUBMIT) != 0) {
+	    msg_warn("uid=%ld: unknown request: \"%.100s\"",
+		     (long) uid, vstring_str(request));
+	    break;
+	}
+	VSTRING_RESET(why);
+	VSTRING_TERMINATE(why);
+	if ((status = postdropd_message(client, uid, buf, why))
+	    == POSTDROPD_STAT_ABORT)
+	    break;
+	attr_print(client, ATTR_FLAG_NONE,
+		   SEND_ATTR_INT(MAIL_ATTR_STATUS, status),
+		   SEND_ATTR_STR(MAIL_ATTR_WHY, vstring_str(why)),
+		   ATTR_TYPE_END);
+	if (vstream_fflush(client) != 0)
+	    break;
+	count++;
+	watchdog_pat();
+    }
+    if (msg_verbose)
+	msg_info("uid=%ld: %d message(s)", (long) uid, count);
+    vstring_free(request);
+    vstring_free(buf);
+    vstring_free(why);
+}
+
+/* post_jail_init - post-jail initialization */
+
+static void post_jail_init(char *unused_name, char **unused_argv)
+{
+    postdropd_input_transp_mask =
+	input_transp_mask(VAR_INPUT_TRANSP, var_input_transp);
+}
+
+MAIL_VERSION_STAMP_DECLARE;
+
+/* main - the main program */
+
+int     main(int argc, char **argv)
+{
+    static const CONFIG_STR_TABLE str_table[] = {
+	VAR_SUBMIT_ACL, DEF_SUBMIT_ACL, &var_submit_acl, 0, 0,
+	VAR_FILTER_XPORT, DEF_FILTER_XPORT, &var_filter_xport, 0, 0,
+	VAR_INPUT_TRANSP, DEF_INPUT_TRANSP, &var_input_transp, 0, 0,
+	0,
+    };
+
+    /*
+     * Fingerprint executables and core dumps.
+     */
+    MAIL_VERSION_STAMP_ALLOCATE;
+
+    /*
+     * Pass control to the single-threaded service skeleton.
+     */
+    single_server_main(argc, argv, postdropd_service,
+		       CA_MAIL_SERVER_STR_TABLE(str_table),
+		       CA_MAIL_SERVER_POST_INIT(post_jail_init),
+		       0);
+}
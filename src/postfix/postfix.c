@@ -85,6 +85,12 @@
 /*	This will not rotate /dev/* files.
 /* .sp
 /*	This feature is available in Postfix 3.4 and later.
+/* .IP "\fBstats\fR"
+/*	Report the performance counters of Postfix daemon processes,
+/*	added up per \fBmaster.cf\fR service. See poststats(1) for
+/*	the output format.
+/* .sp
+/*	This feature is available in Postfix 3.5 and later.
 /* .IP "\fBtls\fR \fIsubcommand\fR"
 /*	Enable opportunistic TLS in the Postfix SMTP client or
 /*	server, and manage Postfix SMTP server TLS private keys and
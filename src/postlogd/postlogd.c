@@ -9,6 +9,34 @@
 /*	This program logs events on behalf of Postfix programs
 /*	when the maillog configuration parameter specifies a non-empty
 /*	value.
+/*
+/*	To reduce the number of write system calls, \fBpostlogd\fR(8)
+/*	accumulates records that arrive in quick succession, and
+/*	writes them to the logfile when no more records are waiting.
+/*
+/*	Optionally, \fBpostlogd\fR(8) also writes each record as
+/*	one line of JSON text to \fB$maillog_json_file\fR. Each
+/*	object has members "time" (the time of arrival, in RFC 3339
+/*	format), "host", "program", "pid", "level" (info, warning,
+/*	error, fatal, or panic), "queue_id" (if the message text starts
+/*	with a queue ID), "message" (the remainder of the message text),
+/*	and "fields". The last one is an object with the \fIname=value\fR
+/*	pairs in messages such as "to=<user@example.com>, relay=...,
+/*	status=sent (250 Ok)"; a trailing parenthesized comment becomes
+/*	the "detail" member.
+/*
+/*	When \fBmaillog_ring_size\fR is not zero, Postfix daemon
+/*	processes append records to a shared-memory ring per process
+/*	in the "logring" queue subdirectory, instead of sending one
+/*	datagram per record. \fBpostlogd\fR(8) drains those rings
+/*	once per second, and removes a ring after its process has
+/*	terminated. When a ring is full, the process drops informational
+/*	records, and \fBpostlogd\fR(8) logs how many were dropped;
+/*	other records are sent as datagrams. Before \fBpostlogd\fR(8)
+/*	logs a datagram, it drains the rings, so that the records
+/*	from one process are logged in order.
+/*	With this, \fBpostlogd\fR(8) does not terminate after
+/*	\fBmax_idle\fR seconds.
 /* BUGS
 /*	Non-daemon Postfix programs don't know that they should log
 /*	to the internal logging service before they have processed
@@ -56,6 +84,15 @@
 /* .IP "\fBpostlogd_watchdog_timeout (10s)\fR"
 /*	How much time a \fBpostlogd\fR(8) process may take to process a request
 /*	before it is terminated by a built-in watchdog timer.
+/* .PP
+/*	Available in Postfix 3.5 and later:
+/* .IP "\fBmaillog_json_file (empty)\fR"
+/*	The name of an optional file with newline-delimited JSON records
+/*	that is written by the Postfix \fBpostlogd\fR(8) service in
+/*	addition to \fB$maillog_file\fR.
+/* .IP "\fBmaillog_ring_size (0)\fR"
+/*	The size of the per-process shared-memory ring for logfile
+/*	records, or zero to send one datagram per record.
 /* SEE ALSO
 /*	postconf(5), configuration parameters
 /*	syslogd(8), system logging
@@ -90,11 +127,13 @@
  /*
   * Utility library.
   */
+#include <argv.h>
 #include <logwriter.h>
 #include <msg.h>
 #include <msg_logger.h>
 #include <stringops.h>
 #include <vstream.h>
+#include <vstring.h>
 
  /*
   * Global library.
@@ -109,10 +148,16 @@
   */
 #include <mail_server.h>
 
+ /*
+  * Application-specific.
+  */
+#include "postlogd.h"
+
  /*
   * Tunable parameters.
   */
 int     var_postlogd_watchdog;
+char   *var_maillog_json_file;
 
  /*
   * Silly little macros.
@@ -121,25 +166,58 @@ int     var_postlogd_watchdog;
 #define LEN(x)			VSTRING_LEN(x)
 
  /*
-  * Logfile stream.
+  * Logfile streams.
   */
 static VSTREAM *postlogd_stream = 0;
+static VSTREAM *postlogd_json_stream = 0;
+static VSTRING *postlogd_json_buf = 0;
+
+ /*
+  * Records are written to the logfile stream buffer, and the buffer is
+  * flushed before postlogd(8) waits for more input. The buffer is larger
+  * than the default, so that a burst of records results in fewer writes.
+  */
+#define POSTLOGD_BUFSIZE	(64 * 1024)
+
+/* postlogd_write - append one record to the logfiles, without flushing */
+
+static void postlogd_write(const char *buf, ssize_t len)
+{
+    if (vstream_fwrite(postlogd_stream, buf, len) == len)
+	VSTREAM_PUTC('\n', postlogd_stream);
+    if (postlogd_json_stream) {
+	postlogd_json(postlogd_json_buf, buf, len);
+	if (vstream_fwrite(postlogd_json_stream, STR(postlogd_json_buf),
+			   LEN(postlogd_json_buf)) == LEN(postlogd_json_buf))
+	    VSTREAM_PUTC('\n', postlogd_json_stream);
+    }
+}
+
+/* postlogd_flush - write pending records */
+
+static void postlogd_flush(void)
+{
+    if (postlogd_stream)
+	(void) vstream_fflush(postlogd_stream);
+    if (postlogd_json_stream)
+	(void) vstream_fflush(postlogd_json_stream);
+}
 
 /* postlogd_fallback - log messages from postlogd(8) itself */
 
 static void postlogd_fallback(const char *buf)
 {
-    (void) logwriter_write(postlogd_stream, buf, strlen(buf));
+    postlogd_write(buf, strlen(buf));
+    postlogd_flush();
 }
 
-/* postlogd_service - perform service for client */
+/* postlogd_record - log one record */
 
-static void postlogd_service(char *buf, ssize_t len, char *unused_service,
-			             char **unused_argv)
+static void postlogd_record(char *buf, ssize_t len)
 {
 
     if (postlogd_stream) {
-	(void) logwriter_write(postlogd_stream, buf, len);
+	postlogd_write(buf, len);
     }
 
     /*
@@ -179,6 +257,25 @@ static void postlogd_service(char *buf, ssize_t len, char *unused_service,
     }
 }
 
+/* postlogd_service - perform service for client */
+
+static void postlogd_service(char *buf, ssize_t len, char *unused_service,
+			             char **unused_argv)
+{
+
+    /*
+     * An empty datagram means that a client has created a shared-memory
+     * ring, or that its ring is not being drained. Before logging a
+     * datagram record, log the older records that are still in a ring.
+     */
+    if (len == 0) {
+	postlogd_ring_wakeup();
+    } else {
+	postlogd_ring_flush();
+	postlogd_record(buf, len);
+    }
+}
+
 /* pre_jail_init - pre-jail handling */
 
 static void pre_jail_init(char *unused_service_name, char **argv)
@@ -210,6 +307,34 @@ static void pre_jail_init(char *unused_service_name, char **argv)
 	 * Instantiate the logwriter or bust.
 	 */
 	postlogd_stream = logwriter_open_or_die(var_maillog_file);
+	vstream_control(postlogd_stream,
+			CA_VSTREAM_CTL_BUFSIZE(POSTLOGD_BUFSIZE),
+			CA_VSTREAM_CTL_END);
+
+	/*
+	 * The optional JSON file must satisfy the same pathname constraints
+	 * as the maillog_file.
+	 */
+	if (*var_maillog_json_file != 0) {
+	    ARGV   *good_prefixes = argv_split(var_maillog_file_pfxs,
+					       CHARS_COMMA_SP);
+	    char  **cpp;
+
+	    for (cpp = good_prefixes->argv; /* see below */ ; cpp++) {
+		if (*cpp == 0)
+		    msg_fatal("%s value '%s' does not match any prefix in %s",
+			      VAR_MAILLOG_JSON_FILE, var_maillog_json_file,
+			      VAR_MAILLOG_FILE_PFXS);
+		if (strncmp(var_maillog_json_file, *cpp, strlen(*cpp)) == 0)
+		    break;
+	    }
+	    argv_free(good_prefixes);
+	    postlogd_json_stream = logwriter_open_or_die(var_maillog_json_file);
+	    vstream_control(postlogd_json_stream,
+			    CA_VSTREAM_CTL_BUFSIZE(POSTLOGD_BUFSIZE),
+			    CA_VSTREAM_CTL_END);
+	    postlogd_json_buf = vstring_alloc(1000);
+	}
 
 	/*
 	 * Inform the msg_logger client to stop using the postlog socket, and
@@ -231,6 +356,30 @@ static void post_jail_init(char *unused_name, char **unused_argv)
      * requests. It is OK to terminate after a limited amount of idle time.
      */
     var_use_limit = 0;
+
+    /*
+     * Drain shared-memory rings, including rings that were left behind by
+     * processes that used an earlier configuration. Processes expect that
+     * their ring is drained, so don't terminate after idling.
+     */
+    postlogd_ring_init(postlogd_record);
+    if (var_maillog_ring_size > 0)
+	var_idle_limit = 0;
+}
+
+/* postlogd_loop - flush before waiting for input */
+
+static int postlogd_loop(char *unused_name, char **unused_argv)
+{
+    postlogd_flush();
+    return (-1);
+}
+
+/* postlogd_exit - flush before termination */
+
+static void postlogd_exit(char *unused_name, char **unused_argv)
+{
+    postlogd_flush();
 }
 
 MAIL_VERSION_STAMP_DECLARE;
@@ -243,6 +392,10 @@ int     main(int argc, char **argv)
 	VAR_POSTLOGD_WATCHDOG, DEF_POSTLOGD_WATCHDOG, &var_postlogd_watchdog, 10, 0,
 	0,
     };
+    static const CONFIG_STR_TABLE str_table[] = {
+	VAR_MAILLOG_JSON_FILE, DEF_MAILLOG_JSON_FILE, &var_maillog_json_file, 0, 0,
+	0,
+    };
 
     /*
      * Fingerprint executables and core dumps.
@@ -259,8 +412,11 @@ int     main(int argc, char **argv)
      */
     dgram_server_main(argc, argv, postlogd_service,
 		      CA_MAIL_SERVER_TIME_TABLE(time_table),
+		      CA_MAIL_SERVER_STR_TABLE(str_table),
 		      CA_MAIL_SERVER_PRE_INIT(pre_jail_init),
 		      CA_MAIL_SERVER_POST_INIT(post_jail_init),
+		      CA_MAIL_SERVER_LOOP(postlogd_loop),
+		      CA_MAIL_SERVER_EXIT(postlogd_exit),
 		      CA_MAIL_SERVER_SOLITARY,
 		      CA_MAIL_SERVER_WATCHDOG(&var_postlogd_watchdog),
 		      0);
@@ -0,0 +1,39 @@
+/*++
+/* NAME
+/*	postlogd 3h
+/* SUMMARY
+/*	postlogd internal interfaces
+/* SYNOPSIS
+/*	#include "postlogd.h"
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * Utility library.
+  */
+#include <vstring.h>
+
+ /*
+  * postlogd_json.c
+  */
+extern char *postlogd_json(VSTRING *, const char *, ssize_t);
+
+ /*
+  * postlogd_ring.c
+  */
+typedef void (*POSTLOGD_RING_FN) (char *, ssize_t);
+
+extern void postlogd_ring_init(POSTLOGD_RING_FN);
+extern void postlogd_ring_wakeup(void);
+extern void postlogd_ring_flush(void);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
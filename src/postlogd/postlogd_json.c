@@ -0,0 +1,322 @@
+/*++
+/* NAME
+/*	postlogd_json 3
+/* SUMMARY
+/*	convert logfile record to JSON
+/* SYNOPSIS
+/*	#include "postlogd.h"
+/*
+/*	char	*postlogd_json(result, buf, len)
+/*	VSTRING	*result;
+/*	const char *buf;
+/*	ssize_t	len;
+/* DESCRIPTION
+/*	postlogd_json() converts one logfile record in msg_logger(3)
+/*	format to one line of JSON text, without trailing newline.
+/*	The result value is the result buffer content.
+/*
+/*	The record is split into the following members:
+/* .IP time
+/*	The time of arrival in postlogd(8), in RFC 3339 format
+/*	with microsecond resolution. The record's own time stamp
+/*	lacks a year and time zone.
+/* .IP host
+/*	The host name label.
+/* .IP program
+/*	The program name, including the syslog_name prefix.
+/* .IP pid
+/*	The process ID.
+/* .IP level
+/*	One of "info", "warning", "error", "fatal", or "panic".
+/* .IP queue_id
+/*	The queue ID that the message text starts with, if any.
+/* .IP fields
+/*	When the message text (after the queue ID) has the form
+/*	"name=value, name=value, ...", an object with those names
+/*	and values. The last value may be followed by a parenthesized
+/*	comment, as with "status=sent (250 Ok)"; the comment becomes
+/*	the "detail" member. Parsing stops at the first element that
+/*	does not have the name=value form.
+/* .IP message
+/*	The message text, without queue ID.
+/* .PP
+/*	Records that don't have the expected format are converted
+/*	to an object with only the "time" and "message" members.
+/* SEE ALSO
+/*	msg_logger(3), logging to postlogd(8)
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+ /*
+  * System library.
+  */
+#include <sys_defs.h>
+#include <sys/time.h>
+#include <ctype.h>
+#include <string.h>
+#include <time.h>
+
+ /*
+  * Utility library.
+  */
+#include <msg.h>
+#include <stringops.h>
+#include <vstring.h>
+
+ /*
+  * Global library.
+  */
+#include <mail_queue.h>
+
+ /*
+  * Application-specific.
+  */
+#include "postlogd.h"
+
+#define STR(x)	vstring_str(x)
+#define LEN(x)	VSTRING_LEN(x)
+
+/* postlogd_json_quote - append quoted JSON string */
+
+static void postlogd_json_quote(VSTRING *result, const char *text, ssize_t len)
+{
+    const unsigned char *cp;
+    const unsigned char *end;
+    int     ch;
+
+    VSTRING_ADDCH(result, '"');
+    for (cp = (const unsigned char *) text, end = cp + len; cp < end; cp++) {
+	ch = *cp;
+	if (UNEXPECTED(ISCNTRL(ch))) {
+	    switch (ch) {
+	    case '\n':
+		vstring_strcat(result, "\\n");
+		break;
+	    case '\r':
+		vstring_strcat(result, "\\r");
+		break;
+	    case '\t':
+		vstring_strcat(result, "\\t");
+		break;
+	    default:
+		vstring_sprintf_append(result, "\\u%04X", ch);
+		break;
+	    }
+	} else {
+	    if (ch == '\\' || ch == '"')
+		VSTRING_ADDCH(result, '\\');
+	    VSTRING_ADDCH(result, ch);
+	}
+    }
+    VSTRING_ADDCH(result, '"');
+}
+
+/* postlogd_json_member - append "name":"value" */
+
+static void postlogd_json_member(VSTRING *result, const char *name,
+				         const char *value, ssize_t len)
+{
+    if (vstring_end(result)[-1] != '{')
+	VSTRING_ADDCH(result, ',');
+    postlogd_json_quote(result, name, strlen(name));
+    VSTRING_ADDCH(result, ':');
+    postlogd_json_quote(result, value, len);
+}
+
+/* postlogd_json_token - skip one space-terminated token */
+
+static const char *postlogd_json_token(const char **bufp, const char *end,
+				               ssize_t *lenp)
+{
+    const char *start = *bufp;
+    const char *cp;
+
+    for (cp = start; cp < end && *cp != ' '; cp++)
+	 /* void */ ;
+    if (cp == start || cp >= end)
+	return (0);
+    *lenp = cp - start;
+    *bufp = cp + 1;
+    return (start);
+}
+
+/* postlogd_json_digits - all digits */
+
+static int postlogd_json_digits(const char *cp, const char *end)
+{
+    for ( /* void */ ; cp < end; cp++)
+	if (!ISDIGIT(*cp))
+	    return (0);
+    return (1);
+}
+
+/* postlogd_json_fields - convert name=value list */
+
+static void postlogd_json_fields(VSTRING *result, const char *cp,
+				         const char *end)
+{
+    const char *name;
+    const char *value;
+    const char *next;
+    const char *comment;
+    ssize_t name_len;
+    int     count = 0;
+    static VSTRING *name_buf;
+
+    if (name_buf == 0)
+	name_buf = vstring_alloc(20);
+
+    while (cp < end) {
+
+	/*
+	 * Require name=value. Names are what Postfix uses: letters, digits,
+	 * '-' and '_'.
+	 */
+	for (name = cp; cp < end && (ISALNUM(*cp) || *cp == '_' || *cp == '-'); cp++)
+	     /* void */ ;
+	if (cp == name || cp >= end || *cp != '=' || !ISALPHA(*name))
+	    break;
+	name_len = cp - name;
+	value = cp + 1;
+
+	/*
+	 * The value ends at ", " or at the end. A " (" starts a trailing
+	 * comment that extends to the end of the text; commas in a comment
+	 * are not separators.
+	 */
+	for (next = value, comment = 0; next < end; next++) {
+	    if (next[0] == ',' && next + 1 < end && next[1] == ' ')
+		break;
+	    if (next[0] == ' ' && next + 1 < end && next[1] == '(') {
+		comment = next + 1;
+		break;
+	    }
+	}
+	if (count++ == 0) {
+	    vstring_strcat(result, ",\"fields\":{");
+	}
+	vstring_strncpy(name_buf, name, name_len);
+	postlogd_json_member(result, STR(name_buf), value, next - value);
+	if (comment) {
+	    if (end[-1] == ')' && end - comment >= 2)
+		postlogd_json_member(result, "detail", comment + 1,
+				     end - comment - 2);
+	    else
+		postlogd_json_member(result, "detail", comment, end - comment);
+	    break;
+	}
+	cp = next + 2;
+    }
+    if (count > 0)
+	VSTRING_ADDCH(result, '}');
+}
+
+/* postlogd_json - convert one record */
+
+char   *postlogd_json(VSTRING *result, const char *buf, ssize_t len)
+{
+    static const char *levels[] = {
+	"warning", "error", "fatal", "panic", 0,
+    };
+    const char **lp;
+    const char *end = buf + len;
+    const char *cp = buf;
+    const char *host;
+    const char *prog;
+    const char *pid;
+    const char *text;
+    const char *qid;
+    ssize_t host_len;
+    ssize_t prog_len;
+    ssize_t tok_len;
+    ssize_t n;
+    struct timeval tv;
+    struct tm *lt;
+    char    stamp[100];
+    static VSTRING *qid_buf;
+
+    if (qid_buf == 0)
+	qid_buf = vstring_alloc(20);
+
+    /*
+     * Arrival time stamp.
+     */
+    GETTIMEOFDAY(&tv);
+    lt = localtime(&tv.tv_sec);
+    if (strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", lt) == 0)
+	msg_panic("postlogd_json: strftime failed");
+    vstring_sprintf(result, "{\"time\":\"%s.%06ld", stamp, (long) tv.tv_usec);
+    if (strftime(stamp, sizeof(stamp), "%z", lt) == 5)
+	vstring_sprintf_append(result, "%.3s:%s", stamp, stamp + 3);
+    VSTRING_ADDCH(result, '"');
+
+    /*
+     * Skip "Mmm dd hh:mm:ss ", then "host program[pid]: ". Note that the
+     * day of month may be padded with a space.
+     */
+    if (postlogd_json_token(&cp, end, &tok_len) == 0
+	|| (*cp == ' ' && ++cp >= end)
+	|| postlogd_json_token(&cp, end, &tok_len) == 0
+	|| postlogd_json_token(&cp, end, &tok_len) == 0
+	|| (host = postlogd_json_token(&cp, end, &host_len)) == 0
+	|| (prog = postlogd_json_token(&cp, end, &prog_len)) == 0
+	|| prog_len < 5 || prog[prog_len - 1] != ':'
+	|| prog[prog_len - 2] != ']'
+	|| (pid = memchr(prog, '[', prog_len)) == 0
+	|| pid + 1 >= prog + prog_len - 2
+	|| !postlogd_json_digits(pid + 1, prog + prog_len - 2)) {
+	postlogd_json_member(result, "message", buf, len);
+	VSTRING_ADDCH(result, '}');
+	VSTRING_TERMINATE(result);
+	return (STR(result));
+    }
+    postlogd_json_member(result, "host", host, host_len);
+    postlogd_json_member(result, "program", prog, pid - prog);
+    vstring_sprintf_append(result, ",\"pid\":%.*s",
+			   (int) (prog + prog_len - 2 - pid - 1), pid + 1);
+    text = cp;
+
+    /*
+     * Severity level, as formatted by msg_logger(3).
+     */
+    for (lp = levels; *lp; lp++) {
+	n = strlen(*lp);
+	if (end - text > n + 1 && strncmp(text, *lp, n) == 0
+	    && text[n] == ':' && text[n + 1] == ' ') {
+	    text += n + 2;
+	    break;
+	}
+    }
+    postlogd_json_member(result, "level", *lp ? *lp : "info",
+			 *lp ? strlen(*lp) : 4);
+
+    /*
+     * Queue ID.
+     */
+    for (qid = cp = text; cp < end && ISALNUM(*cp); cp++)
+	 /* void */ ;
+    if (cp > qid && end - cp >= 2 && cp[0] == ':' && cp[1] == ' ') {
+	vstring_strncpy(qid_buf, qid, cp - qid);
+	if (mail_queue_id_ok(STR(qid_buf))) {
+	    postlogd_json_member(result, "queue_id", qid, cp - qid);
+	    text = cp + 2;
+	}
+    }
+
+    /*
+     * Structured content, and the message text itself.
+     */
+    postlogd_json_fields(result, text, end);
+    postlogd_json_member(result, "message", text, end - text);
+    VSTRING_ADDCH(result, '}');
+    VSTRING_TERMINATE(result);
+    return (STR(result));
+}
@@ -0,0 +1,270 @@
+/*++
+/* NAME
+/*	postlogd_ring 3
+/* SUMMARY
+/*	drain shared-memory logfile record rings
+/* SYNOPSIS
+/*	#include "postlogd.h"
+/*
+/*	void	postlogd_ring_init(handler)
+/*	void	(*handler)(char *buf, ssize_t len);
+/*
+/*	void	postlogd_ring_wakeup(void)
+/*
+/*	void	postlogd_ring_flush(void)
+/* DESCRIPTION
+/*	This module drains the shared-memory logfile record rings
+/*	that Postfix daemon processes create in the "logring" queue
+/*	subdirectory when maillog_ring_size is not zero.
+/*
+/*	postlogd_ring_init() arranges for all rings to be drained
+/*	once per second, and for the directory to be scanned for
+/*	new rings once per minute. Each record is passed to the
+/*	specified handler. When a process dropped records because
+/*	its ring was full, this module logs a warning with the
+/*	number of dropped records. When a process has terminated,
+/*	its ring is drained for the last time and removed.
+/*
+/*	postlogd_ring_wakeup() scans the directory for new rings
+/*	and drains all rings. This is called when a client sends
+/*	an empty datagram, as it does after creating a ring, and
+/*	when it finds that its ring is not drained.
+/*
+/*	postlogd_ring_flush() drains all open rings. This is called
+/*	before a record that arrives as a datagram is logged. A
+/*	process sends a record as a datagram when its ring is full,
+/*	or when the record was produced before the ring existed or
+/*	after it was disabled; draining the ring first ensures that
+/*	the records from one process are logged in the order that
+/*	they were produced. There is no ordering between records
+/*	from different processes.
+/*
+/*	A ring is accepted only when the process ID in the ring
+/*	file matches the file name. The process ID is not read
+/*	again after the ring is opened.
+/* DIAGNOSTICS
+/*	Problems are logged to the logfile.
+/* SEE ALSO
+/*	msg_ring(3), shared-memory logfile record ring
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+ /*
+  * System library.
+  */
+#include <sys_defs.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+ /*
+  * Utility library.
+  */
+#include <events.h>
+#include <htable.h>
+#include <msg.h>
+#include <msg_ring.h>
+#include <mymalloc.h>
+#include <scan_dir.h>
+#include <stringops.h>
+#include <vstring.h>
+
+ /*
+  * Global library.
+  */
+#include <mail_params.h>
+#include <mail_proto.h>
+
+ /*
+  * Application-specific.
+  */
+#include "postlogd.h"
+
+ /*
+  * One open ring. The device and inode number tell us when a ring file was
+  * replaced by a process with a recycled process ID.
+  */
+typedef struct {
+    MSG_RING *ring;			/* mapped ring */
+    char   *path;			/* ring file */
+    dev_t   dev;			/* ring file */
+    ino_t   ino;			/* ring file */
+} POSTLOGD_RING;
+
+static HTABLE *postlogd_rings;		/* open rings by file name */
+static POSTLOGD_RING_FN postlogd_ring_handler;
+static VSTRING *postlogd_ring_buf;
+static time_t postlogd_ring_scanned;	/* time of last directory scan */
+
+#define POSTLOGD_RING_DRAIN	1	/* drain interval */
+#define POSTLOGD_RING_RESCAN	60	/* directory scan interval */
+
+#define STR(x)	vstring_str(x)
+
+/* postlogd_ring_drain - drain one ring */
+
+static void postlogd_ring_drain(POSTLOGD_RING *rp, time_t now)
+{
+    ssize_t len;
+    unsigned long dropped;
+
+    while ((len = msg_ring_get(rp->ring, postlogd_ring_buf)) >= 0)
+	postlogd_ring_handler(STR(postlogd_ring_buf), len);
+    if ((dropped = msg_ring_dropped(rp->ring)) > 0)
+	msg_warn("process %ld dropped %lu logfile records because its ring"
+		 " was full; consider increasing %s",
+		 msg_ring_pid(rp->ring), dropped, VAR_MAILLOG_RING_SIZE);
+    msg_ring_drained(rp->ring, now);
+}
+
+/* postlogd_ring_free - destroy ring handle */
+
+static void postlogd_ring_free(void *ptr)
+{
+    POSTLOGD_RING *rp = (POSTLOGD_RING *) ptr;
+
+    msg_ring_free(rp->ring);
+    myfree(rp->path);
+    myfree((void *) rp);
+}
+
+/* postlogd_ring_close - drain and close ring, optionally remove file */
+
+static void postlogd_ring_close(const char *name, POSTLOGD_RING *rp,
+				        time_t now, int remove)
+{
+    struct stat st;
+
+    postlogd_ring_drain(rp, now);
+    if (remove && stat(rp->path, &st) == 0
+	&& st.st_dev == rp->dev && st.st_ino == rp->ino
+	&& unlink(rp->path) < 0 && errno != ENOENT)
+	msg_warn("remove %s: %m", rp->path);
+    htable_delete(postlogd_rings, name, postlogd_ring_free);
+}
+
+/* postlogd_ring_scan - look for new rings */
+
+static void postlogd_ring_scan(time_t now)
+{
+    SCAN_DIR *scan;
+    struct stat st;
+    POSTLOGD_RING *rp;
+    MSG_RING *ring;
+    char   *name;
+    char   *path;
+
+    postlogd_ring_scanned = now;
+    if (stat(MAIL_CLASS_LOGRING, &st) < 0)
+	return;
+    scan = scan_dir_open(MAIL_CLASS_LOGRING);
+    while ((name = scan_dir_next(scan)) != 0) {
+	if (!alldig(name))
+	    continue;
+	path = concatenate(MAIL_CLASS_LOGRING, "/", name, (char *) 0);
+	if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+	    myfree(path);
+	    continue;
+	}
+	if ((rp = (POSTLOGD_RING *) htable_find(postlogd_rings, name)) != 0) {
+	    if (st.st_dev == rp->dev && st.st_ino == rp->ino) {
+		myfree(path);
+		continue;
+	    }
+	    postlogd_ring_close(name, rp, now, 0);
+	}
+	if ((ring = msg_ring_open(path)) == 0) {
+	    /* Maybe the producer is still initializing it. */
+	    if (msg_verbose)
+		msg_info("open %s: %m", path);
+	    myfree(path);
+	    continue;
+	}
+	if (msg_ring_pid(ring) != atol(name)) {
+	    msg_warn("%s: ring file has process ID %ld; ignoring this file",
+		     path, msg_ring_pid(ring));
+	    msg_ring_free(ring);
+	    myfree(path);
+	    continue;
+	}
+	if (msg_verbose)
+	    msg_info("open %s for process %ld", path, msg_ring_pid(ring));
+	rp = (POSTLOGD_RING *) mymalloc(sizeof(*rp));
+	rp->ring = ring;
+	rp->path = path;
+	rp->dev = st.st_dev;
+	rp->ino = st.st_ino;
+	htable_enter(postlogd_rings, name, (void *) rp);
+    }
+    scan_dir_close(scan);
+}
+
+/* postlogd_ring_event - periodic drain */
+
+static void postlogd_ring_event(int unused_event, void *unused_context)
+{
+    HTABLE_INFO **list;
+    HTABLE_INFO **ht;
+    POSTLOGD_RING *rp;
+    time_t  now = time((time_t *) 0);
+
+    if (now - postlogd_ring_scanned >= POSTLOGD_RING_RESCAN)
+	postlogd_ring_scan(now);
+    list = htable_list(postlogd_rings);
+    for (ht = list; *ht; ht++) {
+	rp = (POSTLOGD_RING *) ht[0]->value;
+	if (kill((pid_t) msg_ring_pid(rp->ring), 0) < 0 && errno == ESRCH)
+	    postlogd_ring_close(ht[0]->key, rp, now, 1);
+	else
+	    postlogd_ring_drain(rp, now);
+    }
+    myfree((void *) list);
+    event_request_timer(postlogd_ring_event, (void *) 0, POSTLOGD_RING_DRAIN);
+}
+
+/* postlogd_ring_wakeup - scan for new rings and drain now */
+
+void    postlogd_ring_wakeup(void)
+{
+    postlogd_ring_scanned = 0;
+    postlogd_ring_event(0, (void *) 0);
+}
+
+/* postlogd_ring_flush - drain open rings before datagram */
+
+void    postlogd_ring_flush(void)
+{
+    HTABLE_INFO **list;
+    HTABLE_INFO **ht;
+    time_t  now;
+
+    if (postlogd_rings->used == 0)
+	return;
+    now = time((time_t *) 0);
+    list = htable_list(postlogd_rings);
+    for (ht = list; *ht; ht++)
+	postlogd_ring_drain((POSTLOGD_RING *) ht[0]->value, now);
+    myfree((void *) list);
+}
+
+/* postlogd_ring_init - initialize */
+
+void    postlogd_ring_init(POSTLOGD_RING_FN handler)
+{
+    postlogd_rings = htable_create(100);
+    postlogd_ring_handler = handler;
+    postlogd_ring_buf = vstring_alloc(2048);
+    postlogd_ring_wakeup();
+}
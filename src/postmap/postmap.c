@@ -5,8 +5,8 @@
 /*	Postfix lookup table management
 /* SYNOPSIS
 /* .fi
-/*	\fBpostmap\fR [\fB-bfFhimnNoprsuUvw\fR] [\fB-c \fIconfig_dir\fR]
-/*	[\fB-d \fIkey\fR] [\fB-q \fIkey\fR]
+/*	\fBpostmap\fR [\fB-bDfFhimnNoprsuUvw\fR] [\fB-c \fIconfig_dir\fR]
+/*	[\fB-d \fIkey\fR] [\fB-P \fIconcurrency\fR] [\fB-q \fIkey\fR]
 /*		[\fIfile_type\fR:]\fIfile_name\fR ...
 /* DESCRIPTION
 /*	The \fBpostmap\fR(1) command creates or queries one or more Postfix
@@ -93,6 +93,25 @@
 /*	If a key value of \fB-\fR is specified, the program reads key
 /*	values from the standard input stream. The exit status is zero
 /*	when at least one of the requested keys was found.
+/* .IP \fB-D\fR
+/*	Differential rebuild. Compare the source file against a
+/*	digest of the source file that built the current table,
+/*	and apply only the added, changed and deleted entries. The
+/*	digest is saved in \fIfile_name\fB.\fIfile_type\fB.digest\fR.
+/*	With \fBlmdb\fR tables, all changes are made in one
+/*	transaction that becomes visible when it is committed. With
+/*	other table types, changes are made under the same exclusive
+/*	lock as a full rebuild.
+/* .sp
+/*	\fBpostmap\fR(1) falls back to a full rebuild (and saves
+/*	a new digest) when there is no digest, when the digest was
+/*	made with different command-line options, when the table
+/*	is empty, or with \fBcdb\fR tables which cannot be updated
+/*	in place. Any other \fBpostmap\fR(1) update removes the
+/*	digest. With \fB-D\fR, \fBpostmap\fR(1) reports the number
+/*	of changes and the elapsed time.
+/* .sp
+/*	This feature is available in Postfix version 3.5 and later.
 /* .IP \fB-f\fR
 /*	Do not fold the lookup key to lower case while creating or querying
 /*	a table.
@@ -153,6 +172,19 @@
 /*	Do not inherit the file access permissions from the input file
 /*	when creating a new file.  Instead, create a new file with default
 /*	access permissions (mode 0644).
+/* .IP "\fB-P \fIconcurrency\fR"
+/*	With "\fB-q -\fR", perform up to \fIconcurrency\fR queries
+/*	in parallel, each in its own process. This speeds up bulk
+/*	queries of tables with a high lookup latency, such as
+/*	network-based tables. The results are written in the same
+/*	order as the input keys. At the end, the program reports the
+/*	number of lookups, the number of results, and the lookup
+/*	latency for each table to the standard error stream. Latency
+/*	percentiles are rounded up to a power of two microseconds.
+/*	This option cannot be combined with \fB-b\fR, \fB-h\fR
+/*	or \fB-m\fR.
+/* .sp
+/*	This feature is available in Postfix 3.5 and later.
 /* .IP "\fB-q \fIkey\fR"
 /*	Search the specified maps for \fIkey\fR and write the first value
 /*	found to the standard output stream. The exit status is zero
@@ -309,11 +341,13 @@
 
 #include <sys_defs.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <ctype.h>
 #include <string.h>
+#include <errno.h>
 
 /* Utility library. */
 
@@ -329,6 +363,13 @@
 #include <set_eugid.h>
 #include <warn_stat.h>
 #include <clean_env.h>
+#include <argv.h>
+#include <hash_fnv.h>
+#include <format_tv.h>
+#include <sane_fsops.h>
+#include <dict_cdb.h>
+#include <stats.h>
+#include <work_pool.h>
 
 /* Global library. */
 
@@ -354,6 +395,7 @@
 #define POSTMAP_FLAG_HEADER_KEY	(1<<2)	/* apply to header text */
 #define POSTMAP_FLAG_BODY_KEY	(1<<3)	/* apply to body text */
 #define POSTMAP_FLAG_MIME_KEY	(1<<4)	/* enable MIME parsing */
+#define POSTMAP_FLAG_DIFF	(1<<5)	/* incremental rebuild */
 
 #define POSTMAP_FLAG_HB_KEY (POSTMAP_FLAG_HEADER_KEY | POSTMAP_FLAG_BODY_KEY)
 #define POSTMAP_FLAG_FULL_KEY (POSTMAP_FLAG_BODY_KEY | POSTMAP_FLAG_MIME_KEY)
@@ -372,6 +414,555 @@ typedef struct {
     int     found;			/* result */
 } POSTMAP_KEY_STATE;
 
+ /*
+  * Incremental update support. The digest of a table has one entry for each
+  * key: a hash of the key after case folding, a hash of the value, and the
+  * key itself. Entries are sorted by key hash, so that the digest of the
+  * previous source file can be searched while the new source file is read.
+  * The digest is stored as text next to the source file.
+  */
+typedef struct {
+    HASH_FNV_T key_hash;		/* folded key hash */
+    HASH_FNV_T val_hash;		/* value hash */
+    ssize_t key_offs;			/* key text in digest->keys */
+    int     seq;			/* source entry or digest line */
+    int     flags;			/* see below */
+} POSTMAP_ENTRY;
+
+#define POSTMAP_ENTRY_FLAG_DROP	(1<<0)	/* duplicate key */
+#define POSTMAP_ENTRY_FLAG_SEEN	(1<<1)	/* old key still exists */
+
+typedef struct {
+    POSTMAP_ENTRY *entries;		/* key/value hashes */
+    ssize_t used;			/* entries in use */
+    ssize_t size;			/* entries allocated */
+    ssize_t distinct;			/* entries minus duplicates */
+    VSTRING *keys;			/* null-terminated key text */
+    VSTRING *fold_buf;			/* case folding */
+} POSTMAP_DIGEST;
+
+#define POSTMAP_DIGEST_SUFFIX	"digest"
+#define POSTMAP_DIGEST_VERSION	"1"
+
+ /*
+  * Flags that change what is stored in a table. A digest that was made with
+  * different flags is useless.
+  */
+#define POSTMAP_DIGEST_FLAGS	(DICT_FLAG_FOLD_FIX | DICT_FLAG_TRY0NULL \
+				| DICT_FLAG_TRY1NULL | DICT_FLAG_SRC_RHS_IS_FILE \
+				| DICT_FLAG_UTF8_REQUEST)
+
+
+ /*
+  * Parallel queries with "-q -" and "-P concurrency". Worker processes open
+  * the maps on the fly. The reply to a query has a line with the number of
+  * the map that produced a result (-1 if none) followed by the lookup time
+  * in microseconds for each map that was searched, a line with the key, and
+  * the value.
+  */
+typedef struct {
+    DICT  **dicts;			/* map handles */
+    char  **maps;			/* map names */
+    int     map_count;			/* yes, indeed */
+    int     dict_flags;			/* query flags */
+    VSTRING *times;			/* per-map lookup times */
+} POSTMAP_POOL_STATE;
+
+typedef struct {
+    STATS_CELL cells[STATS_HIST_CELLS];	/* latency histogram */
+    unsigned long found;		/* lookups with result */
+    unsigned long max;			/* worst latency */
+} POSTMAP_LATENCY;
+
+/* postmap_digest_path - digest pathname for table */
+
+static const char *postmap_digest_path(VSTRING *buf, const char *map_type,
+				               const char *path_name)
+{
+    vstring_sprintf(buf, "%s.%s.%s", path_name, map_type,
+		    POSTMAP_DIGEST_SUFFIX);
+    return (STR(buf));
+}
+
+/* postmap_digest_remove - invalidate digest after other table updates */
+
+static void postmap_digest_remove(const char *map_type, const char *path_name)
+{
+    VSTRING *buf = vstring_alloc(100);
+
+    if (strcmp(map_type, DICT_TYPE_PROXY) != 0
+	&& unlink(postmap_digest_path(buf, map_type, path_name)) < 0
+	&& errno != ENOENT)
+	msg_warn("remove %s: %m", STR(buf));
+    vstring_free(buf);
+}
+
+/* postmap_digest_create - create empty digest */
+
+static POSTMAP_DIGEST *postmap_digest_create(int with_keys)
+{
+    POSTMAP_DIGEST *digest = (POSTMAP_DIGEST *) mymalloc(sizeof(*digest));
+
+    digest->size = 1024;
+    digest->used = 0;
+    digest->distinct = 0;
+    digest->entries = (POSTMAP_ENTRY *)
+	mymalloc(sizeof(*digest->entries) * digest->size);
+    digest->keys = with_keys ? vstring_alloc(1024 * 16) : 0;
+    digest->fold_buf = vstring_alloc(100);
+    return (digest);
+}
+
+/* postmap_digest_free - destroy digest */
+
+static void postmap_digest_free(POSTMAP_DIGEST *digest)
+{
+    myfree((void *) digest->entries);
+    if (digest->keys)
+	vstring_free(digest->keys);
+    vstring_free(digest->fold_buf);
+    myfree((void *) digest);
+}
+
+/* postmap_digest_entry - append one entry */
+
+static POSTMAP_ENTRY *postmap_digest_entry(POSTMAP_DIGEST *digest)
+{
+    if (digest->used >= digest->size) {
+	digest->size *= 2;
+	digest->entries = (POSTMAP_ENTRY *)
+	    myrealloc((void *) digest->entries,
+		      sizeof(*digest->entries) * digest->size);
+    }
+    return (digest->entries + digest->used++);
+}
+
+/* postmap_digest_add - add source entry */
+
+static void postmap_digest_add(POSTMAP_DIGEST *digest, DICT *dict,
+			               const char *key, const char *value)
+{
+    POSTMAP_ENTRY *ep;
+
+    /*
+     * Hash the key as it will be stored, so that keys that differ only in
+     * case are recognized as duplicates.
+     */
+    if (dict->flags & DICT_FLAG_FOLD_FIX)
+	key = casefoldx((dict->flags & DICT_FLAG_UTF8_ACTIVE) ?
+			CASEF_FLAG_UTF8 : 0, digest->fold_buf, key, -1);
+    ep = postmap_digest_entry(digest);
+    ep->key_hash = hash_fnvz(key);
+    ep->val_hash = hash_fnvz(value);
+    ep->seq = digest->used - 1;
+    ep->flags = 0;
+    ep->key_offs = LEN(digest->keys);
+    vstring_strcat(digest->keys, key);
+    VSTRING_ADDCH(digest->keys, 0);
+}
+
+/* postmap_digest_cmp - sort by key hash, then by input order */
+
+static int postmap_digest_cmp(const void *a, const void *b)
+{
+    const POSTMAP_ENTRY *ea = (const POSTMAP_ENTRY *) a;
+    const POSTMAP_ENTRY *eb = (const POSTMAP_ENTRY *) b;
+
+    if (ea->key_hash != eb->key_hash)
+	return (ea->key_hash < eb->key_hash ? -1 : 1);
+    return (ea->seq - eb->seq);
+}
+
+/* postmap_digest_sort - sort and resolve duplicate keys */
+
+static int postmap_digest_sort(POSTMAP_DIGEST *digest, const char *path_name,
+			               int dict_flags)
+{
+    POSTMAP_ENTRY *ep;
+    POSTMAP_ENTRY *winner;
+    const char *key;
+
+    qsort((void *) digest->entries, digest->used, sizeof(*digest->entries),
+	  postmap_digest_cmp);
+    digest->distinct = 0;
+
+    /*
+     * Among entries with the same key, keep the first one, or the last one
+     * with "postmap -r", just like the database does. Give up when two
+     * different keys have the same hash.
+     */
+    for (winner = 0, ep = digest->entries; ep < digest->entries + digest->used; ep++) {
+	if (winner == 0 || winner->key_hash != ep->key_hash) {
+	    winner = ep;
+	    digest->distinct += 1;
+	    continue;
+	}
+	key = STR(digest->keys) + ep->key_offs;
+	if (strcmp(STR(digest->keys) + winner->key_offs, key) != 0) {
+	    msg_warn("%s: key hash collision for \"%s\"", path_name, key);
+	    return (-1);
+	}
+	if (dict_flags & DICT_FLAG_DUP_REPLACE) {
+	    winner->flags |= POSTMAP_ENTRY_FLAG_DROP;
+	    winner = ep;
+	} else {
+	    if ((dict_flags & DICT_FLAG_DUP_IGNORE) == 0
+		&& (dict_flags & DICT_FLAG_DUP_WARN) != 0)
+		msg_warn("%s: duplicate entry: \"%s\"", path_name, key);
+	    ep->flags |= POSTMAP_ENTRY_FLAG_DROP;
+	}
+    }
+    return (0);
+}
+
+/* postmap_digest_find - binary search by key hash */
+
+static POSTMAP_ENTRY *postmap_digest_find(POSTMAP_DIGEST *digest,
+					          HASH_FNV_T key_hash)
+{
+    ssize_t lo = 0;
+    ssize_t hi = digest->used - 1;
+    ssize_t mid;
+    POSTMAP_ENTRY *ep;
+
+    while (lo <= hi) {
+	mid = lo + (hi - lo) / 2;
+	ep = digest->entries + mid;
+	if (ep->key_hash == key_hash)
+	    return (ep);
+	if (ep->key_hash < key_hash)
+	    lo = mid + 1;
+	else
+	    hi = mid - 1;
+    }
+    return (0);
+}
+
+/* postmap_digest_header - digest file signature */
+
+static const char *postmap_digest_header(VSTRING *buf, const char *map_type,
+					         int dict_flags)
+{
+    vstring_sprintf(buf, "# postmap digest %s %s %x", POSTMAP_DIGEST_VERSION,
+		    map_type, dict_flags & POSTMAP_DIGEST_FLAGS);
+    return (STR(buf));
+}
+
+/* postmap_hash_print - hash value as fixed-width hex */
+
+static void postmap_hash_print(VSTREAM *fp, HASH_FNV_T hash)
+{
+    vstream_fprintf(fp, "%08lx%08lx", (unsigned long) (hash >> 32),
+		    (unsigned long) (hash & 0xffffffffUL));
+}
+
+/* postmap_hash_scan - parse fixed-width hex hash value */
+
+static char *postmap_hash_scan(char *cp, HASH_FNV_T *hash)
+{
+    int     n;
+    int     ch;
+
+    for (*hash = 0, n = 0; n < 16; n++, cp++) {
+	if ((ch = *cp) >= '0' && ch <= '9')
+	    ch -= '0';
+	else if (ch >= 'a' && ch <= 'f')
+	    ch -= 'a' - 10;
+	else
+	    return (0);
+	*hash = (*hash << 4) | ch;
+    }
+    return (*cp == ' ' ? cp + 1 : 0);
+}
+
+/* postmap_digest_load - read old digest, without key text */
+
+static POSTMAP_DIGEST *postmap_digest_load(const char *path,
+					           const char *header)
+{
+    VSTREAM *fp;
+    VSTRING *line = vstring_alloc(100);
+    POSTMAP_DIGEST *digest;
+    POSTMAP_ENTRY *ep;
+    char   *cp;
+
+    if ((fp = vstream_fopen(path, O_RDONLY, 0)) == 0) {
+	if (errno != ENOENT)
+	    msg_warn("open %s: %m", path);
+	vstring_free(line);
+	return (0);
+    }
+    if (vstring_get_nonl(line, fp) == VSTREAM_EOF
+	|| strcmp(STR(line), header) != 0) {
+	msg_info("%s: digest was made with different options", path);
+	vstream_fclose(fp);
+	vstring_free(line);
+	return (0);
+    }
+    digest = postmap_digest_create(0);
+    while (vstring_get_nonl(line, fp) != VSTREAM_EOF) {
+	ep = postmap_digest_entry(digest);
+	ep->seq = digest->used - 1;
+	ep->flags = 0;
+	ep->key_offs = -1;
+	if ((cp = postmap_hash_scan(STR(line), &ep->key_hash)) == 0
+	    || postmap_hash_scan(cp, &ep->val_hash) == 0
+	    || (ep > digest->entries && ep[-1].key_hash >= ep->key_hash)) {
+	    msg_warn("%s: bad digest entry %ld -- ignoring this file",
+		     path, (long) digest->used);
+	    postmap_digest_free(digest);
+	    digest = 0;
+	    break;
+	}
+    }
+    if (digest != 0)
+	digest->distinct = digest->used;
+    if (digest != 0 && vstream_ferror(fp)) {
+	msg_warn("read %s: %m", path);
+	postmap_digest_free(digest);
+	digest = 0;
+    }
+    vstream_fclose(fp);
+    vstring_free(line);
+    return (digest);
+}
+
+/* postmap_digest_deleted - look up old keys that were not seen */
+
+static ARGV *postmap_digest_deleted(const char *path, POSTMAP_DIGEST *digest)
+{
+    VSTREAM *fp;
+    VSTRING *line = vstring_alloc(100);
+    ARGV   *keys = argv_alloc(10);
+    POSTMAP_ENTRY *ep = digest->entries;
+    int     lineno;
+
+    /*
+     * The old digest is sorted, so its line numbers are also the entry
+     * indices.
+     */
+    if ((fp = vstream_fopen(path, O_RDONLY, 0)) == 0)
+	msg_fatal("open %s: %m", path);
+    if (vstring_get_nonl(line, fp) == VSTREAM_EOF)
+	msg_fatal("%s: premature end-of-file", path);
+    for (lineno = 0; ep < digest->entries + digest->used; lineno++) {
+	if (vstring_get_nonl(line, fp) == VSTREAM_EOF)
+	    msg_fatal("%s: premature end-of-file", path);
+	if ((ep->flags & POSTMAP_ENTRY_FLAG_SEEN) == 0
+	    && ep->seq == lineno && LEN(line) > 34)
+	    argv_add(keys, STR(line) + 34, (char *) 0);
+	ep++;
+    }
+    vstream_fclose(fp);
+    vstring_free(line);
+    return (keys);
+}
+
+/* postmap_digest_store - save digest of current table */
+
+static void postmap_digest_store(POSTMAP_DIGEST *digest, const char *path,
+				         const char *header, mode_t mode)
+{
+    VSTRING *temp = vstring_alloc(100);
+    VSTREAM *fp;
+    POSTMAP_ENTRY *ep;
+    const char *key;
+
+    /*
+     * Write a temporary file and rename it, so that an interrupted update
+     * never leaves a partial digest behind.
+     */
+    vstring_sprintf(temp, "%s.%ld", path, (long) getpid());
+    if ((fp = vstream_fopen(STR(temp), O_WRONLY | O_CREAT | O_TRUNC, mode)) == 0)
+	msg_fatal("open %s: %m", STR(temp));
+    vstream_fprintf(fp, "%s\n", header);
+    for (ep = digest->entries; ep < digest->entries + digest->used; ep++) {
+	if (ep->flags & POSTMAP_ENTRY_FLAG_DROP)
+	    continue;
+	key = STR(digest->keys) + ep->key_offs;
+	if (strchr(key, '\n') != 0) {
+	    msg_warn("%s: key contains newline -- not saving digest", path);
+	    vstream_fclose(fp);
+	    (void) unlink(STR(temp));
+	    vstring_free(temp);
+	    return;
+	}
+	postmap_hash_print(fp, ep->key_hash);
+	VSTREAM_PUTC(' ', fp);
+	postmap_hash_print(fp, ep->val_hash);
+	vstream_fprintf(fp, " %s\n", key);
+    }
+    if (vstream_fclose(fp) != 0)
+	msg_fatal("write %s: %m", STR(temp));
+    if (sane_rename(STR(temp), path) < 0)
+	msg_fatal("rename %s to %s: %m", STR(temp), path);
+    vstring_free(temp);
+}
+
+/* postmap_parse - parse one logical source line */
+
+static int postmap_parse(VSTRING *line_buffer, VSTREAM *source_fp,
+			         int lineno, DICT *dict, int report,
+			         char **key, char **value)
+{
+    int     in_quotes = 0;
+    char   *cp;
+
+    /*
+     * First some UTF-8 checks sans casefolding.
+     */
+    if ((dict->flags & DICT_FLAG_UTF8_ACTIVE)
+	&& !allascii(STR(line_buffer))
+	&& !valid_utf8_string(STR(line_buffer), LEN(line_buffer))) {
+	if (report)
+	    msg_warn("%s, line %d: non-UTF-8 input \"%s\""
+		     " -- ignoring this line",
+		     VSTREAM_PATH(source_fp), lineno, STR(line_buffer));
+	return (0);
+    }
+
+    /*
+     * Terminate the key on the first unquoted whitespace character, then
+     * trim leading and trailing whitespace from the value.
+     */
+    for (cp = STR(line_buffer); *cp; cp++) {
+	if (*cp == '\\') {
+	    if (*++cp == 0)
+		break;
+	} else if (ISSPACE(*cp)) {
+	    if (!in_quotes)
+		break;
+	} else if (*cp == '"') {
+	    in_quotes = !in_quotes;
+	}
+    }
+    if (in_quotes) {
+	if (report)
+	    msg_warn("%s, line %d: unbalanced '\"' in '%s'"
+		     " -- ignoring this line",
+		     VSTREAM_PATH(source_fp), lineno, STR(line_buffer));
+	return (0);
+    }
+    if (*cp)
+	*cp++ = 0;
+    while (ISSPACE(*cp))
+	cp++;
+    trimblanks(cp, 0)[0] = 0;
+    *value = cp;
+
+    /*
+     * Leave the key in quoted form, because 1) postmap cannot assume that a
+     * string without @ contains an email address localpart, and 2) an
+     * address localpart may require quoting even when the quoted form
+     * contains no backslash or ".
+     */
+    *key = STR(line_buffer);
+
+    /*
+     * Enforce the "key whitespace value" format. Disallow missing keys or
+     * missing values.
+     */
+    if (**key == 0 || **value == 0) {
+	if (report)
+	    msg_warn("%s, line %d: expected format: key whitespace value",
+		     VSTREAM_PATH(source_fp), lineno);
+	return (0);
+    }
+    if (report && (*key)[strlen(*key) - 1] == ':')
+	msg_warn("%s, line %d: record is in \"key: value\" format; is this an alias file?",
+		 VSTREAM_PATH(source_fp), lineno);
+
+    /*
+     * Optionally treat the vale as a filename, and replace the value with
+     * the BASE64-encoded content of the named file.
+     */
+    if (dict->flags & DICT_FLAG_SRC_RHS_IS_FILE) {
+	VSTRING *base64_buf;
+	char   *err;
+
+	if ((base64_buf = dict_file_to_b64(dict, *value)) == 0) {
+	    err = dict_file_get_error(dict);
+	    if (report)
+		msg_warn("%s, line %d: %s: skipping this entry",
+			 VSTREAM_PATH(source_fp), lineno, err);
+	    myfree(err);
+	    return (0);
+	}
+	*value = vstring_str(base64_buf);
+    }
+    return (1);
+}
+
+/* postmap_diff - compare source file against old digest */
+
+static POSTMAP_DIGEST *postmap_diff(VSTREAM *source_fp, DICT *dict,
+				            POSTMAP_DIGEST *old,
+				            ARGV *puts)
+{
+    VSTRING *line_buffer = vstring_alloc(100);
+    POSTMAP_DIGEST *new = postmap_digest_create(1);
+    POSTMAP_ENTRY *ep;
+    POSTMAP_ENTRY *op;
+    char   *want;
+    char   *key;
+    char   *value;
+    int     lineno;
+    int     last_line;
+    int     seq;
+
+    /*
+     * Pass 1: hash all source entries.
+     */
+    last_line = 0;
+    while (readllines(line_buffer, source_fp, &last_line, &lineno))
+	if (postmap_parse(line_buffer, source_fp, lineno, dict, 1, &key, &value))
+	    postmap_digest_add(new, dict, key, value);
+    if (vstream_ferror(source_fp))
+	msg_fatal("read %s: %m", VSTREAM_PATH(source_fp));
+    if (postmap_digest_sort(new, VSTREAM_PATH(source_fp), dict->flags) < 0) {
+	postmap_digest_free(new);
+	vstring_free(line_buffer);
+	return (0);
+    }
+
+    /*
+     * Find new and changed keys. Old keys that are not marked as seen must
+     * be deleted.
+     */
+    want = mymalloc(new->used + 1);
+    memset(want, 0, new->used + 1);
+    for (ep = new->entries; ep < new->entries + new->used; ep++) {
+	if (ep->flags & POSTMAP_ENTRY_FLAG_DROP)
+	    continue;
+	if ((op = postmap_digest_find(old, ep->key_hash)) != 0)
+	    op->flags |= POSTMAP_ENTRY_FLAG_SEEN;
+	if (op == 0 || op->val_hash != ep->val_hash)
+	    want[ep->seq] = 1;
+    }
+
+    /*
+     * Pass 2: collect the text of new and changed entries. The parser skips
+     * the same lines as in pass 1, so entry numbers are the same.
+     */
+    if (vstream_fseek(source_fp, 0, SEEK_SET) < 0)
+	msg_fatal("seek %s: %m", VSTREAM_PATH(source_fp));
+    last_line = 0;
+    seq = 0;
+    while (readllines(line_buffer, source_fp, &last_line, &lineno)) {
+	if (postmap_parse(line_buffer, source_fp, lineno, dict, 0,
+			  &key, &value) == 0)
+	    continue;
+	if (seq < new->used && want[seq])
+	    argv_add(puts, key, value, (char *) 0);
+	seq++;
+    }
+    if (seq != new->used)
+	msg_fatal("%s: file changed while reading", VSTREAM_PATH(source_fp));
+    myfree(want);
+    vstring_free(line_buffer);
+    return (new);
+}
+
 /* postmap - create or update mapping database */
 
 static void postmap(char *map_type, char *path_name, int postmap_flags,
@@ -386,10 +977,22 @@ static void postmap(char *map_type, char *path_name, int postmap_flags,
     char   *value;
     struct stat st;
     mode_t  saved_mask;
+    int     count = 0;
+    VSTRING *digest_path = 0;
+    VSTRING *digest_header = 0;
+    POSTMAP_DIGEST *old = 0;
+    POSTMAP_DIGEST *NOCLOBBER new = 0;
+    ARGV   *puts = 0;
+    ARGV   *dels = 0;
+    char  **cpp;
+    struct timeval start;
+    struct timeval done;
+    VSTRING *elapsed;
 
     /*
      * Initialize.
      */
+    GETTIMEOFDAY(&start);
     line_buffer = vstring_alloc(100);
     if ((open_flags & O_TRUNC) == 0) {
 	/* Incremental mode. */
@@ -421,12 +1024,57 @@ static void postmap(char *map_type, char *path_name, int postmap_flags,
 	&& (st.st_uid != geteuid() || st.st_gid != getegid()))
 	set_eugid(st.st_uid, st.st_gid);
 
+    /*
+     * With "postmap -D", look for the digest of the source file that built
+     * the current table. Without it, or with a table type that can't be
+     * updated in place, rebuild the table and save a new digest. Any other
+     * update makes the digest obsolete.
+     */
+    if (postmap_flags & POSTMAP_FLAG_DIFF) {
+	digest_path = vstring_alloc(100);
+	digest_header = vstring_alloc(100);
+	postmap_digest_path(digest_path, map_type, path_name);
+	postmap_digest_header(digest_header, map_type, dict_flags);
+	if (strcmp(map_type, DICT_TYPE_CDB) != 0)
+	    old = postmap_digest_load(STR(digest_path), STR(digest_header));
+	if (old != 0)
+	    open_flags &= ~O_TRUNC;
+    } else {
+	postmap_digest_remove(map_type, path_name);
+    }
+
     /*
      * Open the database, optionally create it when it does not exist,
      * optionally truncate it when it does exist, and lock out any
      * spectators.
      */
-    mkmap = mkmap_open(map_type, path_name, open_flags, dict_flags);
+    for (;;) {
+	mkmap = mkmap_open(map_type, path_name, open_flags, dict_flags);
+	if (old == 0)
+	    break;
+
+	/*
+	 * Compute the differences while holding the lock. Rebuild the table
+	 * if it is unexpectedly empty, or if the diff fails.
+	 */
+	if (old->used == 0
+	    || dict_seq(mkmap->dict, DICT_SEQ_FUN_FIRST, (const char **) &key,
+			(const char **) &value) == 0) {
+	    puts = argv_alloc(10);
+	    if ((new = postmap_diff(source_fp, mkmap->dict, old, puts)) != 0)
+		break;
+	    argv_free(puts);
+	    puts = 0;
+	} else {
+	    msg_info("%s:%s: table is empty -- rebuilding", map_type, path_name);
+	}
+	mkmap_close(mkmap);
+	postmap_digest_free(old);
+	old = 0;
+	open_flags |= O_TRUNC;
+	if (vstream_fseek(source_fp, 0, SEEK_SET) < 0)
+	    msg_fatal("seek %s: %m", VSTREAM_PATH(source_fp));
+    }
 
     /*
      * And restore the umask, in case it matters.
@@ -434,15 +1082,54 @@ static void postmap(char *map_type, char *path_name, int postmap_flags,
     if ((postmap_flags & POSTMAP_FLAG_SAVE_PERM) && S_ISREG(st.st_mode))
 	umask(saved_mask);
 
+    /*
+     * Don't leave a digest that no longer matches the table, should we be
+     * interrupted. But first, find out what old keys must be deleted.
+     */
+    if (old != 0)
+	dels = postmap_digest_deleted(STR(digest_path), old);
+    if (digest_path && unlink(STR(digest_path)) < 0 && errno != ENOENT)
+	msg_fatal("remove %s: %m", STR(digest_path));
+
+    /*
+     * Apply an incremental update. Updates replace existing entries. With a
+     * bulk-mode transaction (LMDB), the update becomes visible only when the
+     * table is closed.
+     */
+    if (old != 0) {
+	mkmap->dict->flags &= ~(DICT_FLAG_DUP_WARN | DICT_FLAG_DUP_IGNORE);
+	mkmap->dict->flags |= DICT_FLAG_DUP_REPLACE;
+	if (dict_isjmp(mkmap->dict) != 0)
+	    (void) dict_setjmp(mkmap->dict);
+	for (cpp = puts->argv; cpp[0] && cpp[1]; cpp += 2) {
+	    mkmap_append(mkmap, cpp[0], cpp[1]);
+	    if (mkmap->dict->error)
+		msg_fatal("table %s:%s: write error: %m",
+			  mkmap->dict->type, mkmap->dict->name);
+	}
+	for (cpp = dels->argv; *cpp; cpp++) {
+	    (void) dict_del(mkmap->dict, *cpp);
+	    if (mkmap->dict->error)
+		msg_fatal("table %s:%s: delete error: %m",
+			  mkmap->dict->type, mkmap->dict->name);
+	}
+    }
+
     /*
      * Trap "exceptions" so that we can restart a bulk-mode update after a
      * recoverable error.
      */
-    for (;;) {
+    for (/* void */ ; old == 0; /* void */ ) {
 	if (dict_isjmp(mkmap->dict) != 0
 	    && dict_setjmp(mkmap->dict) != 0
 	    && vstream_fseek(source_fp, SEEK_SET, 0) < 0)
 	    msg_fatal("seek %s: %m", VSTREAM_PATH(source_fp));
+	if (digest_path && strcmp(map_type, DICT_TYPE_CDB) != 0) {
+	    if (new)
+		postmap_digest_free(new);
+	    new = postmap_digest_create(1);
+	}
+	count = 0;
 
 	/*
 	 * Add records to the database. XXX This duplicates the parser in
@@ -450,91 +1137,18 @@ static void postmap(char *map_type, char *path_name, int postmap_flags,
 	 */
 	last_line = 0;
 	while (readllines(line_buffer, source_fp, &last_line, &lineno)) {
-	    int     in_quotes = 0;
-
-	    /*
-	     * First some UTF-8 checks sans casefolding.
-	     */
-	    if ((mkmap->dict->flags & DICT_FLAG_UTF8_ACTIVE)
-		&& !allascii(STR(line_buffer))
-		&& !valid_utf8_string(STR(line_buffer), LEN(line_buffer))) {
-		msg_warn("%s, line %d: non-UTF-8 input \"%s\""
-			 " -- ignoring this line",
-			 VSTREAM_PATH(source_fp), lineno, STR(line_buffer));
-		continue;
-	    }
-
-	    /*
-	     * Terminate the key on the first unquoted whitespace character,
-	     * then trim leading and trailing whitespace from the value.
-	     */
-	    for (value = STR(line_buffer); *value; value++) {
-		if (*value == '\\') {
-		    if (*++value == 0)
-			break;
-		} else if (ISSPACE(*value)) {
-		    if (!in_quotes)
-			break;
-		} else if (*value == '"') {
-		    in_quotes = !in_quotes;
-		}
-	    }
-	    if (in_quotes) {
-		msg_warn("%s, line %d: unbalanced '\"' in '%s'"
-			 " -- ignoring this line",
-			 VSTREAM_PATH(source_fp), lineno, STR(line_buffer));
+	    if (postmap_parse(line_buffer, source_fp, lineno, mkmap->dict, 1,
+			      &key, &value) == 0)
 		continue;
-	    }
-	    if (*value)
-		*value++ = 0;
-	    while (ISSPACE(*value))
-		value++;
-	    trimblanks(value, 0)[0] = 0;
-
-	    /*
-	     * Leave the key in quoted form, because 1) postmap cannot assume
-	     * that a string without @ contains an email address localpart,
-	     * and 2) an address localpart may require quoting even when the
-	     * quoted form contains no backslash or ".
-	     */
-	    key = STR(line_buffer);
-
-	    /*
-	     * Enforce the "key whitespace value" format. Disallow missing
-	     * keys or missing values.
-	     */
-	    if (*key == 0 || *value == 0) {
-		msg_warn("%s, line %d: expected format: key whitespace value",
-			 VSTREAM_PATH(source_fp), lineno);
-		continue;
-	    }
-	    if (key[strlen(key) - 1] == ':')
-		msg_warn("%s, line %d: record is in \"key: value\" format; is this an alias file?",
-			 VSTREAM_PATH(source_fp), lineno);
-
-	    /*
-	     * Optionally treat the vale as a filename, and replace the value
-	     * with the BASE64-encoded content of the named file.
-	     */
-	    if (dict_flags & DICT_FLAG_SRC_RHS_IS_FILE) {
-		VSTRING *base64_buf;
-		char   *err;
-
-		if ((base64_buf = dict_file_to_b64(mkmap->dict, value)) == 0) {
-		    err = dict_file_get_error(mkmap->dict);
-		    msg_warn("%s, line %d: %s: skipping this entry",
-			     VSTREAM_PATH(source_fp), lineno, err);
-		    myfree(err);
-		    continue;
-		}
-		value = vstring_str(base64_buf);
-	    }
 
 	    /*
 	     * Store the value under a (possibly case-insensitive) key, as
 	     * specified with open_flags.
 	     */
+	    if (new)
+		postmap_digest_add(new, mkmap->dict, key, value);
 	    mkmap_append(mkmap, key, value);
+	    count++;
 	    if (mkmap->dict->error)
 		msg_fatal("table %s:%s: write error: %m",
 			  mkmap->dict->type, mkmap->dict->name);
@@ -547,9 +1161,53 @@ static void postmap(char *map_type, char *path_name, int postmap_flags,
      */
     mkmap_close(mkmap);
 
+    /*
+     * Save the digest of the source that the table now reflects, and report
+     * the work done.
+     */
+    if (digest_path) {
+	if (new && old == 0 && postmap_digest_sort(new, path_name,
+			       dict_flags & ~DICT_FLAG_DUP_WARN) < 0) {
+	    postmap_digest_free(new);
+	    new = 0;
+	}
+	/* The digest reveals as much as the source file. */
+	if (new)
+	    postmap_digest_store(new, STR(digest_path), STR(digest_header),
+				 (postmap_flags & POSTMAP_FLAG_SAVE_PERM)
+				 && S_ISREG(st.st_mode) ?
+				 st.st_mode & 0644 : 0644);
+	GETTIMEOFDAY(&done);
+	elapsed = vstring_alloc(20);
+	done.tv_sec -= start.tv_sec;
+	if ((done.tv_usec -= start.tv_usec) < 0) {
+	    done.tv_usec += 1000000;
+	    done.tv_sec -= 1;
+	}
+	format_tv(elapsed, done.tv_sec, done.tv_usec, 3, 3);
+	if (old != 0)
+	    msg_info("%s:%s: updated %ld of %ld entries, deleted %ld,"
+		     " in %ss", map_type, path_name, (long) puts->argc / 2,
+		     (long) new->distinct, (long) dels->argc, STR(elapsed));
+	else
+	    msg_info("%s:%s: rebuilt from %d entries in %ss", map_type,
+		     path_name, count, STR(elapsed));
+	vstring_free(elapsed);
+	vstring_free(digest_path);
+	vstring_free(digest_header);
+    }
+
     /*
      * Cleanup. We're about to terminate, but it is a good sanity check.
      */
+    if (old)
+	postmap_digest_free(old);
+    if (new)
+	postmap_digest_free(new);
+    if (puts)
+	argv_free(puts);
+    if (dels)
+	argv_free(dels);
     vstring_free(line_buffer);
     if (source_fp != VSTREAM_IN)
 	vstream_fclose(source_fp);
@@ -744,6 +1402,182 @@ static int postmap_queries(VSTREAM *in, char **maps, const int map_count,
     return (found);
 }
 
+/* postmap_pool_lookup - look up one key in a worker process */
+
+static void postmap_pool_lookup(VSTRING *key, VSTRING *reply, void *context)
+{
+    POSTMAP_POOL_STATE *state = (POSTMAP_POOL_STATE *) context;
+    DICT  **dicts = state->dicts;
+    struct timeval start;
+    struct timeval done;
+    const char *map_name;
+    const char *value = 0;
+    int     n;
+
+    VSTRING_RESET(state->times);
+    for (n = 0; n < state->map_count; n++) {
+	if (dicts[n] == 0)
+	    dicts[n] = ((map_name = split_at(state->maps[n], ':')) != 0 ?
+			dict_open3(state->maps[n], map_name, O_RDONLY,
+				   state->dict_flags) :
+			dict_open3(var_db_type, state->maps[n], O_RDONLY,
+				   state->dict_flags));
+	GETTIMEOFDAY(&start);
+	value = ((state->dict_flags & DICT_FLAG_SRC_RHS_IS_FILE) ?
+		 dict_file_lookup : dicts[n]->lookup) (dicts[n], STR(key));
+	GETTIMEOFDAY(&done);
+	vstring_sprintf_append(state->times, " %ld",
+			       (long) (done.tv_sec - start.tv_sec) * 1000000
+			       + (done.tv_usec - start.tv_usec));
+	if (value != 0) {
+	    if (*value == 0) {
+		msg_warn("table %s:%s: key %s: empty string result is not allowed",
+			 dicts[n]->type, dicts[n]->name, STR(key));
+		msg_warn("table %s:%s should return NO RESULT in case of NOT FOUND",
+			 dicts[n]->type, dicts[n]->name);
+	    }
+	    break;
+	}
+	switch (dicts[n]->error) {
+	case 0:
+	    break;
+	case DICT_ERR_CONFIG:
+	    msg_fatal("table %s:%s: query error",
+		      dicts[n]->type, dicts[n]->name);
+	default:
+	    msg_fatal("table %s:%s: query error: %m",
+		      dicts[n]->type, dicts[n]->name);
+	}
+    }
+    vstring_sprintf(reply, "%d%s\n%s\n%s", value != 0 ? n : -1,
+		    STR(state->times), STR(key), value != 0 ? value : "");
+}
+
+/* postmap_pool_result - print one worker reply, update statistics */
+
+static int postmap_pool_result(VSTRING *reply, POSTMAP_LATENCY *latency,
+			               const int map_count)
+{
+    char   *cp = STR(reply);
+    char   *key;
+    char   *value;
+    unsigned long usec;
+    int     which;
+    int     n;
+
+    if ((key = strchr(cp, '\n')) == 0 || (value = strchr(key + 1, '\n')) == 0)
+	msg_panic("postmap_pool_result: malformed reply");
+    *key++ = 0;
+    *value++ = 0;
+    which = atoi(cp);
+    for (n = 0; n < map_count && (cp = strchr(cp, ' ')) != 0; n++) {
+	usec = strtoul(++cp, (char **) 0, 10);
+	stats_observe(latency[n].cells, usec);
+	if (usec > latency[n].max)
+	    latency[n].max = usec;
+    }
+    if (which < 0 || which >= map_count)
+	return (0);
+    latency[which].found += 1;
+    vstream_printf("%s	%s\n", key, value);
+    return (1);
+}
+
+/* postmap_pool_report - log per-map latency statistics */
+
+static void postmap_pool_report(char **maps, POSTMAP_LATENCY *latency,
+				        const int map_count)
+{
+    static const int percents[] = {50, 90, 99, 0};
+    VSTRING *buf = vstring_alloc(100);
+    const STATS_CELL *cells;
+    const int *pp;
+    int     bucket;
+    int     n;
+
+    for (n = 0; n < map_count; n++) {
+	cells = latency[n].cells;
+	if (STATS_HIST_COUNT(cells) == 0)
+	    continue;
+	vstring_sprintf(buf, "table %s: %lu lookups, %lu found, avg %luus",
+			maps[n], STATS_HIST_COUNT(cells), latency[n].found,
+			STATS_HIST_SUM(cells) / STATS_HIST_COUNT(cells));
+	for (pp = percents; *pp; pp++) {
+	    bucket = stats_quantile(cells, *pp);
+	    if (bucket < STATS_HIST_BUCKETS - 1)
+		vstring_sprintf_append(buf, ", p%d<=%luus", *pp, 1UL << bucket);
+	    else
+		vstring_sprintf_append(buf, ", p%d>%luus", *pp,
+				       1UL << (bucket - 1));
+	}
+	vstring_sprintf_append(buf, ", max %luus", latency[n].max);
+	msg_info("%s", STR(buf));
+    }
+    vstring_free(buf);
+}
+
+/* postmap_pool_queries - apply multiple requests from stdin in parallel */
+
+static int postmap_pool_queries(VSTREAM *in, char **maps, const int map_count,
+				        const int dict_flags,
+				        const int concurrency)
+{
+    POSTMAP_POOL_STATE state;
+    POSTMAP_LATENCY *latency;
+    WORK_POOL *pool;
+    VSTRING *keybuf = vstring_alloc(100);
+    VSTRING *reply = vstring_alloc(100);
+    int     found = 0;
+    int     n;
+
+    /*
+     * Sanity check.
+     */
+    if (map_count <= 0)
+	msg_panic("postmap_pool_queries: bad map count");
+
+    /*
+     * Prepare to open maps lazily in the worker processes.
+     */
+    state.dicts = (DICT **) mymalloc(sizeof(*state.dicts) * map_count);
+    for (n = 0; n < map_count; n++)
+	state.dicts[n] = 0;
+    state.maps = maps;
+    state.map_count = map_count;
+    state.dict_flags = dict_flags;
+    state.times = vstring_alloc(100);
+    latency = (POSTMAP_LATENCY *) mymalloc(sizeof(*latency) * map_count);
+    memset((void *) latency, 0, sizeof(*latency) * map_count);
+
+    /*
+     * Keep all workers busy, and print results in the order of the input.
+     */
+    pool = work_pool_create(concurrency, postmap_pool_lookup, (void *) &state);
+    while (vstring_get_nonl(keybuf, in) != VSTREAM_EOF) {
+	if (work_pool_full(pool) && work_pool_reply(pool, reply))
+	    found |= postmap_pool_result(reply, latency, map_count);
+	work_pool_request(pool, STR(keybuf), LEN(keybuf));
+    }
+    while (work_pool_reply(pool, reply))
+	found |= postmap_pool_result(reply, latency, map_count);
+    work_pool_free(pool);
+
+    if (found)
+	vstream_fflush(VSTREAM_OUT);
+    postmap_pool_report(maps, latency, map_count);
+
+    /*
+     * Cleanup.
+     */
+    myfree((void *) state.dicts);
+    vstring_free(state.times);
+    myfree((void *) latency);
+    vstring_free(keybuf);
+    vstring_free(reply);
+
+    return (found);
+}
+
 /* postmap_query - query a map and print the result to stdout */
 
 static int postmap_query(const char *map_type, const char *map_name,
@@ -810,6 +1644,7 @@ static int postmap_deletes(VSTREAM *in, char **maps, const int map_count,
 	dicts[n] = (map_name != 0 ?
 		    dict_open3(maps[n], map_name, open_flags, dict_flags) :
 		  dict_open3(var_db_type, maps[n], open_flags, dict_flags));
+	postmap_digest_remove(dicts[n]->type, dicts[n]->name);
     }
 
     /*
@@ -850,6 +1685,7 @@ static int postmap_delete(const char *map_type, const char *map_name,
     else
 	open_flags = O_RDWR;
     dict = dict_open3(map_type, map_name, open_flags, dict_flags);
+    postmap_digest_remove(map_type, map_name);
     status = dict_del(dict, key);
     if (dict->error)
 	msg_fatal("table %s:%s: delete error: %m", dict->type, dict->name);
@@ -908,7 +1744,7 @@ static void postmap_seq(const char *map_type, const char *map_name,
 
 static NORETURN usage(char *myname)
 {
-    msg_fatal("usage: %s [-bfFhimnNoprsuUvw] [-c config_dir] [-d key] [-q key] [map_type:]file...",
+    msg_fatal("usage: %s [-bDfFhimnNoprsuUvw] [-c config_dir] [-d key] [-P concurrency] [-q key] [map_type:]file...",
 	      myname);
 }
 
@@ -930,6 +1766,7 @@ int     main(int argc, char **argv)
     int     sequence = 0;
     int     found;
     int     force_utf8 = 0;
+    int     concurrency = 0;
     ARGV   *import_env;
 
     /*
@@ -976,7 +1813,7 @@ int     main(int argc, char **argv)
     /*
      * Parse JCL.
      */
-    while ((ch = GETOPT(argc, argv, "bc:d:fFhimnNopq:rsuUvw")) > 0) {
+    while ((ch = GETOPT(argc, argv, "bc:d:DfFhimnNopP:q:rsuUvw")) > 0) {
 	switch (ch) {
 	default:
 	    usage(argv[0]);
@@ -997,6 +1834,9 @@ int     main(int argc, char **argv)
 		msg_fatal("specify only one of -s -q or -d");
 	    delkey = optarg;
 	    break;
+	case 'D':
+	    postmap_flags |= POSTMAP_FLAG_DIFF;
+	    break;
 	case 'f':
 	    dict_flags &= ~DICT_FLAG_FOLD_FIX;
 	    break;
@@ -1022,6 +1862,10 @@ int     main(int argc, char **argv)
 	case 'p':
 	    postmap_flags &= ~POSTMAP_FLAG_SAVE_PERM;
 	    break;
+	case 'P':
+	    if ((concurrency = atoi(optarg)) <= 0)
+		msg_fatal("bad concurrency: %s", optarg);
+	    break;
 	case 'q':
 	    if (sequence || query || delkey)
 		msg_fatal("specify only one of -s -q or -d");
@@ -1066,6 +1910,13 @@ int     main(int argc, char **argv)
 	&& (postmap_flags & POSTMAP_FLAG_ANY_KEY)
 	== (postmap_flags & POSTMAP_FLAG_MIME_KEY))
 	msg_warn("ignoring -m option without -b or -h");
+    if ((postmap_flags & POSTMAP_FLAG_DIFF)
+	&& (query || delkey || sequence || (open_flags & O_TRUNC) == 0))
+	msg_fatal("specify -D only when building a table from a source file");
+    if (concurrency > 0
+	&& (query == 0 || strcmp(query, "-") != 0
+	    || (postmap_flags & POSTMAP_FLAG_ANY_KEY)))
+	msg_fatal("specify -P only with \"-q -\", and not with -b -h or -m");
     if ((postmap_flags & (POSTMAP_FLAG_ANY_KEY & ~POSTMAP_FLAG_MIME_KEY))
 	&& force_utf8 == 0)
 	dict_flags &= ~DICT_FLAG_UTF8_MASK;
@@ -1095,6 +1946,10 @@ int     main(int argc, char **argv)
     } else if (query) {				/* query map(s) */
 	if (optind + 1 > argc)
 	    usage(argv[0]);
+	if (strcmp(query, "-") == 0 && concurrency > 0)
+	    exit(postmap_pool_queries(VSTREAM_IN, argv + optind, argc - optind,
+				      dict_flags | DICT_FLAG_LOCK,
+				      concurrency) == 0);
 	if (strcmp(query, "-") == 0)
 	    exit(postmap_queries(VSTREAM_IN, argv + optind, argc - optind,
 			  postmap_flags, dict_flags | DICT_FLAG_LOCK) == 0);
@@ -0,0 +1,262 @@
+/*++
+/* NAME
+/*	postscache 1
+/* SUMMARY
+/*	Postfix delivery phase timing report
+/* SYNOPSIS
+/* .fi
+/*	\fBpostscache\fR [\fB-rv\fR] [\fB-c \fIconfig_dir\fR]
+/* DESCRIPTION
+/*	The \fBpostscache\fR(1) command reports per-destination
+/*	delivery phase timing statistics that Postfix SMTP and LMTP
+/*	clients send to the \fBscache\fR(8) server when
+/*	\fBsmtp_delivery_timing_statistics\fR or
+/*	\fBlmtp_delivery_timing_statistics\fR is enabled.
+/*
+/*	The output has one line per destination. The destination
+/*	is the transport name and the delivery request next-hop,
+/*	separated by ":". This is followed by the number of delivery
+/*	requests, and for each delivery phase, the average and
+/*	maximal time in milliseconds, as \fIphase\fB=\fIavg\fB/\fImax\fR.
+/*	The average is taken over the delivery requests that went
+/*	through that phase; a phase that did not happen (for example
+/*	connection setup with a reused connection) is shown as "-".
+/*
+/*	The phases are: \fBdns\fR (address lookup), \fBconn\fR
+/*	(TCP or UNIX-domain connection setup), \fBbanner\fR (waiting
+/*	for the server greeting), \fBtls\fR (STARTTLS and TLS
+/*	handshake), \fBhelo\fR (EHLO, HELO or LHLO), \fBenvelope\fR
+/*	(MAIL FROM and RCPT TO), and \fBdata\fR (message content
+/*	until the server's final reply).
+/*
+/*	This command must be run by the super-user or by the
+/*	mail_owner user.
+/*
+/*	Options:
+/* .IP "\fB-c\fR \fIconfig_dir\fR"
+/*	Read the \fBmain.cf\fR configuration file in the named directory
+/*	instead of the default configuration directory.
+/* .IP \fB-r\fR
+/*	Reset the statistics after reporting them.
+/* .IP \fB-v\fR
+/*	Enable verbose logging for debugging purposes. Multiple \fB-v\fR
+/*	options make the software increasingly verbose.
+/* DIAGNOSTICS
+/*	Problems are reported to the standard error stream. The
+/*	exit status is non-zero when the \fBscache\fR(8) server
+/*	could not be reached.
+/* BUGS
+/*	The statistics are kept in memory by the \fBscache\fR(8)
+/*	server, and are lost when that server terminates after
+/*	\fBmax_idle\fR seconds without clients.
+/* ENVIRONMENT
+/* .ad
+/* .fi
+/* .IP \fBMAIL_CONFIG\fR
+/*	Directory with Postfix configuration files.
+/* .IP \fBMAIL_VERBOSE\fR
+/*	Enable verbose logging for debugging purposes.
+/* CONFIGURATION PARAMETERS
+/* .ad
+/* .fi
+/*	The following \fBmain.cf\fR parameters are especially relevant to
+/*	this program.
+/*	The text below provides only a parameter summary. See
+/*	\fBpostconf\fR(5) for more details including examples.
+/* .IP "\fBconfig_directory (see 'postconf -d' output)\fR"
+/*	The default location of the Postfix main.cf and master.cf
+/*	configuration files.
+/* .IP "\fBconnection_cache_service_name (scache)\fR"
+/*	The name of the \fBscache\fR(8) connection cache service.
+/* .IP "\fBconnection_cache_protocol_timeout (5s)\fR"
+/*	Time limit for connection cache connect, send or receive
+/*	operations.
+/* .IP "\fBimport_environment (see 'postconf -d' output)\fR"
+/*	The list of environment parameters that a privileged Postfix
+/*	process will import from a non-Postfix parent process, or name=value
+/*	environment overrides.
+/* .IP "\fBqueue_directory (see 'postconf -d' output)\fR"
+/*	The location of the Postfix top-level queue directory.
+/* SEE ALSO
+/*	scache(8), connection cache server
+/*	smtp(8), SMTP client
+/*	postconf(5), configuration parameters
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* HISTORY
+/*	This command was introduced with Postfix version 3.5.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <vstream.h>
+#include <vstring.h>
+#include <msg_vstream.h>
+#include <safe.h>
+#include <warn_stat.h>
+#include <clean_env.h>
+
+/* Global library. */
+
+#include <mail_proto.h>
+#include <mail_params.h>
+#include <mail_version.h>
+#include <mail_conf.h>
+#include <mail_parm_split.h>
+#include <scache_times.h>
+
+ /*
+  * Tunable parameters.
+  */
+char   *var_scache_service;
+int     var_scache_proto_tmout;
+
+static NORETURN usage(char *myname)
+{
+    msg_fatal("usage: %s [-c config_dir] [-rv]", myname);
+}
+
+/* postscache_print - print one destination */
+
+static void postscache_print(const char *dest, const SCACHE_TIMES *times,
+			             void *context)
+{
+    VSTREAM *fp = (VSTREAM *) context;
+    const SCACHE_PHASE_STAT *sp;
+    int     n;
+
+    vstream_fprintf(fp, "%s deliveries=%ld", dest, times->deliveries);
+    for (n = 0; n < SCACHE_PHASE_COUNT; n++) {
+	sp = times->phase + n;
+	if (sp->count > 0)
+	    vstream_fprintf(fp, " %s=%.1f/%.1f", scache_phase_names[n],
+			    sp->total / sp->count / 1000.0,
+			    sp->max / 1000.0);
+	else
+	    vstream_fprintf(fp, " %s=-", scache_phase_names[n]);
+    }
+    VSTREAM_PUTC('\n', fp);
+}
+
+MAIL_VERSION_STAMP_DECLARE;
+
+int     main(int argc, char **argv)
+{
+    SCACHE_TIMES_CLNT *clnt;
+    int     flags = SCACHE_TIMES_FLAG_NONE;
+    int     fd;
+    struct stat st;
+    char   *slash;
+    int     c;
+    int     status;
+    ARGV   *import_env;
+    static const CONFIG_STR_TABLE str_table[] = {
+	VAR_SCACHE_SERVICE, DEF_SCACHE_SERVICE, &var_scache_service, 1, 0,
+	0,
+    };
+    static const CONFIG_TIME_TABLE time_table[] = {
+	VAR_SCACHE_PROTO_TMOUT, DEF_SCACHE_PROTO_TMOUT, &var_scache_proto_tmout, 1, 0,
+	0,
+    };
+
+    /*
+     * Fingerprint executables and core dumps.
+     */
+    MAIL_VERSION_STAMP_ALLOCATE;
+
+    /*
+     * To minimize confusion, make sure that the standard file descriptors
+     * are open before opening anything else. XXX Work around for 44BSD where
+     * fstat can return EBADF on an open file descriptor.
+     */
+    for (fd = 0; fd < 3; fd++)
+	if (fstat(fd, &st) == -1
+	    && (close(fd), open("/dev/null", O_RDWR, 0)) != fd)
+	    msg_fatal("open /dev/null: %m");
+
+    /*
+     * Process environment options as early as we can.
+     */
+    if (safe_getenv(CONF_ENV_VERB))
+	msg_verbose = 1;
+
+    /*
+     * Initialize. Set up logging. Read the global configuration file after
+     * parsing command-line arguments.
+     */
+    if ((slash = strrchr(argv[0], '/')) != 0 && slash[1])
+	argv[0] = slash + 1;
+    msg_vstream_init(argv[0], VSTREAM_ERR);
+    set_mail_conf_str(VAR_PROCNAME, var_procname = mystrdup(argv[0]));
+
+    /*
+     * Parse JCL.
+     */
+    while ((c = GETOPT(argc, argv, "c:rv")) > 0) {
+	switch (c) {
+	default:
+	    usage(argv[0]);
+	case 'c':
+	    if (setenv(CONF_ENV_PATH, optarg, 1) < 0)
+		msg_fatal("out of memory");
+	    break;
+	case 'r':
+	    flags |= SCACHE_TIMES_FLAG_RESET;
+	    break;
+	case 'v':
+	    msg_verbose++;
+	    break;
+	}
+    }
+    if (argc != optind)
+	usage(argv[0]);
+
+    /*
+     * Finish initializations.
+     */
+    mail_conf_read();
+    get_mail_conf_str_table(str_table);
+    get_mail_conf_time_table(time_table);
+    /* Enforce consistent operation of different Postfix parts. */
+    import_env = mail_parm_split(VAR_IMPORT_ENVIRON, var_import_environ);
+    update_env(import_env->argv);
+    argv_free(import_env);
+    if (chdir(var_queue_dir))
+	msg_fatal("chdir %s: %m", var_queue_dir);
+
+    /*
+     * Ask the connection cache server for its statistics.
+     */
+    clnt = scache_times_clnt_create(var_scache_service,
+				    var_scache_proto_tmout,
+				    var_ipc_idle_limit, var_ipc_ttl_limit);
+    status = scache_times_clnt_list(clnt, flags, postscache_print,
+				    (void *) VSTREAM_OUT);
+    scache_times_clnt_free(clnt);
+    if (vstream_fflush(VSTREAM_OUT))
+	msg_fatal("write error: %m");
+    if (status < 0) {
+	msg_warn("Cannot contact service %s - perhaps the mail system is down",
+		 var_scache_service);
+	exit(1);
+    }
+    exit(0);
+}
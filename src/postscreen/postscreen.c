@@ -295,6 +295,11 @@
 /* .IP "\fBpostscreen_pipelining_ttl (30d)\fR"
 /*	The amount of time that \fBpostscreen\fR(8) will use the result from
 /*	a successful "pipelining" SMTP protocol test.
+/* .PP
+/*	Available in Postfix 3.5 and later:
+/* .IP "\fBpostscreen_cache_cleanup_budget (10)\fR"
+/*	The amount of time in milliseconds that a \fBpostscreen\fR(8)
+/*	cache cleanup run may spend before it handles other events.
 /* RESOURCE CONTROLS
 /* .ad
 /* .fi
@@ -323,6 +328,18 @@
 /*	How much time a \fBpostscreen\fR(8) process may take to respond to
 /*	a remote SMTP client command or to perform a cache operation before it
 /*	is terminated by a built-in watchdog timer.
+/* .PP
+/*	Available in Postfix 3.5 and later:
+/* .IP "\fBpostscreen_shed_levels (60, 80, 95)\fR"
+/*	The \fBpostscreen\fR(8) load percentages at which it shortens
+/*	the greet wait for clients with a cache record, skips deep
+/*	protocol tests, and hangs up on clients with a DNSBL score.
+/* .IP "\fBpostscreen_shed_lag_limit (200)\fR"
+/*	The \fBpostscreen\fR(8) event loop lag in milliseconds that
+/*	counts as a load of 100 percent.
+/* .IP "\fBpostscreen_shed_greet_wait (1s)\fR"
+/*	The greet wait time for clients with a \fBpostscreen\fR(8)
+/*	cache record, while load shedding is in effect.
 /* STARTTLS CONTROLS
 /* .ad
 /* .fi
@@ -474,10 +491,14 @@ bool    var_psc_helo_required;
 
 char   *var_psc_cache_map;
 int     var_psc_cache_scan;
+int     var_psc_cache_budget;
 int     var_psc_cache_ret;
 int     var_psc_post_queue_limit;
 int     var_psc_pre_queue_limit;
 int     var_psc_watchdog;
+char   *var_psc_shed_levels;
+int     var_psc_shed_lag_limit;
+int     var_psc_shed_greet_wait;
 
 char   *var_psc_acl;
 char   *var_psc_blist_action;
@@ -543,6 +564,9 @@ int     psc_dnsbl_action;		/* PSC_ACT_DROP/ENFORCE/etc */
 int     psc_pipel_action;		/* PSC_ACT_DROP/ENFORCE/etc */
 int     psc_nsmtp_action;		/* PSC_ACT_DROP/ENFORCE/etc */
 int     psc_barlf_action;		/* PSC_ACT_DROP/ENFORCE/etc */
+STATS_CELL *psc_stats_forward;		/* sessions sent to real SMTPD */
+STATS_CELL *psc_stats_reject;		/* sessions not sent to real SMTPD */
+static STATS_CELL *psc_stats_connect;	/* all sessions */
 int     psc_min_ttl;			/* Update with new tests! */
 STRING_LIST *psc_forbid_cmds;		/* CONNECT GET POST */
 int     psc_stress_greet_wait;		/* stressed greet wait */
@@ -690,6 +714,7 @@ static void psc_endpt_lookup_done(int endpt_status,
     msg_info("CONNECT from [%s]:%s to [%s]:%s",
 	     smtp_client_addr->buf, smtp_client_port->buf,
 	     smtp_server_addr->buf, smtp_server_port->buf);
+    STATS_INC(psc_stats_connect);
 
     /*
      * Bundle up all the loose session pieces. This zeroes all flags and time
@@ -841,6 +866,8 @@ static void psc_endpt_lookup_done(int endpt_status,
      */
     if (state->flags & PSC_STATE_MASK_EARLY_TODO)
 	psc_early_tests(state);
+    else if (PSC_SHED_DEEP(state) && (state->flags & PSC_STATE_MASK_SMTPD_TODO))
+	psc_shed_deep_tests(state);
     else if (state->flags & (PSC_STATE_MASK_SMTPD_TODO | PSC_STATE_FLAG_NOFORWARD))
 	psc_smtpd_tests(state);
     else
@@ -1005,6 +1032,7 @@ static void post_jail_init(char *unused_name, char **unused_argv)
     psc_dnsbl_init();
     psc_early_init();
     psc_smtpd_init();
+    psc_shed_init();
 
     if ((psc_blist_action = name_code(actions, NAME_CODE_FLAG_NONE,
 				      var_psc_blist_action)) < 0)
@@ -1046,6 +1074,7 @@ static void post_jail_init(char *unused_name, char **unused_argv)
 	dict_cache_control(psc_cache_map,
 			   CA_DICT_CACHE_CTL_FLAGS(cache_flags),
 			   CA_DICT_CACHE_CTL_INTERVAL(var_psc_cache_scan),
+			   CA_DICT_CACHE_CTL_BUDGET(var_psc_cache_budget),
 			   CA_DICT_CACHE_CTL_VALIDATOR(psc_cache_validator),
 			   CA_DICT_CACHE_CTL_CONTEXT((void *) 0),
 			   CA_DICT_CACHE_CTL_END);
@@ -1091,6 +1120,13 @@ static void post_jail_init(char *unused_name, char **unused_argv)
      * Per-client concurrency.
      */
     psc_client_concurrency = htable_create(var_psc_pre_queue_limit);
+
+    /*
+     * Performance counters. See "postfix stats".
+     */
+    psc_stats_connect = stats_counter("postscreen_connections_total");
+    psc_stats_forward = stats_counter("postscreen_passed_total");
+    psc_stats_reject = stats_counter("postscreen_rejected_total");
 }
 
 MAIL_VERSION_STAMP_DECLARE;
@@ -1133,6 +1169,7 @@ int     main(int argc, char **argv)
 	VAR_PSC_WLIST_IF, DEF_PSC_WLIST_IF, &var_psc_wlist_if, 0, 0,
 	VAR_PSC_UPROXY_PROTO, DEF_PSC_UPROXY_PROTO, &var_psc_uproxy_proto, 0, 0,
 	VAR_PSC_REJ_FTR_MAPS, DEF_PSC_REJ_FTR_MAPS, &var_psc_rej_ftr_maps, 0, 0,
+	VAR_PSC_SHED_LEVELS, DEF_PSC_SHED_LEVELS, &var_psc_shed_levels, 0, 0,
 	0,
     };
     static const CONFIG_INT_TABLE int_table[] = {
@@ -1140,6 +1177,8 @@ int     main(int argc, char **argv)
 	VAR_PSC_DNSBL_WTHRESH, DEF_PSC_DNSBL_WTHRESH, &var_psc_dnsbl_wthresh, 0, 0,
 	VAR_PSC_CMD_COUNT, DEF_PSC_CMD_COUNT, &var_psc_cmd_count, 1, 0,
 	VAR_SMTPD_CCONN_LIMIT, DEF_SMTPD_CCONN_LIMIT, &var_smtpd_cconn_limit, 0, 0,
+	VAR_PSC_CACHE_BUDGET, DEF_PSC_CACHE_BUDGET, &var_psc_cache_budget, 0, 0,
+	VAR_PSC_SHED_LAG_LIMIT, DEF_PSC_SHED_LAG_LIMIT, &var_psc_shed_lag_limit, 0, 0,
 	0,
     };
     static const CONFIG_NINT_TABLE nint_table[] = {
@@ -1162,6 +1201,7 @@ int     main(int argc, char **argv)
 	VAR_PSC_WATCHDOG, DEF_PSC_WATCHDOG, &var_psc_watchdog, 10, 0,
 	VAR_PSC_UPROXY_TMOUT, DEF_PSC_UPROXY_TMOUT, &var_psc_uproxy_tmout, 1, 0,
 	VAR_PSC_DNSBL_TMOUT, DEF_PSC_DNSBL_TMOUT, &var_psc_dnsbl_tmout, 1, 0,
+	VAR_PSC_SHED_GREET_WAIT, DEF_PSC_SHED_GREET_WAIT, &var_psc_shed_greet_wait, 1, 0,
 
 	0,
     };
@@ -21,6 +21,8 @@
 #include <events.h>
 #include <htable.h>
 #include <myaddrinfo.h>
+#include <ring.h>
+#include <stats.h>
 
  /*
   * Global library.
@@ -97,6 +99,15 @@ typedef struct {
     int     ehlo_discard_mask;		/* EHLO filter */
     VSTRING *expand_buf;		/* macro expansion */
     const char *where;			/* SMTP protocol state */
+    /* Storage for the endpoint strings above. */
+    MAI_HOSTADDR_STR client_addr_buf;
+    MAI_SERVPORT_STR client_port_buf;
+    MAI_HOSTADDR_STR server_addr_buf;
+    MAI_SERVPORT_STR server_port_buf;
+    /* Per-session timer. */
+    RING    deadline_ring;		/* timer wheel or free list */
+    time_t  deadline;			/* expiration time */
+    EVENT_NOTIFY_TIME_FN deadline_fn;	/* expiration call-back */
 } PSC_STATE;
 
  /*
@@ -111,7 +122,7 @@ typedef struct {
   */
 #define PSC_STATE_FLAG_NOFORWARD	(1<<0)	/* don't forward this session */
 #define PSC_STATE_FLAG_USING_TLS	(1<<1)	/* using the TLS proxy */
-#define PSC_STATE_FLAG_UNUSED2		(1<<2)	/* use me! */
+#define PSC_STATE_FLAG_SHED_DROP	(1<<2)	/* drop due to load shedding */
 #define PSC_STATE_FLAG_NEW		(1<<3)	/* some test was never passed */
 #define PSC_STATE_FLAG_BLIST_FAIL	(1<<4)	/* blacklisted */
 #define PSC_STATE_FLAG_HANGUP		(1<<5)	/* NOT a test failure */
@@ -336,6 +347,17 @@ typedef struct {
 	event_request_timer((time_act), (context), (timeout)); \
     } while (0)
 
+/* PSC_READ_EVENT_DEADLINE - same, for the client stream, with session timer */
+
+#define PSC_READ_EVENT_DEADLINE(state, read_act, time_act, timeout) do { \
+	if (msg_verbose > 1) \
+	    msg_info("%s: read-request fd=%d", myname, \
+		     vstream_fileno((state)->smtp_client_stream)); \
+	event_enable_read(vstream_fileno((state)->smtp_client_stream), \
+			  (read_act), (void *) (state)); \
+	psc_deadline_request((state), (time_act), (timeout)); \
+    } while (0)
+
 /* PSC_CLEAR_EVENT_REQUEST - complete state transition */
 
 #define PSC_CLEAR_EVENT_REQUEST(fd, time_act, context) do { \
@@ -345,6 +367,14 @@ typedef struct {
 	event_cancel_timer((time_act), (context)); \
     } while (0)
 
+#define PSC_CLEAR_EVENT_DEADLINE(state, time_act) do { \
+	if (msg_verbose > 1) \
+	    msg_info("%s: clear-request fd=%d", myname, \
+		     vstream_fileno((state)->smtp_client_stream)); \
+	event_disable_readwrite(vstream_fileno((state)->smtp_client_stream)); \
+	psc_deadline_cancel((state), (time_act)); \
+    } while (0)
+
  /*
   * Failure enforcement policies.
   */
@@ -368,6 +398,8 @@ extern char *psc_smtpd_service_name;	/* path to real SMTPD */
 extern int psc_pregr_action;		/* PSC_ACT_DROP etc. */
 extern int psc_dnsbl_action;		/* PSC_ACT_DROP etc. */
 extern int psc_pipel_action;		/* PSC_ACT_DROP etc. */
+extern STATS_CELL *psc_stats_forward;	/* sessions sent to real SMTPD */
+extern STATS_CELL *psc_stats_reject;	/* sessions not sent to real SMTPD */
 extern int psc_nsmtp_action;		/* PSC_ACT_DROP etc. */
 extern int psc_barlf_action;		/* PSC_ACT_DROP etc. */
 extern int psc_min_ttl;			/* Update with new tests! */
@@ -382,8 +414,12 @@ extern int psc_hiwat_check_queue_length;/* stress high-water mark */
 extern DICT *psc_dnsbl_reply;		/* DNSBL name mapper */
 extern HTABLE *psc_client_concurrency;	/* per-client concurrency */
 
-#define PSC_EFF_GREET_WAIT \
+#define PSC_BASE_GREET_WAIT \
 	(psc_stress ? psc_stress_greet_wait : psc_normal_greet_wait)
+#define PSC_EFF_GREET_WAIT(state) \
+	(PSC_SHED_GREET(state) ? \
+	 PSC_MIN(var_psc_shed_greet_wait, PSC_BASE_GREET_WAIT) : \
+	 PSC_BASE_GREET_WAIT)
 #define PSC_EFF_CMD_TIME_LIMIT \
 	(psc_stress ? psc_stress_cmd_time_limit : psc_normal_cmd_time_limit)
 
@@ -469,6 +505,8 @@ extern HTABLE *psc_client_concurrency;	/* per-client concurrency */
 extern PSC_STATE *psc_new_session_state(VSTREAM *, const char *, const char *, const char *, const char *);
 extern void psc_free_session_state(PSC_STATE *);
 extern const char *psc_print_state_flags(int, const char *);
+extern void psc_deadline_request(PSC_STATE *, EVENT_NOTIFY_TIME_FN, int);
+extern void psc_deadline_cancel(PSC_STATE *, EVENT_NOTIFY_TIME_FN);
 
  /*
   * postscreen_dict.c
@@ -541,6 +579,31 @@ extern char *psc_format_delta_time(VSTRING *, struct timeval, DELTA_TIME *);
 extern void psc_conclude(PSC_STATE *);
 extern void psc_hangup_event(PSC_STATE *);
 
+ /*
+  * postscreen_shed.c
+  */
+#define PSC_SHED_LEVEL_GREET	1	/* shorter greet wait if cached */
+#define PSC_SHED_LEVEL_DEEP	2	/* skip deep protocol tests */
+#define PSC_SHED_LEVEL_DNSBL	3	/* drop DNSBL-scored clients */
+
+extern int psc_shed_level;		/* current shedding level */
+extern STATS_CELL *psc_shed_stats_greet;/* shortened greet waits */
+
+#define PSC_SHED_GREET(state) \
+	(psc_shed_level >= PSC_SHED_LEVEL_GREET \
+	 && ((state)->flags & PSC_STATE_FLAG_NEW) == 0)
+#define PSC_SHED_DEEP(state) \
+	(psc_shed_level >= PSC_SHED_LEVEL_DEEP \
+	 && ((state)->flags & PSC_STATE_FLAG_NOFORWARD) == 0)
+#define PSC_SHED_DNSBL(state) \
+	(psc_shed_level >= PSC_SHED_LEVEL_DNSBL \
+	 && (state)->dnsbl_score > 0 \
+	 && (state)->dnsbl_score < var_psc_dnsbl_thresh)
+
+extern void psc_shed_init(void);
+extern void psc_shed_deep_tests(PSC_STATE *);
+extern void psc_shed_dnsbl_drop(PSC_STATE *);
+
  /*
   * postscreen_send.c
   */
@@ -568,6 +631,7 @@ typedef void (*PSC_ENDPT_LOOKUP_FN) (int, VSTREAM *,
 			             MAI_HOSTADDR_STR *, MAI_SERVPORT_STR *,
 			            MAI_HOSTADDR_STR *, MAI_SERVPORT_STR *);
 extern void psc_endpt_lookup(VSTREAM *, PSC_ENDPT_LOOKUP_FN);
+extern void psc_endpt_local_lookup(VSTREAM *, PSC_ENDPT_LOOKUP_FN);
 
  /*
   * postscreen_access emulation.
@@ -116,8 +116,7 @@ static void psc_early_event(int event, void *context)
 		 state->smtp_client_addr, state->smtp_client_port,
 		 psc_print_state_flags(state->flags, myname));
 
-    PSC_CLEAR_EVENT_REQUEST(vstream_fileno(state->smtp_client_stream),
-			    psc_early_event, context);
+    PSC_CLEAR_EVENT_DEADLINE(state, psc_early_event);
 
     /*
      * XXX Be sure to empty the DNSBL lookup buffer otherwise we have a
@@ -138,6 +137,35 @@ static void psc_early_event(int event, void *context)
 	 */
     case EVENT_TIME:
 
+	/*
+	 * Collect the DNSBL score, and whitelist other tests if applicable.
+	 * Note: this score will be partial when some DNS lookup did not
+	 * complete before the pregreet timer expired.
+	 */
+#define NO_DNSBL_SCORE	INT_MAX
+
+	if ((state->flags & PSC_STATE_FLAG_DNSBL_TODO)
+	    && state->dnsbl_score == NO_DNSBL_SCORE) {
+	    state->dnsbl_score =
+		psc_dnsbl_retrieve(state->smtp_client_addr,
+				   &state->dnsbl_name,
+				   state->dnsbl_index,
+				   &state->dnsbl_ttl);
+	    if (var_psc_dnsbl_wthresh < 0)
+		psc_whitelist_non_dnsbl(state);
+	}
+
+	/*
+	 * Under heavy load, hang up on a client with a DNSBL score, before
+	 * any test is flagged as passed.
+	 */
+	if ((state->flags & PSC_STATE_FLAG_SHED_DROP)
+	    || ((state->flags & PSC_STATE_FLAG_DNSBL_TODO)
+		&& PSC_SHED_DNSBL(state))) {
+	    psc_shed_dnsbl_drop(state);
+	    return;
+	}
+
 	/*
 	 * Check if the SMTP client spoke before its turn.
 	 */
@@ -154,27 +182,13 @@ static void psc_early_event(int event, void *context)
 	}
 
 	/*
-	 * Collect the DNSBL score, and whitelist other tests if applicable.
-	 * Note: this score will be partial when some DNS lookup did not
-	 * complete before the pregreet timer expired.
-	 * 
 	 * If the client is DNS blocklisted, drop the connection, send the
 	 * client to a dummy protocol engine, or continue to the next test.
 	 */
 #define PSC_DNSBL_FORMAT \
 	"%s 5.7.1 Service unavailable; client [%s] blocked using %s\r\n"
-#define NO_DNSBL_SCORE	INT_MAX
 
 	if (state->flags & PSC_STATE_FLAG_DNSBL_TODO) {
-	    if (state->dnsbl_score == NO_DNSBL_SCORE) {
-		state->dnsbl_score =
-		    psc_dnsbl_retrieve(state->smtp_client_addr,
-				       &state->dnsbl_name,
-				       state->dnsbl_index,
-				       &state->dnsbl_ttl);
-		if (var_psc_dnsbl_wthresh < 0)
-		    psc_whitelist_non_dnsbl(state);
-	    }
 	    if (state->dnsbl_score < var_psc_dnsbl_thresh) {
 		expire_time[PSC_TINDX_DNSBL] = event_time() + state->dnsbl_ttl;
 		PSC_PASS_SESSION_STATE(state, "dnsbl test",
@@ -212,13 +226,16 @@ static void psc_early_event(int event, void *context)
 
 	/*
 	 * Pass the connection to a real SMTP server, or enter the dummy
-	 * engine for deep tests.
+	 * engine for deep tests. Under heavy load, skip the deep tests.
 	 */
 	if ((state->flags & PSC_STATE_FLAG_NOFORWARD) != 0
 	    || ((state->flags & PSC_STATE_MASK_SMTPD_PASS)
-		!= PSC_STATE_FLAGS_TODO_TO_PASS(state->flags & PSC_STATE_MASK_SMTPD_TODO)))
-	    psc_smtpd_tests(state);
-	else
+		!= PSC_STATE_FLAGS_TODO_TO_PASS(state->flags & PSC_STATE_MASK_SMTPD_TODO))) {
+	    if (PSC_SHED_DEEP(state))
+		psc_shed_deep_tests(state);
+	    else
+		psc_smtpd_tests(state);
+	} else
 	    psc_conclude(state);
 	return;
 
@@ -281,13 +298,13 @@ static void psc_early_event(int event, void *context)
 	 * EVENT_TIME, instead of calling psc_early_event recursively.
 	 */
 	state->flags |= PSC_STATE_FLAG_PREGR_DONE;
-	if (elapsed.dt_sec >= PSC_EFF_GREET_WAIT
+	if (elapsed.dt_sec >= PSC_EFF_GREET_WAIT(state)
 	    || ((state->flags & PSC_STATE_MASK_EARLY_DONE)
 		== PSC_STATE_FLAGS_TODO_TO_DONE(state->flags & PSC_STATE_MASK_EARLY_TODO)))
 	    psc_early_event(EVENT_TIME, context);
 	else
-	    event_request_timer(psc_early_event, context,
-				PSC_EFF_GREET_WAIT - elapsed.dt_sec);
+	    psc_deadline_request(state, psc_early_event,
+				 PSC_EFF_GREET_WAIT(state) - elapsed.dt_sec);
 	return;
     }
 }
@@ -313,13 +330,16 @@ static void psc_early_dnsbl_event(int unused_event, void *context)
 
     /*
      * Terminate the greet delay if we're just waiting for DNSBL lookup to
-     * complete. Don't call psc_early_event directly, that would result in a
-     * dangling pointer.
+     * complete, or if we will hang up due to load shedding. Don't call
+     * psc_early_event directly, that would result in a dangling pointer.
      */
     state->flags |= PSC_STATE_FLAG_DNSBL_DONE;
-    if ((state->flags & PSC_STATE_MASK_EARLY_DONE)
+    if (PSC_SHED_DNSBL(state)) {
+	state->flags |= PSC_STATE_FLAG_SHED_DROP;
+	psc_deadline_request(state, psc_early_event, EVENT_NULL_DELAY);
+    } else if ((state->flags & PSC_STATE_MASK_EARLY_DONE)
 	== PSC_STATE_FLAGS_TODO_TO_DONE(state->flags & PSC_STATE_MASK_EARLY_TODO))
-	event_request_timer(psc_early_event, context, EVENT_NULL_DELAY);
+	psc_deadline_request(state, psc_early_event, EVENT_NULL_DELAY);
 }
 
 /* psc_early_tests - start the early (before protocol) tests */
@@ -358,11 +378,15 @@ void    psc_early_tests(PSC_STATE *state)
     /*
      * Wait for the client to respond or for DNS lookup to complete.
      */
+    if (PSC_SHED_GREET(state)
+	&& var_psc_shed_greet_wait < PSC_BASE_GREET_WAIT)
+	STATS_INC(psc_shed_stats_greet);
     if ((state->flags & PSC_STATE_FLAG_PREGR_TODO) != 0)
-	PSC_READ_EVENT_REQUEST(vstream_fileno(state->smtp_client_stream),
-		       psc_early_event, (void *) state, PSC_EFF_GREET_WAIT);
+	PSC_READ_EVENT_DEADLINE(state, psc_early_event, psc_early_event,
+				PSC_EFF_GREET_WAIT(state));
     else
-	event_request_timer(psc_early_event, (void *) state, PSC_EFF_GREET_WAIT);
+	psc_deadline_request(state, psc_early_event,
+			     PSC_EFF_GREET_WAIT(state));
 }
 
 /* psc_early_init - initialize early tests */
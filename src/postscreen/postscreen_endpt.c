@@ -16,11 +16,22 @@
 /*	MAI_SERVPORT_STR *smtp_client_port;
 /*	MAI_HOSTADDR_STR *smtp_server_addr;
 /*	MAI_SERVPORT_STR *smtp_server_port;
+/*
+/*	void	psc_endpt_local_lookup(smtp_client_stream, lookup_done)
+/*	VSTREAM	*smtp_client_stream;
+/*	void	(*lookup_done)(status, smtp_client_stream,
+/*				smtp_client_addr, smtp_client_port,
+/*				smtp_server_addr, smtp_server_port)
 /* DESCRIPTION
 /*	psc_endpt_lookup() looks up remote and local connection
 /*	endpoint information, either through local system calls,
 /*	or through an adapter for an up-stream proxy protocol.
 /*
+/*	psc_endpt_local_lookup() looks up connection endpoint
+/*	information through local system calls only. A proxy
+/*	protocol adapter may use this when the proxy reports that
+/*	a connection is not proxied (for example, a health check).
+/*
 /*	The following summarizes what the postscreen(8) server
 /*	expects from a proxy protocol adapter routine.
 /* .IP \(bu
@@ -105,8 +116,8 @@ static int psc_sockaddr_to_hostaddr(struct sockaddr *addr_storage,
 
 /* psc_endpt_local_lookup - look up local system connection information */
 
-static void psc_endpt_local_lookup(VSTREAM *smtp_client_stream,
-				           PSC_ENDPT_LOOKUP_FN lookup_done)
+void    psc_endpt_local_lookup(VSTREAM *smtp_client_stream,
+				               PSC_ENDPT_LOOKUP_FN lookup_done)
 {
     struct sockaddr_storage addr_storage;
     SOCKADDR_SIZE addr_storage_len = sizeof(addr_storage);
@@ -18,8 +18,11 @@
 /*	MAI_SERVPORT_STR *smtp_server_port;
 /* DESCRIPTION
 /*	psc_endpt_haproxy_lookup() looks up connection endpoint
-/*	information via the haproxy protocol.  Arguments and results
-/*	conform to the postscreen_endpt(3) API.
+/*	information via the haproxy protocol version 1 or 2.
+/*	Arguments and results conform to the postscreen_endpt(3)
+/*	API. Version 2 TLVs are ignored. With the version 2 LOCAL
+/*	command, the endpoint information is that of the connection
+/*	itself.
 /* LICENSE
 /* .ad
 /* .fi
@@ -83,19 +86,22 @@ static void psc_endpt_haproxy_event(int event, void *context)
     MAI_SERVPORT_STR smtp_client_port;
     MAI_HOSTADDR_STR smtp_server_addr;
     MAI_SERVPORT_STR smtp_server_port;
-    int     last_char = 0;
+    int     non_proxy = 0;
     const char *err;
     VSTRING *escape_buf;
-    char    read_buf[HAPROXY_MAX_LEN];
-    ssize_t read_len;
-    char   *cp;
 
     /*
-     * We must not read(2) past the <CR><LF> that terminates the haproxy
-     * line. For efficiency reasons we read the entire haproxy line in one
-     * read(2) call when we know that the line is unfragmented. In the rare
-     * case that the line is fragmented, we fall back and read(2) it one
-     * character at a time.
+     * We must not read(2) past the end of the haproxy header. The
+     * haproxy_srvr_receive() routine peeks at the data, and reads exactly
+     * the header bytes. A version 2 header, or an unfragmented version 1
+     * line, takes one recv(MSG_PEEK) and one read(2) call. In the rare case
+     * that the header is fragmented, we keep the partial header and wait
+     * for the next read event.
+     * 
+     * Note: haproxy_srvr_receive() performs address protocol checks, address
+     * and port syntax checks, and converts IPv4-in-IPv6 address string
+     * syntax (::ffff:1.2.3.4) to IPv4 syntax where permitted by the
+     * main.cf:inet_protocols setting.
      */
     switch (event) {
     case EVENT_TIME:
@@ -103,74 +109,42 @@ static void psc_endpt_haproxy_event(int event, void *context)
 	status = -1;
 	break;
     case EVENT_READ:
-	/* Determine the initial VSTREAM read(2) buffer size. */
-	if (VSTRING_LEN(state->buffer) == 0) {
-	    if ((read_len = recv(vstream_fileno(state->stream),
-			      read_buf, sizeof(read_buf) - 1, MSG_PEEK)) > 0
-		&& ((cp = memchr(read_buf, '\n', read_len)) != 0)) {
-		read_len = cp - read_buf + 1;
-	    } else {
-		read_len = 1;
-	    }
-	    vstream_control(state->stream, CA_VSTREAM_CTL_BUFSIZE(read_len),
-			    CA_VSTREAM_CTL_END);
-	}
-	/* Drain the VSTREAM buffer, otherwise this pseudo-thread will hang. */
-	do {
-	    if ((last_char = VSTREAM_GETC(state->stream)) == VSTREAM_EOF) {
-		if (vstream_ferror(state->stream))
-		    msg_warn("haproxy read: %m");
-		else
-		    msg_warn("haproxy read: lost connection");
-		status = -1;
-		break;
-	    }
-	    if (VSTRING_LEN(state->buffer) >= HAPROXY_MAX_LEN) {
-		msg_warn("haproxy read: line too long");
-		status = -1;
-		break;
-	    }
-	    VSTRING_ADDCH(state->buffer, last_char);
-	} while (vstream_peek(state->stream) > 0);
-	break;
-    }
-
-    /*
-     * Parse the haproxy line. Note: the haproxy_srvr_parse() routine
-     * performs address protocol checks, address and port syntax checks, and
-     * converts IPv4-in-IPv6 address string syntax (::ffff:1.2.3.4) to IPv4
-     * syntax where permitted by the main.cf:inet_protocols setting.
-     */
-    if (status == 0 && last_char == '\n') {
-	VSTRING_TERMINATE(state->buffer);
-	if ((err = haproxy_srvr_parse(vstring_str(state->buffer),
-				      &smtp_client_addr, &smtp_client_port,
-			      &smtp_server_addr, &smtp_server_port)) != 0) {
+	err = haproxy_srvr_receive(vstream_fileno(state->stream),
+				   state->buffer, &non_proxy,
+				   &smtp_client_addr, &smtp_client_port,
+				   &smtp_server_addr, &smtp_server_port,
+				   (HAPROXY_SRVR_TLV **) 0);
+	if (err != 0 && HAPROXY_SRVR_INCOMPLETE(err))
+	    return;
+	if (err != 0) {
 	    escape_buf = vstring_alloc(HAPROXY_MAX_LEN + 2);
 	    escape(escape_buf, vstring_str(state->buffer),
-		   VSTRING_LEN(state->buffer));
+		   VSTRING_LEN(state->buffer) < HAPROXY_MAX_LEN ?
+		   VSTRING_LEN(state->buffer) : HAPROXY_MAX_LEN);
 	    msg_warn("haproxy read: %s: %s", err, vstring_str(escape_buf));
 	    status = -1;
 	    vstring_free(escape_buf);
 	}
+	break;
     }
 
     /*
-     * Are we done yet?
+     * We're done.
      */
-    if (status < 0 || last_char == '\n') {
-	PSC_CLEAR_EVENT_REQUEST(vstream_fileno(state->stream),
-				psc_endpt_haproxy_event, context);
-	vstream_control(state->stream,
-			CA_VSTREAM_CTL_BUFSIZE(VSTREAM_BUFSIZE),
-			CA_VSTREAM_CTL_END);
+    PSC_CLEAR_EVENT_REQUEST(vstream_fileno(state->stream),
+			    psc_endpt_haproxy_event, context);
+    if (status == 0 && non_proxy) {
+	if (msg_verbose)
+	    msg_info("%s: haproxy LOCAL command", myname);
+	psc_endpt_local_lookup(state->stream, state->notify);
+    } else {
 	state->notify(status, state->stream,
 		      &smtp_client_addr, &smtp_client_port,
 		      &smtp_server_addr, &smtp_server_port);
-	/* Note: the stream may be closed at this point. */
-	vstring_free(state->buffer);
-	myfree((void *) state);
     }
+    /* Note: the stream may be closed at this point. */
+    vstring_free(state->buffer);
+    myfree((void *) state);
 }
 
 /* psc_endpt_haproxy_lookup - event-driven haproxy client */
@@ -192,7 +166,7 @@ void    psc_endpt_haproxy_lookup(VSTREAM *stream,
     state->buffer = vstring_alloc(100);
 
     /*
-     * Read the haproxy line.
+     * Read the haproxy header.
      */
     PSC_READ_EVENT_REQUEST(vstream_fileno(stream), psc_endpt_haproxy_event,
 			   (void *) state, var_psc_uproxy_tmout);
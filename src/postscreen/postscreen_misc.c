@@ -132,8 +132,10 @@ void    psc_conclude(PSC_STATE *state)
      * Either hand off the socket to a real SMTP engine, or say bye-bye.
      */
     if ((state->flags & PSC_STATE_FLAG_NOFORWARD) == 0) {
+	STATS_INC(psc_stats_forward);
 	psc_send_socket(state);
     } else {
+	STATS_INC(psc_stats_reject);
 	if ((state->flags & PSC_STATE_FLAG_HANGUP) == 0)
 	    (void) PSC_SEND_REPLY(state, state->final_reply);
 	msg_info("DISCONNECT [%s]:%s", PSC_CLIENT_ADDR_PORT(state));
@@ -139,8 +139,10 @@ int     psc_send_reply(PSC_STATE *state, const char *text)
 
     /*
      * Append the new text to earlier text that could not be sent because the
-     * output was throttled.
+     * output was throttled. The buffer is created upon first use.
      */
+    if (state->send_buf == 0)
+	state->send_buf = vstring_alloc(100);
     start = VSTRING_LEN(state->send_buf);
     vstring_strcat(state->send_buf, text);
 
@@ -0,0 +1,276 @@
+/*++
+/* NAME
+/*	postscreen_shed 3
+/* SUMMARY
+/*	postscreen graduated load shedding
+/* SYNOPSIS
+/*	#include <postscreen.h>
+/*
+/*	int	psc_shed_level;
+/*
+/*	void	psc_shed_init(void)
+/*
+/*	int	PSC_SHED_GREET(state)
+/*	PSC_STATE *state;
+/*
+/*	int	PSC_SHED_DEEP(state)
+/*	PSC_STATE *state;
+/*
+/*	int	PSC_SHED_DNSBL(state)
+/*	PSC_STATE *state;
+/*
+/*	void	psc_shed_deep_tests(state)
+/*	PSC_STATE *state;
+/*
+/*	void	psc_shed_dnsbl_drop(state)
+/*	PSC_STATE *state;
+/* DESCRIPTION
+/*	This module measures the postscreen(8) load, and reduces
+/*	the amount of work per session in steps as the load goes
+/*	up, instead of making all clients wait or hanging up on
+/*	them when a queue limit is reached.
+/*
+/*	The load is the larger of two percentages: the number of
+/*	sessions that are waiting for a real SMTP server process
+/*	relative to $postscreen_post_queue_limit, and the event
+/*	loop lag relative to $postscreen_shed_lag_limit. The event
+/*	loop lag is measured once per second, as the time for a
+/*	zero-delay timer request to be delivered. It goes up
+/*	immediately, and decays by half each second.
+/*
+/*	psc_shed_level is the current load shedding level, from
+/*	zero (no shedding) to PSC_SHED_LEVEL_DNSBL. A level is
+/*	entered when the load reaches the corresponding percentage
+/*	in $postscreen_shed_levels. Levels are left one at a time,
+/*	when the load falls a few points below the percentage that
+/*	started the level.
+/*
+/*	psc_shed_init() parses the load shedding parameters, and
+/*	starts the load measurement. It does nothing when
+/*	$postscreen_shed_levels is empty.
+/*
+/*	PSC_SHED_GREET() returns non-zero when the shedding level
+/*	is at least PSC_SHED_LEVEL_GREET, and the client has a
+/*	postscreen cache record. Such clients receive the greet
+/*	wait time $postscreen_shed_greet_wait, when that is shorter.
+/*
+/*	PSC_SHED_DEEP() returns non-zero when the shedding level
+/*	is at least PSC_SHED_LEVEL_DEEP, and the session could
+/*	otherwise be forwarded to a real SMTP server.
+/*
+/*	PSC_SHED_DNSBL() returns non-zero when the shedding level
+/*	is at least PSC_SHED_LEVEL_DNSBL, and the client has a
+/*	DNSBL score that is positive but below the DNSBL threshold.
+/*
+/*	psc_shed_deep_tests() hands off a session to a real SMTP
+/*	server without performing the pending deep protocol tests.
+/*	The tests are not flagged as passed, and will be repeated
+/*	in a later session.
+/*
+/*	psc_shed_dnsbl_drop() hangs up on a client with a 421
+/*	response without completing the tests before the SMTP
+/*	handshake.
+/*
+/*	Level changes and load shedding actions are logged, and
+/*	are maintained as performance counters.
+/* DIAGNOSTICS
+/*	Fatal error: invalid $postscreen_shed_levels value.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <stdlib.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <stringops.h>
+#include <events.h>
+#include <stats.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+
+/* Application-specific. */
+
+#include <postscreen.h>
+
+int     psc_shed_level;			/* current shedding level */
+
+static int psc_shed_start[PSC_SHED_LEVEL_DNSBL + 1];	/* load thresholds */
+static int psc_shed_lag;		/* smoothed event loop lag, ms */
+static struct timeval psc_shed_probe_time;	/* probe request time */
+
+ /*
+  * Hysteresis: leave a level only when the load is this many points below
+  * the threshold that started it.
+  */
+#define PSC_SHED_HYSTERESIS	10
+
+ /*
+  * Performance counters. See "postfix stats".
+  */
+static STATS_CELL *psc_shed_stats_level;
+static STATS_CELL *psc_shed_stats_enter[PSC_SHED_LEVEL_DNSBL + 1];
+static STATS_CELL *psc_shed_stats_lag;
+STATS_CELL *psc_shed_stats_greet;
+static STATS_CELL *psc_shed_stats_deep;
+static STATS_CELL *psc_shed_stats_dnsbl;
+
+static void psc_shed_tick(int, void *);
+
+/* psc_shed_load - compute the current load percentage */
+
+static int psc_shed_load(void)
+{
+    int     backlog;
+    int     lag;
+
+    backlog = (var_psc_post_queue_limit > 0 ?
+	       100 * psc_post_queue_length / var_psc_post_queue_limit : 0);
+    lag = (var_psc_shed_lag_limit > 0 ?
+	   100 * psc_shed_lag / var_psc_shed_lag_limit : 0);
+    return (PSC_MAX(backlog, lag));
+}
+
+/* psc_shed_update - update the shedding level */
+
+static void psc_shed_update(void)
+{
+    int     load = psc_shed_load();
+    int     level;
+
+    /*
+     * Go up as many levels as needed at once. Come down one level at a time.
+     */
+    for (level = psc_shed_level; level < PSC_SHED_LEVEL_DNSBL
+	 && load >= psc_shed_start[level + 1]; level++)
+	 /* void */ ;
+    if (level == psc_shed_level && level > 0
+	&& load < psc_shed_start[level] - PSC_SHED_HYSTERESIS)
+	level -= 1;
+    if (level == psc_shed_level)
+	return;
+
+    msg_info("%s load shedding level %d: smtpd backlog %d/%d,"
+	     " event loop lag %dms",
+	     level > psc_shed_level ? "entering" : "leaving",
+	     level > psc_shed_level ? level : psc_shed_level,
+	     psc_post_queue_length, var_psc_post_queue_limit, psc_shed_lag);
+    psc_shed_level = level;
+    STATS_SET(psc_shed_stats_level, level);
+    STATS_INC(psc_shed_stats_enter[level]);
+}
+
+/* psc_shed_probe - measure the event loop lag */
+
+static void psc_shed_probe(int unused_event, void *unused_context)
+{
+    struct timeval now;
+    int     sample;
+
+    /*
+     * This zero-delay request is delivered in the next event loop iteration,
+     * after all I/O events that are pending in this one.
+     */
+    GETTIMEOFDAY(&now);
+    sample = (now.tv_sec - psc_shed_probe_time.tv_sec) * 1000
+	+ (now.tv_usec - psc_shed_probe_time.tv_usec) / 1000;
+    if (sample < 0)
+	sample = 0;
+    stats_observe(psc_shed_stats_lag, sample);
+    psc_shed_lag = PSC_MAX(sample, psc_shed_lag / 2);
+
+    psc_shed_update();
+    event_request_timer(psc_shed_tick, (void *) 0, 1);
+}
+
+/* psc_shed_tick - start a measurement */
+
+static void psc_shed_tick(int unused_event, void *unused_context)
+{
+    GETTIMEOFDAY(&psc_shed_probe_time);
+    event_request_timer(psc_shed_probe, (void *) 0, EVENT_NULL_DELAY);
+}
+
+/* psc_shed_deep_tests - hand off without deep protocol tests */
+
+void    psc_shed_deep_tests(PSC_STATE *state)
+{
+    msg_info("SHED deep protocol tests [%s]:%s", PSC_CLIENT_ADDR_PORT(state));
+    STATS_INC(psc_shed_stats_deep);
+    psc_conclude(state);
+}
+
+/* psc_shed_dnsbl_drop - hang up on a DNSBL-scored client */
+
+void    psc_shed_dnsbl_drop(PSC_STATE *state)
+{
+    msg_info("NOQUEUE: reject: CONNECT from [%s]:%s: DNSBL rank %d"
+	     " at load shedding level %d", PSC_CLIENT_ADDR_PORT(state),
+	     state->dnsbl_score, psc_shed_level);
+    STATS_INC(psc_shed_stats_dnsbl);
+    PSC_DROP_SESSION_STATE(state,
+			   "421 4.3.2 Service currently unavailable\r\n");
+}
+
+/* psc_shed_init - parse parameters and start measurements */
+
+void    psc_shed_init(void)
+{
+    char   *saved_levels;
+    char   *cp;
+    char   *word;
+    int     level;
+
+    if (*var_psc_shed_levels == 0)
+	return;
+
+    /*
+     * Parse the load percentages that start each shedding level.
+     */
+    cp = saved_levels = mystrdup(var_psc_shed_levels);
+    for (level = 1; (word = mystrtok(&cp, CHARS_COMMA_SP)) != 0; level++) {
+	if (level > PSC_SHED_LEVEL_DNSBL || !alldig(word)
+	    || (psc_shed_start[level] = atoi(word)) <= psc_shed_start[level - 1])
+	    msg_fatal("bad %s value \"%s\": specify %d increasing"
+		      " positive percentages", VAR_PSC_SHED_LEVELS,
+		      var_psc_shed_levels, PSC_SHED_LEVEL_DNSBL);
+    }
+    if (level != PSC_SHED_LEVEL_DNSBL + 1)
+	msg_fatal("bad %s value \"%s\": specify %d increasing"
+		  " positive percentages", VAR_PSC_SHED_LEVELS,
+		  var_psc_shed_levels, PSC_SHED_LEVEL_DNSBL);
+    myfree(saved_levels);
+
+    /*
+     * Performance counters.
+     */
+    psc_shed_stats_level = stats_gauge("postscreen_shed_level");
+    for (level = 0; level <= PSC_SHED_LEVEL_DNSBL; level++) {
+	vstring_sprintf(psc_temp, "postscreen_shed_transitions_total"
+			"{level=\"%d\"}", level);
+	psc_shed_stats_enter[level] = stats_counter(STR(psc_temp));
+    }
+    psc_shed_stats_lag = stats_histogram("postscreen_event_loop_lag_milliseconds");
+    psc_shed_stats_greet =
+	stats_counter("postscreen_shed_actions_total{action=\"greet_wait\"}");
+    psc_shed_stats_deep =
+	stats_counter("postscreen_shed_actions_total{action=\"deep_tests\"}");
+    psc_shed_stats_dnsbl =
+	stats_counter("postscreen_shed_actions_total{action=\"dnsbl_drop\"}");
+
+    event_request_timer(psc_shed_tick, (void *) 0, 1);
+}
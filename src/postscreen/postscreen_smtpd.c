@@ -204,7 +204,7 @@ static char *psc_smtpd_timeout_reply;	/* timeout reply */
 static char *psc_smtpd_421_reply;	/* generic final_reply value */
 
  /*
-  * Forward declaration, needed by PSC_CLEAR_EVENT_REQUEST.
+  * Forward declaration, needed by PSC_CLEAR_EVENT_DEADLINE.
   */
 static void psc_smtpd_time_event(int, void *);
 static void psc_smtpd_read_event(int, void *);
@@ -218,16 +218,14 @@ static void psc_smtpd_read_event(int, void *);
   * the client IP address and on the presence on TLS encryption).
   */
 #define PSC_RESUME_SMTP_CMD_EVENTS(state) do { \
-	PSC_READ_EVENT_REQUEST2(vstream_fileno((state)->smtp_client_stream), \
-			       psc_smtpd_read_event, psc_smtpd_time_event, \
-			       (void *) (state), PSC_EFF_CMD_TIME_LIMIT); \
+	PSC_READ_EVENT_DEADLINE((state), psc_smtpd_read_event, \
+				psc_smtpd_time_event, PSC_EFF_CMD_TIME_LIMIT); \
 	if (!PSC_SMTPD_BUFFER_EMPTY(state)) \
 	    psc_smtpd_read_event(EVENT_READ, (void *) state); \
     } while (0)
 
 #define PSC_SUSPEND_SMTP_CMD_EVENTS(state) \
-    PSC_CLEAR_EVENT_REQUEST(vstream_fileno((state)->smtp_client_stream), \
-			   psc_smtpd_time_event, (void *) (state));
+    PSC_CLEAR_EVENT_DEADLINE((state), psc_smtpd_time_event);
 
  /*
   * Make control characters and other non-text visible.
@@ -264,14 +262,12 @@ static DICT *psc_cmd_filter;
   * noticeably increase the run-time cost.
   */
 #define PSC_CLEAR_EVENT_DROP_SESSION_STATE(state, event, reply) do { \
-	PSC_CLEAR_EVENT_REQUEST(vstream_fileno((state)->smtp_client_stream), \
-				   (event), (void *) (state)); \
+	PSC_CLEAR_EVENT_DEADLINE((state), (event)); \
 	PSC_DROP_SESSION_STATE((state), (reply)); \
     } while (0)
 
 #define PSC_CLEAR_EVENT_HANGUP(state, event) do { \
-	PSC_CLEAR_EVENT_REQUEST(vstream_fileno((state)->smtp_client_stream), \
-				   (event), (void *) (state)); \
+	PSC_CLEAR_EVENT_DEADLINE((state), (event)); \
 	psc_hangup_event(state); \
     } while (0)
 
@@ -1142,8 +1138,8 @@ static void psc_smtpd_read_event(int event, void *context)
 	/*
 	 * Reset the command read timeout before reading the next command.
 	 */
-	event_request_timer(psc_smtpd_time_event, (void *) state,
-			    PSC_EFF_CMD_TIME_LIMIT);
+	psc_deadline_request(state, psc_smtpd_time_event,
+			     PSC_EFF_CMD_TIME_LIMIT);
 
 	/*
 	 * Yield this pseudo thread when the VSTREAM buffer is empty.
@@ -1168,7 +1164,10 @@ void    psc_smtpd_tests(PSC_STATE *state)
      * Initialize per-session state that is used only by the dummy engine:
      * the command read buffer and the command read state machine.
      */
-    state->cmd_buffer = vstring_alloc(100);
+    if (state->cmd_buffer == 0)
+	state->cmd_buffer = vstring_alloc(100);
+    else
+	VSTRING_RESET(state->cmd_buffer);
     state->read_state = PSC_SMTPD_CMD_ST_ANY;
 
     /*
@@ -1197,9 +1196,8 @@ void    psc_smtpd_tests(PSC_STATE *state)
     /*
      * Wait for the client to respond.
      */
-    PSC_READ_EVENT_REQUEST2(vstream_fileno(state->smtp_client_stream),
-			    psc_smtpd_read_event, psc_smtpd_time_event,
-			    (void *) state, PSC_EFF_CMD_TIME_LIMIT);
+    PSC_READ_EVENT_DEADLINE(state, psc_smtpd_read_event, psc_smtpd_time_event,
+			    PSC_EFF_CMD_TIME_LIMIT);
 }
 
 /* psc_smtpd_init - per-process deep protocol test initialization */
@@ -51,6 +51,15 @@
 /*	void	PSC_UNFAIL_SESSION_STATE(state, fail_flag)
 /*	PSC_STATE *state;
 /*	int	fail_flag;
+/*
+/*	void	psc_deadline_request(state, callback, delay)
+/*	PSC_STATE *state;
+/*	EVENT_NOTIFY_TIME_FN callback;
+/*	int	delay;
+/*
+/*	void	psc_deadline_cancel(state, callback)
+/*	PSC_STATE *state;
+/*	EVENT_NOTIFY_TIME_FN callback;
 /* DESCRIPTION
 /*	This module maintains per-client session state, and two
 /*	global file descriptor counters:
@@ -74,6 +83,12 @@
 /*	The psc_stress variable is set to non-zero when
 /*	psc_check_queue_length passes over a high-water mark.
 /*
+/*	Session state objects are allocated in slabs, and are
+/*	recycled instead of being returned to malloc(). The send
+/*	and command buffers are created when they are first needed,
+/*	and are kept with a recycled object unless they have grown
+/*	large.
+/*
 /*	psc_free_session_state() destroys the specified session state
 /*	object, closes the applicable I/O channels, and decrements
 /*	the applicable file descriptor counters: psc_check_queue_length
@@ -114,6 +129,18 @@
 /*	PSC_FAIL_SESSION_STATE() sets the specified "fail" flag.
 /*
 /*	PSC_UNFAIL_SESSION_STATE() unsets the specified "fail" flag.
+/*
+/*	psc_deadline_request() is a replacement for event_request_timer()
+/*	for session state objects: it arranges that the call-back
+/*	function is called with EVENT_TIME and the session state as
+/*	arguments after the specified number of seconds. A session
+/*	has at most one deadline; a new request replaces an existing
+/*	one. Deadlines are kept in a timing wheel that is driven by
+/*	one event timer, so that the cost of a request does not
+/*	depend on the number of sessions.
+/*
+/*	psc_deadline_cancel() cancels the deadline of the specified
+/*	session, if it has the specified call-back function.
 /* LICENSE
 /* .ad
 /* .fi
@@ -133,6 +160,8 @@
 /* System library. */
 
 #include <sys_defs.h>
+#include <stddef.h>
+#include <string.h>
 
 /* Utility library. */
 
@@ -140,6 +169,8 @@
 #include <mymalloc.h>
 #include <name_mask.h>
 #include <htable.h>
+#include <ring.h>
+#include <events.h>
 
 /* Global library. */
 
@@ -153,6 +184,83 @@
 
 #include <postscreen.h>
 
+
+ /*
+  * Session state allocation. Objects are allocated in slabs and are recycled
+  * through a free list, which uses the deadline linkage while an object is
+  * not in use. Buffers larger than PSC_STATE_BUF_LIMIT are not recycled.
+  */
+#define PSC_STATE_SLAB_SIZE	128
+#define PSC_STATE_BUF_LIMIT	4096
+
+static RING psc_state_free_list;
+
+ /*
+  * Session deadlines. The timing wheel has one slot per second; a deadline
+  * that is further away than the wheel is long stays in its slot until its
+  * time has come. Zero-delay requests are kept in a separate list, so that
+  * they run after the next event loop pass, not after the next tick.
+  */
+#define PSC_DEADLINE_SLOTS	64	/* must be a power of 2 */
+#define PSC_DEADLINE_SLOT(t)	((t) & (PSC_DEADLINE_SLOTS - 1))
+
+static RING psc_deadline_wheel[PSC_DEADLINE_SLOTS];
+static RING psc_deadline_soon;		/* zero-delay requests */
+static time_t psc_deadline_last;	/* last examined wheel slot time */
+static int psc_deadline_count;		/* pending requests */
+static int psc_deadline_tick = -1;	/* pending event timer delay */
+
+#define PSC_STATE_FROM_RING(r) RING_TO_APPL((r), PSC_STATE, deadline_ring)
+
+/* psc_state_alloc - allocate session state from slab */
+
+static PSC_STATE *psc_state_alloc(void)
+{
+    PSC_STATE *slab;
+    RING   *ring;
+    int     n;
+
+    if (psc_state_free_list.succ == 0)
+	ring_init(&psc_state_free_list);
+    if ((ring = ring_succ(&psc_state_free_list)) == &psc_state_free_list) {
+	slab = (PSC_STATE *) mymalloc(PSC_STATE_SLAB_SIZE * sizeof(*slab));
+	for (n = 0; n < PSC_STATE_SLAB_SIZE; n++) {
+	    slab[n].send_buf = 0;
+	    slab[n].cmd_buffer = 0;
+	    ring_prepend(&psc_state_free_list, &slab[n].deadline_ring);
+	}
+	ring = ring_succ(&psc_state_free_list);
+    }
+    ring_detach(ring);
+    return (PSC_STATE_FROM_RING(ring));
+}
+
+/* psc_state_recycle - return session state to slab */
+
+static void psc_state_recycle(PSC_STATE *state)
+{
+#define PSC_RECYCLE_BUF(bp) do { \
+	if ((bp) != 0 && (bp)->vbuf.len > PSC_STATE_BUF_LIMIT) \
+	    (bp) = vstring_free(bp); \
+    } while (0)
+
+    PSC_RECYCLE_BUF(state->send_buf);
+    PSC_RECYCLE_BUF(state->cmd_buffer);
+    ring_prepend(&psc_state_free_list, &state->deadline_ring);
+}
+
+/* psc_endpt_copy - save endpoint string */
+
+static char *psc_endpt_copy(char *dst, size_t len, const char *src)
+{
+    if (strlen(src) >= len)
+	msg_panic("psc_endpt_copy: endpoint string too long: %.100s", src);
+    return (strcpy(dst, src));
+}
+
+#define PSC_ENDPT_COPY(dst, src) \
+	psc_endpt_copy((dst).buf, sizeof((dst).buf), (src))
+
 /* psc_new_session_state - fill in connection state for event processing */
 
 PSC_STATE *psc_new_session_state(VSTREAM *stream,
@@ -163,15 +271,20 @@ PSC_STATE *psc_new_session_state(VSTREAM *stream,
 {
     PSC_STATE *state;
 
-    state = (PSC_STATE *) mymalloc(sizeof(*state));
+    state = psc_state_alloc();
     if ((state->smtp_client_stream = stream) != 0)
 	psc_check_queue_length++;
     state->smtp_server_fd = (-1);
-    state->smtp_client_addr = mystrdup(client_addr);
-    state->smtp_client_port = mystrdup(client_port);
-    state->smtp_server_addr = mystrdup(server_addr);
-    state->smtp_server_port = mystrdup(server_port);
-    state->send_buf = vstring_alloc(100);
+    state->smtp_client_addr = PSC_ENDPT_COPY(state->client_addr_buf,
+					     client_addr);
+    state->smtp_client_port = PSC_ENDPT_COPY(state->client_port_buf,
+					     client_port);
+    state->smtp_server_addr = PSC_ENDPT_COPY(state->server_addr_buf,
+					     server_addr);
+    state->smtp_server_port = PSC_ENDPT_COPY(state->server_port_buf,
+					     server_port);
+    if (state->send_buf != 0)
+	VSTRING_RESET(state->send_buf);
     state->test_name = "TEST NAME HERE";
     state->dnsbl_reply = 0;
     state->final_reply = "421 4.3.2 Service currently unavailable\r\n";
@@ -185,6 +298,7 @@ PSC_STATE *psc_new_session_state(VSTREAM *stream,
     state->ehlo_discard_mask = 0;		/* XXX Should be ~0 */
     state->expand_buf = 0;
     state->where = PSC_SMTPD_CMD_CONNECT;
+    state->deadline_fn = 0;
 
     /*
      * Update the stress level.
@@ -239,23 +353,17 @@ void    psc_free_session_state(PSC_STATE *state)
     if (state->smtp_server_fd >= 0) {
 	PSC_DEL_SERVER_STATE(state);
     }
-    if (state->send_buf != 0)
-	state->send_buf = vstring_free(state->send_buf);
-    myfree(state->smtp_client_addr);
-    myfree(state->smtp_client_port);
-    myfree(state->smtp_server_addr);
-    myfree(state->smtp_server_port);
+    if (state->deadline_fn != 0)
+	psc_deadline_cancel(state, state->deadline_fn);
     if (state->dnsbl_reply)
 	vstring_free(state->dnsbl_reply);
     if (state->helo_name)
 	myfree(state->helo_name);
     if (state->sender)
 	myfree(state->sender);
-    if (state->cmd_buffer)
-	vstring_free(state->cmd_buffer);
     if (state->expand_buf)
 	vstring_free(state->expand_buf);
-    myfree((void *) state);
+    psc_state_recycle(state);
 
     if (psc_check_queue_length < 0 || psc_post_queue_length < 0)
 	msg_panic("bad queue length: check_queue=%d, post_queue=%d",
@@ -279,6 +387,7 @@ const char *psc_print_state_flags(int flags, const char *context)
     static const NAME_MASK flags_mask[] = {
 	"NOFORWARD", PSC_STATE_FLAG_NOFORWARD,
 	"USING_TLS", PSC_STATE_FLAG_USING_TLS,
+	"SHED_DROP", PSC_STATE_FLAG_SHED_DROP,
 	"NEW", PSC_STATE_FLAG_NEW,
 	"BLIST_FAIL", PSC_STATE_FLAG_BLIST_FAIL,
 	"HANGUP", PSC_STATE_FLAG_HANGUP,
@@ -315,3 +424,122 @@ const char *psc_print_state_flags(int flags, const char *context)
     return (str_name_mask_opt((VSTRING *) 0, context, flags_mask, flags,
 			      NAME_MASK_PIPE | NAME_MASK_NUMBER));
 }
+
+/* psc_deadline_event - run expired session deadlines */
+
+static void psc_deadline_event(int unused_event, void *unused_context)
+{
+    RING    due;
+    RING   *ring;
+    RING   *next;
+    RING   *slot;
+    PSC_STATE *state;
+    EVENT_NOTIFY_TIME_FN callback;
+    time_t  now = event_time();
+    time_t  when;
+
+    psc_deadline_tick = -1;
+    ring_init(&due);
+
+    /*
+     * Collect the zero-delay requests that were made before this call, and
+     * the deadlines that have expired, including those in slots that we
+     * skipped because the event loop was busy.
+     */
+    while ((ring = ring_succ(&psc_deadline_soon)) != &psc_deadline_soon) {
+	ring_detach(ring);
+	ring_prepend(&due, ring);
+    }
+    if (now - psc_deadline_last > PSC_DEADLINE_SLOTS)
+	psc_deadline_last = now - PSC_DEADLINE_SLOTS;
+    for (when = psc_deadline_last + 1; when <= now; when++) {
+	slot = psc_deadline_wheel + PSC_DEADLINE_SLOT(when);
+	for (ring = ring_succ(slot); ring != slot; ring = next) {
+	    next = ring_succ(ring);
+	    if (PSC_STATE_FROM_RING(ring)->deadline <= now) {
+		ring_detach(ring);
+		ring_prepend(&due, ring);
+	    }
+	}
+    }
+    if (now > psc_deadline_last)
+	psc_deadline_last = now;
+
+    /*
+     * A call-back may request or cancel other deadlines, including those
+     * that are still in the list of expired requests, and may destroy other
+     * sessions.
+     */
+    while ((ring = ring_succ(&due)) != &due) {
+	state = PSC_STATE_FROM_RING(ring);
+	ring_detach(ring);
+	callback = state->deadline_fn;
+	state->deadline_fn = 0;
+	psc_deadline_count--;
+	callback(EVENT_TIME, (void *) state);
+    }
+
+    /*
+     * Keep the wheel turning while there is work.
+     */
+    if (ring_succ(&psc_deadline_soon) != &psc_deadline_soon) {
+	event_request_timer(psc_deadline_event, (void *) 0, EVENT_NULL_DELAY);
+	psc_deadline_tick = EVENT_NULL_DELAY;
+    } else if (psc_deadline_count > 0 && psc_deadline_tick < 0) {
+	event_request_timer(psc_deadline_event, (void *) 0, 1);
+	psc_deadline_tick = 1;
+    }
+}
+
+/* psc_deadline_request - set or replace session deadline */
+
+void    psc_deadline_request(PSC_STATE *state, EVENT_NOTIFY_TIME_FN callback,
+			             int delay)
+{
+    const char *myname = "psc_deadline_request";
+    int     n;
+
+    if (delay < 0)
+	msg_panic("%s: invalid delay: %d", myname, delay);
+    if (psc_deadline_soon.succ == 0) {
+	for (n = 0; n < PSC_DEADLINE_SLOTS; n++)
+	    ring_init(psc_deadline_wheel + n);
+	ring_init(&psc_deadline_soon);
+	psc_deadline_last = event_time();
+    }
+    if (state->deadline_fn != 0)
+	ring_detach(&state->deadline_ring);
+    else
+	psc_deadline_count++;
+    state->deadline_fn = callback;
+    state->deadline = event_time() + delay;
+    if (delay == EVENT_NULL_DELAY) {
+	ring_prepend(&psc_deadline_soon, &state->deadline_ring);
+	if (psc_deadline_tick != EVENT_NULL_DELAY) {
+	    event_request_timer(psc_deadline_event, (void *) 0,
+				EVENT_NULL_DELAY);
+	    psc_deadline_tick = EVENT_NULL_DELAY;
+	}
+    } else {
+	ring_prepend(psc_deadline_wheel + PSC_DEADLINE_SLOT(state->deadline),
+		     &state->deadline_ring);
+	if (psc_deadline_tick < 0) {
+	    event_request_timer(psc_deadline_event, (void *) 0, 1);
+	    psc_deadline_tick = 1;
+	}
+    }
+    if (msg_verbose > 2)
+	msg_info("%s: [%s]:%s 0x%lx %d", myname, PSC_CLIENT_ADDR_PORT(state),
+		 (long) callback, delay);
+}
+
+/* psc_deadline_cancel - cancel session deadline */
+
+void    psc_deadline_cancel(PSC_STATE *state, EVENT_NOTIFY_TIME_FN callback)
+{
+    if (state->deadline_fn != 0 && state->deadline_fn == callback) {
+	ring_detach(&state->deadline_ring);
+	state->deadline_fn = 0;
+	psc_deadline_count--;
+    }
+}
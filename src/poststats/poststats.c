@@ -0,0 +1,205 @@
+/*++
+/* NAME
+/*	poststats 1
+/* SUMMARY
+/*	Postfix performance counter report
+/* SYNOPSIS
+/* .fi
+/*	\fBpoststats\fR [\fB-pv\fR] [\fB-c \fIconfig_dir\fR]
+/* DESCRIPTION
+/*	The \fBpoststats\fR(1) command reports the performance
+/*	counters that Postfix daemon processes maintain in the
+/*	shared counter segment of the \fBmaster\fR(8) daemon. The
+/*	counters of all processes that run the same \fBmaster.cf\fR
+/*	service are added up, including processes that have
+/*	terminated since the mail system was started.
+/*	The command "\fBpostfix stats\fR" runs this program.
+/*
+/*	The default output has one line per service and metric:
+/*	the service name, the metric name, and the value. For a
+/*	histogram, the value is replaced with the number of
+/*	observations (\fBcount=\fR), their sum (\fBsum=\fR), and
+/*	upper bounds for the 50th, 90th and 99th percentiles.
+/*	Histogram buckets are powers of two.
+/*
+/*	This command must be run by the super-user.
+/*
+/*	Options:
+/* .IP "\fB-c\fR \fIconfig_dir\fR"
+/*	Read the \fBmain.cf\fR configuration file in the named directory
+/*	instead of the default configuration directory.
+/* .IP \fB-p\fR
+/*	Produce output in the Prometheus text exposition format.
+/*	Metric names get a "postfix_" prefix, and the service name
+/*	becomes a "service" label.
+/* .IP \fB-v\fR
+/*	Enable verbose logging for debugging purposes. Multiple \fB-v\fR
+/*	options make the software increasingly verbose.
+/* DIAGNOSTICS
+/*	Problems are reported to the standard error stream. The
+/*	exit status is non-zero when the counter segment does not
+/*	exist.
+/* ENVIRONMENT
+/* .ad
+/* .fi
+/* .IP \fBMAIL_CONFIG\fR
+/*	Directory with Postfix configuration files.
+/* .IP \fBMAIL_VERBOSE\fR
+/*	Enable verbose logging for debugging purposes.
+/* CONFIGURATION PARAMETERS
+/* .ad
+/* .fi
+/*	The following \fBmain.cf\fR parameters are especially relevant to
+/*	this program.
+/*	The text below provides only a parameter summary. See
+/*	\fBpostconf\fR(5) for more details including examples.
+/* .IP "\fBconfig_directory (see 'postconf -d' output)\fR"
+/*	The default location of the Postfix main.cf and master.cf
+/*	configuration files.
+/* .IP "\fBimport_environment (see 'postconf -d' output)\fR"
+/*	The list of environment parameters that a privileged Postfix
+/*	process will import from a non-Postfix parent process, or name=value
+/*	environment overrides.
+/* .IP "\fBqueue_directory (see 'postconf -d' output)\fR"
+/*	The location of the Postfix top-level queue directory.
+/* .IP "\fBstats_process_limit (1000)\fR"
+/*	The maximal number of Postfix daemon processes that can
+/*	maintain performance counters.
+/* FILES
+/*	/var/spool/postfix/pid/master.stats, counter segment
+/* SEE ALSO
+/*	master(8), Postfix master daemon
+/*	poststatsd(8), Prometheus counter exporter
+/*	postconf(5), configuration parameters
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* HISTORY
+/*	This command was introduced with Postfix version 3.5.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <vstream.h>
+#include <msg_vstream.h>
+#include <safe.h>
+#include <clean_env.h>
+#include <stats.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <mail_version.h>
+#include <mail_conf.h>
+#include <mail_parm_split.h>
+#include <mail_stats.h>
+
+static NORETURN usage(char *myname)
+{
+    msg_fatal("usage: %s [-c config_dir] [-pv]", myname);
+}
+
+MAIL_VERSION_STAMP_DECLARE;
+
+int     main(int argc, char **argv)
+{
+    STATS_SEG *seg;
+    int     flags = MAIL_STATS_FLAG_NONE;
+    int     fd;
+    struct stat st;
+    char   *slash;
+    int     c;
+    ARGV   *import_env;
+
+    /*
+     * Fingerprint executables and core dumps.
+     */
+    MAIL_VERSION_STAMP_ALLOCATE;
+
+    /*
+     * To minimize confusion, make sure that the standard file descriptors
+     * are open before opening anything else. XXX Work around for 44BSD where
+     * fstat can return EBADF on an open file descriptor.
+     */
+    for (fd = 0; fd < 3; fd++)
+	if (fstat(fd, &st) == -1
+	    && (close(fd), open("/dev/null", O_RDWR, 0)) != fd)
+	    msg_fatal("open /dev/null: %m");
+
+    /*
+     * Process environment options as early as we can.
+     */
+    if (safe_getenv(CONF_ENV_VERB))
+	msg_verbose = 1;
+
+    /*
+     * Initialize. Set up logging. Read the global configuration file after
+     * parsing command-line arguments.
+     */
+    if ((slash = strrchr(argv[0], '/')) != 0 && slash[1])
+	argv[0] = slash + 1;
+    msg_vstream_init(argv[0], VSTREAM_ERR);
+    set_mail_conf_str(VAR_PROCNAME, var_procname = mystrdup(argv[0]));
+
+    /*
+     * Parse JCL.
+     */
+    while ((c = GETOPT(argc, argv, "c:pv")) > 0) {
+	switch (c) {
+	default:
+	    usage(argv[0]);
+	case 'c':
+	    if (setenv(CONF_ENV_PATH, optarg, 1) < 0)
+		msg_fatal("out of memory");
+	    break;
+	case 'p':
+	    flags |= MAIL_STATS_FLAG_PROMETHEUS;
+	    break;
+	case 'v':
+	    msg_verbose++;
+	    break;
+	}
+    }
+    if (argc != optind)
+	usage(argv[0]);
+
+    /*
+     * Finish initializations.
+     */
+    mail_conf_read();
+    /* Enforce consistent operation of different Postfix parts. */
+    import_env = mail_parm_split(VAR_IMPORT_ENVIRON, var_import_environ);
+    update_env(import_env->argv);
+    argv_free(import_env);
+
+    /*
+     * Report the counters.
+     */
+    if ((seg = stats_seg_open(mail_stats_path(), O_RDONLY)) == 0) {
+	msg_warn("open %s: %m - perhaps the mail system is down,"
+		 " or %s is zero", mail_stats_path(), VAR_STATS_SLOTS);
+	exit(1);
+    }
+    mail_stats_print(VSTREAM_OUT, seg, flags);
+    stats_seg_free(seg);
+    if (vstream_fflush(VSTREAM_OUT))
+	msg_fatal("write error: %m");
+    exit(0);
+}
@@ -0,0 +1,227 @@
+/*++
+/* NAME
+/*	poststatsd 8
+/* SUMMARY
+/*	Postfix Prometheus counter exporter
+/* SYNOPSIS
+/*	\fBpoststatsd\fR [generic Postfix daemon options]
+/* DESCRIPTION
+/*	The \fBpoststatsd\fR(8) server answers HTTP GET requests
+/*	for "/metrics" (or "/") with the Postfix performance counters
+/*	in the Prometheus text exposition format, as produced with
+/*	"\fBpoststats -p\fR". The program expects to be run from the
+/*	\fBmaster\fR(8) process manager, with a \fBmaster.cf\fR entry
+/*	such as:
+/*
+/* .nf
+/*	    127.0.0.1:9154 inet n - n - 1 poststatsd
+/* .fi
+/*
+/*	The server implements only the part of HTTP/1.0 that a
+/*	metrics scraper needs. It ignores request headers, and
+/*	closes the connection after each response.
+/* SECURITY
+/* .ad
+/* .fi
+/*	The \fBpoststatsd\fR(8) server is not security-sensitive.
+/*	It maps the counter segment read-only before it drops
+/*	privileges, and may run chrooted at fixed low privilege.
+/*	The counters reveal information about mail traffic; the
+/*	service should listen on a loopback or otherwise protected
+/*	address only.
+/* DIAGNOSTICS
+/*	Problems and transactions are logged to \fBsyslogd\fR(8)
+/*	or \fBpostlogd\fR(8).
+/* CONFIGURATION PARAMETERS
+/* .ad
+/* .fi
+/*	Changes to \fBmain.cf\fR are picked up automatically, as
+/*	\fBpoststatsd\fR(8) processes run for only a limited amount
+/*	of time. Use the command "\fBpostfix reload\fR" to speed up
+/*	a change.
+/*
+/*	The text below provides only a parameter summary. See
+/*	\fBpostconf\fR(5) for more details including examples.
+/* .IP "\fBconfig_directory (see 'postconf -d' output)\fR"
+/*	The default location of the Postfix main.cf and master.cf
+/*	configuration files.
+/* .IP "\fBdaemon_timeout (18000s)\fR"
+/*	How much time a Postfix daemon process may take to handle a
+/*	request before it is terminated by a built-in watchdog timer.
+/* .IP "\fBmax_idle (100s)\fR"
+/*	The maximum amount of time that an idle Postfix daemon process waits
+/*	for an incoming connection before terminating voluntarily.
+/* .IP "\fBmax_use (100)\fR"
+/*	The maximal number of incoming connections that a Postfix daemon
+/*	process will service before terminating voluntarily.
+/* .IP "\fBprocess_id (read-only)\fR"
+/*	The process ID of a Postfix command or daemon process.
+/* .IP "\fBprocess_name (read-only)\fR"
+/*	The process name of a Postfix command or daemon process.
+/* .IP "\fBqueue_directory (see 'postconf -d' output)\fR"
+/*	The location of the Postfix top-level queue directory.
+/* .IP "\fBstats_process_limit (1000)\fR"
+/*	The maximal number of Postfix daemon processes that can
+/*	maintain performance counters.
+/* .IP "\fBsyslog_facility (mail)\fR"
+/*	The syslog facility of Postfix logging.
+/* .IP "\fBsyslog_name (see 'postconf -d' output)\fR"
+/*	A prefix that is prepended to the process name in syslog
+/*	records, so that, for example, "smtpd" becomes "prefix/smtpd".
+/* SEE ALSO
+/*	poststats(1), Postfix performance counter report
+/*	postconf(5), configuration parameters
+/*	master(5), generic daemon options
+/*	master(8), process manager
+/*	postlogd(8), Postfix logging
+/*	syslogd(8), system logging
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* HISTORY
+/* .ad
+/* .fi
+/*	The poststatsd service was introduced with Postfix version 3.5.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <fcntl.h>
+#include <string.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <stats.h>
+#include <stringops.h>
+#include <vstream.h>
+#include <vstring.h>
+#include <vstring_vstream.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <mail_stats.h>
+#include <mail_version.h>
+
+/* Single-threaded server skeleton. */
+
+#include <mail_server.h>
+
+ /*
+  * A scraper either sends its request quickly, or not at all.
+  */
+#define POSTSTATSD_TIMEOUT	10
+#define POSTSTATSD_LINE_LIMIT	1024
+#define POSTSTATSD_HDR_LIMIT	100
+
+static STATS_SEG *poststatsd_seg;
+
+#define STR(x)	vstring_str(x)
+
+/* poststatsd_reply - send response header */
+
+static void poststatsd_reply(VSTREAM *client, const char *status)
+{
+    vstream_fprintf(client, "HTTP/1.0 %s\r\n"
+		    "Content-Type: text/plain; version=0.0.4\r\n"
+		    "Connection: close\r\n"
+		    "\r\n", status);
+}
+
+/* poststatsd_service - serve one HTTP request */
+
+static void poststatsd_service(VSTREAM *client, char *unused_service,
+			               char **argv)
+{
+    VSTRING *request = vstring_alloc(100);
+    VSTRING *header = vstring_alloc(100);
+    char   *cp;
+    char   *method;
+    char   *path;
+    int     count;
+
+    /*
+     * Sanity check. This service takes no command-line arguments.
+     */
+    if (argv[0])
+	msg_fatal("unexpected command-line argument: %s", argv[0]);
+
+    vstream_control(client,
+		    CA_VSTREAM_CTL_PATH("client"),
+		    CA_VSTREAM_CTL_TIMEOUT(POSTSTATSD_TIMEOUT),
+		    CA_VSTREAM_CTL_END);
+
+    /*
+     * Read the request line, and skip the request headers.
+     */
+    if (vstring_get_nonl_bound(request, client, POSTSTATSD_LINE_LIMIT)
+	== VSTREAM_EOF) {
+	vstring_free(request);
+	vstring_free(header);
+	return;
+    }
+    for (count = 0; count < POSTSTATSD_HDR_LIMIT; count++)
+	if (vstring_get_nonl_bound(header, client, POSTSTATSD_LINE_LIMIT)
+	    == VSTREAM_EOF || VSTRING_LEN(header) == 0
+	    || strcmp(STR(header), "\r") == 0)
+	    break;
+
+    /*
+     * Serve the counters.
+     */
+    cp = STR(request);
+    if ((method = mystrtok(&cp, " ")) == 0
+	|| (path = mystrtok(&cp, " ")) == 0) {
+	poststatsd_reply(client, "400 Bad Request");
+    } else if (strcmp(method, "GET") != 0) {
+	poststatsd_reply(client, "405 Method Not Allowed");
+    } else if (strcmp(path, "/metrics") != 0 && strcmp(path, "/") != 0) {
+	poststatsd_reply(client, "404 Not Found");
+    } else if (poststatsd_seg == 0) {
+	poststatsd_reply(client, "503 Service Unavailable");
+    } else {
+	poststatsd_reply(client, "200 OK");
+	mail_stats_print(client, poststatsd_seg, MAIL_STATS_FLAG_PROMETHEUS);
+    }
+    if (vstream_fflush(client) != 0 && msg_verbose)
+	msg_info("write client: %m");
+    vstring_free(request);
+    vstring_free(header);
+}
+
+/* pre_jail_init - pre-jail initialization */
+
+static void pre_jail_init(char *unused_name, char **unused_argv)
+{
+    if ((poststatsd_seg = stats_seg_open(mail_stats_path(), O_RDONLY)) == 0)
+	msg_warn("open %s: %m -- is %s zero?",
+		 mail_stats_path(), VAR_STATS_SLOTS);
+}
+
+MAIL_VERSION_STAMP_DECLARE;
+
+/* main - the main program */
+
+int     main(int argc, char **argv)
+{
+
+    /*
+     * Fingerprint executables and core dumps.
+     */
+    MAIL_VERSION_STAMP_ALLOCATE;
+
+    /*
+     * Pass control to the single-threaded service skeleton.
+     */
+    single_server_main(argc, argv, poststatsd_service,
+		       CA_MAIL_SERVER_PRE_INIT(pre_jail_init),
+		       0);
+}
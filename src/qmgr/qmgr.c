@@ -453,6 +453,7 @@
 #include <events.h>
 #include <vstream.h>
 #include <dict.h>
+#include <stats.h>
 
 /* Global library. */
 
@@ -516,6 +517,13 @@ int     var_vrfy_pend_limit;
 
 static QMGR_SCAN *qmgr_scans[2];
 
+ /*
+  * Performance counters.
+  */
+STATS_CELL *qmgr_stats_requests;
+static STATS_CELL *qmgr_stats_messages;
+static STATS_CELL *qmgr_stats_recipients;
+
 #define QMGR_SCAN_IDX_INCOMING 0
 #define QMGR_SCAN_IDX_DEFERRED 1
 #define QMGR_SCAN_IDX_COUNT (sizeof(qmgr_scans) / sizeof(qmgr_scans[0]))
@@ -667,6 +675,8 @@ static int qmgr_loop(char *unused_name, char **unused_argv)
 	    mail_flow_get(token_count - var_proc_limit);
 	}
     }
+    STATS_SET(qmgr_stats_messages, qmgr_message_count);
+    STATS_SET(qmgr_stats_recipients, qmgr_recipient_count);
     return (delay);
 }
 
@@ -740,6 +750,13 @@ static void qmgr_post_init(char *name, char **unused_argv)
     qmgr_scans[QMGR_SCAN_IDX_DEFERRED] = qmgr_scan_create(MAIL_QUEUE_DEFERRED);
     qmgr_scan_request(qmgr_scans[QMGR_SCAN_IDX_INCOMING], QMGR_SCAN_START);
     qmgr_deferred_run_event(0, (void *) 0);
+
+    /*
+     * Performance counters. See "postfix stats".
+     */
+    qmgr_stats_requests = stats_counter("qmgr_delivery_requests_total");
+    qmgr_stats_messages = stats_gauge("qmgr_active_messages");
+    qmgr_stats_recipients = stats_gauge("qmgr_active_recipients");
 }
 
 MAIL_VERSION_STAMP_DECLARE;
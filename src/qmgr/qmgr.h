@@ -19,6 +19,7 @@
   */
 #include <vstream.h>
 #include <scan_dir.h>
+#include <stats.h>
 
  /*
   * Global library.
@@ -382,6 +383,11 @@ extern int qmgr_message_count;
 extern int qmgr_recipient_count;
 extern int qmgr_vrfy_pend_count;
 
+ /*
+  * qmgr.c, performance counters.
+  */
+extern STATS_CELL *qmgr_stats_requests;
+
 extern void qmgr_message_free(QMGR_MESSAGE *);
 extern void qmgr_message_update_warn(QMGR_MESSAGE *);
 extern void qmgr_message_kill_record(QMGR_MESSAGE *, long);
@@ -30,6 +30,16 @@
 /*	pointer if the transport accepts no connection. Upon completion
 /*	of delivery (successful or not), the stream is closed, so that the
 /*	delivery process is released.
+/*
+/*	As of Postfix 3.5, a delivery process that announces support
+/*	in its initial status report may indicate in its final status
+/*	report that it is willing to handle another delivery request
+/*	over the same stream. If the transport is
+/*	still available, the queue manager then selects a new queue
+/*	entry and sends it over the same stream, instead of closing
+/*	the stream and waiting for the master to hand out another
+/*	delivery process. The new entry is chosen with the normal
+/*	scheduling algorithm and need not be for the same destination.
 /* DIAGNOSTICS
 /* LICENSE
 /* .ad
@@ -106,16 +116,22 @@ int     qmgr_deliver_concurrency;
 
 /* qmgr_deliver_initial_reply - retrieve initial delivery process response */
 
-static int qmgr_deliver_initial_reply(VSTREAM *stream)
+static int qmgr_deliver_initial_reply(VSTREAM *stream, int *more)
 {
     int     stat;
 
+    /*
+     * The "more" attribute is optional; only delivery agents that can
+     * handle more than one request per connection send it.
+     */
+    *more = 0;
     if (peekfd(vstream_fileno(stream)) < 0) {
 	msg_warn("%s: premature disconnect", VSTREAM_PATH(stream));
 	return (DELIVER_STAT_CRASH);
-    } else if (attr_scan(stream, ATTR_FLAG_STRICT,
+    } else if (attr_scan(stream, ATTR_FLAG_EXTRA,
 			 RECV_ATTR_INT(MAIL_ATTR_STATUS, &stat),
-			 ATTR_TYPE_END) != 1) {
+			 RECV_ATTR_INT(MAIL_ATTR_MORE, more),
+			 ATTR_TYPE_END) < 1) {
 	msg_warn("%s: malformed response", VSTREAM_PATH(stream));
 	return (DELIVER_STAT_CRASH);
     } else {
@@ -125,17 +141,23 @@ static int qmgr_deliver_initial_reply(VSTREAM *stream)
 
 /* qmgr_deliver_final_reply - retrieve final delivery process response */
 
-static int qmgr_deliver_final_reply(VSTREAM *stream, DSN_BUF *dsb)
+static int qmgr_deliver_final_reply(VSTREAM *stream, DSN_BUF *dsb,
+				            int *more)
 {
     int     stat;
 
+    /*
+     * The "more" attribute is optional; older delivery agents don't send it.
+     */
+    *more = 0;
     if (peekfd(vstream_fileno(stream)) < 0) {
 	msg_warn("%s: premature disconnect", VSTREAM_PATH(stream));
 	return (DELIVER_STAT_CRASH);
-    } else if (attr_scan(stream, ATTR_FLAG_STRICT,
+    } else if (attr_scan(stream, ATTR_FLAG_EXTRA,
 			 RECV_ATTR_FUNC(dsb_scan, (void *) dsb),
 			 RECV_ATTR_INT(MAIL_ATTR_STATUS, &stat),
-			 ATTR_TYPE_END) != 2) {
+			 RECV_ATTR_INT(MAIL_ATTR_MORE, more),
+			 ATTR_TYPE_END) < 2) {
 	msg_warn("%s: malformed response", VSTREAM_PATH(stream));
 	return (DELIVER_STAT_CRASH);
     } else {
@@ -145,7 +167,8 @@ static int qmgr_deliver_final_reply(VSTREAM *stream, DSN_BUF *dsb)
 
 /* qmgr_deliver_send_request - send delivery request to delivery process */
 
-static int qmgr_deliver_send_request(QMGR_ENTRY *entry, VSTREAM *stream)
+static int qmgr_deliver_send_request(QMGR_ENTRY *entry, VSTREAM *stream,
+				             int more)
 {
     RECIPIENT_LIST list = entry->rcpt_list;
     RECIPIENT *recipient;
@@ -184,6 +207,7 @@ static int qmgr_deliver_send_request(QMGR_ENTRY *entry, VSTREAM *stream)
 
     flags = message->tflags
 	| entry->queue->dflags
+	| (more ? DEL_REQ_FLAG_MORE : 0)
 	| (message->inspect_xport ? DEL_REQ_FLAG_BOUNCE : DEL_REQ_FLAG_DEFLT);
     (void) QMGR_MSG_STATS(&stats, message);
     attr_print(stream, ATTR_FLAG_NONE,
@@ -243,6 +267,8 @@ static void qmgr_deliver_abort(int unused_event, void *context)
 	      message->queue_id, transport->name);
 }
 
+static void qmgr_deliver_request(QMGR_TRANSPORT *, VSTREAM *, int);
+
 /* qmgr_deliver_update - process delivery status report */
 
 static void qmgr_deliver_update(int unused_event, void *context)
@@ -253,6 +279,8 @@ static void qmgr_deliver_update(int unused_event, void *context)
     QMGR_MESSAGE *message = entry->message;
     static DSN_BUF *dsb;
     int     status;
+    int     more;
+    VSTREAM *stream;
 
     /*
      * Release the delivery agent from a "hot" queue entry.
@@ -279,7 +307,7 @@ static void qmgr_deliver_update(int unused_event, void *context)
      * manager can log why it does not even try to schedule delivery to the
      * affected recipients.
      */
-    status = qmgr_deliver_final_reply(entry->stream, dsb);
+    status = qmgr_deliver_final_reply(entry->stream, dsb, &more);
 
     /*
      * The mail delivery process failed for some reason (although delivery
@@ -365,47 +393,47 @@ static void qmgr_deliver_update(int unused_event, void *context)
 	    qmgr_queue_unthrottle(queue);
     }
 
+    /*
+     * If the delivery process asks for more work, detach it from this queue
+     * entry without closing the stream, so that we can hand it another entry
+     * below. Don't do this when the transport is throttled, or when each
+     * delivery must wait for the transport rate delay: those cases must go
+     * through the transport allocation machinery.
+     */
+    if (more && !QMGR_TRANSPORT_THROTTLED(transport)
+	&& transport->xport_rate_delay <= 0) {
+	stream = entry->stream;
+	event_disable_readwrite(vstream_fileno(stream));
+	entry->stream = 0;
+	qmgr_deliver_concurrency--;
+    } else {
+	stream = 0;
+	QMGR_DELIVER_RELEASE_AGENT(entry);
+    }
+
     /*
      * Release the delivery process, and give some other queue entry a chance
      * to be delivered. When all recipients for a message have been tried,
      * decide what to do next with this message: defer, bounce, delete.
      */
-    QMGR_DELIVER_RELEASE_AGENT(entry);
     qmgr_entry_done(entry, QMGR_QUEUE_BUSY);
+
+    /*
+     * Reuse the delivery process for the next suitable queue entry, if any.
+     * The entry and its queue may be gone by now, but the transport is not.
+     */
+    if (stream != 0)
+	qmgr_deliver_request(transport, stream, 1);
 }
 
-/* qmgr_deliver - deliver one per-site queue entry */
+/* qmgr_deliver_request - send delivery request to available process */
 
-void    qmgr_deliver(QMGR_TRANSPORT *transport, VSTREAM *stream)
+static void qmgr_deliver_request(QMGR_TRANSPORT *transport, VSTREAM *stream,
+				         int more)
 {
     QMGR_ENTRY *entry;
     DSN     dsn;
 
-    /*
-     * Find out if this delivery process is really available. Once elected,
-     * the delivery process is supposed to express its happiness. If there is
-     * a problem, wipe the pending deliveries for this transport. This
-     * routine runs in response to an external event, so it does not run
-     * while some other queue manipulation is happening.
-     */
-    if (stream == 0 || qmgr_deliver_initial_reply(stream) != 0) {
-#if 0
-	whatsup = concatenate(transport->name,
-			      " mail transport unavailable", (char *) 0);
-	qmgr_transport_throttle(transport,
-				DSN_SIMPLE(&dsn, "4.3.0", whatsup));
-	myfree(whatsup);
-#else
-	qmgr_transport_throttle(transport,
-				DSN_SIMPLE(&dsn, "4.3.0",
-					   "mail transport unavailable"));
-#endif
-	qmgr_defer_transport(transport, &dsn);
-	if (stream)
-	    (void) vstream_fclose(stream);
-	return;
-    }
-
     /*
      * Find a suitable queue entry. Things may have changed since this
      * transport was allocated. If no suitable entry is found,
@@ -424,7 +452,7 @@ void    qmgr_deliver(QMGR_TRANSPORT *transport, VSTREAM *stream)
      * This routine runs in response to an external event, so it does not run
      * while some other queue manipulation is happening.
      */
-    if (qmgr_deliver_send_request(entry, stream) < 0) {
+    if (qmgr_deliver_send_request(entry, stream, more) < 0) {
 	qmgr_entry_unselect(entry);
 #if 0
 	whatsup = concatenate(transport->name,
@@ -446,6 +474,7 @@ void    qmgr_deliver(QMGR_TRANSPORT *transport, VSTREAM *stream)
     /*
      * If we get this far, go wait for the delivery status report.
      */
+    STATS_INC(qmgr_stats_requests);
     qmgr_deliver_concurrency++;
     entry->stream = stream;
     event_enable_read(vstream_fileno(stream),
@@ -456,3 +485,43 @@ void    qmgr_deliver(QMGR_TRANSPORT *transport, VSTREAM *stream)
      */
     event_request_timer(qmgr_deliver_abort, (void *) entry, var_daemon_timeout);
 }
+
+/* qmgr_deliver - deliver one per-site queue entry */
+
+void    qmgr_deliver(QMGR_TRANSPORT *transport, VSTREAM *stream)
+{
+    DSN     dsn;
+    int     more;
+
+    /*
+     * Find out if this delivery process is really available. Once elected,
+     * the delivery process is supposed to express its happiness. If there is
+     * a problem, wipe the pending deliveries for this transport. This
+     * routine runs in response to an external event, so it does not run
+     * while some other queue manipulation is happening.
+     */
+    if (stream == 0 || qmgr_deliver_initial_reply(stream, &more) != 0) {
+#if 0
+	whatsup = concatenate(transport->name,
+			      " mail transport unavailable", (char *) 0);
+	qmgr_transport_throttle(transport,
+				DSN_SIMPLE(&dsn, "4.3.0", whatsup));
+	myfree(whatsup);
+#else
+	qmgr_transport_throttle(transport,
+				DSN_SIMPLE(&dsn, "4.3.0",
+					   "mail transport unavailable"));
+#endif
+	qmgr_defer_transport(transport, &dsn);
+	if (stream)
+	    (void) vstream_fclose(stream);
+	return;
+    }
+
+    /*
+     * Hand the delivery process a suitable queue entry. Ask for a final
+     * report with "more" only if the delivery process announced that it
+     * supports this.
+     */
+    qmgr_deliver_request(transport, stream, more);
+}
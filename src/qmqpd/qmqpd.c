@@ -12,6 +12,12 @@
 /*	single queue file.  The program expects to be run from the
 /*	\fBmaster\fR(8) process manager.
 /*
+/*	As a non-standard extension, the server can receive multiple
+/*	messages per connection. After replying to a message, the
+/*	server then waits for the next QMQP packet until the client
+/*	closes the connection. The client may send the next packet
+/*	before it has received the reply for the previous one.
+/*
 /*	The QMQP server implements one access policy: only explicitly
 /*	authorized client hosts are allowed to use the service.
 /* SECURITY
@@ -33,6 +39,11 @@
 /*	netstring component is longer than acceptable, Postfix replies
 /*	immediately and closes the connection. It is left up to the
 /*	client to handle the situation.
+/*
+/*	The QMQP protocol sends the message content before the
+/*	envelope, while Postfix needs the envelope first. Message
+/*	content that does not fit in memory is therefore spooled
+/*	to a temporary file.
 /* CONFIGURATION PARAMETERS
 /* .ad
 /* .fi
@@ -80,6 +91,14 @@
 /*	The maximal size in bytes of a message, including envelope information.
 /* .IP "\fBqmqpd_timeout (300s)\fR"
 /*	The time limit for sending or receiving information over the network.
+/* .PP
+/*	Available in Postfix version 3.5 and later:
+/* .IP "\fBqmqpd_content_memory_limit (1048576)\fR"
+/*	The maximal size in bytes of QMQP message content that the Postfix
+/*	QMQP server keeps in memory; larger content is spooled to a
+/*	temporary file in $data_directory.
+/* .IP "\fBqmqpd_multi_message_enable (no)\fR"
+/*	Allow a QMQP client to send multiple messages over one connection.
 /* TROUBLE SHOOTING CONTROLS
 /* .ad
 /* .fi
@@ -185,6 +204,7 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <fcntl.h>
 
 /* Utility library. */
 
@@ -195,6 +215,8 @@
 #include <netstring.h>
 #include <dict.h>
 #include <inet_proto.h>
+#include <watchdog.h>
+#include <iostuff.h>
 
 /* Global library. */
 
@@ -236,6 +258,8 @@ char   *var_filter_xport;
 char   *var_qmqpd_clients;
 char   *var_input_transp;
 bool    var_qmqpd_client_port_log;
+int     var_qmqpd_mem_limit;
+bool    var_qmqpd_multi_msg;
 
  /*
   * Silly little macros.
@@ -258,6 +282,12 @@ static NAMADR_LIST *qmqpd_clients;
   */
 int     qmqpd_input_transp_mask;
 
+ /*
+  * Spool for message content that is too large to keep in memory. This is
+  * created before entering the chroot jail, and is unlinked immediately.
+  */
+static VSTREAM *qmqpd_spool;
+
 /* qmqpd_open_file - open a queue file */
 
 static void qmqpd_open_file(QMQPD_STATE *state)
@@ -296,8 +326,54 @@ static void qmqpd_open_file(QMQPD_STATE *state)
 
 static void qmqpd_read_content(QMQPD_STATE *state)
 {
+    ssize_t len;
+    ssize_t count;
+
+    /*
+     * Small content is kept in memory. Larger content is copied to the
+     * spool file in chunks, so that memory usage stays bounded no matter
+     * how large the message is. Either way, the content is read back later
+     * through a stream.
+     */
     state->where = "receiving message content";
-    netstring_get(state->client, state->message, var_message_limit);
+    len = netstring_get_length(state->client);
+    if (var_message_limit > 0 && len > var_message_limit)
+	netstring_except(state->client, NETSTRING_ERR_SIZE);
+    if (qmqpd_spool == 0 || len <= var_qmqpd_mem_limit) {
+	netstring_get_data(state->client, state->message, len);
+	state->content = vstream_memopen(state->message, O_RDONLY);
+	return;
+    }
+    if (vstream_fseek(qmqpd_spool, (off_t) 0, SEEK_SET) < 0
+	|| ftruncate(vstream_fileno(qmqpd_spool), (off_t) 0) < 0)
+	msg_fatal("reset content spool file: %m");
+    for ( /* void */ ; len > 0; len -= count) {
+	count = (len > VSTREAM_BUFSIZE ? VSTREAM_BUFSIZE : len);
+	if (vstream_fread_buf(state->client, state->message, count) != count)
+	    netstring_except(state->client, vstream_ftimeout(state->client) ?
+			     NETSTRING_ERR_TIME : NETSTRING_ERR_EOF);
+	if (state->err == CLEANUP_STAT_OK
+	    && vstream_fwrite(qmqpd_spool, STR(state->message), count) != count) {
+	    msg_warn("%s: write content spool file: %m", state->queue_id);
+	    state->err = CLEANUP_STAT_WRITE;
+	}
+    }
+    netstring_get_terminator(state->client);
+    if (state->err == CLEANUP_STAT_OK
+	&& vstream_fseek(qmqpd_spool, (off_t) 0, SEEK_SET) < 0) {
+	msg_warn("%s: write content spool file: %m", state->queue_id);
+	state->err = CLEANUP_STAT_WRITE;
+    }
+    state->content = qmqpd_spool;
+}
+
+/* qmqpd_close_content - finish with message content */
+
+static void qmqpd_close_content(QMQPD_STATE *state)
+{
+    if (state->content != qmqpd_spool)
+	(void) vstream_fclose(state->content);
+    state->content = 0;
 }
 
 /* qmqpd_copy_sender - copy envelope sender */
@@ -414,28 +490,31 @@ static void qmqpd_copy_recipients(QMQPD_STATE *state)
     }
 }
 
-/* qmqpd_next_line - get line from buffer, return last char, newline, or -1 */
+/* qmqpd_next_line - get line from content, return last char, newline, or -1 */
 
-static int qmqpd_next_line(VSTRING *message, char **start, int *len,
-			           char **next)
+static int qmqpd_next_line(VSTREAM *content, VSTRING *line)
 {
-    char   *beyond = STR(message) + LEN(message);
-    char   *enough = *next + var_line_limit;
-    char   *cp;
+    int     ch;
 
     /*
-     * Stop at newline or at some limit. Don't look beyond the end of the
-     * buffer.
+     * Stop at newline or at some limit. The newline is not stored.
      */
-#define UCHARPTR(x) ((unsigned char *) (x))
-
-    for (cp = *start = *next; /* void */ ; cp++) {
-	if (cp >= beyond)
-	    return ((*len = (*next = cp) - *start) > 0 ? UCHARPTR(cp)[-1] : -1);
-	if (*cp == '\n')
-	    return ((*len = cp - *start), (*next = cp + 1), '\n');
-	if (cp >= enough)
-	    return ((*len = cp - *start), (*next = cp), UCHARPTR(cp)[-1]);
+    VSTRING_RESET(line);
+    for (;;) {
+	if ((ch = VSTREAM_GETC(content)) == VSTREAM_EOF) {
+	    VSTRING_TERMINATE(line);
+	    return (LEN(line) > 0 ? vstring_end(line)[-1] & 0xff : -1);
+	}
+	if (ch == '\n') {
+	    VSTRING_TERMINATE(line);
+	    return ('\n');
+	}
+	if (LEN(line) >= var_line_limit) {
+	    vstream_ungetc(content, ch);
+	    VSTRING_TERMINATE(line);
+	    return (vstring_end(line)[-1] & 0xff);
+	}
+	VSTRING_ADDCH(line, ch);
     }
 }
 
@@ -444,7 +523,6 @@ static int qmqpd_next_line(VSTRING *message, char **start, int *len,
 static void qmqpd_write_content(QMQPD_STATE *state)
 {
     char   *start;
-    char   *next;
     int     len;
     int     rec_type;
     int     first = 1;
@@ -492,9 +570,11 @@ static void qmqpd_write_content(QMQPD_STATE *state)
      * XXX Deal with UNIX-style From_ lines at the start of message content just
      * in case.
      */
-    for (next = STR(state->message); /* void */ ; /* void */ ) {
-	if ((ch = qmqpd_next_line(state->message, &start, &len, &next)) < 0)
+    for (;;) {
+	if ((ch = qmqpd_next_line(state->content, state->buf)) < 0)
 	    break;
+	start = STR(state->buf);
+	len = LEN(state->buf);
 	if (ch == '\n')
 	    rec_type = REC_TYPE_NORM;
 	else
@@ -630,13 +710,13 @@ static void qmqpd_receive(QMQPD_STATE *state)
     (void) netstring_get_length(state->client);
 
     /*
-     * XXX Read the message content into memory, because Postfix expects to
-     * store the sender before storing the message content. Fixing that
-     * requires changes to pickup, cleanup, qmgr, and perhaps elsewhere, so
-     * that will have to happen later when I have more time. However, QMQP is
-     * used for mailing list distribution, so the bulk of the volume is
-     * expected to be not message content but recipients, and recipients are
-     * not accumulated in memory.
+     * XXX Read the message content into memory or into the spool file,
+     * because Postfix expects to store the sender before storing the message
+     * content. Fixing that requires changes to pickup, cleanup, qmgr, and
+     * perhaps elsewhere, so that will have to happen later when I have more
+     * time. However, QMQP is used for mailing list distribution, so the bulk
+     * of the volume is expected to be not message content but recipients,
+     * and recipients are not accumulated in memory.
      */
     qmqpd_read_content(state);
 
@@ -662,6 +742,7 @@ static void qmqpd_receive(QMQPD_STATE *state)
      */
     if (state->err == 0)
 	qmqpd_write_content(state);
+    qmqpd_close_content(state);
 
     /*
      * Close the queue file.
@@ -674,6 +755,26 @@ static void qmqpd_receive(QMQPD_STATE *state)
     qmqpd_send_status(state);
 }
 
+/* qmqpd_next_message - wait for the next message from the same client */
+
+static int qmqpd_next_message(QMQPD_STATE *state)
+{
+    int     ch;
+
+    /*
+     * As a non-standard extension, receive another message over the same
+     * connection. A client that has no more messages closes the connection,
+     * which is not an error.
+     */
+    if (var_qmqpd_multi_msg == 0
+	|| (ch = VSTREAM_GETC(state->client)) == VSTREAM_EOF)
+	return (0);
+    vstream_ungetc(state->client, ch);
+    qmqpd_state_reset(state);
+    watchdog_pat();
+    return (1);
+}
+
 /* qmqpd_proto - speak the QMQP "protocol" */
 
 static void qmqpd_proto(QMQPD_STATE *state)
@@ -717,7 +818,9 @@ static void qmqpd_proto(QMQPD_STATE *state)
 	 * See if we want to talk to this client at all.
 	 */
 	if (namadr_list_match(qmqpd_clients, state->name, state->addr) != 0) {
-	    qmqpd_receive(state);
+	    do {
+		qmqpd_receive(state);
+	    } while (qmqpd_next_message(state));
 	} else if (qmqpd_clients->error == 0) {
 	    qmqpd_reply(state, DONT_LOG, QMQPD_STAT_HARD,
 			"Error: %s is not authorized to use this service",
@@ -728,6 +831,8 @@ static void qmqpd_proto(QMQPD_STATE *state)
 	}
 	break;
     }
+    if (state->content)
+	qmqpd_close_content(state);
 
     /*
      * Log abnormal session termination. Indicate the last recognized state
@@ -803,7 +908,30 @@ static void pre_accept(char *unused_name, char **unused_argv)
 
 static void pre_jail_init(char *unused_name, char **unused_argv)
 {
+    VSTRING *path;
+    int     fd;
+
     debug_peer_init();
+
+    /*
+     * Create the content spool file while we still have access to the data
+     * directory. The file is removed immediately, so that nothing is left
+     * behind when this process terminates.
+     */
+    if (var_qmqpd_mem_limit < var_message_limit || var_message_limit == 0) {
+	path = vstring_alloc(100);
+	vstring_sprintf(path, "%s/%s.XXXXXX", var_data_dir, var_procname);
+	if ((fd = mkstemp(STR(path))) < 0)
+	    msg_fatal("create content spool file %s: %m", STR(path));
+	if (unlink(STR(path)) < 0)
+	    msg_fatal("remove content spool file %s: %m", STR(path));
+	close_on_exec(fd, CLOSE_ON_EXEC);
+	qmqpd_spool = vstream_fdopen(fd, O_RDWR);
+	vstream_control(qmqpd_spool,
+			CA_VSTREAM_CTL_PATH("content spool file"),
+			CA_VSTREAM_CTL_END);
+	vstring_free(path);
+    }
     qmqpd_clients =
 	namadr_list_init(VAR_QMQPD_CLIENTS, MATCH_FLAG_RETURN
 			 | match_parent_style(VAR_QMQPD_CLIENTS),
@@ -834,6 +962,10 @@ int     main(int argc, char **argv)
 	VAR_QMTPD_ERR_SLEEP, DEF_QMTPD_ERR_SLEEP, &var_qmqpd_err_sleep, 0, 0,
 	0,
     };
+    static const CONFIG_INT_TABLE int_table[] = {
+	VAR_QMQPD_MEM_LIMIT, DEF_QMQPD_MEM_LIMIT, &var_qmqpd_mem_limit, 0, 0,
+	0,
+    };
     static const CONFIG_STR_TABLE str_table[] = {
 	VAR_FILTER_XPORT, DEF_FILTER_XPORT, &var_filter_xport, 0, 0,
 	VAR_QMQPD_CLIENTS, DEF_QMQPD_CLIENTS, &var_qmqpd_clients, 0, 0,
@@ -842,6 +974,7 @@ int     main(int argc, char **argv)
     };
     static const CONFIG_BOOL_TABLE bool_table[] = {
 	VAR_QMQPD_CLIENT_PORT_LOG, DEF_QMQPD_CLIENT_PORT_LOG, &var_qmqpd_client_port_log,
+	VAR_QMQPD_MULTI_MSG, DEF_QMQPD_MULTI_MSG, &var_qmqpd_multi_msg,
 	0,
     };
 
@@ -854,6 +987,7 @@ int     main(int argc, char **argv)
      * Pass control to the single-threaded service skeleton.
      */
     single_server_main(argc, argv, qmqpd_service,
+		       CA_MAIL_SERVER_INT_TABLE(int_table),
 		       CA_MAIL_SERVER_TIME_TABLE(time_table),
 		       CA_MAIL_SERVER_STR_TABLE(str_table),
 		       CA_MAIL_SERVER_BOOL_TABLE(bool_table),
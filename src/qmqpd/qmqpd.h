@@ -31,6 +31,7 @@ typedef struct {
     int     err;			/* error flags */
     VSTREAM *client;			/* client connection */
     VSTRING *message;			/* message buffer */
+    VSTREAM *content;			/* message content reader */
     VSTRING *buf;			/* line buffer */
     struct timeval arrival_time;	/* start of session */
     char   *name;			/* client name */
@@ -75,6 +76,7 @@ typedef struct {
   * qmqpd_state.c
   */
 QMQPD_STATE *qmqpd_state_alloc(VSTREAM *);
+void    qmqpd_state_reset(QMQPD_STATE *);
 void    qmqpd_state_free(QMQPD_STATE *);
 
  /*
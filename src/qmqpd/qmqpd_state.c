@@ -9,11 +9,18 @@
 /*	QMQPD_STATE *qmqpd_state_alloc(stream)
 /*	VSTREAM *stream;
 /*
+/*	void	qmqpd_state_reset(state)
+/*	QMQPD_STATE *state;
+/*
 /*	void	qmqpd_state_free(state)
 /*	QMQPD_STATE *state;
 /* DESCRIPTION
 /*	qmqpd_state_alloc() creates and initializes session context.
 /*
+/*	qmqpd_state_reset() cleans up after one message, and prepares
+/*	the session context for receiving the next message over
+/*	the same connection.
+/*
 /*	qmqpd_state_free() destroys session context.
 /*
 /*	Arguments:
@@ -63,6 +70,7 @@ QMQPD_STATE *qmqpd_state_alloc(VSTREAM *stream)
     state->err = CLEANUP_STAT_OK;
     state->client = stream;
     state->message = vstring_alloc(1000);
+    state->content = 0;
     state->buf = vstring_alloc(100);
     GETTIMEOFDAY(&state->arrival_time);
     qmqpd_peer_init(state);
@@ -79,6 +87,36 @@ QMQPD_STATE *qmqpd_state_alloc(VSTREAM *stream)
     return (state);
 }
 
+/* qmqpd_state_reset - clean up after one message */
+
+void    qmqpd_state_reset(QMQPD_STATE *state)
+{
+    state->err = CLEANUP_STAT_OK;
+    GETTIMEOFDAY(&state->arrival_time);
+    if (state->queue_id) {
+	myfree(state->queue_id);
+	state->queue_id = 0;
+    }
+    if (state->dest) {
+	mail_stream_cleanup(state->dest);
+	state->dest = 0;
+    }
+    state->cleanup = 0;
+    state->rcpt_count = 0;
+    state->reason = 0;
+    if (state->sender) {
+	myfree(state->sender);
+	state->sender = 0;
+    }
+    if (state->recipient) {
+	myfree(state->recipient);
+	state->recipient = 0;
+    }
+    state->where = "receiving QMQP packet header";
+    VSTRING_RESET(state->why_rejected);
+    VSTRING_TERMINATE(state->why_rejected);
+}
+
 /* qmqpd_state_free - destroy session state */
 
 void    qmqpd_state_free(QMQPD_STATE *state)
@@ -53,6 +53,15 @@
 /* .IP "\fBfind_dest\fI destination\fR"
 /*	Look up cached destination properties, cached endpoint properties,
 /*	and a cached file descriptor for the specified logical destination.
+/* .IP "\fBsave_times\fI destination sample\fR"
+/*	Add one delivery's phase timings to the statistics for the
+/*	specified destination.
+/* .IP "\fBlist_times\fI flags\fR"
+/*	Report the per-destination delivery phase statistics, and
+/*	optionally reset them.
+/* .PP
+/*	Delivery phase statistics are kept in memory only, and are
+/*	lost when the \fBscache\fR(8) server terminates.
 /* SECURITY
 /* .ad
 /* .fi
@@ -90,6 +99,11 @@
 /*	How frequently the \fBscache\fR(8) server logs usage statistics with
 /*	connection cache hit and miss rates for logical destinations and for
 /*	physical endpoints.
+/* .PP
+/*	Available in Postfix 3.5 and later:
+/* .IP "\fBconnection_cache_timing_limit (1000)\fR"
+/*	The maximal number of destinations for which the \fBscache\fR(8)
+/*	server maintains delivery phase timing statistics.
 /* MISCELLANEOUS CONTROLS
 /* .ad
 /* .fi
@@ -158,6 +172,7 @@
 /* Utility library. */
 
 #include <msg.h>
+#include <mymalloc.h>
 #include <iostuff.h>
 #include <htable.h>
 #include <ring.h>
@@ -169,6 +184,7 @@
 #include <mail_version.h>
 #include <mail_proto.h>
 #include <scache.h>
+#include <scache_times.h>
 
 /* Single server skeleton. */
 
@@ -182,6 +198,7 @@
   */
 int     var_scache_ttl_lim;
 int     var_scache_stat_time;
+int     var_scache_times_limit;
 
  /*
   * Request parameters.
@@ -214,6 +231,16 @@ static int scache_endp_count;
 static int scache_sess_count;
 time_t  scache_start_time;
 
+ /*
+  * Per-destination delivery phase timing statistics.
+  */
+typedef struct {
+    SCACHE_TIMES times;			/* aggregate */
+    time_t  updated;			/* time of last update */
+} SCACHE_TIMES_ENTRY;
+
+static HTABLE *scache_times_table;
+
  /*
   * Silly little macros.
   */
@@ -417,6 +444,105 @@ static void scache_find_dest_service(VSTREAM *client_stream)
     }
 }
 
+/* scache_save_times_service - protocol to add delivery phase timings */
+
+static void scache_save_times_service(VSTREAM *client_stream)
+{
+    const char *myname = "scache_save_times_service";
+    long    sample[SCACHE_PHASE_COUNT];
+    SCACHE_TIMES_ENTRY *ep;
+    HTABLE_INFO **ht_info;
+    HTABLE_INFO **ht;
+    HTABLE_INFO *oldest;
+
+    if (attr_scan(client_stream,
+		  ATTR_FLAG_STRICT,
+		  RECV_ATTR_STR(MAIL_ATTR_LABEL, scache_dest_label),
+		  RECV_ATTR_STR(MAIL_ATTR_PROP, scache_dest_prop),
+		  ATTR_TYPE_END) != 2
+	|| scache_times_sample_import(STR(scache_dest_prop), sample) < 0) {
+	msg_warn("%s: bad or missing request parameter", myname);
+	attr_print(client_stream, ATTR_FLAG_NONE,
+		   SEND_ATTR_INT(MAIL_ATTR_STATUS, SCACHE_STAT_BAD),
+		   ATTR_TYPE_END);
+	return;
+    }
+
+    /*
+     * Bound memory usage. When the table is full, discard the destination
+     * that was updated least recently. This is a linear search, but it
+     * happens only when a new destination shows up.
+     */
+    if ((ep = (SCACHE_TIMES_ENTRY *)
+	 htable_find(scache_times_table, STR(scache_dest_label))) == 0) {
+	if (scache_times_table->used >= var_scache_times_limit) {
+	    ht_info = htable_list(scache_times_table);
+	    for (oldest = 0, ht = ht_info; *ht; ht++)
+		if (oldest == 0 || ((SCACHE_TIMES_ENTRY *) ht[0]->value)->updated
+		    < ((SCACHE_TIMES_ENTRY *) oldest->value)->updated)
+		    oldest = *ht;
+	    if (oldest)
+		htable_delete(scache_times_table, oldest->key, myfree);
+	    myfree((void *) ht_info);
+	}
+	ep = (SCACHE_TIMES_ENTRY *) mymalloc(sizeof(*ep));
+	scache_times_init(&ep->times);
+	htable_enter(scache_times_table, STR(scache_dest_label), (void *) ep);
+    }
+    scache_times_add(&ep->times, sample);
+    ep->updated = event_time();
+    attr_print(client_stream, ATTR_FLAG_NONE,
+	       SEND_ATTR_INT(MAIL_ATTR_STATUS, SCACHE_STAT_OK),
+	       ATTR_TYPE_END);
+}
+
+/* scache_list_times_service - protocol to report delivery phase timings */
+
+static void scache_list_times_service(VSTREAM *client_stream)
+{
+    const char *myname = "scache_list_times_service";
+    int     flags;
+    HTABLE_INFO **ht_info;
+    HTABLE_INFO **ht;
+
+    if (attr_scan(client_stream,
+		  ATTR_FLAG_STRICT,
+		  RECV_ATTR_INT(MAIL_ATTR_FLAGS, &flags),
+		  ATTR_TYPE_END) != 1) {
+	msg_warn("%s: bad or missing request parameter", myname);
+	attr_print(client_stream, ATTR_FLAG_NONE,
+		   SEND_ATTR_INT(MAIL_ATTR_STATUS, SCACHE_STAT_BAD),
+		   SEND_ATTR_STR(MAIL_ATTR_LABEL, ""),
+		   SEND_ATTR_STR(MAIL_ATTR_PROP, ""),
+		   ATTR_TYPE_END);
+	return;
+    }
+
+    /*
+     * One reply per destination, and an empty destination at the end.
+     */
+    ht_info = htable_list(scache_times_table);
+    for (ht = ht_info; *ht; ht++) {
+	scache_times_export(scache_dest_prop,
+			    &((SCACHE_TIMES_ENTRY *) ht[0]->value)->times);
+	attr_print(client_stream, ATTR_FLAG_NONE,
+		   SEND_ATTR_INT(MAIL_ATTR_STATUS, SCACHE_STAT_OK),
+		   SEND_ATTR_STR(MAIL_ATTR_LABEL, ht[0]->key),
+		   SEND_ATTR_STR(MAIL_ATTR_PROP, STR(scache_dest_prop)),
+		   ATTR_TYPE_END);
+    }
+    myfree((void *) ht_info);
+    attr_print(client_stream, ATTR_FLAG_NONE,
+	       SEND_ATTR_INT(MAIL_ATTR_STATUS, SCACHE_STAT_OK),
+	       SEND_ATTR_STR(MAIL_ATTR_LABEL, ""),
+	       SEND_ATTR_STR(MAIL_ATTR_PROP, ""),
+	       ATTR_TYPE_END);
+    if (flags & SCACHE_TIMES_FLAG_RESET) {
+	htable_free(scache_times_table, myfree);
+	scache_times_table = htable_create(100);
+    }
+}
+
 /* scache_service - perform service for client */
 
 static void scache_service(VSTREAM *client_stream, char *unused_service,
@@ -454,6 +580,10 @@ static void scache_service(VSTREAM *client_stream, char *unused_service,
 		scache_save_endp_service(client_stream);
 	    } else if (VSTREQ(scache_request, SCACHE_REQ_FIND_ENDP)) {
 		scache_find_endp_service(client_stream);
+	    } else if (VSTREQ(scache_request, SCACHE_REQ_SAVE_TIMES)) {
+		scache_save_times_service(client_stream);
+	    } else if (VSTREQ(scache_request, SCACHE_REQ_LIST_TIMES)) {
+		scache_list_times_service(client_stream);
 	    } else {
 		msg_warn("unrecognized request: \"%s\", ignored",
 			 STR(scache_request));
@@ -518,6 +648,7 @@ static void post_jail_init(char *unused_name, char **unused_argv)
      * Pre-allocate the cache instance.
      */
     scache = scache_multi_create();
+    scache_times_table = htable_create(100);
 
     /*
      * Pre-allocate buffers.
@@ -555,6 +686,10 @@ int     main(int argc, char **argv)
 	VAR_SCACHE_STAT_TIME, DEF_SCACHE_STAT_TIME, &var_scache_stat_time, 1, 0,
 	0,
     };
+    static const CONFIG_INT_TABLE int_table[] = {
+	VAR_SCACHE_TIMES_LIMIT, DEF_SCACHE_TIMES_LIMIT, &var_scache_times_limit, 1, 0,
+	0,
+    };
 
     /*
      * Fingerprint executables and core dumps.
@@ -562,6 +697,7 @@ int     main(int argc, char **argv)
     MAIL_VERSION_STAMP_ALLOCATE;
 
     multi_server_main(argc, argv, scache_service,
+		      CA_MAIL_SERVER_INT_TABLE(int_table),
 		      CA_MAIL_SERVER_TIME_TABLE(time_table),
 		      CA_MAIL_SERVER_POST_INIT(post_jail_init),
 		      CA_MAIL_SERVER_EXIT(scache_status_dump),
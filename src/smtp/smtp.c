@@ -91,6 +91,7 @@
 /*	RFC 2554 (AUTH command)
 /*	RFC 2821 (SMTP protocol)
 /*	RFC 2920 (SMTP Pipelining)
+/*	RFC 3030 (CHUNKING without BINARYMIME)
 /*	RFC 3207 (STARTTLS command)
 /*	RFC 3461 (SMTP DSN Extension)
 /*	RFC 3463 (Enhanced Status Codes)
@@ -269,6 +270,14 @@
 /*	When a remote destination resolves to a combination of IPv4 and
 /*	IPv6 addresses, ensure that the Postfix SMTP client can try both
 /*	address types before it runs into the smtp_mx_address_limit.
+/* .PP
+/*	Available in Postfix version 3.5 and later:
+/* .IP "\fBsmtp_use_bdat_command (no)\fR"
+/*	Send message content with the BDAT command when the remote SMTP
+/*	server announces CHUNKING support.
+/* .IP "\fBsmtp_bdat_chunk_size (131072)\fR"
+/*	The maximal amount of message content in bytes that the Postfix
+/*	SMTP client sends with one BDAT command.
 /* MIME PROCESSING CONTROLS
 /* .ad
 /* .fi
@@ -610,6 +619,17 @@
 /* .IP "\fBsmtp_tls_connection_reuse (no)\fR"
 /*	Try to make multiple deliveries per TLS-encrypted connection.
 /* .PP
+/*	Available in Postfix version 3.5 and later:
+/* .IP "\fBsmtp_delivery_request_limit (100)\fR"
+/*	The maximal number of delivery requests that a Postfix SMTP client
+/*	process handles in a row over one queue manager connection, while
+/*	it keeps its SMTP session open between requests.
+/* .IP "\fBsmtp_delivery_timing_statistics (no)\fR"
+/*	Report the time that each delivery spends in DNS lookup, connection
+/*	setup, server greeting, TLS handshake, EHLO, envelope and content
+/*	transfer to the scache(8) server, which aggregates this information
+/*	per destination for display with postscache(1).
+/* .PP
 /*	Implemented in the qmgr(8) daemon:
 /* .IP "\fBtransport_destination_concurrency_limit ($default_destination_concurrency_limit)\fR"
 /*	A transport-specific override for the
@@ -833,6 +853,7 @@
 #include <mymalloc.h>
 #include <name_mask.h>
 #include <name_code.h>
+#include <stats.h>
 
 /* Global library. */
 
@@ -860,6 +881,7 @@
 
 #include "smtp.h"
 #include "smtp_sasl.h"
+#include "smtp_reuse.h"
 
  /*
   * Tunable parameters. These have compiled-in defaults that can be overruled
@@ -905,11 +927,15 @@ char   *var_smtp_host_lookup;
 bool    var_smtp_quote_821_env;
 bool    var_smtp_defer_mxaddr;
 bool    var_smtp_send_xforward;
+bool    var_smtp_use_bdat;
+int     var_smtp_bdat_chunk;
 int     var_smtp_mxaddr_limit;
 int     var_smtp_mxsess_limit;
 int     var_smtp_cache_conn;
 int     var_smtp_reuse_time;
 int     var_smtp_reuse_count;
+int     var_smtp_dreq_limit;
+bool    var_smtp_times_stats;
 char   *var_smtp_cache_dest;
 char   *var_scache_service;		/* You can now leave this here. */
 bool    var_smtp_cache_demand;
@@ -997,6 +1023,8 @@ int     smtp_host_lookup_mask;
 int     smtp_dns_support;
 STRING_LIST *smtp_cache_dest;
 SCACHE *smtp_scache;
+SCACHE *smtp_hold_scache;
+SCACHE_TIMES_CLNT *smtp_times_clnt;
 MAPS   *smtp_ehlo_dis_maps;
 MAPS   *smtp_generic_maps;
 int     smtp_ext_prop_mask;
@@ -1020,12 +1048,21 @@ int     smtp_tls_insecure_mx_policy;
   */
 static int smtp_addr_pref;
 
+ /*
+  * Performance counters.
+  */
+static STATS_CELL *smtp_stats_requests;
+static STATS_CELL *smtp_stats_deferred;
+static STATS_CELL *smtp_stats_time;
+
 /* deliver_message - deliver message with extreme prejudice */
 
 static int deliver_message(const char *service, DELIVER_REQUEST *request)
 {
     SMTP_STATE *state;
     int     result;
+    struct timeval start;
+    struct timeval done;
 
     if (msg_verbose)
 	msg_info("deliver_message: from %s", request->sender);
@@ -1058,7 +1095,15 @@ static int deliver_message(const char *service, DELIVER_REQUEST *request)
      * Optionally deliver mail locally when this machine is the best mail
      * exchanger.
      */
+    GETTIMEOFDAY(&start);
     result = smtp_connect(state);
+    smtp_phase_report(state);
+    GETTIMEOFDAY(&done);
+    STATS_INC(smtp_stats_requests);
+    if (result != 0)
+	STATS_INC(smtp_stats_deferred);
+    stats_observe(smtp_stats_time, (done.tv_sec - start.tv_sec) * 1000
+		  + (done.tv_usec - start.tv_usec) / 1000);
 
     /*
      * Clean up.
@@ -1074,6 +1119,7 @@ static void smtp_service(VSTREAM *client_stream, char *service, char **argv)
 {
     DELIVER_REQUEST *request;
     int     status;
+    int     count;
 
     /*
      * Sanity check. This service takes no command-line arguments.
@@ -1088,11 +1134,27 @@ static void smtp_service(VSTREAM *client_stream, char *service, char **argv)
      * read a request from the queue manager, and (3) report the completion
      * status of that request. All connection-management stuff is handled by
      * the common code in single_server.c.
+     * 
+     * When the queue manager supports it, and this process still holds an
+     * open SMTP session after delivery, ask the queue manager for another
+     * request over the same connection. This avoids handing the session to
+     * the scache(8) server and back, and avoids a new connection and
+     * handshake when the next request is for the same destination.
      */
-    if ((request = deliver_request_read(client_stream)) != 0) {
+    for (count = 1, request = var_smtp_dreq_limit > 1 ?
+	 deliver_request_read_more(client_stream) :
+	 deliver_request_read(client_stream);
+	 request != 0; count++) {
 	status = deliver_message(service, request);
-	deliver_request_done(client_stream, request, status);
+	if ((request->flags & DEL_REQ_FLAG_MORE) != 0
+	    && count < var_smtp_dreq_limit && smtp_reuse_held()) {
+	    request = deliver_request_next(client_stream, request, status);
+	} else {
+	    deliver_request_done(client_stream, request, status);
+	    request = 0;
+	}
     }
+    smtp_reuse_release();
 }
 
 /* post_init - post-jail initialization */
@@ -1174,6 +1236,22 @@ static void post_init(char *unused_name, char **unused_argv)
 					 var_ipc_ttl_limit);
 #endif
 
+    /*
+     * Process-private session cache for sessions that are held open between
+     * delivery requests over the same queue manager connection.
+     */
+    if (var_smtp_dreq_limit > 1)
+	smtp_hold_scache = scache_single_create();
+
+    /*
+     * Per-destination delivery timing statistics.
+     */
+    if (var_smtp_times_stats)
+	smtp_times_clnt = scache_times_clnt_create(var_scache_service,
+						   var_scache_proto_tmout,
+						   var_ipc_idle_limit,
+						   var_ipc_ttl_limit);
+
     /*
      * Select DNS query flags.
      */
@@ -1184,6 +1262,13 @@ static void post_init(char *unused_name, char **unused_argv)
      * Address verification.
      */
     smtp_vrfy_init();
+
+    /*
+     * Performance counters. See "postfix stats".
+     */
+    smtp_stats_requests = stats_counter("smtp_delivery_requests_total");
+    smtp_stats_deferred = stats_counter("smtp_delivery_requests_deferred_total");
+    smtp_stats_time = stats_histogram("smtp_delivery_milliseconds");
 }
 
 /* pre_init - pre-jail initialization */
@@ -27,6 +27,7 @@
   */
 #include <deliver_request.h>
 #include <scache.h>
+#include <scache_times.h>
 #include <string_list.h>
 #include <maps.h>
 #include <tok822.h>
@@ -150,6 +151,10 @@ typedef struct SMTP_STATE {
     struct SMTP_SESSION *session;	/* network connection */
     int     status;			/* delivery status */
     ssize_t space_left;			/* output length control */
+    VSTRING *bdat_buf;			/* BDAT content, or null */
+    int     bdat_sent;			/* unacknowledged BDAT chunks */
+    int     bdat_sync;			/* receiver has caught up */
+    int     bdat_fail;			/* server rejected a BDAT chunk */
 
     /*
      * Global iterator.
@@ -185,6 +190,12 @@ typedef struct SMTP_STATE {
      * DSN Support introduced major bloat in error processing.
      */
     DSN_BUF *why;			/* on-the-fly formatting buffer */
+
+    /*
+     * Delivery phase timing, in microseconds; -1 means not done.
+     */
+    struct timeval phase_start;		/* start of current phase */
+    long    phase_usec[SCACHE_PHASE_COUNT];
 } SMTP_STATE;
 
  /*
@@ -235,6 +246,7 @@ typedef struct SMTP_STATE {
 #define SMTP_FEATURE_XFORWARD_IDENT	(1<<20)
 #define SMTP_FEATURE_SMTPUTF8		(1<<21)	/* RFC 6531 */
 #define SMTP_FEATURE_FROM_PROXY		(1<<22)	/* proxied connection */
+#define SMTP_FEATURE_CHUNKING		(1<<23)	/* RFC 3030 */
 
  /*
   * Features that passivate under the endpoint.
@@ -261,9 +273,20 @@ typedef struct SMTP_STATE {
 #define SMTP_MISC_FLAG_COMPLETE_SESSION	(1<<7)
 #define SMTP_MISC_FLAG_PREF_IPV6	(1<<8)
 #define SMTP_MISC_FLAG_PREF_IPV4	(1<<9)
+#define SMTP_MISC_FLAG_CONN_HOLD	(1<<10)
 
 #define SMTP_MISC_FLAG_CONN_CACHE_MASK \
-	(SMTP_MISC_FLAG_CONN_LOAD | SMTP_MISC_FLAG_CONN_STORE)
+	(SMTP_MISC_FLAG_CONN_LOAD | SMTP_MISC_FLAG_CONN_STORE \
+	| SMTP_MISC_FLAG_CONN_HOLD)
+
+ /*
+  * A session that is held open for the next delivery request is looked up
+  * and saved like a cached session.
+  */
+#define SMTP_MISC_FLAG_CONN_LOAD_MASK \
+	(SMTP_MISC_FLAG_CONN_LOAD | SMTP_MISC_FLAG_CONN_HOLD)
+#define SMTP_MISC_FLAG_CONN_STORE_MASK \
+	(SMTP_MISC_FLAG_CONN_STORE | SMTP_MISC_FLAG_CONN_HOLD)
 
  /*
   * smtp.c
@@ -290,6 +313,8 @@ extern int smtp_dns_support;		/* dns support level */
 #define SMTP_DNS_DNSSEC		2	/* smtp_dns_support_level = dnssec */
 
 extern SCACHE *smtp_scache;		/* connection cache instance */
+extern SCACHE *smtp_hold_scache;	/* held session, or null */
+extern SCACHE_TIMES_CLNT *smtp_times_clnt;	/* timing statistics, or null */
 extern STRING_LIST *smtp_cache_dest;	/* cached destinations */
 
 extern MAPS *smtp_ehlo_dis_maps;	/* ehlo keyword filter */
@@ -608,6 +633,15 @@ extern VSTRING *smtp_unalias_addr(VSTRING *, const char *);
 extern SMTP_STATE *smtp_state_alloc(void);
 extern void smtp_state_free(SMTP_STATE *);
 
+ /*
+  * smtp_phase.c
+  */
+#define SMTP_PHASE_START(state)	GETTIMEOFDAY(&(state)->phase_start)
+
+extern void smtp_phase_init(SMTP_STATE *);
+extern void smtp_phase_done(SMTP_STATE *, int);
+extern void smtp_phase_report(SMTP_STATE *);
+
  /*
   * smtp_map11.c
   */
@@ -459,13 +459,23 @@ static void smtp_cache_policy(SMTP_STATE *state, const char *dest)
     state->misc_flags &= ~SMTP_MISC_FLAG_CONN_CACHE_MASK;
 
     if (smtp_cache_dest && string_list_match(smtp_cache_dest, dest)) {
-	state->misc_flags |= SMTP_MISC_FLAG_CONN_CACHE_MASK;
+	state->misc_flags |=
+	    (SMTP_MISC_FLAG_CONN_LOAD | SMTP_MISC_FLAG_CONN_STORE);
     } else if (var_smtp_cache_demand) {
 	if (request->flags & DEL_REQ_FLAG_CONN_LOAD)
 	    state->misc_flags |= SMTP_MISC_FLAG_CONN_LOAD;
 	if (request->flags & DEL_REQ_FLAG_CONN_STORE)
 	    state->misc_flags |= SMTP_MISC_FLAG_CONN_STORE;
     }
+
+    /*
+     * When the queue manager can send more requests over the same
+     * connection, hold the session open in this process. The held session
+     * goes to the shared connection cache (if permitted above) only when
+     * this process has no more work.
+     */
+    if (smtp_hold_scache && (request->flags & DEL_REQ_FLAG_MORE))
+	state->misc_flags |= SMTP_MISC_FLAG_CONN_HOLD;
 }
 
 /* smtp_connect_local - connect to local server */
@@ -529,10 +539,13 @@ static void smtp_connect_local(SMTP_STATE *state, const char *path)
 	return;
     }
 #endif
-    if ((state->misc_flags & SMTP_MISC_FLAG_CONN_LOAD) == 0
+    if ((state->misc_flags & SMTP_MISC_FLAG_CONN_LOAD_MASK) == 0
 	|| (session = smtp_reuse_nexthop(state,
-				     SMTP_KEY_MASK_SCACHE_DEST_LABEL)) == 0)
+				     SMTP_KEY_MASK_SCACHE_DEST_LABEL)) == 0) {
+	SMTP_PHASE_START(state);
 	session = smtp_connect_unix(iter, why, state->misc_flags);
+	smtp_phase_done(state, SCACHE_PHASE_CONN);
+    }
     if ((state->session = session) != 0) {
 	session->state = state;
 #ifdef USE_TLS
@@ -863,6 +876,7 @@ static void smtp_connect_inet(SMTP_STATE *state, const char *nexthop,
 	    lookup_mx = (smtp_dns_support != SMTP_DNS_DISABLED && *dest != '[');
 	} else
 	    lookup_mx = 0;
+	SMTP_PHASE_START(state);
 	if (!lookup_mx) {
 	    addr_list = smtp_host_addr(domain, state->misc_flags, why);
 	    /* XXX We could be an MX host for this destination... */
@@ -875,6 +889,7 @@ static void smtp_connect_inet(SMTP_STATE *state, const char *nexthop,
 	    if (i_am_mx)
 		state->misc_flags |= SMTP_MISC_FLAG_FINAL_NEXTHOP;
 	}
+	smtp_phase_done(state, SCACHE_PHASE_DNS);
 
 	/*
 	 * Don't try fall-back hosts if mail loops to myself. That would just
@@ -922,7 +937,7 @@ static void smtp_connect_inet(SMTP_STATE *state, const char *nexthop,
 	 * fall-back destination. smtp_reuse_session() will truncate the
 	 * address list when either limit is reached.
 	 */
-	if (addr_list && (state->misc_flags & SMTP_MISC_FLAG_CONN_LOAD)) {
+	if (addr_list && (state->misc_flags & SMTP_MISC_FLAG_CONN_LOAD_MASK)) {
 	    if (state->cache_used->used > 0)
 		smtp_scrub_addr_list(state->cache_used, &addr_list);
 	    sess_count = addr_count =
@@ -990,11 +1005,14 @@ static void smtp_connect_inet(SMTP_STATE *state, const char *nexthop,
 		retry_plain = 0;
 	    }
 #endif
-	    if ((state->misc_flags & SMTP_MISC_FLAG_CONN_LOAD) == 0
+	    if ((state->misc_flags & SMTP_MISC_FLAG_CONN_LOAD_MASK) == 0
 		|| addr->pref == domain_best_pref
 		|| !(session = smtp_reuse_addr(state,
-					  SMTP_KEY_MASK_SCACHE_ENDP_LABEL)))
+					  SMTP_KEY_MASK_SCACHE_ENDP_LABEL))) {
+		SMTP_PHASE_START(state);
 		session = smtp_connect_addr(iter, why, state->misc_flags);
+		smtp_phase_done(state, SCACHE_PHASE_CONN);
+	    }
 	    if ((state->session = session) != 0) {
 		session->state = state;
 #ifdef USE_TLS
@@ -0,0 +1,125 @@
+/*++
+/* NAME
+/*	smtp_phase 3
+/* SUMMARY
+/*	delivery phase timing
+/* SYNOPSIS
+/*	#include "smtp.h"
+/*
+/*	void	SMTP_PHASE_START(state)
+/*	SMTP_STATE *state;
+/*
+/*	void	smtp_phase_init(state)
+/*	SMTP_STATE *state;
+/*
+/*	void	smtp_phase_done(state, phase)
+/*	SMTP_STATE *state;
+/*	int	phase;
+/*
+/*	void	smtp_phase_report(state)
+/*	SMTP_STATE *state;
+/* DESCRIPTION
+/*	This module measures how much time a delivery request spends
+/*	in address lookup, connection setup, server greeting, TLS
+/*	handshake, EHLO, envelope, and message content transfer,
+/*	and optionally reports the result to the scache(8) server
+/*	where it is aggregated per destination.
+/*
+/*	Phases are measured back to back: SMTP_PHASE_START() starts
+/*	the clock, and smtp_phase_done() charges the elapsed time to
+/*	the specified phase and restarts the clock for the next one.
+/*	When a phase happens more than once in the same request (for
+/*	example, connection attempts to multiple MX hosts), the times
+/*	are added up.
+/*
+/*	smtp_phase_init() marks all phases as not done, and starts
+/*	the clock.
+/*
+/*	smtp_phase_done() charges the time since the last
+/*	SMTP_PHASE_START() or smtp_phase_done() call to the specified
+/*	phase (SCACHE_PHASE_XXX).
+/*
+/*	smtp_phase_report() sends the timings for the current
+/*	delivery request to the timing statistics service, labeled
+/*	with the transport name and the delivery request next-hop
+/*	destination. This does nothing when timing statistics are
+/*	disabled.
+/* DIAGNOSTICS
+/*	Panic: invalid phase.
+/* SEE ALSO
+/*	scache_times(3), delivery phase timing statistics
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <vstring.h>
+
+/* Global library. */
+
+#include <scache_times.h>
+
+/* Application-specific. */
+
+#include "smtp.h"
+
+/* smtp_phase_init - reset phase timers */
+
+void    smtp_phase_init(SMTP_STATE *state)
+{
+    long   *tp;
+
+    for (tp = state->phase_usec; tp < state->phase_usec + SCACHE_PHASE_COUNT; tp++)
+	*tp = -1;
+    SMTP_PHASE_START(state);
+}
+
+/* smtp_phase_done - charge elapsed time to phase, restart clock */
+
+void    smtp_phase_done(SMTP_STATE *state, int phase)
+{
+    struct timeval now;
+    long    usec;
+
+    if (phase < 0 || phase >= SCACHE_PHASE_COUNT)
+	msg_panic("smtp_phase_done: bad phase: %d", phase);
+
+    GETTIMEOFDAY(&now);
+    usec = (now.tv_sec - state->phase_start.tv_sec) * 1000000
+	+ (now.tv_usec - state->phase_start.tv_usec);
+    if (usec < 0)				/* clock went backwards */
+	usec = 0;
+    if (state->phase_usec[phase] < 0)
+	state->phase_usec[phase] = usec;
+    else
+	state->phase_usec[phase] += usec;
+    state->phase_start = now;
+}
+
+/* smtp_phase_report - send timings to statistics service */
+
+void    smtp_phase_report(SMTP_STATE *state)
+{
+    static VSTRING *label;
+
+    if (smtp_times_clnt == 0)
+	return;
+    if (label == 0)
+	label = vstring_alloc(100);
+    vstring_sprintf(label, "%s:%s", state->service, state->request->nexthop);
+    scache_times_clnt_save(smtp_times_clnt, vstring_str(label),
+			   state->phase_usec);
+}
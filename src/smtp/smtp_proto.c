@@ -30,6 +30,8 @@
 /*	Recipients are marked as "done" in the mail queue file when
 /*	bounced or delivered. The message delivery status is updated
 /*	accordingly.
+/*	When the server announces CHUNKING support, the message
+/*	content is sent with BDAT commands instead of DATA.
 /*
 /*	smtp_rset() sends a single RSET command and waits for the
 /*	response. In case of a negative reply it sets the
@@ -364,7 +366,9 @@ int     smtp_helo(SMTP_STATE *state)
 	 * Read and parse the server's SMTP greeting banner.
 	 */
 	where = "receiving the initial server greeting";
-	switch ((resp = smtp_chat_resp(session))->code / 100) {
+	resp = smtp_chat_resp(session);
+	smtp_phase_done(state, SCACHE_PHASE_BANNER);
+	switch (resp->code / 100) {
 	case 2:
 	    break;
 	case 5:
@@ -495,6 +499,7 @@ int     smtp_helo(SMTP_STATE *state)
 				   session->namaddr,
 				   translit(resp->str, "\n", " ")));
     }
+    smtp_phase_done(state, SCACHE_PHASE_HELO);
 
     /*
      * No early returns allowed, to ensure consistent handling of TLS and
@@ -603,6 +608,10 @@ int     smtp_helo(SMTP_STATE *state)
 		} else if (strcasecmp(word, "SMTPUTF8") == 0) {
 		    if ((discard_mask & EHLO_MASK_SMTPUTF8) == 0)
 			session->features |= SMTP_FEATURE_SMTPUTF8;
+		} else if (var_smtp_use_bdat
+			   && strcasecmp(word, "CHUNKING") == 0) {
+		    if ((discard_mask & EHLO_MASK_CHUNKING) == 0)
+			session->features |= SMTP_FEATURE_CHUNKING;
 		}
 		n++;
 	    }
@@ -1074,6 +1083,7 @@ static int smtp_start_tls(SMTP_STATE *state)
     }						/* state->tls->conn_reuse */
 
     vstring_free(serverid);
+    smtp_phase_done(state, SCACHE_PHASE_TLS);
 
     if (session->tls_context == 0) {
 
@@ -1156,6 +1166,127 @@ static void smtp_hbc_logger(void *context, const char *action,
     }
 }
 
+/* smtp_bdat_resp - receive the response to one BDAT chunk */
+
+static void smtp_bdat_resp(SMTP_STATE *state)
+{
+    SMTP_SESSION *session = state->session;
+    SMTP_RESP *resp;
+
+    /*
+     * After the server rejects a chunk, the message transfer has failed, and
+     * no more chunks will be sent (RFC 3030 section 2). The replies to chunks
+     * that were already sent are read and ignored.
+     */
+    resp = smtp_chat_resp(session);
+    state->bdat_sent -= 1;
+    if (resp->code / 100 != 2 && state->bdat_fail == 0) {
+	smtp_mesg_fail(state, STR(state->iterator->host), resp,
+		       "host %s said: %s (in reply to %s)",
+		       session->namaddr,
+		       translit(resp->str, "\n", " "),
+		       "BDAT command");
+	state->bdat_fail = 1;
+    }
+}
+
+/* smtp_bdat_send - send one BDAT chunk */
+
+static void smtp_bdat_send(SMTP_STATE *state, int last)
+{
+    SMTP_SESSION *session = state->session;
+    VSTRING *buf = state->bdat_buf;
+
+    /*
+     * Don't send content after the server rejected a chunk.
+     */
+    if (state->bdat_fail) {
+	VSTRING_RESET(buf);
+	return;
+    }
+
+    /*
+     * Before BDAT LAST, receive the responses to all earlier chunks, so that
+     * the end-of-data responses are never mixed with chunk responses. This
+     * also means that BDAT LAST is never sent after a chunk was rejected.
+     */
+    if (last) {
+	while (state->bdat_sent > 0)
+	    smtp_bdat_resp(state);
+	if (state->bdat_fail) {
+	    VSTRING_RESET(buf);
+	    return;
+	}
+    }
+    smtp_chat_cmd(session, "BDAT %ld%s", (long) VSTRING_LEN(buf),
+		  last ? " LAST" : "");
+    if (VSTRING_LEN(buf) > 0)
+	smtp_fwrite(vstring_str(buf), VSTRING_LEN(buf), session->stream);
+    VSTRING_RESET(buf);
+
+    /*
+     * Receive chunk responses while more chunks go out, so that the sender
+     * runs at most one chunk ahead of the server. Otherwise, a large message
+     * could fill up the server's output buffer with unread responses, and
+     * the client and server would block on each other.
+     */
+    if (!last) {
+	state->bdat_sent += 1;
+	while (state->bdat_sent > 1)
+	    smtp_bdat_resp(state);
+    }
+}
+
+ /*
+  * Message content output. With DATA, content goes straight to the SMTP
+  * stream. With BDAT, content is collected in a buffer that is sent as one
+  * chunk when it fills up. The content is split into chunks only after the
+  * receiver has caught up with the sender: when it is pipelined with MAIL
+  * FROM and RCPT TO, small content is sent as one BDAT LAST command.
+  */
+#define SMTP_BDAT_CHECK(state) do { \
+	if ((state)->bdat_sync \
+	    && VSTRING_LEN((state)->bdat_buf) >= var_smtp_bdat_chunk) \
+	    smtp_bdat_send((state), 0); \
+    } while (0)
+
+/* smtp_data_fputs - output content with CRLF */
+
+static void smtp_data_fputs(SMTP_STATE *state, const char *text, ssize_t len)
+{
+    if (state->bdat_buf == 0) {
+	smtp_fputs(text, len, state->session->stream);
+    } else {
+	vstring_memcat(state->bdat_buf, text, len);
+	vstring_memcat(state->bdat_buf, "\r\n", 2);
+	SMTP_BDAT_CHECK(state);
+    }
+}
+
+/* smtp_data_fwrite - output content without CRLF */
+
+static void smtp_data_fwrite(SMTP_STATE *state, const char *text, ssize_t len)
+{
+    if (state->bdat_buf == 0) {
+	smtp_fwrite(text, len, state->session->stream);
+    } else {
+	vstring_memcat(state->bdat_buf, text, len);
+	SMTP_BDAT_CHECK(state);
+    }
+}
+
+/* smtp_data_fputc - output one content character */
+
+static void smtp_data_fputc(SMTP_STATE *state, int ch)
+{
+    if (state->bdat_buf == 0) {
+	smtp_fputc(ch, state->session->stream);
+    } else {
+	VSTRING_ADDCH(state->bdat_buf, ch);
+	SMTP_BDAT_CHECK(state);
+    }
+}
+
 /* smtp_text_out - output one header/body record */
 
 static void smtp_text_out(void *context, int rec_type,
@@ -1163,7 +1294,6 @@ static void smtp_text_out(void *context, int rec_type,
 			          off_t unused_offset)
 {
     SMTP_STATE *state = (SMTP_STATE *) context;
-    SMTP_SESSION *session = state->session;
     ssize_t data_left;
     const char *data_start;
 
@@ -1173,28 +1303,30 @@ static void smtp_text_out(void *context, int rec_type,
      * $smtp_line_length_limit). The code below does a little too much work
      * when the SMTP line length limit is disabled, but it avoids code
      * duplication, and thus, it avoids testing and maintenance problems.
+     * 
+     * Content that is sent with BDAT is not dot-stuffed.
      */
     data_left = len;
     data_start = text;
     do {
-	if (state->space_left == var_smtp_line_limit
+	if (state->space_left == var_smtp_line_limit && state->bdat_buf == 0
 	    && data_left > 0 && *data_start == '.')
-	    smtp_fputc('.', session->stream);
+	    smtp_data_fputc(state, '.');
 	if (var_smtp_line_limit > 0 && data_left >= state->space_left) {
-	    smtp_fputs(data_start, state->space_left, session->stream);
+	    smtp_data_fputs(state, data_start, state->space_left);
 	    data_start += state->space_left;
 	    data_left -= state->space_left;
 	    state->space_left = var_smtp_line_limit;
 	    if (data_left > 0 || rec_type == REC_TYPE_CONT) {
-		smtp_fputc(' ', session->stream);
+		smtp_data_fputc(state, ' ');
 		state->space_left -= 1;
 	    }
 	} else {
 	    if (rec_type == REC_TYPE_CONT) {
-		smtp_fwrite(data_start, data_left, session->stream);
+		smtp_data_fwrite(state, data_start, data_left);
 		state->space_left -= data_left;
 	    } else {
-		smtp_fputs(data_start, data_left, session->stream);
+		smtp_data_fputs(state, data_start, data_left);
 		state->space_left = var_smtp_line_limit;
 	    }
 	    break;
@@ -1412,6 +1544,7 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
     NOCLOBBER int prev_type = 0;
     NOCLOBBER int mail_from_rejected;
     NOCLOBBER int downgrading;
+    NOCLOBBER int use_bdat;
     int     mime_errs;
     SMTP_RESP fake;
     int     fail_status;
@@ -1444,6 +1577,10 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 	    myfree((void *) survivors); \
 	if (session->mime_state) \
 	    session->mime_state = mime_state_free(session->mime_state); \
+	if (state->bdat_buf) { \
+	    vstring_free(state->bdat_buf); \
+	    state->bdat_buf = 0; \
+	} \
 	return (x); \
     } while (0)
 
@@ -1451,7 +1588,8 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 	(recv_state < send_state || recv_rcpt != send_rcpt)
 
 #define SENDER_IN_WAIT_STATE \
-	(send_state == SMTP_STATE_DOT || send_state == SMTP_STATE_LAST)
+	((send_state == SMTP_STATE_DOT && !use_bdat) \
+	 || send_state == SMTP_STATE_LAST)
 
 #define SENDING_MAIL \
 	(recv_state <= SMTP_STATE_DOT)
@@ -1459,6 +1597,9 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 #define CANT_RSET_THIS_SESSION \
 	(session->features |= SMTP_FEATURE_RSET_REJECTED)
 
+#define SMTP_DOT_REQUEST \
+	(use_bdat ? "BDAT LAST command" : xfer_request[SMTP_STATE_DOT])
+
     /*
      * Pipelining support requires two loops: one loop for sending and one
      * for receiving. Each loop has its own independent state. Most of the
@@ -1474,10 +1615,26 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
      * receiver detects a serious problem (MAIL FROM rejected, all RCPT TO
      * commands rejected, DATA rejected) it forces the sender to abort the
      * SMTP dialog with RSET and QUIT.
+     * 
+     * With BDAT there is no DATA command: the sender goes from RCPT TO
+     * straight to sending message content. When the envelope and a small
+     * message fit the PIPELINING buffer, the BDAT LAST command and content
+     * are pipelined with MAIL FROM and RCPT TO; otherwise the sender waits
+     * for the RCPT TO responses before it sends the content, and
+     * smtp_bdat_send() receives the chunk responses as it goes. BDAT is not
+     * used with the PIX workaround that delays the end-of-data, nor for
+     * address probes that must stop after the DATA command.
      */
     nrcpt = 0;
     next_rcpt = send_rcpt = recv_rcpt = recv_done = 0;
     mail_from_rejected = 0;
+    use_bdat = ((session->features & SMTP_FEATURE_CHUNKING) != 0
+		&& (session->features & SMTP_FEATURE_PIX_DELAY_DOTCRLF) == 0
+		&& !(DEL_REQ_TRACE_ONLY(request->flags)
+		     && smtp_vrfy_tgt == SMTP_STATE_DATA));
+    state->bdat_sent = 0;
+    state->bdat_sync = 0;
+    state->bdat_fail = 0;
 
     /*
      * Prepare for disaster. This should not be needed because the design
@@ -1738,7 +1895,8 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 	    if ((next_rcpt = send_rcpt + 1) == SMTP_RCPT_LEFT(state))
 		next_state = (DEL_REQ_TRACE_ONLY(request->flags)
 			      && smtp_vrfy_tgt == SMTP_STATE_RCPT) ?
-		    SMTP_STATE_ABORT : SMTP_STATE_DATA;
+		    SMTP_STATE_ABORT : use_bdat ?
+		    SMTP_STATE_DOT : SMTP_STATE_DATA;
 	    break;
 
 	    /*
@@ -1752,14 +1910,18 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 
 	    /*
 	     * Build the "." command after we have seen the DATA response
-	     * (DATA is a protocol synchronization point).
+	     * (DATA is a protocol synchronization point). With BDAT, the
+	     * final command is sent along with the message content.
 	     * 
 	     * Changing the connection caching state here is safe because it
 	     * affects none of the not-yet processed replies to
 	     * already-generated commands.
 	     */
 	case SMTP_STATE_DOT:
-	    vstring_strcpy(next_command, ".");
+	    if (use_bdat)
+		VSTRING_RESET(next_command);
+	    else
+		vstring_strcpy(next_command, ".");
 	    if (THIS_SESSION_IS_EXPIRED)
 		DONT_CACHE_THIS_SESSION;
 	    next_state = THIS_SESSION_IS_CACHED ?
@@ -1847,11 +2009,19 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 #define CHECK_PIPELINING_BUFSIZE \
 	(recv_state != SMTP_STATE_DOT || send_state != SMTP_STATE_QUIT)
 
+	/*
+	 * With BDAT, the content is pipelined only if it fits the PIPELINING
+	 * buffer. The estimate allows for LF to CRLF conversion.
+	 */
+#define BDAT_CONTENT_ESTIMATE \
+	(send_state == SMTP_STATE_DOT ? \
+	 request->data_size + request->data_size / 16 + 30 : 0)
+
 	if (SENDER_IN_WAIT_STATE
 	    || (SENDER_IS_AHEAD
 		&& ((session->features & SMTP_FEATURE_PIPELINING) == 0
 		    || (CHECK_PIPELINING_BUFSIZE
-			&& (VSTRING_LEN(next_command) + 2
+			&& (VSTRING_LEN(next_command) + 2 + BDAT_CONTENT_ESTIMATE
 		    + vstream_bufstat(session->stream, VSTREAM_BST_OUT_PEND)
 			    > PIPELINING_BUFSIZE))
 		    || time((time_t *) 0)
@@ -2018,10 +2188,13 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 			}
 		    }
 		    /* If trace-only, send RSET instead of DATA. */
-		    if (++recv_rcpt == SMTP_RCPT_LEFT(state))
+		    if (++recv_rcpt == SMTP_RCPT_LEFT(state)) {
 			recv_state = (DEL_REQ_TRACE_ONLY(request->flags)
 				      && smtp_vrfy_tgt == SMTP_STATE_RCPT) ?
-			    SMTP_STATE_ABORT : SMTP_STATE_DATA;
+			    SMTP_STATE_ABORT : use_bdat ?
+			    SMTP_STATE_DOT : SMTP_STATE_DATA;
+			smtp_phase_done(state, SCACHE_PHASE_ENVELOPE);
+		    }
 		    /* XXX Also: record if non-delivering session. */
 		    break;
 
@@ -2077,7 +2250,9 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 		     * delivered.
 		     */
 		case SMTP_STATE_DOT:
+
 		    GETTIMEOFDAY(&request->msg_stats.deliver_done);
+		    smtp_phase_done(state, SCACHE_PHASE_DATA);
 		    if (smtp_mode) {
 			if (nrcpt > 0) {
 			    if (resp->code / 100 != 2) {
@@ -2085,7 +2260,7 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 					"host %s said: %s (in reply to %s)",
 					       session->namaddr,
 					     translit(resp->str, "\n", " "),
-					       xfer_request[SMTP_STATE_DOT]);
+					       SMTP_DOT_REQUEST);
 			    } else {
 				for (nrcpt = 0; nrcpt < recv_rcpt; nrcpt++) {
 				    rcpt = request->rcpt_list.info + nrcpt;
@@ -2112,7 +2287,7 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 					"host %s said: %s (in reply to %s)",
 					       session->namaddr,
 					     translit(resp->str, "\n", " "),
-					       xfer_request[SMTP_STATE_DOT]);
+					       SMTP_DOT_REQUEST);
 			    } else {
 				translit(resp->str, "\n", " ");
 				smtp_rcpt_done(state, resp, rcpt);
@@ -2193,7 +2368,8 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 	     */
 	    if ((send_state == SMTP_STATE_RCPT && mail_from_rejected)
 		|| (send_state == SMTP_STATE_DATA && nrcpt == 0)
-		|| (send_state == SMTP_STATE_DOT && nrcpt < 0)) {
+		|| (send_state == SMTP_STATE_DOT && nrcpt < 0)
+		|| (send_state == SMTP_STATE_DOT && nrcpt == 0 && use_bdat)) {
 		send_state = recv_state = SMTP_STATE_ABORT;
 		send_rcpt = recv_rcpt = 0;
 		vstring_strcpy(next_command, "RSET");
@@ -2217,11 +2393,15 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 	 * server accepted at least one recipient send the entire message.
 	 * Otherwise, just send "." as per RFC 2197.
 	 * 
+	 * With BDAT, send the message in chunks, ending with BDAT LAST. If the
+	 * content is pipelined, we don't yet know if any recipient was
+	 * accepted.
+	 * 
 	 * XXX If there is a hard MIME error while downgrading to 7-bit mail,
 	 * disconnect ungracefully, because there is no other way to cancel a
 	 * transaction in progress.
 	 */
-	if (send_state == SMTP_STATE_DOT && nrcpt > 0) {
+	if (send_state == SMTP_STATE_DOT && (nrcpt > 0 || use_bdat)) {
 
 	    smtp_stream_setup(session->stream, var_smtp_data1_tmout,
 			      var_smtp_rec_deadline);
@@ -2231,6 +2411,11 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 		if (vstream_fseek(state->src, request->data_offset, SEEK_SET) < 0)
 		    msg_fatal("seek queue file: %m");
 
+		if (use_bdat) {
+		    state->bdat_buf = vstring_alloc(var_smtp_bdat_chunk + 1024);
+		    state->bdat_sync = !SENDER_IS_AHEAD;
+		}
+
 		downgrading = SMTP_MIME_DOWNGRADE(session, request);
 
 		/*
@@ -2262,6 +2447,8 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 		while ((rec_type = rec_get(state->src, session->scratch, 0)) > 0) {
 		    if (rec_type != REC_TYPE_NORM && rec_type != REC_TYPE_CONT)
 			break;
+		    if (state->bdat_fail)
+			break;
 		    if (session->mime_state == 0) {
 			smtp_text_out((void *) state, rec_type,
 				      vstring_str(session->scratch),
@@ -2280,7 +2467,9 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 		    prev_type = rec_type;
 		}
 
-		if (session->mime_state) {
+		if (state->bdat_fail) {
+		    /* The server rejected a BDAT chunk; discard the rest. */
+		} else if (session->mime_state) {
 
 		    /*
 		     * The cleanup server normally ends MIME content with a
@@ -2299,14 +2488,14 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 			RETURN(0);
 		    }
 		} else if (prev_type == REC_TYPE_CONT)	/* missing newline */
-		    smtp_fputs("", 0, session->stream);
+		    smtp_data_fputs(state, "", 0);
 		if (session->features & SMTP_FEATURE_PIX_DELAY_DOTCRLF) {
 		    smtp_flush(session->stream);/* hurts performance */
 		    sleep(var_smtp_pix_delay);	/* not to mention this */
 		}
 		if (vstream_ferror(state->src))
 		    msg_fatal("queue file read error");
-		if (rec_type != REC_TYPE_XTRA) {
+		if (rec_type != REC_TYPE_XTRA && !state->bdat_fail) {
 		    msg_warn("%s: bad record type: %d in message content",
 			     request->queue_id, rec_type);
 		    fail_status = smtp_mesg_fail(state, DSN_BY_LOCAL_MTA,
@@ -2321,6 +2510,21 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 		    /* Don't override smtp_mesg_fail() here. */
 		    RETURN(fail_status);
 		}
+		if (state->bdat_buf) {
+		    smtp_bdat_send(state, 1);
+		    vstring_free(state->bdat_buf);
+		    state->bdat_buf = 0;
+		}
+
+		/*
+		 * The server rejected a BDAT chunk, and all chunk responses
+		 * have been received. BDAT LAST was not sent. Abort the mail
+		 * transaction with RSET, as if DATA was rejected.
+		 */
+		if (state->bdat_fail) {
+		    vstring_strcpy(next_command, "RSET");
+		    recv_state = SMTP_STATE_ABORT;
+		}
 	    } else {
 		if (!LOST_CONNECTION_INSIDE_DATA)
 		    RETURN(smtp_stream_except(state, except,
@@ -2340,14 +2544,20 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 		 */
 		(void) vstream_fpurge(session->stream, VSTREAM_PURGE_WRITE);
 		next_state = SMTP_STATE_LAST;
+		if (state->bdat_buf) {
+		    vstring_free(state->bdat_buf);
+		    state->bdat_buf = 0;
+		}
 	    }
 	}
 
 	/*
 	 * Copy the next command to the buffer and update the sender state.
+	 * With BDAT, the end-of-data command was sent with the content.
 	 */
 	if (except == 0) {
-	    smtp_chat_cmd(session, "%s", vstring_str(next_command));
+	    if (VSTRING_LEN(next_command) > 0)
+		smtp_chat_cmd(session, "%s", vstring_str(next_command));
 	} else {
 	    DONT_CACHE_THIS_SESSION;
 	}
@@ -2378,6 +2588,7 @@ int     smtp_xfer(SMTP_STATE *state)
     if (SMTP_RCPT_ISMARKED(request->rcpt_list.info))
 	msg_panic("smtp_xfer: bad recipient status: %d",
 		  request->rcpt_list.info->u.status);
+    SMTP_PHASE_START(state);
 
     /*
      * See if we should even try to send this message at all. This code sits
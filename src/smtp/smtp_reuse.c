@@ -19,6 +19,10 @@
 /*	SMTP_SESSION *smtp_reuse_addr(state, endp_key_flags)
 /*	SMTP_STATE *state;
 /*	int	endp_key_flags;
+/*
+/*	int	smtp_reuse_held()
+/*
+/*	void	smtp_reuse_release()
 /* DESCRIPTION
 /*	This module implements the SMTP client specific interface to
 /*	the generic session cache infrastructure.
@@ -44,6 +48,22 @@
 /*	MX" bit, and does not override the iterator dest, host and
 /*	addr fields. The result is null in case of failure.
 /*
+/*	When the SMTP_MISC_FLAG_CONN_HOLD flag is set, the above
+/*	functions save a session in the process-private smtp_hold_scache
+/*	instead of the shared connection cache, and look up a session
+/*	in smtp_hold_scache before they look in the shared connection
+/*	cache. This keeps a session open for the next delivery request
+/*	over the same queue manager connection.
+/*
+/*	smtp_reuse_held() returns non-zero when a session is held open
+/*	in smtp_hold_scache.
+/*
+/*	smtp_reuse_release() disposes of a held session. The session
+/*	is saved in the shared connection cache when that was permitted
+/*	for the request that saved the session; otherwise it is
+/*	re-activated and closed with smtp_quit(), as if it were never
+/*	held.
+/*
 /*	Arguments:
 /* .IP state
 /*	SMTP client state, including the current session, the original
@@ -106,14 +126,136 @@
   */
 #define SMTP_REUSE_KEY_DELIM_NA	"\n*"
 
+ /*
+  * The session that is held open for the next delivery request. We remember
+  * its cache labels so that we can move it to the shared connection cache
+  * when this process has no more work.
+  */
+static VSTRING *smtp_held_dest_label;
+static VSTRING *smtp_held_dest_prop;
+static VSTRING *smtp_held_endp_label;
+static VSTRING *smtp_held_host;
+static VSTRING *smtp_held_addr;
+static unsigned smtp_held_port;
+static int smtp_held_flags;
+
+#define SMTP_HELD_FLAG_BUSY	(1<<0)	/* a session is held */
+#define SMTP_HELD_FLAG_DEST	(1<<1)	/* held under next-hop name */
+#define SMTP_HELD_FLAG_STORE	(1<<2)	/* may go to shared cache */
+
+/* smtp_reuse_held - is a session held open? */
+
+int     smtp_reuse_held(void)
+{
+    return (smtp_held_flags & SMTP_HELD_FLAG_BUSY);
+}
+
+/* smtp_reuse_release - dispose of held session */
+
+void    smtp_reuse_release(void)
+{
+    static VSTRING *endp_prop;
+    static SMTP_STATE *state;
+    static DELIVER_REQUEST request;
+    SMTP_SESSION *session;
+    int     flags = smtp_held_flags;
+    int     fd;
+
+    if ((flags & SMTP_HELD_FLAG_BUSY) == 0)
+	return;
+    smtp_held_flags = 0;
+    if (endp_prop == 0)
+	endp_prop = vstring_alloc(100);
+    if ((fd = scache_find_endp(smtp_hold_scache, STR(smtp_held_endp_label),
+			       endp_prop)) < 0)
+	return;
+    if (smtp_scache != 0 && (flags & SMTP_HELD_FLAG_STORE)) {
+	if (flags & SMTP_HELD_FLAG_DEST)
+	    scache_save_dest(smtp_scache, var_smtp_cache_conn,
+			     STR(smtp_held_dest_label),
+			     STR(smtp_held_dest_prop),
+			     STR(smtp_held_endp_label));
+	scache_save_endp(smtp_scache, var_smtp_cache_conn,
+			 STR(smtp_held_endp_label), STR(endp_prop), fd);
+    } else {
+	if (msg_verbose)
+	    msg_info("closing held session %s", STR(smtp_held_endp_label));
+
+	/*
+	 * The delivery request that saved the session is gone. Re-activate
+	 * the session with a private SMTP_STATE that has no recipients, so
+	 * that smtp_quit() can send QUIT and receive the reply. This state
+	 * is never destroyed, because smtp_state_free() would flush the TLS
+	 * policy cache of a delivery in progress.
+	 */
+	if (state == 0) {
+	    state = smtp_state_alloc();
+	    request.queue_id = (char *) "NOQUEUE";
+	    state->request = &request;
+	}
+#ifdef USE_TLS
+	smtp_tls_policy_dummy(state->tls);
+#endif
+	SMTP_ITER_INIT(state->iterator, "", STR(smtp_held_host),
+		       STR(smtp_held_addr), smtp_held_port, state);
+	if ((session = smtp_session_activate(fd, state->iterator,
+					     (VSTRING *) 0, endp_prop)) == 0) {
+	    (void) close(fd);
+	    return;
+	}
+	state->session = session;
+	session->state = state;
+	(void) smtp_quit(state);
+	smtp_session_free(session);
+	state->session = 0;
+    }
+}
+
+/* smtp_hold_session - remember held session */
+
+static void smtp_hold_session(SMTP_STATE *state)
+{
+    if (smtp_held_endp_label == 0) {
+	smtp_held_dest_label = vstring_alloc(100);
+	smtp_held_dest_prop = vstring_alloc(100);
+	smtp_held_endp_label = vstring_alloc(100);
+	smtp_held_host = vstring_alloc(100);
+	smtp_held_addr = vstring_alloc(100);
+    }
+    smtp_held_flags = SMTP_HELD_FLAG_BUSY;
+    if (HAVE_SCACHE_REQUEST_NEXTHOP(state)) {
+	smtp_held_flags |= SMTP_HELD_FLAG_DEST;
+	vstring_strcpy(smtp_held_dest_label, STR(state->dest_label));
+	vstring_strcpy(smtp_held_dest_prop, STR(state->dest_prop));
+    }
+    if (state->misc_flags & SMTP_MISC_FLAG_CONN_STORE)
+	smtp_held_flags |= SMTP_HELD_FLAG_STORE;
+    vstring_strcpy(smtp_held_endp_label, STR(state->endp_label));
+    vstring_strcpy(smtp_held_host, STR(state->iterator->host));
+    vstring_strcpy(smtp_held_addr, STR(state->iterator->addr));
+    smtp_held_port = state->iterator->port;
+}
+
 /* smtp_save_session - save session under next-hop name and server address */
 
 void    smtp_save_session(SMTP_STATE *state, int name_key_flags,
 			          int endp_key_flags)
 {
     SMTP_SESSION *session = state->session;
+    SCACHE *scache;
     int     fd;
 
+    /*
+     * A process holds at most one session open for the next delivery
+     * request. Make room for the new session.
+     */
+    if (state->misc_flags & SMTP_MISC_FLAG_CONN_HOLD) {
+	smtp_reuse_release();
+	scache = smtp_hold_scache;
+    } else {
+	scache = smtp_scache;
+    }
+
     /*
      * Encode the delivery request next-hop destination, if applicable. Reuse
      * storage that is also used for cache lookup queries.
@@ -152,15 +294,17 @@ void    smtp_save_session(SMTP_STATE *state, int name_key_flags,
      * so.
      */
     if (HAVE_SCACHE_REQUEST_NEXTHOP(state))
-	scache_save_dest(smtp_scache, var_smtp_cache_conn,
+	scache_save_dest(scache, var_smtp_cache_conn,
 			 STR(state->dest_label), STR(state->dest_prop),
 			 STR(state->endp_label));
 
     /*
      * Save every good session under its physical endpoint address.
      */
-    scache_save_endp(smtp_scache, var_smtp_cache_conn, STR(state->endp_label),
+    scache_save_endp(scache, var_smtp_cache_conn, STR(state->endp_label),
 		     STR(state->endp_prop), fd);
+    if (scache == smtp_hold_scache)
+	smtp_hold_session(state);
 }
 
 /* smtp_reuse_common - common session reuse code */
@@ -219,8 +363,15 @@ SMTP_SESSION *smtp_reuse_nexthop(SMTP_STATE *state, int name_key_flags)
      */
     smtp_key_prefix(state->dest_label, SMTP_REUSE_KEY_DELIM_NA,
 		    state->iterator, name_key_flags);
-    if ((fd = scache_find_dest(smtp_scache, STR(state->dest_label),
-			       state->dest_prop, state->endp_prop)) < 0)
+    if ((state->misc_flags & SMTP_MISC_FLAG_CONN_HOLD) != 0
+	&& smtp_reuse_held()
+	&& (fd = scache_find_dest(smtp_hold_scache, STR(state->dest_label),
+				  state->dest_prop, state->endp_prop)) >= 0) {
+	smtp_held_flags = 0;
+    } else if ((state->misc_flags & SMTP_MISC_FLAG_CONN_LOAD) == 0
+	       || smtp_scache == 0
+	       || (fd = scache_find_dest(smtp_scache, STR(state->dest_label),
+				   state->dest_prop, state->endp_prop)) < 0)
 	return (0);
 
     /*
@@ -253,8 +404,15 @@ SMTP_SESSION *smtp_reuse_addr(SMTP_STATE *state, int endp_key_flags)
      */
     smtp_key_prefix(state->endp_label, SMTP_REUSE_KEY_DELIM_NA,
 		    state->iterator, endp_key_flags);
-    if ((fd = scache_find_endp(smtp_scache, STR(state->endp_label),
-			       state->endp_prop)) < 0)
+    if ((state->misc_flags & SMTP_MISC_FLAG_CONN_HOLD) != 0
+	&& smtp_reuse_held()
+	&& (fd = scache_find_endp(smtp_hold_scache, STR(state->endp_label),
+				  state->endp_prop)) >= 0) {
+	smtp_held_flags = 0;
+    } else if ((state->misc_flags & SMTP_MISC_FLAG_CONN_LOAD) == 0
+	       || smtp_scache == 0
+	       || (fd = scache_find_endp(smtp_scache, STR(state->endp_label),
+					 state->endp_prop)) < 0)
 	return (0);
     VSTRING_RESET(state->dest_prop);
     VSTRING_TERMINATE(state->dest_prop);
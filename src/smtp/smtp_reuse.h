@@ -14,6 +14,8 @@
 extern void smtp_save_session(SMTP_STATE *, int, int);
 extern SMTP_SESSION *smtp_reuse_nexthop(SMTP_STATE *, int);
 extern SMTP_SESSION *smtp_reuse_addr(SMTP_STATE *, int);
+extern int smtp_reuse_held(void);
+extern void smtp_reuse_release(void);
 
 /* LICENSE
 /* .ad
@@ -62,6 +62,9 @@
 /*	Enable re-use of cached SMTP or LMTP connections.
 /* .IP SMTP_MISC_FLAG_CONN_STORE
 /*	Enable saving of cached SMTP or LMTP connections.
+/* .IP SMTP_MISC_FLAG_CONN_HOLD
+/*	Enable saving of the connection for the next delivery request
+/*	that this process receives from the queue manager.
 /* .RE
 /*	SMTP_MISC_FLAG_CONN_MASK corresponds with both _LOAD and _STORE.
 /* .IP dest_prop
@@ -136,6 +139,12 @@
 #define SESS_ATTR_ENDP_FEATURES	"endpoint_features"
 #define SESS_ATTR_EXPIRE_TIME	"expire_time"
 
+#ifdef USE_TLS
+#define SESS_ENDP_ATTR_COUNT	4
+#else
+#define SESS_ENDP_ATTR_COUNT	3	/* no tls_level */
+#endif
+
 /* smtp_session_alloc - allocate and initialize SMTP_SESSION structure */
 
 SMTP_SESSION *smtp_session_alloc(VSTREAM *stream, SMTP_ITERATOR *iter,
@@ -171,7 +180,7 @@ SMTP_SESSION *smtp_session_alloc(VSTREAM *stream, SMTP_ITERATOR *iter,
 
     session->send_proto_helo = 0;
 
-    if (flags & SMTP_MISC_FLAG_CONN_STORE)
+    if (flags & SMTP_MISC_FLAG_CONN_STORE_MASK)
 	CACHE_THIS_SESSION_UNTIL(start + var_smtp_reuse_time);
     else
 	DONT_CACHE_THIS_SESSION;
@@ -365,7 +374,7 @@ SMTP_SESSION *smtp_session_activate(int fd, SMTP_ITERATOR *iter,
 					 &endp_features),
 			   RECV_ATTR_LONG(SESS_ATTR_EXPIRE_TIME,
 					  &expire_time),
-			   ATTR_TYPE_END) != 4
+			   ATTR_TYPE_END) != SESS_ENDP_ATTR_COUNT
 #ifdef USE_TLS
 	|| ((tls->level > TLS_LEV_MAY
 	     || (tls->level == TLS_LEV_MAY && vstream_peek(mp) > 0))
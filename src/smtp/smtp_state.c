@@ -62,6 +62,11 @@ SMTP_STATE *smtp_state_alloc(void)
     state->session = 0;
     state->status = 0;
     state->space_left = 0;
+    state->bdat_buf = 0;
+    state->bdat_sent = 0;
+    state->bdat_sync = 0;
+    state->bdat_fail = 0;
+    smtp_phase_init(state);
     state->iterator->request_nexthop = vstring_alloc(100);
     state->iterator->dest = vstring_alloc(100);
     state->iterator->host = vstring_alloc(100);
@@ -171,6 +171,12 @@
 /* .IP "\fBsmtpd_upstream_proxy_timeout (5s)\fR"
 /*	The time limit for the proxy protocol specified with the
 /*	smtpd_upstream_proxy_protocol parameter.
+/* .PP
+/*	Available in Postfix version 3.5 and later:
+/* .IP "\fBsmtpd_upstream_proxy_tls_termination (no)\fR"
+/*	Trust TLS session information from a haproxy version 2
+/*	up-stream proxy that terminates TLS, and don't offer
+/*	STARTTLS when the remote SMTP client used TLS with the proxy.
 /* AFTER QUEUE EXTERNAL CONTENT INSPECTION CONTROLS
 /* .ad
 /* .fi
@@ -1183,6 +1189,7 @@
 #include <split_at.h>
 #include <name_code.h>
 #include <inet_proto.h>
+#include <stats.h>
 
 /* Global library. */
 
@@ -1445,6 +1452,7 @@ char   *var_tlsproxy_service;
 
 char   *var_smtpd_uproxy_proto;
 int     var_smtpd_uproxy_tmout;
+bool    var_smtpd_uproxy_tls;
 
  /*
   * Silly little macros.
@@ -1491,6 +1499,13 @@ static int xforward_allowed;		/* XXX should be SMTPD_STATE member */
 ANVIL_CLNT *anvil_clnt;
 static NAMADR_LIST *hogger_list;
 
+ /*
+  * Performance counters.
+  */
+static STATS_CELL *smtpd_stats_conns;
+static STATS_CELL *smtpd_stats_msgs;
+static STATS_CELL *smtpd_stats_session;
+
  /*
   * Other application-specific globals.
   */
@@ -3647,6 +3662,7 @@ static int common_post_message_handling(SMTPD_STATE *state)
      * See also: qmqpd.c
      */
     if (state->err == CLEANUP_STAT_OK) {
+	STATS_INC(smtpd_stats_msgs);
 	state->error_count = 0;
 	state->error_mask = 0;
 	state->junk_cmds = 0;
@@ -5264,10 +5280,15 @@ static void tls_reset(SMTPD_STATE *state)
 #ifdef USE_TLSPROXY
 	tls_proxy_context_free(state->tls_context);
 #else
-	tls_server_stop(smtpd_tls_ctx, state->client, var_smtpd_starttls_tmout,
-			failure, state->tls_context);
+	if (state->flags & SMTPD_FLAG_UPROXY_TLS)
+	    tls_proxy_context_free(state->tls_context);
+	else
+	    tls_server_stop(smtpd_tls_ctx, state->client,
+			    var_smtpd_starttls_tmout, failure,
+			    state->tls_context);
 #endif
 	state->tls_context = 0;
+	state->flags &= ~SMTPD_FLAG_UPROXY_TLS;
     }
 }
 
@@ -5433,7 +5454,24 @@ static void smtpd_proto(SMTPD_STATE *state)
 	 * obsolete, so we don't have to provide perfect support.
 	 */
 #ifdef USE_TLS
-	if (SMTPD_STAND_ALONE(state) == 0 && var_smtpd_tls_wrappermode) {
+
+	/*
+	 * When an up-stream proxy terminated TLS, use its TLS session
+	 * information as if the client had sent STARTTLS. This suppresses
+	 * the STARTTLS offer, satisfies smtpd_tls_security_level=encrypt,
+	 * and enables the TLS-only SASL mechanisms.
+	 */
+	if (var_smtpd_uproxy_tls && state->haproxy_tlv != 0
+	    && (state->tls_context = smtpd_haproxy_tls_context(state)) != 0) {
+	    state->flags |= SMTPD_FLAG_UPROXY_TLS;
+#ifdef USE_SASL_AUTH
+	    if (var_smtpd_sasl_enable && smtpd_sasl_is_active(state) == 0)
+		smtpd_sasl_activate(state, VAR_SMTPD_SASL_TLS_OPTS,
+				    var_smtpd_sasl_tls_opts);
+#endif
+	}
+	if (SMTPD_STAND_ALONE(state) == 0 && var_smtpd_tls_wrappermode
+	    && state->tls_context == 0) {
 #ifdef USE_TLSPROXY
 	    /* We garbage-collect the VSTREAM in smtpd_state_reset() */
 	    state->tlsproxy =
@@ -5900,6 +5938,8 @@ static void teardown_milters(SMTPD_STATE *state)
 static void smtpd_service(VSTREAM *stream, char *service, char **argv)
 {
     SMTPD_STATE state;
+    struct timeval start;
+    struct timeval done;
 
     /*
      * Sanity check. This service takes no command-line arguments.
@@ -5926,8 +5966,12 @@ static void smtpd_service(VSTREAM *stream, char *service, char **argv)
      * take a while. This is why I always run a local name server on critical
      * machines.
      */
+    GETTIMEOFDAY(&start);
+    STATS_INC(smtpd_stats_conns);
     smtpd_state_init(&state, stream, service);
     msg_info("connect from %s", state.namaddr);
+    if (state.haproxy_tlv)
+	smtpd_haproxy_log(&state);
 
     /*
      * Disable TLS when running in stand-alone mode via "sendmail -bs".
@@ -5975,6 +6019,10 @@ static void smtpd_service(VSTREAM *stream, char *service, char **argv)
     teardown_milters(&state);			/* duplicates xclient_cmd */
     smtpd_state_reset(&state);
     debug_peer_restore();
+    GETTIMEOFDAY(&done);
+    stats_observe(smtpd_stats_session,
+		  (done.tv_sec - start.tv_sec) * 1000
+		  + (done.tv_usec - start.tv_usec) / 1000);
 }
 
 /* pre_accept - see if tables have changed */
@@ -6231,6 +6279,13 @@ static void pre_jail_init(char *unused_name, char **unused_argv)
 static void post_jail_init(char *unused_name, char **unused_argv)
 {
 
+    /*
+     * Performance counters. See "postfix stats".
+     */
+    smtpd_stats_conns = stats_counter("smtpd_connections_total");
+    smtpd_stats_msgs = stats_counter("smtpd_messages_total");
+    smtpd_stats_session = stats_histogram("smtpd_session_milliseconds");
+
     /*
      * Initialize the receive transparency options: do we want unknown
      * recipient checks, address mapping, header_body_checks?.
@@ -6366,6 +6421,7 @@ int     main(int argc, char **argv)
 	VAR_SMTPD_PEERNAME_LOOKUP, DEF_SMTPD_PEERNAME_LOOKUP, &var_smtpd_peername_lookup,
 	VAR_SMTPD_DELAY_OPEN, DEF_SMTPD_DELAY_OPEN, &var_smtpd_delay_open,
 	VAR_SMTPD_CLIENT_PORT_LOG, DEF_SMTPD_CLIENT_PORT_LOG, &var_smtpd_client_port_log,
+	VAR_SMTPD_UPROXY_TLS, DEF_SMTPD_UPROXY_TLS, &var_smtpd_uproxy_tls,
 	0,
     };
     static const CONFIG_NBOOL_TABLE nbool_table[] = {
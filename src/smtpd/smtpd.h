@@ -25,6 +25,7 @@
  /*
   * Global library.
   */
+#include <haproxy_srvr.h>
 #include <mail_stream.h>
 
  /*
@@ -81,6 +82,7 @@ typedef struct {
     int     addr_family;		/* address family */
     char   *dest_addr;			/* Dovecot AUTH, Milter {daemon_addr} */
     char   *dest_port;			/* Milter {daemon_port} */
+    HAPROXY_SRVR_TLV *haproxy_tlv;	/* haproxy version 2 TLVs */
     struct sockaddr_storage sockaddr;	/* binary client endpoint */
     SOCKADDR_SIZE sockaddr_len;		/* binary client endpoint */
     struct sockaddr_storage dest_sockaddr;	/* binary local endpoint */
@@ -206,6 +208,7 @@ typedef struct {
 #define SMTPD_FLAG_ILL_PIPELINING  (1<<1)	/* inappropriate pipelining */
 #define SMTPD_FLAG_AUTH_USED	   (1<<2)	/* don't reuse SASL state */
 #define SMTPD_FLAG_SMTPUTF8	   (1<<3)	/* RFC 6531/2 transaction */
+#define SMTPD_FLAG_UPROXY_TLS	   (1<<4)	/* TLS by up-stream proxy */
 
  /* Security: don't reset SMTPD_FLAG_AUTH_USED. */
 #define SMTPD_MASK_MAIL_KEEP \
@@ -346,6 +349,11 @@ extern void smtpd_state_reset(SMTPD_STATE *);
 extern void smtpd_peer_init(SMTPD_STATE *state);
 extern void smtpd_peer_reset(SMTPD_STATE *state);
 extern int smtpd_peer_from_haproxy(SMTPD_STATE *state);
+extern void smtpd_haproxy_log(SMTPD_STATE *state);
+
+#ifdef USE_TLS
+extern TLS_SESS_STATE *smtpd_haproxy_tls_context(SMTPD_STATE *state);
+#endif
 
 #define	SMTPD_PEER_CODE_OK	2
 #define SMTPD_PEER_CODE_TEMP	4
@@ -3974,6 +3974,15 @@ static int check_policy_service(SMTPD_STATE *state, const char *server,
 #endif
 			  SEND_ATTR_STR(MAIL_ATTR_POL_CONTEXT,
 					policy_clnt->policy_context),
+#define IF_PROXY_TLV(x) \
+	((state->haproxy_tlv && state->haproxy_tlv->x) ? \
+	 state->haproxy_tlv->x : "")
+			  SEND_ATTR_STR(MAIL_ATTR_PROXY_UNIQUE_ID,
+					IF_PROXY_TLV(unique_id)),
+			  SEND_ATTR_STR(MAIL_ATTR_PROXY_AUTHORITY,
+					IF_PROXY_TLV(authority)),
+			  SEND_ATTR_STR(MAIL_ATTR_PROXY_ALPN,
+					IF_PROXY_TLV(alpn)),
 			  ATTR_TYPE_END,
 			  ATTR_FLAG_MISSING,	/* Reply attributes. */
 			  RECV_ATTR_STR(MAIL_ATTR_ACTION, action),
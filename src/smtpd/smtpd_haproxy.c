@@ -8,9 +8,17 @@
 /*
 /*	int	smtpd_peer_from_haproxy(state)
 /*	SMTPD_STATE *state;
+/*
+/*	void	smtpd_haproxy_log(state)
+/*	SMTPD_STATE *state;
+/*
+/*	TLS_SESS_STATE *smtpd_haproxy_tls_context(state)
+/*	SMTPD_STATE *state;
 /* DESCRIPTION
 /*	smtpd_peer_from_haproxy() receives endpoint address and
-/*	port information via the haproxy protocol.
+/*	port information via the haproxy protocol version 1 or 2.
+/*	Information from version 2 TLVs is saved in the haproxy_tlv
+/*	session context field.
 /*
 /*	The following summarizes what the Postfix SMTP server expects
 /*	from an up-stream proxy adapter.
@@ -38,11 +46,30 @@
 /*	Arguments:
 /* .IP state
 /*	Session context.
+/* .PP
+/*	smtpd_haproxy_log() logs the connection ID, authority (server
+/*	name) and application protocol that the up-stream proxy
+/*	reported in version 2 TLVs, if any, so that the connection
+/*	can be matched with the proxy's logging. This information
+/*	is also available as the policy attributes proxy_unique_id,
+/*	proxy_authority and proxy_alpn, and as the Milter macros
+/*	{proxy_unique_id}, {proxy_authority} and {proxy_alpn}.
+/*
+/*	smtpd_haproxy_tls_context() returns a TLS session context
+/*	that describes the TLS session between the remote SMTP
+/*	client and the up-stream proxy, or a null pointer when the
+/*	proxy did not report such a session. The context has only
+/*	the TLS protocol version and cipher name; a client certificate
+/*	is never considered present. Destroy the result with
+/*	tls_proxy_context_free().
 /* DIAGNOSTICS
-/*	Warnings: I/O errors, malformed haproxy line.
+/*	Warnings: I/O errors, malformed haproxy header.
 /*
-/*	The result value is 0 in case of success, -1 in case of
-/*	error.
+/*	The smtpd_peer_from_haproxy() result value is 0 in case of
+/*	success, -1 in case of error, and 1 when the proxy reports
+/*	that the connection is not proxied (for example, a health
+/*	check); the caller should then use the connection endpoint
+/*	information.
 /* LICENSE
 /* .ad
 /* .fi
@@ -63,6 +90,8 @@
 
 #include <sys_defs.h>
 #include <sys/socket.h>
+#include <string.h>
+#include <time.h>
 
 /* Utility library. */
 
@@ -70,10 +99,10 @@
 #include <myaddrinfo.h>
 #include <mymalloc.h>
 #include <stringops.h>
+#include <iostuff.h>
 
 /* Global library. */
 
-#include <smtp_stream.h>
 #include <mail_params.h>
 #include <valid_mailhost_addr.h>
 #include <haproxy_srvr.h>
@@ -91,78 +120,153 @@
 
 int     smtpd_peer_from_haproxy(SMTPD_STATE *state)
 {
-    const char *myname = "smtpd_peer_from_haproxy";
     MAI_HOSTADDR_STR smtp_client_addr;
     MAI_SERVPORT_STR smtp_client_port;
     MAI_HOSTADDR_STR smtp_server_addr;
     MAI_SERVPORT_STR smtp_server_port;
     const char *proxy_err;
-    int     io_err;
+    int     non_proxy;
+    int     fd = vstream_fileno(state->client);
+    time_t  deadline = time((time_t *) 0) + var_smtpd_uproxy_tmout;
+    int     timeout;
     VSTRING *escape_buf;
+    HAPROXY_SRVR_TLV *tlv;
 
     /*
-     * While reading HAProxy handshake information, don't buffer input beyond
-     * the end-of-line. That would break the TLS wrappermode handshake.
+     * While reading HAProxy handshake information, don't read input beyond
+     * the end of the header. That would break the TLS wrappermode
+     * handshake. We bypass the VSTREAM buffer, and let haproxy_srvr_receive()
+     * peek at the data and consume exactly the header bytes.
+     * 
+     * Note: haproxy_srvr_receive() performs address protocol checks, address
+     * and port syntax checks, and converts IPv4-in-IPv6 address string
+     * syntax (::ffff:1.2.3.4) to IPv4 syntax where permitted by the
+     * main.cf:inet_protocols setting, but logs no warnings.
      */
-    vstream_control(state->client,
-		    VSTREAM_CTL_BUFSIZE, 1,
-		    VSTREAM_CTL_END);
-
-    /*
-     * Note: the haproxy_srvr_parse() routine performs address protocol
-     * checks, address and port syntax checks, and converts IPv4-in-IPv6
-     * address string syntax (::ffff:1.2.3.4) to IPv4 syntax where permitted
-     * by the main.cf:inet_protocols setting, but logs no warnings.
-     */
-#define ENABLE_DEADLINE	1
-
-    smtp_stream_setup(state->client, var_smtpd_uproxy_tmout, ENABLE_DEADLINE);
-    switch (io_err = vstream_setjmp(state->client)) {
-    default:
-	msg_panic("%s: unhandled I/O error %d", myname, io_err);
-    case SMTP_ERR_EOF:
-	msg_warn("haproxy read: unexpected EOF");
-	return (-1);
-    case SMTP_ERR_TIME:
-	msg_warn("haproxy read: timeout error");
-	return (-1);
-    case 0:
-	if (smtp_get(state->buffer, state->client, HAPROXY_MAX_LEN,
-		     SMTP_GET_FLAG_NONE) != '\n') {
-	    msg_warn("haproxy read: line > %d characters", HAPROXY_MAX_LEN);
+    VSTRING_RESET(state->buffer);
+    do {
+	if ((timeout = deadline - time((time_t *) 0)) <= 0
+	    || read_wait(fd, timeout) < 0) {
+	    msg_warn("haproxy read: timeout error");
 	    return (-1);
 	}
-	if ((proxy_err = haproxy_srvr_parse(STR(state->buffer),
+	proxy_err = haproxy_srvr_receive(fd, state->buffer, &non_proxy,
 				       &smtp_client_addr, &smtp_client_port,
-			      &smtp_server_addr, &smtp_server_port)) != 0) {
+				       &smtp_server_addr, &smtp_server_port,
+					 &state->haproxy_tlv);
+    } while (proxy_err != 0 && HAPROXY_SRVR_INCOMPLETE(proxy_err));
+
+    if (proxy_err != 0) {
+	if (LEN(state->buffer) == 0) {
+	    msg_warn("haproxy read: %s", proxy_err);
+	} else {
 	    escape_buf = vstring_alloc(HAPROXY_MAX_LEN + 2);
-	    escape(escape_buf, STR(state->buffer), LEN(state->buffer));
+	    escape(escape_buf, STR(state->buffer),
+		   LEN(state->buffer) < HAPROXY_MAX_LEN ?
+		   LEN(state->buffer) : HAPROXY_MAX_LEN);
 	    msg_warn("haproxy read: %s: %s", proxy_err, STR(escape_buf));
 	    vstring_free(escape_buf);
-	    return (-1);
-	}
-	state->addr = mystrdup(smtp_client_addr.buf);
-	if (strrchr(state->addr, ':') != 0) {
-	    state->rfc_addr = concatenate(IPV6_COL, state->addr, (char *) 0);
-	    state->addr_family = AF_INET6;
-	} else {
-	    state->rfc_addr = mystrdup(state->addr);
-	    state->addr_family = AF_INET;
 	}
-	state->port = mystrdup(smtp_client_port.buf);
-
-	/*
-	 * The Dovecot authentication server needs the server IP address.
-	 */
-	state->dest_addr = mystrdup(smtp_server_addr.buf);
-	state->dest_port = mystrdup(smtp_server_port.buf);
-
-	/*
-	 * Enable normal buffering.
-	 */
-	vstream_control(state->client,
-			VSTREAM_CTL_BUFSIZE, VSTREAM_BUFSIZE,
-			VSTREAM_CTL_END);
-	return (0);
+	return (-1);
     }
+    if (non_proxy)
+	return (1);
+
+    state->addr = mystrdup(smtp_client_addr.buf);
+    if (strrchr(state->addr, ':') != 0) {
+	state->rfc_addr = concatenate(IPV6_COL, state->addr, (char *) 0);
+	state->addr_family = AF_INET6;
+    } else {
+	state->rfc_addr = mystrdup(state->addr);
+	state->addr_family = AF_INET;
+    }
+    state->port = mystrdup(smtp_client_port.buf);
+
+    /*
+     * The Dovecot authentication server needs the server IP address.
+     */
+    state->dest_addr = mystrdup(smtp_server_addr.buf);
+    state->dest_port = mystrdup(smtp_server_port.buf);
+
+    if (msg_verbose && (tlv = state->haproxy_tlv) != 0)
+	msg_info("haproxy TLVs: alpn=%s authority=%s unique_id=%s"
+		 " tls=%s version=%s cipher=%s cert=%s%s",
+		 tlv->alpn ? tlv->alpn : "",
+		 tlv->authority ? tlv->authority : "",
+		 tlv->unique_id ? tlv->unique_id : "",
+		 (tlv->flags & HAPROXY_TLV_FLAG_TLS) ? "yes" : "no",
+		 tlv->tls_version ? tlv->tls_version : "",
+		 tlv->tls_cipher ? tlv->tls_cipher : "",
+		 tlv->tls_peer_cn ? tlv->tls_peer_cn : "",
+		 (tlv->flags & HAPROXY_TLV_FLAG_TLS_VERIFIED) ?
+		 " (verified)" : "");
+    return (0);
+}
+
+/* smtpd_haproxy_log - log connection information from proxy */
+
+void    smtpd_haproxy_log(SMTPD_STATE *state)
+{
+    HAPROXY_SRVR_TLV *tlv = state->haproxy_tlv;
+    VSTRING *buf;
+
+    if (tlv == 0 || (tlv->unique_id == 0 && tlv->authority == 0
+		     && tlv->alpn == 0))
+	return;
+    buf = vstring_alloc(100);
+    if (tlv->unique_id)
+	vstring_sprintf_append(buf, ", proxy_unique_id=%s", tlv->unique_id);
+    if (tlv->authority)
+	vstring_sprintf_append(buf, ", proxy_authority=%s", tlv->authority);
+    if (tlv->alpn)
+	vstring_sprintf_append(buf, ", proxy_alpn=%s", tlv->alpn);
+    msg_info("proxied connection from %s%s", state->namaddr, STR(buf));
+    vstring_free(buf);
+}
+
+#ifdef USE_TLS
+
+/* smtpd_haproxy_tls_context - TLS session terminated by haproxy */
+
+TLS_SESS_STATE *smtpd_haproxy_tls_context(SMTPD_STATE *state)
+{
+    HAPROXY_SRVR_TLV *tlv = state->haproxy_tlv;
+    TLS_SESS_STATE *tls_context;
+
+    if (tlv == 0 || (tlv->flags & HAPROXY_TLV_FLAG_TLS) == 0)
+	return (0);
+
+    /*
+     * Construct a structure that tls_proxy_context_free() can destroy. We
+     * have no certificate fingerprints, therefore the client certificate
+     * is never present or trusted, even if the proxy verified it.
+     * 
+     * Note: memset() is not a portable way to initialize non-integer types.
+     */
+    tls_context = (TLS_SESS_STATE *) mymalloc(sizeof(*tls_context));
+    memset(tls_context, 0, sizeof(*tls_context));
+    tls_context->peer_CN = mystrdup("");
+    tls_context->issuer_CN = mystrdup("");
+    tls_context->peer_cert_fprint = mystrdup("");
+    tls_context->peer_pkey_fprint = mystrdup("");
+    tls_context->peer_status = 0;
+    tls_context->protocol =
+	mystrdup(tlv->tls_version ? tlv->tls_version : "unknown");
+    tls_context->cipher_name =
+	mystrdup(tlv->tls_cipher ? tlv->tls_cipher : "unknown");
+    tls_context->kex_name = 0;
+    tls_context->kex_curve = 0;
+    tls_context->clnt_sig_name = 0;
+    tls_context->clnt_sig_curve = 0;
+    tls_context->clnt_sig_dgst = 0;
+    tls_context->srvr_sig_name = 0;
+    tls_context->srvr_sig_curve = 0;
+    tls_context->srvr_sig_dgst = 0;
+    tls_context->namaddr = mystrdup(state->namaddr);
+
+    msg_info("%s: TLS terminated by up-stream proxy: %s with cipher %s",
+	     state->namaddr, tls_context->protocol, tls_context->cipher_name);
+    return (tls_context);
 }
+
+#endif
@@ -118,6 +118,15 @@ const char *smtpd_milter_eval(const char *name, void *ptr)
     if (strcmp(name, S8_MAC_DAEMON_PORT) == 0)
 	return (state->dest_port);
 
+#define IF_PROXY_TLV(x) (state->haproxy_tlv ? state->haproxy_tlv->x : 0)
+
+    if (strcmp(name, S8_MAC_PROXY_ALPN) == 0)
+	return (IF_PROXY_TLV(alpn));
+    if (strcmp(name, S8_MAC_PROXY_AUTHORITY) == 0)
+	return (IF_PROXY_TLV(authority));
+    if (strcmp(name, S8_MAC_PROXY_UNIQUE_ID) == 0)
+	return (IF_PROXY_TLV(unique_id));
+
     /*
      * HELO macros.
      */
@@ -55,6 +55,8 @@
 /* .IP dest_port
 /*	Server port, available as Milter {daemon_port} macro, and
 /*	as server_port policy delegation attribute.
+/* .IP haproxy_tlv
+/*	Information from haproxy version 2 TLVs, or a null pointer.
 /* .IP name_status
 /*	The name_status result field specifies how the name
 /*	information should be interpreted:
@@ -563,11 +565,18 @@ static void smtpd_peer_from_proxy(SMTPD_STATE *state)
 	if (strcmp(var_smtpd_uproxy_proto, pp->name) == 0)
 	    break;
     }
-    if (pp->endpt_lookup(state) < 0) {
+    switch (pp->endpt_lookup(state)) {
+    case -1:
 	smtpd_peer_no_client(state);
 	state->flags |= SMTPD_FLAG_HANGUP;
-    } else {
+	break;
+    case 0:
 	smtpd_peer_hostaddr_to_sockaddr(state);
+	break;
+    default:
+	/* Not proxied, for example a load balancer health check. */
+	smtpd_peer_from_default(state);
+	break;
     }
 }
 
@@ -595,6 +604,7 @@ void    smtpd_peer_init(SMTPD_STATE *state)
     state->port = 0;
     state->dest_addr = 0;
     state->dest_port = 0;
+    state->haproxy_tlv = 0;
 
     /*
      * Determine the remote SMTP client address and port.
@@ -649,4 +659,8 @@ void    smtpd_peer_reset(SMTPD_STATE *state)
 	myfree(state->dest_addr);
     if (state->dest_port)
 	myfree(state->dest_port);
+    if (state->haproxy_tlv) {
+	haproxy_srvr_tlv_free(state->haproxy_tlv);
+	state->haproxy_tlv = 0;
+    }
 }
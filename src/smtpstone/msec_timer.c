@@ -0,0 +1,228 @@
+/*++
+/* NAME
+/*	msec_timer 3
+/* SUMMARY
+/*	millisecond timer events for test programs
+/* SYNOPSIS
+/*	#include "msec_timer.h"
+/*
+/*	void	msec_timer_request(callback, context, delay)
+/*	void	(*callback)(int event, void *context);
+/*	void	*context;
+/*	int	delay;
+/*
+/*	int	msec_timer_cancel(callback, context)
+/*	void	(*callback)(int event, void *context);
+/*	void	*context;
+/* DESCRIPTION
+/*	This module provides timer events with millisecond resolution,
+/*	for test programs that need finer control over time than the
+/*	one-second timers of the events(3) module. The callback is
+/*	invoked from event_loop() with the EVENT_TIME event type.
+/*
+/*	msec_timer_request() schedules a call of the specified
+/*	callback function after \fIdelay\fR milliseconds. A request
+/*	for a callback and context that are already scheduled
+/*	replaces the existing request.
+/*
+/*	msec_timer_cancel() cancels the specified timer request. The
+/*	result is non-zero when a request was found.
+/*
+/*	The implementation uses an interval timer and a self pipe
+/*	that is registered with the events(3) module. It takes over
+/*	the SIGALRM signal and the ITIMER_REAL timer.
+/* DIAGNOSTICS
+/*	Panic: interface violations. Fatal errors: out of resources.
+/* SEE ALSO
+/*	events(3), event manager
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <iostuff.h>
+#include <events.h>
+
+/* Application-specific. */
+
+#include "msec_timer.h"
+
+ /*
+  * Pending requests, sorted by time.
+  */
+typedef struct MSEC_TIMER {
+    struct timeval when;		/* when event is wanted */
+    EVENT_NOTIFY_TIME_FN callback;	/* callback function */
+    void   *context;			/* callback context */
+    struct MSEC_TIMER *next;		/* linkage */
+} MSEC_TIMER;
+
+static MSEC_TIMER *msec_timer_list;
+static int msec_timer_pipe[2] = {-1, -1};
+
+#define MSEC_TIMER_BEFORE(a, b) \
+	((a)->tv_sec < (b)->tv_sec \
+	 || ((a)->tv_sec == (b)->tv_sec && (a)->tv_usec < (b)->tv_usec))
+
+/* msec_timer_sig - wake up the event loop */
+
+static void msec_timer_sig(int unused_sig)
+{
+    int     saved_errno = errno;
+
+    /*
+     * WARNING WARNING WARNING.
+     *
+     * This code runs at unpredictable moments, as a signal handler. Don't put
+     * any code here other than code that is intended to be run within a
+     * signal handler. A full pipe already guarantees a wakeup.
+     */
+    (void) write(msec_timer_pipe[1], "", 1);
+    errno = saved_errno;
+}
+
+/* msec_timer_arm - set the interval timer for the first request */
+
+static void msec_timer_arm(void)
+{
+    struct itimerval it;
+    struct timeval now;
+    long    usec;
+
+    it.it_interval.tv_sec = it.it_interval.tv_usec = 0;
+    it.it_value.tv_sec = it.it_value.tv_usec = 0;
+    if (msec_timer_list != 0) {
+	GETTIMEOFDAY(&now);
+	usec = (msec_timer_list->when.tv_sec - now.tv_sec) * 1000000L
+	    + msec_timer_list->when.tv_usec - now.tv_usec;
+	if (usec <= 0)
+	    usec = 1;
+	it.it_value.tv_sec = usec / 1000000;
+	it.it_value.tv_usec = usec % 1000000;
+    }
+    if (setitimer(ITIMER_REAL, &it, (struct itimerval *) 0) < 0)
+	msg_fatal("setitimer: %m");
+}
+
+/* msec_timer_event - run expired requests */
+
+static void msec_timer_event(int unused_event, void *unused_context)
+{
+    MSEC_TIMER *timer;
+    struct timeval now;
+    char    buf[100];
+
+    while (read(msec_timer_pipe[0], buf, sizeof(buf)) > 0)
+	 /* void */ ;
+
+    /*
+     * Unlink each request before invoking its callback, so that the callback
+     * can safely make new requests or cancel old ones.
+     */
+    GETTIMEOFDAY(&now);
+    while ((timer = msec_timer_list) != 0
+	   && !MSEC_TIMER_BEFORE(&now, &timer->when)) {
+	msec_timer_list = timer->next;
+	timer->callback(EVENT_TIME, timer->context);
+	myfree((void *) timer);
+    }
+    msec_timer_arm();
+}
+
+/* msec_timer_init - one-time initialization */
+
+static void msec_timer_init(void)
+{
+    struct sigaction action;
+
+    if (pipe(msec_timer_pipe) < 0)
+	msg_fatal("pipe: %m");
+    non_blocking(msec_timer_pipe[0], NON_BLOCKING);
+    non_blocking(msec_timer_pipe[1], NON_BLOCKING);
+    close_on_exec(msec_timer_pipe[0], CLOSE_ON_EXEC);
+    close_on_exec(msec_timer_pipe[1], CLOSE_ON_EXEC);
+    event_enable_read(msec_timer_pipe[0], msec_timer_event, (void *) 0);
+
+    /*
+     * Restart interrupted system calls, so that blocking reads and writes
+     * elsewhere in the program are not affected. The event loop itself will
+     * still wake up.
+     */
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    action.sa_handler = msec_timer_sig;
+    if (sigaction(SIGALRM, &action, (struct sigaction *) 0) < 0)
+	msg_fatal("sigaction: %m");
+}
+
+/* msec_timer_request - schedule timer event */
+
+void    msec_timer_request(EVENT_NOTIFY_TIME_FN callback, void *context,
+			           int delay)
+{
+    MSEC_TIMER *timer;
+    MSEC_TIMER **tpp;
+
+    if (delay < 0)
+	msg_panic("msec_timer_request: invalid delay: %d", delay);
+    if (msec_timer_pipe[0] < 0)
+	msec_timer_init();
+    (void) msec_timer_cancel(callback, context);
+
+    timer = (MSEC_TIMER *) mymalloc(sizeof(*timer));
+    GETTIMEOFDAY(&timer->when);
+    timer->when.tv_sec += delay / 1000;
+    timer->when.tv_usec += (delay % 1000) * 1000;
+    if (timer->when.tv_usec >= 1000000) {
+	timer->when.tv_sec += 1;
+	timer->when.tv_usec -= 1000000;
+    }
+    timer->callback = callback;
+    timer->context = context;
+
+    /*
+     * Insert after requests with the same deadline, to preserve FIFO order.
+     */
+    for (tpp = &msec_timer_list; *tpp != 0; tpp = &(*tpp)->next)
+	if (MSEC_TIMER_BEFORE(&timer->when, &(*tpp)->when))
+	    break;
+    timer->next = *tpp;
+    *tpp = timer;
+    if (msec_timer_list == timer)
+	msec_timer_arm();
+}
+
+/* msec_timer_cancel - cancel timer event */
+
+int     msec_timer_cancel(EVENT_NOTIFY_TIME_FN callback, void *context)
+{
+    MSEC_TIMER *timer;
+    MSEC_TIMER **tpp;
+
+    for (tpp = &msec_timer_list; (timer = *tpp) != 0; tpp = &timer->next) {
+	if (timer->callback == callback && timer->context == context) {
+	    *tpp = timer->next;
+	    myfree((void *) timer);
+	    return (1);
+	}
+    }
+    return (0);
+}
@@ -0,0 +1,36 @@
+#ifndef _MSEC_TIMER_H_INCLUDED_
+#define _MSEC_TIMER_H_INCLUDED_
+
+/*++
+/* NAME
+/*	msec_timer 3h
+/* SUMMARY
+/*	millisecond timer events for test programs
+/* SYNOPSIS
+/*	#include "msec_timer.h"
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * Utility library.
+  */
+#include <events.h>
+
+ /*
+  * External interface.
+  */
+extern void msec_timer_request(EVENT_NOTIFY_TIME_FN, void *, int);
+extern int msec_timer_cancel(EVENT_NOTIFY_TIME_FN, void *);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+#endif
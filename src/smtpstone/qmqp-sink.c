@@ -5,10 +5,10 @@
 /*	parallelized QMQP test server
 /* SYNOPSIS
 /* .fi
-/*	\fBqmqp-sink\fR [\fB-46cv\fR] [\fB-x \fItime\fR]
+/*	\fBqmqp-sink\fR [\fB-46cdv\fR] [\fB-x \fItime\fR]
 /*	[\fBinet:\fR][\fIhost\fR]:\fIport\fR \fIbacklog\fR
 /*
-/*	\fBqmqp-sink\fR [\fB-46cv\fR] [\fB-x \fItime\fR]
+/*	\fBqmqp-sink\fR [\fB-46cdv\fR] [\fB-x \fItime\fR]
 /*	\fBunix:\fR\fIpathname\fR \fIbacklog\fR
 /* DESCRIPTION
 /*	\fBqmqp-sink\fR listens on the named host (or address) and port.
@@ -33,6 +33,11 @@
 /* .IP \fB-c\fR
 /*	Display a running counter that is updated whenever a delivery
 /*	is completed.
+/* .IP \fB-d\fR
+/*	Don't disconnect after replying to a message; wait for the
+/*	next message over the same connection, as with the Postfix
+/*	QMQP server and "qmqpd_multi_message_enable = yes". This
+/*	is the complement of "qmqp-source -d".
 /* .IP \fB-v\fR
 /*	Increase verbosity. Specify \fB-v -v\fR to see some of the QMQP
 /*	conversation.
@@ -96,8 +101,10 @@ typedef struct {
 static int var_tmout;
 static VSTRING *buffer;
 static void disconnect(SINK_STATE *);
+static void read_length(int, void *);
 static int count_deliveries;
 static int counter;
+static int multi_message;
 
 /* send_reply - finish conversation */
 
@@ -111,7 +118,14 @@ static void send_reply(SINK_STATE *state)
 	vstream_printf("%d\r", counter);
 	vstream_fflush(VSTREAM_OUT);
     }
-    disconnect(state);
+    if (multi_message) {
+	state->count = 0;
+	event_disable_readwrite(vstream_fileno(state->stream));
+	event_enable_read(vstream_fileno(state->stream), read_length,
+			  (void *) state);
+    } else {
+	disconnect(state);
+    }
 }
 
 /* read_data - read over-all netstring data */
@@ -132,15 +146,21 @@ static void read_data(int unused_event, void *context)
 
     /*
      * Flush the VSTREAM buffer. As documented, vstream_fseek() discards
-     * unread input.
+     * unread input. Don't discard the start of the next message.
      */
-    if ((count = vstream_peek(state->stream)) > 0) {
-	state->count -= count;
-	if (state->count <= 0) {
-	    send_reply(state);
-	    return;
+    if (state->count > 0 && (count = vstream_peek(state->stream)) > 0) {
+	if (multi_message && count > state->count) {
+	    (void) vstream_fread_buf(state->stream, buffer, state->count);
+	    state->count = 0;
+	} else {
+	    state->count -= count;
+	    if (state->count > 0)
+		vstream_fpurge(state->stream, VSTREAM_PURGE_BOTH);
 	}
-	vstream_fpurge(state->stream, VSTREAM_PURGE_BOTH);
+    }
+    if (state->count <= 0) {
+	send_reply(state);
+	return;
     }
 
     /*
@@ -166,7 +186,8 @@ static void read_length(int event, void *context)
 	/* NOTREACHED */
 
     case NETSTRING_ERR_EOF:
-	msg_warn("lost connection");
+	if (state->count > 0 || !multi_message)
+	    msg_warn("lost connection");
 	disconnect(state);
 	return;
 
@@ -227,6 +248,7 @@ static void connect_event(int unused_event, void *context)
 	non_blocking(fd, NON_BLOCKING);
 	state = (SINK_STATE *) mymalloc(sizeof(*state));
 	state->stream = vstream_fdopen(fd, O_RDWR);
+	state->count = 0;
 	vstream_tweak_sock(state->stream);
 	netstring_setup(state->stream, var_tmout);
 	event_enable_read(fd, read_length, (void *) state);
@@ -244,7 +266,7 @@ static void terminate(int unused_event, void *unused_context)
 
 static void usage(char *myname)
 {
-    msg_fatal("usage: %s [-cv] [-x time] [host]:port backlog", myname);
+    msg_fatal("usage: %s [-cdv] [-x time] [host]:port backlog", myname);
 }
 
 MAIL_VERSION_STAMP_DECLARE;
@@ -275,7 +297,7 @@ int     main(int argc, char **argv)
     /*
      * Parse JCL.
      */
-    while ((ch = GETOPT(argc, argv, "46cvx:")) > 0) {
+    while ((ch = GETOPT(argc, argv, "46cdvx:")) > 0) {
 	switch (ch) {
 	case '4':
 	    protocols = INET_PROTO_NAME_IPV4;
@@ -286,6 +308,9 @@ int     main(int argc, char **argv)
 	case 'c':
 	    count_deliveries++;
 	    break;
+	case 'd':
+	    multi_message = 1;
+	    break;
 	case 'v':
 	    msg_verbose++;
 	    break;
@@ -33,6 +33,11 @@
 /*	before giving up. The default count is 1. Specify a larger count in
 /*	order to work around a problem with TCP/IP stacks that send RESET
 /*	when the listen queue is full.
+/* .IP \fB-d\fR
+/*	Don't disconnect after sending a message; send the next
+/*	message over the same connection. This is a non-standard
+/*	extension that requires "qmqpd_multi_message_enable = yes"
+/*	with the Postfix QMQP server, or "qmqp-sink -d".
 /* .IP "\fB-f \fIfrom\fR"
 /*	Use the specified sender address (default: <foo@myhostname>).
 /* .IP "\fB-l \fIlength\fR"
@@ -161,6 +166,7 @@ static int counter = 0;
 static int connect_count = 1;
 static int random_delay = 0;
 static int fixed_delay = 0;
+static int disconnect = 1;
 static const char *mydate;
 static int mypid;
 
@@ -243,7 +249,11 @@ static void startup(SESSION *session)
 	session_count--;
 	return;
     }
-    enqueue_connect(session);
+    if (session->stream == 0) {
+	enqueue_connect(session);
+    } else {
+	send_data(session);
+    }
 }
 
 /* start_event - invoke startup from timer context */
@@ -440,11 +450,14 @@ static void receive_reply(int unused_event, void *context)
     }
 
     /*
-     * Finish this session. QMQP sends only one message per session.
+     * Finish this session, or send the next message. Standard QMQP sends
+     * only one message per session.
      */
     event_disable_readwrite(vstream_fileno(session->stream));
-    vstream_fclose(session->stream);
-    session->stream = 0;
+    if (disconnect || message_count < 1) {
+	vstream_fclose(session->stream);
+	session->stream = 0;
+    }
     start_another(session);
 }
 
@@ -452,7 +465,7 @@ static void receive_reply(int unused_event, void *context)
 
 static void usage(char *myname)
 {
-    msg_fatal("usage: %s -cv -s sess -l msglen -m msgs -C count -M myhostname -f from -t to -R delay -w delay host[:port]", myname);
+    msg_fatal("usage: %s -cdv -s sess -l msglen -m msgs -C count -M myhostname -f from -t to -R delay -w delay host[:port]", myname);
 }
 
 MAIL_VERSION_STAMP_DECLARE;
@@ -488,7 +501,7 @@ int     main(int argc, char **argv)
     /*
      * Parse JCL.
      */
-    while ((ch = GETOPT(argc, argv, "46cC:f:l:m:M:r:R:s:t:vw:")) > 0) {
+    while ((ch = GETOPT(argc, argv, "46cC:df:l:m:M:r:R:s:t:vw:")) > 0) {
 	switch (ch) {
 	case '4':
 	    protocols = INET_PROTO_NAME_IPV4;
@@ -503,6 +516,9 @@ int     main(int argc, char **argv)
 	    if ((connect_count = atoi(optarg)) <= 0)
 		usage(argv[0]);
 	    break;
+	case 'd':
+	    disconnect = 0;
+	    break;
 	case 'f':
 	    sender = optarg;
 	    break;
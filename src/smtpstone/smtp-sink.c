@@ -184,6 +184,13 @@
 /*	random multiplier is equal to the number of times the program
 /*	needs to roll a dice with a range of 0..99 inclusive, before
 /*	the dice produces a result greater than or equal to \fIodds\fR.
+/* .sp
+/*	Specify a \fIdelay\fR with an "ms" suffix for a delay in
+/*	milliseconds (example: "rcpt:150ms"). This option may be
+/*	specified multiple times, to emulate a slow server with
+/*	different delays for each protocol phase (example:
+/*	"-W connect:300ms -W rcpt:50ms -W .:2").
+/*	Millisecond delays are available in Postfix 3.5 and later.
 /* .IP [\fBinet:\fR][\fIhost\fR]:\fIport\fR
 /*	Listen on network interface \fIhost\fR (default: any interface)
 /*	TCP port \fIport\fR. Both \fIhost\fR and \fIport\fR may be
@@ -309,6 +316,8 @@
 
 /* Application-specific. */
 
+#include "msec_timer.h"
+
 typedef struct SINK_STATE {
     VSTREAM *stream;
     VSTRING *buffer;
@@ -892,7 +901,10 @@ static void delay_event(int unused_event, void *context)
 
     /* Resume input event handling after the delayed response. */
     event_enable_read(vstream_fileno(state->stream), read_event, (void *) state);
-    event_request_timer(read_timeout, (void *) state, var_tmout);
+    if (PUSH_BACK_PEEK(state) != 0 || vstream_peek(state->stream) > 0)
+	read_event(0, (void *) state);
+    else
+	event_request_timer(read_timeout, (void *) state, var_tmout);
 }
 
 /* data_read - read data from socket */
@@ -979,7 +991,7 @@ typedef struct SINK_COMMAND {
     void    (*hard_response) (SINK_STATE *);
     void    (*soft_response) (SINK_STATE *);
     int     flags;
-    int     delay;
+    int     delay;				/* milliseconds */
     int     delay_odds;
 } SINK_COMMAND;
 
@@ -1081,6 +1093,8 @@ static void set_cmd_delay_arg(char *arg)
     char   *cmd;
     char   *delay;
     char   *odds;
+    char   *unit;
+    int     msec;
 
     saved_arg = cp = mystrdup(arg);
     cmd = mystrtok(&cp, ":");
@@ -1088,7 +1102,12 @@ static void set_cmd_delay_arg(char *arg)
     if (cmd == 0 || delay == 0)
 	msg_fatal("invalid command delay argument: %s", arg);
     odds = mystrtok(&cp, "");
-    set_cmd_delay(cmd, atoi(delay), odds ? atoi(odds) : 0);
+    msec = strtol(delay, &unit, 10);
+    if (*unit == 0)
+	msec *= 1000;
+    else if (strcasecmp(unit, "ms") != 0)
+	msg_fatal("invalid command delay unit: %s", arg);
+    set_cmd_delay(cmd, msec, odds ? atoi(odds) : 0);
     myfree(saved_arg);
 }
 
@@ -1125,7 +1144,7 @@ static int command_resp(SINK_STATE *state, SINK_COMMAND *cmdp,
 	/* Suspend input event handling while delaying the command response. */
 	event_disable_readwrite(vstream_fileno(state->stream));
 	event_cancel_timer(read_timeout, (void *) state);
-	event_request_timer(delay_event, (void *) state, delay);
+	msec_timer_request(delay_event, (void *) state, delay);
 	state->delayed_response = cmdp->response;
 	state->delayed_args = mystrdup(args);
     } else {
@@ -1298,13 +1317,16 @@ static void read_event(int unused_event, void *context)
 		return;
 	    }
 	}
-    } while (PUSH_BACK_PEEK(state) != 0 || vstream_peek(state->stream) > 0);
+    } while (state->delayed_response == 0
+	     && (PUSH_BACK_PEEK(state) != 0 || vstream_peek(state->stream) > 0));
 
     /*
      * Reset the idle timer. Wait until the next input event, or until the
-     * idle timer goes off.
+     * idle timer goes off. With a delayed response in progress, pipelined
+     * commands stay in the buffer until delay_event() resumes input.
      */
-    event_request_timer(read_timeout, (void *) state, var_tmout);
+    if (state->delayed_response == 0)
+	event_request_timer(read_timeout, (void *) state, var_tmout);
 }
 
 static void connect_event(int, void *);
@@ -1592,7 +1614,7 @@ int     main(int argc, char **argv)
 	case 'w':
 	    if ((delay = atoi(optarg)) <= 0)
 		usage(argv[0]);
-	    set_cmd_delay("data", delay, 0);
+	    set_cmd_delay("data", delay * 1000, 0);
 	    break;
 	case 'W':
 	    set_cmd_delay_arg(optarg);
@@ -27,6 +27,18 @@
 /* .IP \fB-6\fR
 /*	Connect to the server with IPv6. This option is not available when
 /*	Postfix is built without IPv6 support.
+/* .IP "\fB-a \fIrate\fR"
+/*	Open-loop mode: start new sessions at the specified average
+/*	rate (sessions per second, fractions allowed), independent
+/*	of the rate at which the server completes them. Each session
+/*	sends one message. The \fB-s\fR option limits the number of
+/*	simultaneous sessions (default in this mode: 100); sessions
+/*	that cannot start on time are started as soon as possible,
+/*	and the delay is included in the message latency below.
+/*	This option cannot be combined with \fB-d\fR, \fB-R\fR or
+/*	\fB-w\fR.
+/* .sp
+/*	This feature is available in Postfix 3.5 and later.
 /* .IP "\fB-A\fR"
 /*	Don't abort when the server sends something other than the
 /*	expected positive reply code.
@@ -47,6 +59,30 @@
 /*	Send the pre-formatted message header and body in the
 /*	specified \fIfile\fR, while prepending '.' before lines that
 /*	begin with '.', and while appending CRLF after each line.
+/* .IP \fB-H\fR
+/*	Upon termination, write a latency report to the standard
+/*	output stream. For each protocol phase the report shows the
+/*	number of samples, and the minimum, 50th, 90th, 99th, and
+/*	99.9th percentile, and maximum latency in milliseconds.
+/*	Percentiles are accurate to within 7%.
+/* .sp
+/*	The phases are: \fBconnect\fR (TCP handshake), \fBbanner\fR
+/*	(server greeting), \fBhelo\fR (HELO, EHLO or LHLO command),
+/*	\fBmail\fR, \fBrcpt\fR (each recipient), \fBdata\fR (the DATA
+/*	command), \fBdot\fR (from sending "." until the server
+/*	replies), and \fBmessage\fR. The latter covers an entire
+/*	message, including connection setup when a new connection
+/*	is needed; in open-loop mode (see \fB-a\fR) it is counted
+/*	from the time that the session was scheduled to start, so
+/*	that server stalls are not hidden by a client that slows
+/*	down.
+/* .sp
+/*	This feature is available in Postfix 3.5 and later.
+/* .IP \fB-j\fR
+/*	Like \fB-H\fR, but write the report as one JSON object, for
+/*	comparison by scripts. All latencies are in milliseconds.
+/* .sp
+/*	This feature is available in Postfix 3.5 and later.
 /* .IP "\fB-l \fIlength\fR"
 /*	Send \fIlength\fR bytes as message payload. The length does not
 /*	include message headers.
@@ -66,6 +102,15 @@
 /*	performance under real-life work-loads.
 /* .IP \fB-o\fR
 /*	Old mode: don't send HELO, and don't send message headers.
+/* .IP "\fB-P \fIpercentage\fR"
+/*	Use ESMTP command pipelining in the specified percentage of
+/*	sessions (0..100). Those sessions send EHLO instead of HELO,
+/*	and when the server announces PIPELINING, send the MAIL,
+/*	RCPT and DATA commands of a transaction as one group. The
+/*	latency of each command in the group is counted from the
+/*	time that the group was sent.
+/* .sp
+/*	This feature is available in Postfix 3.5 and later.
 /* .IP "\fB-r \fIrecipient_count\fR"
 /*	Send the specified number of recipients per transaction (default: 1).
 /*	Recipient names are generated by prepending a number to the
@@ -75,6 +120,8 @@
 /*	Suspending one thread does not affect other delivery threads.
 /* .IP "\fB-s \fIsession_count\fR"
 /*	Run the specified number of SMTP sessions in parallel (default: 1).
+/*	With \fB-a\fR, this is an upper bound on the number of parallel
+/*	sessions (default: 100).
 /* .IP "\fB-S \fIsubject\fR"
 /*	Send mail with the named subject line (default: none).
 /* .IP "\fB-t \fIto\fR"
@@ -94,7 +141,11 @@
 /* .IP \fBunix:\fIpathname\fR
 /*	Connect to the UNIX-domain socket at \fIpathname\fR.
 /* BUGS
-/*	No SMTP command pipelining support.
+/*	No STARTTLS support.
+/*
+/*	A single process is limited to one CPU. To generate more
+/*	load, run multiple \fBsmtp-source\fR processes, and combine
+/*	their \fB-j\fR reports.
 /* SEE ALSO
 /*	smtp-sink(1), SMTP/LMTP message dump
 /* LICENSE
@@ -118,6 +169,7 @@
 #include <sys_defs.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
+#include <sys/time.h>
 #include <netinet/in.h>
 #include <sys/un.h>
 #include <stdarg.h>
@@ -129,6 +181,10 @@
 #include <fcntl.h>
 #include <errno.h>
 
+#ifdef STRCASECMP_IN_STRINGS_H
+#include <strings.h>
+#endif
+
 /* Utility library. */
 
 #include <msg.h>
@@ -149,6 +205,7 @@
 #include <valid_hostname.h>
 #include <valid_mailhost_addr.h>
 #include <compat_va_copy.h>
+#include <stringops.h>
 
 /* Global library. */
 
@@ -158,6 +215,8 @@
 
 /* Application-specific. */
 
+#include "msec_timer.h"
+
  /*
   * Per-session data structure with state.
   * 
@@ -174,6 +233,9 @@ typedef struct SESSION {
     int     rcpt_accepted;		/* # of recipients accepted */
     VSTREAM *stream;			/* open connection */
     int     connect_count;		/* # of connect()s to retry */
+    int     pipelining;			/* pipeline MAIL/RCPT/DATA */
+    struct timeval msg_start;		/* message start or arrival */
+    struct timeval cmd_start;		/* protocol phase start */
     struct SESSION *next;		/* connect() queue linkage */
 } SESSION;
 
@@ -218,6 +280,53 @@ static int talk_lmtp = 0;
 static char *subject = 0;
 static int number_rcpts = 0;
 static int allow_reject = 0;
+static int pipeline_odds = 0;
+static double arrival_rate = 0;
+static struct timeval arrival_epoch;
+static int arrival_count;
+static int session_limit;
+
+ /*
+  * Latency histograms, one per protocol phase. Buckets are log-linear: each
+  * power of two is split into LAT_SUB_COUNT equal buckets, so that the
+  * relative error is at most 1/LAT_SUB_COUNT, with a fixed memory cost.
+  * Latencies are recorded in microseconds.
+  */
+#define LAT_CONNECT	0
+#define LAT_BANNER	1
+#define LAT_HELO	2
+#define LAT_MAIL	3
+#define LAT_RCPT	4
+#define LAT_DATA	5
+#define LAT_DOT		6
+#define LAT_MESSAGE	7
+#define LAT_PHASES	8
+
+static const char *lat_names[LAT_PHASES] = {
+    "connect", "banner", "helo", "mail", "rcpt", "data", "dot", "message",
+};
+
+#define LAT_SUB_BITS	4
+#define LAT_SUB_COUNT	(1 << LAT_SUB_BITS)
+#define LAT_MAX_BITS	40		/* about 12 days */
+#define LAT_BUCKETS	((LAT_MAX_BITS - LAT_SUB_BITS + 1) * LAT_SUB_COUNT)
+
+typedef struct {
+    long    count;			/* number of samples */
+    long    min;			/* smallest sample */
+    long    max;			/* largest sample */
+    double  sum;			/* for the mean */
+    long    bucket[LAT_BUCKETS];	/* log-linear histogram */
+} LATENCY;
+
+static LATENCY latency[LAT_PHASES];
+
+#define REPORT_NONE	0
+#define REPORT_TEXT	1
+#define REPORT_JSON	2
+
+static int report_format = REPORT_NONE;
+static struct timeval run_start;
 
 static void enqueue_connect(SESSION *);
 static void start_connect(SESSION *);
@@ -227,10 +336,14 @@ static void send_helo(SESSION *);
 static void helo_done(int, void *);
 static void send_mail(SESSION *);
 static void mail_done(int, void *);
+static void send_pipeline(SESSION *);
+static void pipeline_done(int, void *);
+static void rcpt_command(SESSION *, int);
 static void send_rcpt(int, void *);
 static void rcpt_done(int, void *);
 static void send_data(int, void *);
 static void data_done(int, void *);
+static void send_content(SESSION *);
 static void dot_done(int, void *);
 static void send_rset(int, void *);
 static void rset_done(int, void *);
@@ -245,13 +358,146 @@ static int random_interval(int interval)
     return (rand() % (interval + 1));
 }
 
-/* command - send an SMTP command */
+/* lat_bucket - map latency to histogram bucket */
 
-static void command(VSTREAM *stream, char *fmt,...)
+static int lat_bucket(long usec)
 {
-    va_list ap;
+    int     bits;
+
+    if (usec < LAT_SUB_COUNT)
+	return (usec < 0 ? 0 : (int) usec);
+    for (bits = LAT_SUB_BITS; (usec >> (bits + 1)) != 0; bits++)
+	if (bits == LAT_MAX_BITS - 1)
+	    return (LAT_BUCKETS - 1);
+    return ((bits - LAT_SUB_BITS + 1) * LAT_SUB_COUNT
+	    + (int) (usec >> (bits - LAT_SUB_BITS)) - LAT_SUB_COUNT);
+}
 
-    va_start(ap, fmt);
+/* lat_bucket_value - largest latency that maps to histogram bucket */
+
+static long lat_bucket_value(int index)
+{
+    int     shift;
+
+    if (index < LAT_SUB_COUNT)
+	return (index);
+    shift = index / LAT_SUB_COUNT - 1;
+    return (((long) (LAT_SUB_COUNT + index % LAT_SUB_COUNT + 1) << shift) - 1);
+}
+
+/* latency_update - record protocol phase latency */
+
+static void latency_update(int phase, struct timeval * start)
+{
+    LATENCY *lp = latency + phase;
+    struct timeval now;
+    long    usec;
+
+    GETTIMEOFDAY(&now);
+    usec = (now.tv_sec - start->tv_sec) * 1000000L
+	+ now.tv_usec - start->tv_usec;
+    if (usec < 0)
+	usec = 0;
+    if (lp->count == 0 || usec < lp->min)
+	lp->min = usec;
+    if (usec > lp->max)
+	lp->max = usec;
+    lp->count++;
+    lp->sum += usec;
+    lp->bucket[lat_bucket(usec)]++;
+}
+
+/* latency_percentile - find approximate latency percentile */
+
+static long latency_percentile(LATENCY *lp, double percent)
+{
+    long    rank;
+    long    seen;
+    long    value;
+    int     index;
+
+    if (lp->count == 0)
+	return (0);
+    if ((rank = (long) (lp->count * percent / 100.0 + 0.999999)) < 1)
+	rank = 1;
+    for (seen = 0, index = 0; index < LAT_BUCKETS; index++)
+	if ((seen += lp->bucket[index]) >= rank)
+	    break;
+    value = (index < LAT_BUCKETS ? lat_bucket_value(index) : lp->max);
+    if (value > lp->max)
+	value = lp->max;
+    if (value < lp->min)
+	value = lp->min;
+    return (value);
+}
+
+/* latency_report - report latency statistics */
+
+static void latency_report(void)
+{
+    static const double percents[] = {50, 90, 99, 99.9};
+    static const char *percent_names[] = {"p50", "p90", "p99", "p99.9"};
+
+#define NUM_PERCENTS ((int) (sizeof(percents) / sizeof(percents[0])))
+#define MSEC(usec) ((usec) / 1000.0)
+
+    struct timeval now;
+    double  elapsed;
+    long    messages = latency[LAT_MESSAGE].count;
+    LATENCY *lp;
+    int     phase;
+    int     n;
+
+    GETTIMEOFDAY(&now);
+    elapsed = (now.tv_sec - run_start.tv_sec)
+	+ (now.tv_usec - run_start.tv_usec) / 1000000.0;
+    if (elapsed <= 0)
+	elapsed = 1e-6;
+
+    if (report_format == REPORT_JSON) {
+	vstream_printf("{\"messages\":%ld,\"elapsed\":%.3f,\"rate\":%.3f,"
+		       "\"arrival_rate\":%.3f,\"sessions\":%d,"
+		       "\"pipelining\":%d,\"latency\":{",
+		       messages, elapsed * 1000, messages / elapsed,
+		       arrival_rate, session_limit, pipeline_odds);
+	for (phase = 0; phase < LAT_PHASES; phase++) {
+	    lp = latency + phase;
+	    vstream_printf("%s\"%s\":{\"count\":%ld,\"min\":%.3f,"
+			   "\"mean\":%.3f", phase ? "," : "",
+			   lat_names[phase], lp->count, MSEC(lp->min),
+			   lp->count ? MSEC(lp->sum / lp->count) : 0);
+	    for (n = 0; n < NUM_PERCENTS; n++)
+		vstream_printf(",\"%s\":%.3f", percent_names[n],
+			       MSEC(latency_percentile(lp, percents[n])));
+	    vstream_printf(",\"max\":%.3f}", MSEC(lp->max));
+	}
+	vstream_printf("}}\n");
+    } else {
+	vstream_printf("%ld messages in %.3f s, %.1f messages/s\n",
+		       messages, elapsed, messages / elapsed);
+	vstream_printf("%-8s %8s %9s", "phase", "count", "min");
+	for (n = 0; n < NUM_PERCENTS; n++)
+	    vstream_printf(" %9s", percent_names[n]);
+	vstream_printf(" %9s (ms)\n", "max");
+	for (phase = 0; phase < LAT_PHASES; phase++) {
+	    lp = latency + phase;
+	    if (lp->count == 0)
+		continue;
+	    vstream_printf("%-8s %8ld %9.3f", lat_names[phase],
+			   lp->count, MSEC(lp->min));
+	    for (n = 0; n < NUM_PERCENTS; n++)
+		vstream_printf(" %9.3f",
+			       MSEC(latency_percentile(lp, percents[n])));
+	    vstream_printf(" %9.3f\n", MSEC(lp->max));
+	}
+    }
+    vstream_fflush(VSTREAM_OUT);
+}
+
+/* vcommand - send an SMTP command */
+
+static void vcommand(VSTREAM *stream, int flush, char *fmt, va_list ap)
+{
 
     /*
      * Optionally, log the command before actually sending, so we can see
@@ -265,8 +511,43 @@ static void command(VSTREAM *stream, char *fmt,...)
 	va_end(ap2);
     }
     smtp_vprintf(stream, fmt, ap);
+    if (flush)
+	smtp_flush(stream);
+}
+
+/* command - send an SMTP command */
+
+static void command(VSTREAM *stream, char *fmt,...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vcommand(stream, 1, fmt, ap);
     va_end(ap);
-    smtp_flush(stream);
+}
+
+/* pipeline_command - queue an SMTP command without sending it */
+
+static void pipeline_command(VSTREAM *stream, char *fmt,...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vcommand(stream, 0, fmt, ap);
+    va_end(ap);
+}
+
+/* has_pipelining - find PIPELINING in EHLO response */
+
+static int has_pipelining(const char *text)
+{
+    const char *cp;
+
+    for (cp = text; cp != 0; cp = ((cp = strchr(cp, '\n')) ? cp + 1 : 0))
+	if (strncasecmp(cp, "PIPELINING", 10) == 0
+	    && (cp[10] == 0 || ISSPACE(cp[10])))
+	    return (1);
+    return (0);
 }
 
 /* socket_error - look up and reset the last socket error */
@@ -370,13 +651,76 @@ static void startup(SESSION *session)
 	session_count--;
 	return;
     }
+    if (arrival_rate == 0)
+	GETTIMEOFDAY(&session->msg_start);
     if (session->stream == 0) {
+	session->pipelining = (pipeline_odds > 0 && send_helo_first
+			       && random_interval(99) < pipeline_odds);
 	enqueue_connect(session);
     } else {
 	send_mail(session);
     }
 }
 
+/* session_create - instantiate session */
+
+static SESSION *session_create(void)
+{
+    SESSION *session;
+
+    session = (SESSION *) mymalloc(sizeof(*session));
+    session->stream = 0;
+    session->xfer_count = 0;
+    session->connect_count = connect_count;
+    session->pipelining = 0;
+    session->next = 0;
+    session_count++;
+    return (session);
+}
+
+/* arrival_event - start sessions on schedule, in open-loop mode */
+
+static void arrival_event(int unused_event, void *unused_context)
+{
+    SESSION *session;
+    struct timeval now;
+    double  elapsed;
+    double  due;
+    double  when;
+
+    /*
+     * Arrival N is due at N / arrival_rate seconds after the start. When the
+     * session limit prevents an arrival from starting on time, it starts as
+     * soon as another session ends, and its latency is still counted from
+     * the time that it was due.
+     */
+    GETTIMEOFDAY(&now);
+    elapsed = (now.tv_sec - arrival_epoch.tv_sec)
+	+ (now.tv_usec - arrival_epoch.tv_usec) / 1000000.0;
+    due = elapsed * arrival_rate;
+    while (arrival_count <= due && message_count > 0
+	   && session_count < session_limit) {
+	session = session_create();
+	when = arrival_count++ / arrival_rate;
+	session->msg_start.tv_sec = arrival_epoch.tv_sec + (long) when;
+	session->msg_start.tv_usec = arrival_epoch.tv_usec
+	    + (long) ((when - (long) when) * 1000000);
+	if (session->msg_start.tv_usec >= 1000000) {
+	    session->msg_start.tv_sec += 1;
+	    session->msg_start.tv_usec -= 1000000;
+	}
+	startup(session);
+    }
+
+    /*
+     * Wait for the next arrival, unless we are behind schedule.
+     */
+    if (message_count > 0 && arrival_count > due)
+	msec_timer_request(arrival_event, (void *) 0,
+			   (int) ((arrival_count / arrival_rate - elapsed)
+				  * 1000 + 0.999));
+}
+
 /* start_event - invoke startup from timer context */
 
 static void start_event(int unused_event, void *context)
@@ -390,7 +734,11 @@ static void start_event(int unused_event, void *context)
 
 static void start_another(SESSION *session)
 {
-    if (random_delay > 0) {
+    if (arrival_rate > 0) {
+	myfree((void *) session);
+	session_count--;
+	arrival_event(0, (void *) 0);
+    } else if (random_delay > 0) {
 	event_request_timer(start_event, (void *) session,
 			    random_interval(random_delay));
     } else if (fixed_delay > 0) {
@@ -469,6 +817,7 @@ static void start_connect(SESSION *session)
 		   sizeof(linger)) < 0)
 	msg_warn("setsockopt SO_LINGER %d: %m", linger.l_linger);
     session->stream = vstream_fdopen(fd, O_RDWR);
+    GETTIMEOFDAY(&session->cmd_start);
     event_enable_write(fd, connect_done, (void *) session);
     smtp_timeout_setup(session->stream, var_timeout);
     if (inet_windowsize > 0)
@@ -491,6 +840,8 @@ static void connect_done(int unused_event, void *context)
     if (socket_error(fd) < 0) {
 	fail_connect(session);
     } else {
+	latency_update(LAT_CONNECT, &session->cmd_start);
+	GETTIMEOFDAY(&session->cmd_start);
 	non_blocking(fd, BLOCKING);
 	/* Disable write events. */
 	event_disable_readwrite(fd);
@@ -523,7 +874,9 @@ static void read_banner(int unused_event, void *context)
     /*
      * Read and parse the server's SMTP greeting banner.
      */
-    if (((resp = response(session->stream, buffer))->code / 100) == 2) {
+    resp = response(session->stream, buffer);
+    latency_update(LAT_BANNER, &session->cmd_start);
+    if ((resp->code / 100) == 2) {
 	 /* void */ ;
     } else if (allow_reject) {
 	msg_warn("rejected at server banner: %d %s", resp->code, resp->str);
@@ -545,7 +898,8 @@ static void read_banner(int unused_event, void *context)
 static void send_helo(SESSION *session)
 {
     int     except;
-    const char *NOCLOBBER protocol = (talk_lmtp ? "LHLO" : "HELO");
+    const char *NOCLOBBER protocol = (talk_lmtp ? "LHLO" :
+				      session->pipelining ? "EHLO" : "HELO");
 
     /*
      * Send the standard greeting with our hostname
@@ -553,6 +907,7 @@ static void send_helo(SESSION *session)
     if ((except = vstream_setjmp(session->stream)) != 0)
 	msg_fatal("%s while sending %s", exception_text(except), protocol);
 
+    GETTIMEOFDAY(&session->cmd_start);
     command(session->stream, "%s %s", protocol, var_myhostname);
 
     /*
@@ -568,7 +923,8 @@ static void helo_done(int unused_event, void *context)
     SESSION *session = (SESSION *) context;
     RESPONSE *resp;
     int     except;
-    const char *protocol = (talk_lmtp ? "LHLO" : "HELO");
+    const char *protocol = (talk_lmtp ? "LHLO" :
+			    session->pipelining ? "EHLO" : "HELO");
 
     /*
      * Get response to HELO command.
@@ -576,8 +932,11 @@ static void helo_done(int unused_event, void *context)
     if ((except = vstream_setjmp(session->stream)) != 0)
 	msg_fatal("%s while sending %s", exception_text(except), protocol);
 
-    if ((resp = response(session->stream, buffer))->code / 100 == 2) {
-	 /* void */ ;
+    resp = response(session->stream, buffer);
+    latency_update(LAT_HELO, &session->cmd_start);
+    if (resp->code / 100 == 2) {
+	if (session->pipelining && !has_pipelining(resp->str))
+	    session->pipelining = 0;
     } else if (allow_reject) {
 	msg_warn("%s rejected: %d %s", protocol, resp->code, resp->str);
 	if (resp->code == 421 || resp->code == 521) {
@@ -603,6 +962,11 @@ static void send_mail(SESSION *session)
     if ((except = vstream_setjmp(session->stream)) != 0)
 	msg_fatal("%s while sending sender", exception_text(except));
 
+    GETTIMEOFDAY(&session->cmd_start);
+    if (session->pipelining) {
+	send_pipeline(session);
+	return;
+    }
     command(session->stream, "MAIL FROM:<%s>", sender);
 
     /*
@@ -611,6 +975,93 @@ static void send_mail(SESSION *session)
     event_enable_read(vstream_fileno(session->stream), mail_done, (void *) session);
 }
 
+/* send_pipeline - send MAIL, RCPT and DATA as one group */
+
+static void send_pipeline(SESSION *session)
+{
+    pipeline_command(session->stream, "MAIL FROM:<%s>", sender);
+    session->rcpt_count = recipients;
+    session->rcpt_done = 0;
+    session->rcpt_accepted = 0;
+    while (session->rcpt_count > 0)
+	rcpt_command(session, 0);
+    command(session->stream, "DATA");
+
+    /*
+     * Prepare for the next event.
+     */
+    event_enable_read(vstream_fileno(session->stream), pipeline_done,
+		      (void *) session);
+}
+
+/* pipeline_done - handle MAIL, RCPT and DATA responses */
+
+static void pipeline_done(int unused, void *context)
+{
+    SESSION *session = (SESSION *) context;
+    RESPONSE *resp;
+    int     except;
+    int     n;
+
+    /*
+     * Get response to MAIL command.
+     */
+    if ((except = vstream_setjmp(session->stream)) != 0)
+	msg_fatal("%s while sending pipelined commands",
+		  exception_text(except));
+
+    resp = response(session->stream, buffer);
+    latency_update(LAT_MAIL, &session->cmd_start);
+    if (resp->code / 100 == 2) {
+	 /* void */ ;
+    } else if (allow_reject) {
+	msg_warn("sender rejected: %d %s", resp->code, resp->str);
+	if (resp->code == 421 || resp->code == 521) {
+	    close_session(session);
+	    return;
+	}
+    } else {
+	msg_fatal("sender rejected: %d %s", resp->code, resp->str);
+    }
+
+    /*
+     * Get responses to RCPT commands. XXX This could block.
+     */
+    for (n = 0; n < session->rcpt_done; n++) {
+	resp = response(session->stream, buffer);
+	latency_update(LAT_RCPT, &session->cmd_start);
+	if (resp->code / 100 == 2) {
+	    session->rcpt_accepted++;
+	} else if (allow_reject) {
+	    msg_warn("recipient rejected: %d %s", resp->code, resp->str);
+	    if (resp->code == 421 || resp->code == 521) {
+		close_session(session);
+		return;
+	    }
+	} else {
+	    msg_fatal("recipient rejected: %d %s", resp->code, resp->str);
+	}
+    }
+
+    /*
+     * Get response to DATA command.
+     */
+    resp = response(session->stream, buffer);
+    latency_update(LAT_DATA, &session->cmd_start);
+    if (resp->code == 354) {
+	send_content(session);
+    } else if (allow_reject) {
+	msg_warn("data rejected: %d %s", resp->code, resp->str);
+	if (resp->code == 421 || resp->code == 521) {
+	    close_session(session);
+	    return;
+	}
+	send_rset(unused, context);
+    } else {
+	msg_fatal("data rejected: %d %s", resp->code, resp->str);
+    }
+}
+
 /* mail_done - handle MAIL response */
 
 static void mail_done(int unused, void *context)
@@ -625,7 +1076,9 @@ static void mail_done(int unused, void *context)
     if ((except = vstream_setjmp(session->stream)) != 0)
 	msg_fatal("%s while sending sender", exception_text(except));
 
-    if ((resp = response(session->stream, buffer))->code / 100 == 2) {
+    resp = response(session->stream, buffer);
+    latency_update(LAT_MAIL, &session->cmd_start);
+    if (resp->code / 100 == 2) {
 	session->rcpt_count = recipients;
 	session->rcpt_done = 0;
 	session->rcpt_accepted = 0;
@@ -642,6 +1095,23 @@ static void mail_done(int unused, void *context)
     }
 }
 
+/* rcpt_command - format recipient command */
+
+static void rcpt_command(SESSION *session, int flush)
+{
+    void    (*fn) (VSTREAM *, char *,...) =
+    (flush ? command : pipeline_command);
+
+    if (session->rcpt_count > 1 || number_rcpts > 0)
+	fn(session->stream, "RCPT TO:<%d%s>",
+	   number_rcpts ? number_rcpts++ : session->rcpt_count,
+	   recipient);
+    else
+	fn(session->stream, "RCPT TO:<%s>", recipient);
+    session->rcpt_count--;
+    session->rcpt_done++;
+}
+
 /* send_rcpt - send recipient address */
 
 static void send_rcpt(int unused_event, void *context)
@@ -655,14 +1125,8 @@ static void send_rcpt(int unused_event, void *context)
     if ((except = vstream_setjmp(session->stream)) != 0)
 	msg_fatal("%s while sending recipient", exception_text(except));
 
-    if (session->rcpt_count > 1 || number_rcpts > 0)
-	command(session->stream, "RCPT TO:<%d%s>",
-		number_rcpts ? number_rcpts++ : session->rcpt_count,
-		recipient);
-    else
-	command(session->stream, "RCPT TO:<%s>", recipient);
-    session->rcpt_count--;
-    session->rcpt_done++;
+    GETTIMEOFDAY(&session->cmd_start);
+    rcpt_command(session, 1);
 
     /*
      * Prepare for the next event.
@@ -684,7 +1148,9 @@ static void rcpt_done(int unused, void *context)
     if ((except = vstream_setjmp(session->stream)) != 0)
 	msg_fatal("%s while sending recipient", exception_text(except));
 
-    if ((resp = response(session->stream, buffer))->code / 100 == 2) {
+    resp = response(session->stream, buffer);
+    latency_update(LAT_RCPT, &session->cmd_start);
+    if (resp->code / 100 == 2) {
 	session->rcpt_accepted++;
     } else if (allow_reject) {
 	msg_warn("recipient rejected: %d %s", resp->code, resp->str);
@@ -719,6 +1185,7 @@ static void send_data(int unused_event, void *context)
      */
     if ((except = vstream_setjmp(session->stream)) != 0)
 	msg_fatal("%s while sending DATA command", exception_text(except));
+    GETTIMEOFDAY(&session->cmd_start);
     command(session->stream, "DATA");
 
     /*
@@ -727,23 +1194,23 @@ static void send_data(int unused_event, void *context)
     event_enable_read(vstream_fileno(session->stream), data_done, (void *) session);
 }
 
-/* data_done - send message content */
+/* data_done - handle DATA response */
 
 static void data_done(int unused, void *context)
 {
     SESSION *session = (SESSION *) context;
     RESPONSE *resp;
     int     except;
-    static const char *mydate;
-    static int mypid;
 
     /*
      * Get response to DATA command.
      */
     if ((except = vstream_setjmp(session->stream)) != 0)
 	msg_fatal("%s while sending DATA command", exception_text(except));
-    if ((resp = response(session->stream, buffer))->code == 354) {
-	 /* see below */ ;
+    resp = response(session->stream, buffer);
+    latency_update(LAT_DATA, &session->cmd_start);
+    if (resp->code == 354) {
+	send_content(session);
     } else if (allow_reject) {
 	msg_warn("data rejected: %d %s", resp->code, resp->str);
 	if (resp->code == 421 || resp->code == 521) {
@@ -751,10 +1218,18 @@ static void data_done(int unused, void *context)
 	    return;
 	}
 	send_rset(unused, context);
-	return;
     } else {
 	msg_fatal("data rejected: %d %s", resp->code, resp->str);
     }
+}
+
+/* send_content - send message content */
+
+static void send_content(SESSION *session)
+{
+    int     except;
+    static const char *mydate;
+    static int mypid;
 
     /*
      * Send basic header to keep mailers that bother to examine them happy.
@@ -796,6 +1271,7 @@ static void data_done(int unused, void *context)
     /*
      * Send end of message and process the server response.
      */
+    GETTIMEOFDAY(&session->cmd_start);
     command(session->stream, ".");
 
     /*
@@ -839,6 +1315,8 @@ static void dot_done(int unused_event, void *context)
 	    msg_fatal("end of data rejected: %d %s", resp->code, resp->str);
 	}
     } while (talk_lmtp && --session->rcpt_done > 0);
+    latency_update(LAT_DOT, &session->cmd_start);
+    latency_update(LAT_MESSAGE, &session->msg_start);
     session->xfer_count++;
 
     /*
@@ -933,7 +1411,7 @@ static void close_session(SESSION *session)
 
 static void usage(char *myname)
 {
-    msg_fatal("usage: %s -cdLNov -s sess -l msglen -m msgs -C count -M myhostname -f from -t to -r rcptcount -R delay -w delay host[:port]", myname);
+    msg_fatal("usage: %s -cdHjLNov -a rate -s sess -l msglen -m msgs -C count -M myhostname -f from -t to -r rcptcount -P percent -R delay -w delay host[:port]", myname);
 }
 
 MAIL_VERSION_STAMP_DECLARE;
@@ -942,12 +1420,11 @@ MAIL_VERSION_STAMP_DECLARE;
 
 int     main(int argc, char **argv)
 {
-    SESSION *session;
     char   *host;
     char   *port;
     char   *path;
     int     path_len;
-    int     sessions = 1;
+    int     sessions = 0;
     int     ch;
     int     i;
     char   *buf;
@@ -968,7 +1445,7 @@ int     main(int argc, char **argv)
     /*
      * Parse JCL.
      */
-    while ((ch = GETOPT(argc, argv, "46AcC:df:F:l:Lm:M:Nor:R:s:S:t:T:vw:")) > 0) {
+    while ((ch = GETOPT(argc, argv, "46a:AcC:df:F:Hjl:Lm:M:NoP:r:R:s:S:t:T:vw:")) > 0) {
 	switch (ch) {
 	case '4':
 	    protocols = INET_PROTO_NAME_IPV4;
@@ -976,6 +1453,10 @@ int     main(int argc, char **argv)
 	case '6':
 	    protocols = INET_PROTO_NAME_IPV6;
 	    break;
+	case 'a':
+	    if ((arrival_rate = atof(optarg)) <= 0)
+		msg_fatal("bad arrival rate: %s", optarg);
+	    break;
 	case 'A':
 	    allow_reject = 1;
 	    break;
@@ -997,6 +1478,12 @@ int     main(int argc, char **argv)
 		msg_fatal("-l option cannot be used with -F");
 	    message_file = optarg;
 	    break;
+	case 'H':
+	    report_format = REPORT_TEXT;
+	    break;
+	case 'j':
+	    report_format = REPORT_JSON;
+	    break;
 	case 'l':
 	    if (message_file != 0)
 		msg_fatal("-l option cannot be used with -F");
@@ -1027,6 +1514,10 @@ int     main(int argc, char **argv)
 	    send_helo_first = 0;
 	    send_headers = 0;
 	    break;
+	case 'P':
+	    if (!alldig(optarg) || (pipeline_odds = atoi(optarg)) > 100)
+		msg_fatal("bad pipelining percentage: %s", optarg);
+	    break;
 	case 'r':
 	    if ((recipients = atoi(optarg)) <= 0)
 		msg_fatal("bad recipient count: %s", optarg);
@@ -1066,8 +1557,13 @@ int     main(int argc, char **argv)
     }
     if (argc - optind != 1)
 	usage(argv[0]);
+    if (arrival_rate > 0 && (disconnect == 0 || random_delay || fixed_delay))
+	msg_fatal("do not use -a with -d, -R or -w");
+    if (sessions == 0)
+	sessions = (arrival_rate > 0 ? 100 : 1);
+    session_limit = sessions;
 
-    if (random_delay > 0)
+    if (random_delay > 0 || pipeline_odds > 0)
 	srand(getpid());
 
     /*
@@ -1164,16 +1660,15 @@ int     main(int argc, char **argv)
     }
 
     /*
-     * Start sessions.
+     * Start sessions. In open-loop mode, sessions are started by a timer.
      */
-    while (sessions-- > 0) {
-	session = (SESSION *) mymalloc(sizeof(*session));
-	session->stream = 0;
-	session->xfer_count = 0;
-	session->connect_count = connect_count;
-	session->next = 0;
-	session_count++;
-	startup(session);
+    GETTIMEOFDAY(&run_start);
+    if (arrival_rate > 0) {
+	arrival_epoch = run_start;
+	arrival_event(0, (void *) 0);
+    } else {
+	while (sessions-- > 0)
+	    startup(session_create());
     }
     for (;;) {
 	event_loop(-1);
@@ -1182,6 +1677,8 @@ int     main(int argc, char **argv)
 		VSTREAM_PUTC('\n', VSTREAM_OUT);
 		vstream_fflush(VSTREAM_OUT);
 	    }
+	    if (report_format != REPORT_NONE)
+		latency_report();
 	    exit(0);
 	}
     }
@@ -72,6 +72,9 @@
 #include <valid_utf8_hostname.h>
 #include <stringops.h>
 #include <mymalloc.h>
+#include <ctable.h>
+#include <events.h>
+#include <stats.h>
 
 /* Global library. */
 
@@ -753,6 +756,145 @@ static void resolve_addr(RES_CONTEXT *rp, char *sender, char *addr,
 
 /* Static, so they can be used by the network protocol interface only. */
 
+ /*
+  * Result cache. Clients such as qmgr, cleanup and smtpd resolve the same
+  * addresses over and over, and each request runs the whole chain of
+  * domain class and transport table lookups. Each resolver context keeps
+  * recent results in a least-recently-used cache, for $resolve_cache_ttl
+  * seconds. The sender is part of the cache key only when sender-dependent
+  * tables are in use. Temporary lookup errors are not cached. There is no
+  * other invalidation: this process terminates after a file-based table
+  * changes, and after "postfix reload".
+  */
+typedef struct {
+    VSTRING *channel;			/* transport */
+    VSTRING *nexthop;			/* next-hop destination */
+    VSTRING *nextrcpt;			/* final recipient */
+    int     flags;			/* RESOLVE_FLAG_XXX */
+    time_t  expires;			/* time of expiration */
+} RESOLVE_CACHE_ENTRY;
+
+typedef struct {
+    RES_CONTEXT *context;		/* resolver context */
+    char   *sender;			/* sender address */
+    char   *addr;			/* recipient address */
+} RESOLVE_CACHE_REQ;
+
+static RESOLVE_CACHE_REQ resolve_cache_req;
+static VSTRING *resolve_cache_key;
+static unsigned long resolve_cache_hits;
+static unsigned long resolve_cache_misses;
+static STATS_CELL *resolve_stats_hits;
+static STATS_CELL *resolve_stats_misses;
+
+#define RESOLVE_CACHE_REPORT_TIME	600
+
+/* resolve_cache_create - resolve address for cache */
+
+static void *resolve_cache_create(const char *unused_key, void *context)
+{
+    RESOLVE_CACHE_REQ *req = (RESOLVE_CACHE_REQ *) context;
+    RESOLVE_CACHE_ENTRY *ep;
+
+    ep = (RESOLVE_CACHE_ENTRY *) mymalloc(sizeof(*ep));
+    ep->channel = vstring_alloc(10);
+    ep->nexthop = vstring_alloc(10);
+    ep->nextrcpt = vstring_alloc(10);
+    resolve_addr(req->context, req->sender, req->addr,
+		 ep->channel, ep->nexthop, ep->nextrcpt, &ep->flags);
+    ep->expires = (ep->flags & RESOLVE_FLAG_FAIL) ?
+	0 : event_time() + var_resolve_cache_ttl;
+    resolve_cache_misses += 1;
+    if (resolve_stats_misses)
+	STATS_INC(resolve_stats_misses);
+    return ((void *) ep);
+}
+
+/* resolve_cache_delete - destroy cache entry */
+
+static void resolve_cache_delete(void *ptr, void *unused_context)
+{
+    RESOLVE_CACHE_ENTRY *ep = (RESOLVE_CACHE_ENTRY *) ptr;
+
+    vstring_free(ep->channel);
+    vstring_free(ep->nexthop);
+    vstring_free(ep->nextrcpt);
+    myfree((void *) ep);
+}
+
+/* resolve_cached - resolve address through cache */
+
+static void resolve_cached(RES_CONTEXT *context, char *sender, char *addr,
+			           VSTRING *channel, VSTRING *nexthop,
+			           VSTRING *nextrcpt, int *flags)
+{
+    const RESOLVE_CACHE_ENTRY *ep;
+    unsigned long misses = resolve_cache_misses;
+    const char *key_sender;
+
+    if (context->cache == 0)
+	context->cache = ctable_create(var_resolve_cache_size,
+				       resolve_cache_create,
+				       resolve_cache_delete,
+				       (void *) &resolve_cache_req);
+    resolve_cache_req.context = context;
+    resolve_cache_req.sender = sender;
+    resolve_cache_req.addr = addr;
+
+    /*
+     * The sender length makes the key unambiguous.
+     */
+    key_sender = (context->snd_relay_info || context->snd_def_xp_info) ?
+	sender : "";
+    vstring_sprintf(resolve_cache_key, "%ld:%s%s",
+		    (long) strlen(key_sender), key_sender, addr);
+    ep = (const RESOLVE_CACHE_ENTRY *)
+	ctable_locate(context->cache, STR(resolve_cache_key));
+    if (misses == resolve_cache_misses && ep->expires <= event_time())
+	ep = (const RESOLVE_CACHE_ENTRY *)
+	    ctable_refresh(context->cache, STR(resolve_cache_key));
+    if (misses == resolve_cache_misses) {
+	resolve_cache_hits += 1;
+	if (resolve_stats_hits)
+	    STATS_INC(resolve_stats_hits);
+    }
+    vstring_strcpy(channel, STR(ep->channel));
+    vstring_strcpy(nexthop, STR(ep->nexthop));
+    vstring_strcpy(nextrcpt, STR(ep->nextrcpt));
+    *flags = ep->flags;
+}
+
+/* resolve_cache_report - log cache hit rate */
+
+static void resolve_cache_report(int unused_event, void *unused_context)
+{
+    unsigned long total = resolve_cache_hits + resolve_cache_misses;
+
+    if (total > 0)
+	msg_info("resolve cache: %lu requests, %lu hits (%lu%%)",
+		 total, resolve_cache_hits, resolve_cache_hits * 100 / total);
+    resolve_cache_hits = resolve_cache_misses = 0;
+    event_request_timer(resolve_cache_report, (void *) 0,
+			RESOLVE_CACHE_REPORT_TIME);
+}
+
+/* resolve_cache_init - post-jail initialization */
+
+void    resolve_cache_init(void)
+{
+    if (var_resolve_cache_size <= 0)
+	return;
+    resolve_cache_key = vstring_alloc(100);
+
+    /*
+     * Performance counters. See "postfix stats".
+     */
+    resolve_stats_hits = stats_counter("resolve_cache_hits_total");
+    resolve_stats_misses = stats_counter("resolve_cache_misses_total");
+    event_request_timer(resolve_cache_report, (void *) 0,
+			RESOLVE_CACHE_REPORT_TIME);
+}
+
 static VSTRING *channel;
 static VSTRING *nexthop;
 static VSTRING *nextrcpt;
@@ -771,8 +913,12 @@ int     resolve_proto(RES_CONTEXT *context, VSTREAM *stream)
 		  ATTR_TYPE_END) != 2)
 	return (-1);
 
-    resolve_addr(context, STR(sender), STR(query),
-		 channel, nexthop, nextrcpt, &flags);
+    if (resolve_cache_key != 0)
+	resolve_cached(context, STR(sender), STR(query),
+		       channel, nexthop, nextrcpt, &flags);
+    else
+	resolve_addr(context, STR(sender), STR(query),
+		     channel, nexthop, nextrcpt, &flags);
 
     if (msg_verbose)
 	msg_info("`%s' -> `%s' -> (`%s' `%s' `%s' `%d')",
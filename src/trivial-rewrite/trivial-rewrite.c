@@ -260,6 +260,15 @@
 /*	Available in Postfix 3.3 and later:
 /* .IP "\fBservice_name (read-only)\fR"
 /*	The master.cf service name of a Postfix daemon process.
+/* .PP
+/*	Available in Postfix 3.5 and later:
+/* .IP "\fBresolve_cache_size (1000)\fR"
+/*	The maximal number of recent address resolver results that
+/*	each \fBtrivial-rewrite\fR(8) process remembers, per resolver
+/*	personality.
+/* .IP "\fBresolve_cache_ttl (10s)\fR"
+/*	How long a \fBtrivial-rewrite\fR(8) process may reuse an
+/*	address resolver result.
 /* SEE ALSO
 /*	postconf(5), configuration parameters
 /*	transport(5), transport table format
@@ -361,6 +370,8 @@ char   *var_null_relay_maps_key;
 char   *var_null_def_xport_maps_key;
 int     var_resolve_num_dom;
 bool    var_allow_min_user;
+int     var_resolve_cache_size;
+int     var_resolve_cache_ttl;
 
  /*
   * Shadow personality for address verification.
@@ -582,6 +593,7 @@ static void post_jail_init(char *unused_name, char **unused_argv)
 	transport_post_init(resolve_regular.transport_info);
     if (resolve_verify.transport_info)
 	transport_post_init(resolve_verify.transport_info);
+    resolve_cache_init();
     check_table_stats(0, (void *) 0);
 }
 
@@ -618,6 +630,14 @@ int     main(int argc, char **argv)
 	VAR_VRFY_SND_DEF_XPORT_MAPS, DEF_VRFY_SND_DEF_XPORT_MAPS, &var_vrfy_snd_def_xport_maps, 0, 0,
 	0,
     };
+    static const CONFIG_INT_TABLE int_table[] = {
+	VAR_RESOLVE_CACHE_SIZE, DEF_RESOLVE_CACHE_SIZE, &var_resolve_cache_size, 0, 0,
+	0,
+    };
+    static const CONFIG_TIME_TABLE time_table[] = {
+	VAR_RESOLVE_CACHE_TTL, DEF_RESOLVE_CACHE_TTL, &var_resolve_cache_ttl, 1, 0,
+	0,
+    };
     static const CONFIG_BOOL_TABLE bool_table[] = {
 	VAR_SWAP_BANGPATH, DEF_SWAP_BANGPATH, &var_swap_bangpath,
 	VAR_APP_AT_MYORIGIN, DEF_APP_AT_MYORIGIN, &var_append_at_myorigin,
@@ -641,6 +661,8 @@ int     main(int argc, char **argv)
 
     multi_server_main(argc, argv, rewrite_service,
 		      CA_MAIL_SERVER_STR_TABLE(str_table),
+		      CA_MAIL_SERVER_INT_TABLE(int_table),
+		      CA_MAIL_SERVER_TIME_TABLE(time_table),
 		      CA_MAIL_SERVER_BOOL_TABLE(bool_table),
 		      CA_MAIL_SERVER_NBOOL_TABLE(nbool_table),
 		      CA_MAIL_SERVER_PRE_INIT(pre_jail_init),
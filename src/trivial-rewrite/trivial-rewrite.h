@@ -13,6 +13,7 @@
   */
 #include <vstring.h>
 #include <vstream.h>
+#include <ctable.h>
 
  /*
   * Global library.
@@ -67,6 +68,7 @@ typedef struct {
     const char *transport_maps_name;	/* name of variable */
     char  **transport_maps;		/* maptype:mapname */
     struct TRANSPORT_INFO *transport_info;	/* handle */
+    CTABLE *cache;			/* recent results */
 } RES_CONTEXT;
 
 #define RES_PARAM_VALUE(x) (*(x))	/* make it easy to do it right */
@@ -74,6 +76,7 @@ typedef struct {
 extern void resolve_init(void);
 extern int resolve_proto(RES_CONTEXT *, VSTREAM *);
 extern int resolve_class(const char *);
+extern void resolve_cache_init(void);
 
 /* LICENSE
 /* .ad
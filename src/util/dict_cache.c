@@ -93,6 +93,12 @@
 /*	Important: programs must not use both dict_cache_sequence()
 /*	and the built-in cache cleanup feature.
 /*
+/*	The built-in cache cleanup saves its position in the cache
+/*	from time to time, and when it is stopped with
+/*	dict_cache_control() or dict_cache_close(). A new process
+/*	resumes an unfinished cleanup run after the saved position,
+/*	instead of examining all cache entries again.
+/*
 /*	dict_cache_control() provides control over the built-in
 /*	cache cleanup feature and logging. The arguments are a list
 /*	of macros with zero or more arguments, terminated with
@@ -117,6 +123,12 @@
 /*	interval to stop cache cleanup.
 /* .IP "CA_DICT_CACHE_CTL_CONTEXT(void *context)"
 /*	Application context that is passed to the validator function.
+/* .IP "CA_DICT_CACHE_CTL_BUDGET(int budget)"
+/*	The amount of time in milliseconds that a cache cleanup run
+/*	may spend per event loop iteration. The cleanup examines
+/*	as many cache entries as fit in this budget before it yields
+/*	to other events. Specify zero to examine one entry per event
+/*	loop iteration.
 /* .RE
 /* .PP
 /*	dict_cache_name() returns the name of the specified cache.
@@ -155,10 +167,10 @@
 /*	the DICT_CACHE_FLAG_VERBOSE flag (see above) to log all
 /*	warnings.
 /* BUGS
-/*	There should be a way to suspend automatic program suicide
-/*	until a cache cleanup run is completed. Some entries may
-/*	never be removed when the process max_idle time is less
-/*	than the time needed to make a full pass over the cache.
+/*	A resumed cleanup run still reads the cache entries before
+/*	the saved position, because the dict(3) interface has no
+/*	operation to seek to a specific key. When the entry at the
+/*	saved position no longer exists, the run starts over.
 /*
 /*	The delete-behind strategy assumes that all updates are
 /*	made by a single process. Otherwise, delete-behind may
@@ -225,8 +237,15 @@ struct DICT_CACHE {
     int     exp_interval;		/* time between cleanup runs */
     DICT_CACHE_VALIDATOR_FN exp_validator;	/* expiration call-back */
     void   *exp_context;		/* call-back context */
+    int     exp_budget;			/* msec per event loop iteration */
     int     retained;			/* entries retained in cleanup run */
     int     dropped;			/* entries removed in cleanup run */
+    int     completed;			/* completed cleanup runs */
+
+    /* Cleanup resume support. */
+    char   *resume_key;			/* skip entries up to this one */
+    int     skipped;			/* entries skipped in cleanup run */
+    time_t  pos_save_stamp;		/* last position update */
 
     /* Rate-limited logging support. */
     int     log_delay;
@@ -264,6 +283,18 @@ struct DICT_CACHE {
   */
 #define DC_LAST_CACHE_CLEANUP_COMPLETED "_LAST_CACHE_CLEANUP_COMPLETED_"
 
+ /*
+  * Special key to store the last examined entry of an unfinished cache
+  * cleanup run, and how often to update it. Each update is a database
+  * write, so we don't do this after every event loop iteration.
+  */
+#define DC_LAST_CACHE_CLEANUP_POSITION "_LAST_CACHE_CLEANUP_POSITION_"
+#define DC_POSITION_SAVE_INTERVAL	60
+
+#define DC_IS_INTERNAL_KEY(key) \
+    (strcmp((key), DC_LAST_CACHE_CLEANUP_COMPLETED) == 0 \
+	|| strcmp((key), DC_LAST_CACHE_CLEANUP_POSITION) == 0)
+
 /* dict_cache_lookup - load entry from cache */
 
 const char *dict_cache_lookup(DICT_CACHE *cp, const char *cache_key)
@@ -370,12 +401,11 @@ int     dict_cache_sequence(DICT_CACHE *cp, int first_next,
     DICT   *db = cp->db;
 
     /*
-     * Find the first or next database entry. Hide the record with the cache
-     * cleanup completion time stamp.
+     * Find the first or next database entry. Hide the records with the
+     * cache cleanup completion time stamp and position.
      */
     seq_res = dict_seq(db, first_next, &raw_cache_key, &raw_cache_val);
-    if (seq_res == 0
-	&& strcmp(raw_cache_key, DC_LAST_CACHE_CLEANUP_COMPLETED) == 0)
+    while (seq_res == 0 && DC_IS_INTERNAL_KEY(raw_cache_key))
 	seq_res =
 	    dict_seq(db, DICT_SEQ_FUN_NEXT, &raw_cache_key, &raw_cache_val);
     if (cp->user_flags & DICT_CACHE_FLAG_VERBOSE)
@@ -458,7 +488,27 @@ static void dict_cache_clean_stat_log_reset(DICT_CACHE *cp,
     cp->retained = cp->dropped = 0;
 }
 
-/* dict_cache_clean_event - examine one cache entry */
+/* dict_cache_clean_save_position - save position of unfinished cleanup run */
+
+static void dict_cache_clean_save_position(DICT_CACHE *cp)
+{
+
+    /*
+     * Don't save the position of an entry that is scheduled for
+     * delete-behind, nor while we are still looking for the position that
+     * was saved by an earlier process.
+     */
+    if (cp->saved_curr_key == 0 || cp->resume_key != 0
+	|| DC_IS_SCHEDULED_FOR_DELETE_BEHIND(cp))
+	return;
+    if (dict_put(cp->db, DC_LAST_CACHE_CLEANUP_POSITION,
+		 cp->saved_curr_key) != 0)
+	msg_rate_delay(&cp->upd_log_stamp, cp->log_delay, msg_warn,
+		       "%s: could not save cache cleanup position", cp->name);
+    cp->pos_save_stamp = event_time();
+}
+
+/* dict_cache_clean_event - examine a batch of cache entries */
 
 static void dict_cache_clean_event(int unused_event, void *cache_context)
 {
@@ -469,67 +519,120 @@ static void dict_cache_clean_event(int unused_event, void *cache_context)
     int     next_interval;
     VSTRING *stamp_buf;
     int     first_next;
+    struct timeval start;
+    struct timeval now;
 
     /*
      * We interleave cache cleanup with other processing, so that the
      * application's service remains available, with perhaps increased
-     * latency.
-     */
-
-    /*
-     * Start a new cache cleanup run.
+     * latency. Each call examines as many cache entries as fit in the time
+     * budget, or just one entry when there is no budget.
      */
-    if (cp->saved_curr_key == 0) {
-	cp->retained = cp->dropped = 0;
-	first_next = DICT_SEQ_FUN_FIRST;
-	if (cp->user_flags & DICT_CACHE_FLAG_VERBOSE)
-	    msg_info("%s: start %s cache cleanup", myname, cp->name);
-    }
+    if (cp->exp_budget > 0)
+	GETTIMEOFDAY(&start);
 
-    /*
-     * Continue a cache cleanup run in progress.
-     */
-    else {
-	first_next = DICT_SEQ_FUN_NEXT;
-    }
+    for (;;) {
 
-    /*
-     * Examine one cache entry.
-     */
-    if (dict_cache_sequence(cp, first_next, &cache_key, &cache_val) == 0) {
-	if (cp->exp_validator(cache_key, cache_val, cp->exp_context) == 0) {
-	    DC_SCHEDULE_FOR_DELETE_BEHIND(cp);
-	    cp->dropped++;
+	/*
+	 * Start a new cache cleanup run.
+	 */
+	if (cp->saved_curr_key == 0) {
+	    cp->retained = cp->dropped = cp->skipped = 0;
+	    cp->pos_save_stamp = event_time();
+	    first_next = DICT_SEQ_FUN_FIRST;
 	    if (cp->user_flags & DICT_CACHE_FLAG_VERBOSE)
-		msg_info("%s: drop %s cache entry for %s",
-			 myname, cp->name, cache_key);
+		msg_info("%s: start %s cache cleanup", myname, cp->name);
+	}
+
+	/*
+	 * Continue a cache cleanup run in progress.
+	 */
+	else {
+	    first_next = DICT_SEQ_FUN_NEXT;
+	}
+
+	/*
+	 * Examine one cache entry. When resuming an unfinished run, skip the
+	 * entries that an earlier process already examined.
+	 */
+	if (dict_cache_sequence(cp, first_next, &cache_key, &cache_val) == 0) {
+	    if (cp->resume_key != 0) {
+		cp->skipped++;
+		if (strcmp(cache_key, cp->resume_key) == 0) {
+		    if (cp->user_flags & (DICT_CACHE_FLAG_VERBOSE
+					  | DICT_CACHE_FLAG_STATISTICS))
+			msg_info("cache %s cleanup: resume after %d entries",
+				 cp->name, cp->skipped);
+		    FREE_AND_WIPE(cp->resume_key);
+		}
+	    } else if (cp->exp_validator(cache_key, cache_val,
+					 cp->exp_context) == 0) {
+		DC_SCHEDULE_FOR_DELETE_BEHIND(cp);
+		cp->dropped++;
+		if (cp->user_flags & DICT_CACHE_FLAG_VERBOSE)
+		    msg_info("%s: drop %s cache entry for %s",
+			     myname, cp->name, cache_key);
+	    } else {
+		cp->retained++;
+		if (cp->user_flags & DICT_CACHE_FLAG_VERBOSE)
+		    msg_info("%s: keep %s cache entry for %s",
+			     myname, cp->name, cache_key);
+	    }
+	    next_interval = 0;
+	}
+
+	/*
+	 * Cache cleanup completed. Report vital statistics.
+	 */
+	else if (cp->error != 0) {
+	    msg_warn("%s: cache cleanup scan terminated due to error", cp->name);
+	    dict_cache_clean_stat_log_reset(cp, "partial");
+	    FREE_AND_WIPE(cp->resume_key);
+	    next_interval = cp->exp_interval;
+	    break;
+	}
+
+	/*
+	 * The saved position no longer exists. Examine all entries.
+	 */
+	else if (cp->resume_key != 0) {
+	    msg_info("cache %s cleanup: saved position not found, starting over",
+		     cp->name);
+	    FREE_AND_WIPE(cp->resume_key);
+	    continue;
 	} else {
-	    cp->retained++;
 	    if (cp->user_flags & DICT_CACHE_FLAG_VERBOSE)
-		msg_info("%s: keep %s cache entry for %s",
-			 myname, cp->name, cache_key);
+		msg_info("%s: done %s cache cleanup scan", myname, cp->name);
+	    dict_cache_clean_stat_log_reset(cp, "full");
+	    stamp_buf = vstring_alloc(100);
+	    vstring_sprintf(stamp_buf, "%ld", (long) event_time());
+	    dict_put(cp->db, DC_LAST_CACHE_CLEANUP_COMPLETED,
+		     vstring_str(stamp_buf));
+	    vstring_free(stamp_buf);
+	    (void) dict_del(cp->db, DC_LAST_CACHE_CLEANUP_POSITION);
+	    cp->completed++;
+	    next_interval = cp->exp_interval;
+	    break;
 	}
-	next_interval = 0;
+
+	/*
+	 * Yield to other events when the time budget is used up.
+	 */
+	if (cp->exp_budget <= 0)
+	    break;
+	GETTIMEOFDAY(&now);
+	if ((now.tv_sec - start.tv_sec) * 1000
+	    + (now.tv_usec - start.tv_usec) / 1000 >= cp->exp_budget)
+	    break;
     }
 
     /*
-     * Cache cleanup completed. Report vital statistics.
+     * Save the position from time to time, so that a new process can resume
+     * this cleanup run.
      */
-    else if (cp->error != 0) {
-	msg_warn("%s: cache cleanup scan terminated due to error", cp->name);
-	dict_cache_clean_stat_log_reset(cp, "partial");
-	next_interval = cp->exp_interval;
-    } else {
-	if (cp->user_flags & DICT_CACHE_FLAG_VERBOSE)
-	    msg_info("%s: done %s cache cleanup scan", myname, cp->name);
-	dict_cache_clean_stat_log_reset(cp, "full");
-	stamp_buf = vstring_alloc(100);
-	vstring_sprintf(stamp_buf, "%ld", (long) event_time());
-	dict_put(cp->db, DC_LAST_CACHE_CLEANUP_COMPLETED,
-		 vstring_str(stamp_buf));
-	vstring_free(stamp_buf);
-	next_interval = cp->exp_interval;
-    }
+    if (next_interval == 0
+	&& event_time() >= cp->pos_save_stamp + DC_POSITION_SAVE_INTERVAL)
+	dict_cache_clean_save_position(cp);
     event_request_timer(dict_cache_clean_event, cache_context, next_interval);
 }
 
@@ -539,6 +642,7 @@ void    dict_cache_control(DICT_CACHE *cp,...)
 {
     const char *myname = "dict_cache_control";
     const char *last_done;
+    const char *last_pos;
     time_t  next_interval;
     int     cache_cleanup_is_active = (cp->exp_validator && cp->exp_interval);
     va_list ap;
@@ -569,6 +673,12 @@ void    dict_cache_control(DICT_CACHE *cp,...)
 	case DICT_CACHE_CTL_CONTEXT:
 	    cp->exp_context = va_arg(ap, void *);
 	    break;
+	case DICT_CACHE_CTL_BUDGET:
+	    cp->exp_budget = va_arg(ap, int);
+	    if (cp->exp_budget < 0)
+		msg_panic("%s: bad %s cache cleanup budget %d",
+			  myname, cp->name, cp->exp_budget);
+	    break;
 	default:
 	    msg_panic("%s: bad command: %d", myname, name);
 	}
@@ -598,6 +708,14 @@ void    dict_cache_control(DICT_CACHE *cp,...)
 	    next_interval = 0;
 	if (next_interval > cp->exp_interval)
 	    next_interval = cp->exp_interval;
+
+	/*
+	 * Resume an unfinished cleanup run without delay.
+	 */
+	if ((last_pos = dict_get(cp->db, DC_LAST_CACHE_CLEANUP_POSITION)) != 0) {
+	    cp->resume_key = mystrdup(last_pos);
+	    next_interval = 0;
+	}
 	if ((cp->user_flags & DICT_CACHE_FLAG_VERBOSE) && next_interval > 0)
 	    msg_info("%s cache cleanup will start after %ds",
 		     cp->name, (int) next_interval);
@@ -611,7 +729,9 @@ void    dict_cache_control(DICT_CACHE *cp,...)
     else if (cache_cleanup_is_active) {
 	if (cp->retained || cp->dropped)
 	    dict_cache_clean_stat_log_reset(cp, "partial");
+	dict_cache_clean_save_position(cp);
 	dict_cache_delete_behind_reset(cp);
+	FREE_AND_WIPE(cp->resume_key);
 	event_cancel_timer(dict_cache_clean_event, (void *) cp);
     }
 }
@@ -642,8 +762,13 @@ DICT_CACHE *dict_cache_open(const char *dbname, int open_flags, int dict_flags)
     cp->exp_interval = 0;
     cp->exp_validator = 0;
     cp->exp_context = 0;
+    cp->exp_budget = 0;
     cp->retained = 0;
     cp->dropped = 0;
+    cp->completed = 0;
+    cp->resume_key = 0;
+    cp->skipped = 0;
+    cp->pos_save_stamp = 0;
     cp->log_delay = DC_DEF_LOG_DELAY;
     cp->upd_log_stamp = cp->get_log_stamp =
 	cp->del_log_stamp = cp->seq_log_stamp = 0;
@@ -657,10 +782,11 @@ void    dict_cache_close(DICT_CACHE *cp)
 {
 
     /*
-     * Destroy the DICT_CACHE object.
+     * Destroy the DICT_CACHE object. Stop the cleanup thread first, as it
+     * may save its position in the database.
      */
-    myfree(cp->name);
     dict_cache_control(cp, DICT_CACHE_CTL_INTERVAL, 0, DICT_CACHE_CTL_END);
+    myfree(cp->name);
     dict_close(cp->db);
     if (cp->saved_curr_key)
 	myfree(cp->saved_curr_key);
@@ -709,7 +835,9 @@ const char *dict_cache_name(DICT_CACHE *cp)
 		"\n\tupdate <key-suffix> <count> (negative to reverse order)" \
 		"\n\tdelete <key-suffix> <count> (negative to reverse order)" \
 		"\n\tpurge <key-suffix>" \
-		"\n\tcount <key-suffix>"
+		"\n\tcount <key-suffix>" \
+		"\n\n\tTo run one cache cleanup:" \
+		"\n\tcleanup <key-suffix> <msec> (drop entries with suffix)"
 
  /*
   * For realism, open the cache with the same flags as postscreen(8) and
@@ -1045,6 +1173,73 @@ static void add_request(DICT_CACHE_TEST *tp, ARGV *argv)
     tp->used += 1;
 }
 
+static int cleanup_count;		/* validator calls */
+
+/* cleanup_validator - drop entries with the given key suffix */
+
+static int cleanup_validator(const char *cache_key, const char *unused_val,
+			             void *context)
+{
+    const char *suffix = cache_key + strspn(cache_key, "0123456789");
+
+    cleanup_count++;
+    return (!(suffix[0] == '-' && strcmp(suffix + 1, (char *) context) == 0));
+}
+
+/* run_cleanup - run one cache cleanup and report its cost */
+
+static void run_cleanup(DICT_CACHE *dp, ARGV *argv)
+{
+    struct timeval start;
+    struct timeval finish;
+    struct timeval elapsed;
+    double  secs;
+    int     completed;
+    int     ticks = 0;
+
+    if (dp == 0) {
+	msg_warn("no cache");
+	return;
+    }
+    if (!alldig(argv->argv[2])) {
+	msg_warn("cleanup: bad budget: %s", argv->argv[2]);
+	return;
+    }
+
+    /*
+     * Forget when the last cleanup run completed, so that this one starts
+     * right away. Keep a saved position, so that we can test resumption.
+     */
+    (void) dict_del(dp->db, DC_LAST_CACHE_CLEANUP_COMPLETED);
+    completed = dp->completed;
+    cleanup_count = 0;
+    GETTIMEOFDAY(&start);
+    dict_cache_control(dp,
+		       CA_DICT_CACHE_CTL_FLAGS(dp->user_flags
+					       | DICT_CACHE_FLAG_STATISTICS),
+		       CA_DICT_CACHE_CTL_INTERVAL(86400),
+		       CA_DICT_CACHE_CTL_VALIDATOR(cleanup_validator),
+		       CA_DICT_CACHE_CTL_CONTEXT((void *) argv->argv[1]),
+		       CA_DICT_CACHE_CTL_BUDGET(atoi(argv->argv[2])),
+		       CA_DICT_CACHE_CTL_END);
+    while (dp->completed == completed && dp->error == 0) {
+	event_loop(-1);
+	ticks++;
+    }
+    dict_cache_control(dp, CA_DICT_CACHE_CTL_INTERVAL(0),
+		       CA_DICT_CACHE_CTL_END);
+    GETTIMEOFDAY(&finish);
+    timersub(&finish, &start, &elapsed);
+    secs = elapsed.tv_sec + elapsed.tv_usec / 1000000.0;
+    if (show_elapsed)
+	vstream_printf("Elapsed: %g\n", secs);
+    vstream_printf("entries=%d ticks=%d", cleanup_count, ticks);
+    if (cleanup_count > 0)
+	vstream_printf(" cost=%gs per million entries",
+		       secs * 1000000.0 / cleanup_count);
+    vstream_printf("\n");
+}
+
 /* main - main program */
 
 int     main(int argc, char **argv)
@@ -1104,6 +1299,8 @@ int     main(int argc, char **argv)
 	    run_requests(test_job, cache, inbuf);
 	} else if (strcmp(args->argv[0], "status") == 0 && args->argc == 1) {
 	    show_status(test_job, cache);
+	} else if (strcmp(args->argv[0], "cleanup") == 0 && args->argc == 3) {
+	    run_cleanup(cache, args);
 	} else {
 	    add_request(test_job, args);
 	}
@@ -27,6 +27,16 @@
 /*	This variable cannot be exported via the dict(3) API and
 /*	must therefore be defined in the calling program by invoking
 /*	the DEFINE_DICT_LMDB_MAP_SIZE macro at the global level.
+/*
+/*	When a database is created from scratch in bulk mode (as
+/*	with postmap(1) and postalias(1)), updates are collected in
+/*	memory, and are written in key order with MDB_APPEND when
+/*	the database is closed. Duplicate keys are detected and
+/*	reported when they are added, as with other updates. A lookup,
+/*	delete or sequence request ends the collection early.
+/*
+/*	When a small database is opened read-only, the kernel is
+/*	asked to read the file into memory ahead of time.
 /* DIAGNOSTICS
 /*	Fatal errors: cannot open file, file write error, out of
 /*	memory.
@@ -63,7 +73,9 @@
 
 #include <sys/stat.h>
 #include <string.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <limits.h>
 
 /* Utility library. */
@@ -71,6 +83,7 @@
 #include <msg.h>
 #include <mymalloc.h>
 #include <htable.h>
+#include <binhash.h>
 #include <iostuff.h>
 #include <vstring.h>
 #include <myflock.h>
@@ -82,11 +95,23 @@
 
 /* Application-specific. */
 
+typedef struct {
+    ssize_t offset;			/* key then value in bulk_data */
+    size_t  key_size;			/* key length */
+    size_t  val_size;			/* value length */
+} DICT_LMDB_ENTRY;
+
 typedef struct {
     DICT    dict;			/* generic members */
     SLMDB   slmdb;			/* sane LMDB API */
     VSTRING *key_buf;			/* key buffer */
     VSTRING *val_buf;			/* value buffer */
+    VSTRING *bulk_data;			/* collected keys and values */
+    DICT_LMDB_ENTRY *bulk_list;		/* collected updates */
+    BINHASH *bulk_keys;			/* key to bulk_list index */
+    ssize_t bulk_used;			/* collected updates */
+    ssize_t bulk_size;			/* bulk_list allocation */
+    int     bulk_flushing;		/* bulk_list is being written */
 } DICT_LMDB;
 
  /*
@@ -124,6 +149,154 @@ typedef struct {
 
 /* #define msg_verbose 1 */
 
+ /*
+  * Sorted bulk load. LMDB stores keys in a B+tree. Inserting keys in random
+  * order splits pages all over the tree, and leaves them half full; with
+  * MDB_APPEND and sorted keys, LMDB fills one page after the other. The
+  * bulk-mode transaction may be restarted after a recoverable error (see
+  * dict_lmdb_longjmp()); then the application sends all updates again.
+  */
+#define DICT_LMDB_BULK_LIST_INIT	1024
+
+static const char *dict_lmdb_bulk_base;	/* for qsort() */
+
+ /*
+  * Read small read-only databases ahead of time, so that the first lookups
+  * don't each wait for a page fault.
+  */
+#define DICT_LMDB_PREFETCH_LIMIT	(64 * 1024 * 1024)
+
+/* dict_lmdb_bulk_add - collect one update */
+
+static int dict_lmdb_bulk_add(DICT_LMDB *dict_lmdb, MDB_val *mdb_key,
+			              MDB_val *mdb_value)
+{
+    DICT_LMDB_ENTRY *ep;
+    BINHASH_INFO *ht;
+
+    /*
+     * Start over after a restarted bulk-mode transaction.
+     */
+    if (dict_lmdb->bulk_flushing) {
+	dict_lmdb->bulk_flushing = 0;
+	dict_lmdb->bulk_used = 0;
+	VSTRING_RESET(dict_lmdb->bulk_data);
+	binhash_free(dict_lmdb->bulk_keys, (void (*) (void *)) 0);
+	dict_lmdb->bulk_keys = binhash_create(DICT_LMDB_BULK_LIST_INIT);
+    }
+
+    /*
+     * A duplicate key is not added, as with MDB_NOOVERWRITE, unless it
+     * replaces the earlier value.
+     */
+    if ((ht = binhash_locate(dict_lmdb->bulk_keys, mdb_key->mv_data,
+			     mdb_key->mv_size)) != 0) {
+	if ((dict_lmdb->dict.flags & DICT_FLAG_DUP_REPLACE) == 0)
+	    return (MDB_KEYEXIST);
+	ep = dict_lmdb->bulk_list + CAST_ANY_PTR_TO_INT(ht->value);
+    } else {
+	if (dict_lmdb->bulk_used >= dict_lmdb->bulk_size) {
+	    if (dict_lmdb->bulk_list == 0) {
+		dict_lmdb->bulk_size = DICT_LMDB_BULK_LIST_INIT;
+		dict_lmdb->bulk_list = (DICT_LMDB_ENTRY *)
+		    mymalloc(sizeof(*dict_lmdb->bulk_list)
+			     * dict_lmdb->bulk_size);
+	    } else {
+		dict_lmdb->bulk_size *= 2;
+		dict_lmdb->bulk_list = (DICT_LMDB_ENTRY *)
+		    myrealloc((void *) dict_lmdb->bulk_list,
+			      sizeof(*dict_lmdb->bulk_list)
+			      * dict_lmdb->bulk_size);
+	    }
+	}
+	binhash_enter(dict_lmdb->bulk_keys, mdb_key->mv_data, mdb_key->mv_size,
+		      CAST_INT_TO_VOID_PTR(dict_lmdb->bulk_used));
+	ep = dict_lmdb->bulk_list + dict_lmdb->bulk_used++;
+    }
+    ep->offset = VSTRING_LEN(dict_lmdb->bulk_data);
+    ep->key_size = mdb_key->mv_size;
+    ep->val_size = mdb_value->mv_size;
+    vstring_memcat(dict_lmdb->bulk_data, mdb_key->mv_data, mdb_key->mv_size);
+    vstring_memcat(dict_lmdb->bulk_data, mdb_value->mv_data,
+		   mdb_value->mv_size);
+    return (0);
+}
+
+/* dict_lmdb_bulk_keycmp - compare keys as LMDB does */
+
+static int dict_lmdb_bulk_keycmp(const DICT_LMDB_ENTRY *a,
+				         const DICT_LMDB_ENTRY *b)
+{
+    int     diff;
+
+    if ((diff = memcmp(dict_lmdb_bulk_base + a->offset,
+		       dict_lmdb_bulk_base + b->offset,
+		       a->key_size < b->key_size ?
+		       a->key_size : b->key_size)) != 0)
+	return (diff);
+    return (a->key_size < b->key_size ? -1 : a->key_size > b->key_size);
+}
+
+/* dict_lmdb_bulk_compare - qsort() call-back */
+
+static int dict_lmdb_bulk_compare(const void *a, const void *b)
+{
+    return (dict_lmdb_bulk_keycmp((const DICT_LMDB_ENTRY *) a,
+				  (const DICT_LMDB_ENTRY *) b));
+}
+
+/* dict_lmdb_bulk_flush - write collected updates in key order */
+
+static void dict_lmdb_bulk_flush(DICT_LMDB *dict_lmdb)
+{
+    DICT   *dict = &dict_lmdb->dict;
+    DICT_LMDB_ENTRY *ep;
+    DICT_LMDB_ENTRY *end;
+    MDB_val mdb_key;
+    MDB_val mdb_value;
+    int     status;
+
+    dict_lmdb->bulk_flushing = 1;
+    dict_lmdb_bulk_base = vstring_str(dict_lmdb->bulk_data);
+    qsort((void *) dict_lmdb->bulk_list, dict_lmdb->bulk_used,
+	  sizeof(*dict_lmdb->bulk_list), dict_lmdb_bulk_compare);
+
+    end = dict_lmdb->bulk_list + dict_lmdb->bulk_used;
+    for (ep = dict_lmdb->bulk_list; ep < end; ep++) {
+	mdb_key.mv_data = (void *) (dict_lmdb_bulk_base + ep->offset);
+	mdb_key.mv_size = ep->key_size;
+	mdb_value.mv_data = (void *) (dict_lmdb_bulk_base + ep->offset
+				      + ep->key_size);
+	mdb_value.mv_size = ep->val_size;
+	if ((status = slmdb_put(&dict_lmdb->slmdb, &mdb_key, &mdb_value,
+				MDB_APPEND)) != 0)
+	    msg_fatal("error updating %s:%s: %s",
+		      dict->type, dict->name, mdb_strerror(status));
+    }
+}
+
+/* dict_lmdb_bulk_free - stop collecting updates */
+
+static void dict_lmdb_bulk_free(DICT_LMDB *dict_lmdb)
+{
+    vstring_free(dict_lmdb->bulk_data);
+    dict_lmdb->bulk_data = 0;
+    if (dict_lmdb->bulk_list)
+	myfree((void *) dict_lmdb->bulk_list);
+    dict_lmdb->bulk_list = 0;
+    binhash_free(dict_lmdb->bulk_keys, (void (*) (void *)) 0);
+    dict_lmdb->bulk_keys = 0;
+    dict_lmdb->bulk_used = dict_lmdb->bulk_size = 0;
+}
+
+/* dict_lmdb_bulk_end - write collected updates, then stop collecting */
+
+static void dict_lmdb_bulk_end(DICT_LMDB *dict_lmdb)
+{
+    dict_lmdb_bulk_flush(dict_lmdb);
+    dict_lmdb_bulk_free(dict_lmdb);
+}
+
 /* dict_lmdb_lookup - find database entry */
 
 static const char *dict_lmdb_lookup(DICT *dict, const char *name)
@@ -144,6 +317,12 @@ static const char *dict_lmdb_lookup(DICT *dict, const char *name)
     if ((dict->flags & (DICT_FLAG_TRY1NULL | DICT_FLAG_TRY0NULL)) == 0)
 	msg_panic("dict_lmdb_lookup: no DICT_FLAG_TRY1NULL | DICT_FLAG_TRY0NULL flag");
 
+    /*
+     * Don't miss collected updates.
+     */
+    if (dict_lmdb->bulk_data)
+	dict_lmdb_bulk_end(dict_lmdb);
+
     /*
      * Optionally fold the key.
      */
@@ -217,6 +396,7 @@ static int dict_lmdb_update(DICT *dict, const char *name, const char *value)
     MDB_val mdb_key;
     MDB_val mdb_value;
     int     status;
+    int     bulk;
 
     dict->error = 0;
 
@@ -262,17 +442,28 @@ static int dict_lmdb_update(DICT *dict, const char *name, const char *value)
     }
 
     /*
-     * Acquire an exclusive lock.
+     * Collect the update for a sorted bulk load. This reports a duplicate
+     * key as MDB_KEYEXIST, just like a database update, but does not need a
+     * lock.
      */
-    if ((dict->flags & DICT_FLAG_LOCK)
-    && myflock(dict->lock_fd, MYFLOCK_STYLE_FCNTL, MYFLOCK_OP_EXCLUSIVE) < 0)
-	msg_fatal("%s: lock dictionary: %m", dict->name);
+    if ((bulk = (dict_lmdb->bulk_data != 0)) != 0) {
+	status = dict_lmdb_bulk_add(dict_lmdb, &mdb_key, &mdb_value);
+    } else {
 
-    /*
-     * Do the update.
-     */
-    status = slmdb_put(&dict_lmdb->slmdb, &mdb_key, &mdb_value,
+	/*
+	 * Acquire an exclusive lock.
+	 */
+	if ((dict->flags & DICT_FLAG_LOCK)
+	    && myflock(dict->lock_fd, MYFLOCK_STYLE_FCNTL,
+		       MYFLOCK_OP_EXCLUSIVE) < 0)
+	    msg_fatal("%s: lock dictionary: %m", dict->name);
+
+	/*
+	 * Do the update.
+	 */
+	status = slmdb_put(&dict_lmdb->slmdb, &mdb_key, &mdb_value,
 	       (dict->flags & DICT_FLAG_DUP_REPLACE) ? 0 : MDB_NOOVERWRITE);
+    }
     if (status != 0) {
 	if (status == MDB_KEYEXIST) {
 	    if (dict->flags & DICT_FLAG_DUP_IGNORE)
@@ -283,6 +474,7 @@ static int dict_lmdb_update(DICT *dict, const char *name, const char *value)
 	    else
 		msg_fatal("%s:%s: duplicate entry: \"%s\"",
 			  dict_lmdb->dict.type, dict_lmdb->dict.name, name);
+	    status = DICT_STAT_FAIL;		/* not MDB_KEYEXIST (< 0) */
 	} else {
 	    msg_fatal("error updating %s:%s: %s",
 		      dict_lmdb->dict.type, dict_lmdb->dict.name,
@@ -293,7 +485,7 @@ static int dict_lmdb_update(DICT *dict, const char *name, const char *value)
     /*
      * Release the exclusive lock.
      */
-    if ((dict->flags & DICT_FLAG_LOCK)
+    if (!bulk && (dict->flags & DICT_FLAG_LOCK)
 	&& myflock(dict->lock_fd, MYFLOCK_STYLE_FCNTL, MYFLOCK_OP_NONE) < 0)
 	msg_fatal("%s: unlock dictionary: %m", dict->name);
 
@@ -318,6 +510,12 @@ static int dict_lmdb_delete(DICT *dict, const char *name)
     if ((dict->flags & (DICT_FLAG_TRY1NULL | DICT_FLAG_TRY0NULL)) == 0)
 	msg_panic("dict_lmdb_delete: no DICT_FLAG_TRY1NULL | DICT_FLAG_TRY0NULL flag");
 
+    /*
+     * Don't miss collected updates.
+     */
+    if (dict_lmdb->bulk_data)
+	dict_lmdb_bulk_end(dict_lmdb);
+
     /*
      * Optionally fold the key.
      */
@@ -413,6 +611,12 @@ static int dict_lmdb_sequence(DICT *dict, int function,
 	msg_panic("%s: invalid function: %d", myname, function);
     }
 
+    /*
+     * Don't miss collected updates.
+     */
+    if (dict_lmdb->bulk_data)
+	dict_lmdb_bulk_end(dict_lmdb);
+
     /*
      * Acquire a shared lock.
      */
@@ -472,7 +676,11 @@ static void dict_lmdb_close(DICT *dict)
 {
     DICT_LMDB *dict_lmdb = (DICT_LMDB *) dict;
 
+    if (dict_lmdb->bulk_data)
+	dict_lmdb_bulk_flush(dict_lmdb);
     slmdb_close(&dict_lmdb->slmdb);
+    if (dict_lmdb->bulk_data)
+	dict_lmdb_bulk_free(dict_lmdb);
     if (dict_lmdb->key_buf)
 	vstring_free(dict_lmdb->key_buf);
     if (dict_lmdb->val_buf)
@@ -655,6 +863,20 @@ DICT   *dict_lmdb_open(const char *path, int open_flags, int dict_flags)
 
     dict_lmdb->key_buf = 0;
     dict_lmdb->val_buf = 0;
+    dict_lmdb->bulk_data = 0;
+    dict_lmdb->bulk_list = 0;
+    dict_lmdb->bulk_keys = 0;
+    dict_lmdb->bulk_used = dict_lmdb->bulk_size = 0;
+    dict_lmdb->bulk_flushing = 0;
+    if ((dict_flags & DICT_FLAG_BULK_UPDATE) && (open_flags & O_TRUNC)) {
+	dict_lmdb->bulk_data = vstring_alloc(10000);
+	dict_lmdb->bulk_keys = binhash_create(DICT_LMDB_BULK_LIST_INIT);
+    }
+
+#ifdef POSIX_FADV_WILLNEED
+    if (open_flags == O_RDONLY && st.st_size <= DICT_LMDB_PREFETCH_LIMIT)
+	(void) posix_fadvise(db_fd, 0, st.st_size, POSIX_FADV_WILLNEED);
+#endif
 
     /*
      * Warn if the source file is newer than the indexed file, except when
@@ -700,3 +922,128 @@ DICT   *dict_lmdb_open(const char *path, int open_flags, int dict_flags)
 }
 
 #endif
+
+#ifdef TEST
+
+ /*
+  * Benchmark. Create each table from the same generated keys in bulk mode,
+  * as postmap(1) does, then look up the keys in random order. Report the
+  * load time and the lookup rate. This works for any table type that
+  * supports bulk updates, so that LMDB can be compared with other types:
+  * 
+  * dict_lmdb -n 1000000 lmdb hash btree cdb
+  * 
+  * The tables are created as dict_bench.suffix in the current directory.
+  */
+#include <sys/time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <msg.h>
+#include <mymalloc.h>
+#include <vstring.h>
+#include <vstream.h>
+#include <msg_vstream.h>
+#include <myrand.h>
+#include <stringops.h>
+#include <dict.h>
+
+#define BENCH_NAME	"dict_bench"
+
+/* bench_elapsed - seconds since start */
+
+static double bench_elapsed(struct timeval *start)
+{
+    struct timeval now;
+
+    GETTIMEOFDAY(&now);
+    return (now.tv_sec - start->tv_sec
+	    + (now.tv_usec - start->tv_usec) / 1000000.0);
+}
+
+/* bench_remove - remove table files */
+
+static void bench_remove(void)
+{
+    static const char *suffixes[] = {"db", "lmdb", "cdb", "dir", "pag", 0};
+    const char **cpp;
+    char   *path;
+
+    for (cpp = suffixes; *cpp; cpp++) {
+	path = concatenate(BENCH_NAME, ".", *cpp, (char *) 0);
+	(void) unlink(path);
+	myfree(path);
+    }
+}
+
+int     main(int argc, char **argv)
+{
+    VSTRING *key = vstring_alloc(100);
+    VSTRING *val = vstring_alloc(100);
+    struct timeval start;
+    const char *result;
+    double  load_time;
+    double  lookup_time;
+    DICT   *dict;
+    int     count = 100000;
+    int     ch;
+    int     n;
+    int     k;
+
+    msg_vstream_init(argv[0], VSTREAM_ERR);
+    while ((ch = GETOPT(argc, argv, "n:")) > 0) {
+	switch (ch) {
+	case 'n':
+	    if ((count = atoi(optarg)) <= 0)
+		msg_fatal("bad count: %s", optarg);
+	    break;
+	default:
+	    msg_fatal("usage: %s [-n count] type...", argv[0]);
+	}
+    }
+    if (argc == optind)
+	msg_fatal("usage: %s [-n count] type...", argv[0]);
+
+    for (; optind < argc; optind++) {
+	bench_remove();
+
+	GETTIMEOFDAY(&start);
+	dict = dict_open3(argv[optind], BENCH_NAME, O_RDWR | O_CREAT | O_TRUNC,
+			  DICT_FLAG_BULK_UPDATE | DICT_FLAG_DUP_WARN);
+	for (n = 0; n < count; n++) {
+	    vstring_sprintf(key, "user%d@example%d.com", n, n % 1000);
+	    vstring_sprintf(val, "relay%d.example.net", n);
+	    if (dict_put(dict, vstring_str(key), vstring_str(val)) != 0)
+		msg_fatal("%s:%s: update failed for %s",
+			  argv[optind], BENCH_NAME, vstring_str(key));
+	}
+	dict_close(dict);
+	load_time = bench_elapsed(&start);
+
+	dict = dict_open3(argv[optind], BENCH_NAME, O_RDONLY, 0);
+	GETTIMEOFDAY(&start);
+	for (n = 0; n < count; n++) {
+	    k = myrand() % count;
+	    vstring_sprintf(key, "user%d@example%d.com", k, k % 1000);
+	    vstring_sprintf(val, "relay%d.example.net", k);
+	    if ((result = dict_get(dict, vstring_str(key))) == 0
+		|| strcmp(result, vstring_str(val)) != 0)
+		msg_fatal("%s:%s: lookup failed for %s",
+			  argv[optind], BENCH_NAME, vstring_str(key));
+	}
+	lookup_time = bench_elapsed(&start);
+	dict_close(dict);
+
+	vstream_printf("%-8s %d keys: load %.3fs, %.0f lookups/s\n",
+		       argv[optind], count, load_time,
+		       lookup_time > 0 ? count / lookup_time : 0.0);
+	vstream_fflush(VSTREAM_OUT);
+    }
+    bench_remove();
+    vstring_free(key);
+    vstring_free(val);
+    return (0);
+}
+
+#endif
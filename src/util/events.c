@@ -37,6 +37,9 @@
 /*	int	time_limit;
 /*
 /*	void	event_fork(void)
+/*
+/*	void	event_profile(stall_limit)
+/*	int	stall_limit;
 /* DESCRIPTION
 /*	This module delivers I/O and timer events.
 /*	Multiple I/O streams and timers can be monitored simultaneously.
@@ -116,6 +119,19 @@
 /*
 /*	event_fork() must be called by a child process after it is
 /*	created with fork(), to re-initialize event processing.
+/*
+/*	event_profile() enables the event loop profiler. event_loop()
+/*	then measures the time spent in each call-back and in each
+/*	event_loop() iteration, and maintains the stats(3) histograms
+/*	event_callback_milliseconds and event_loop_milliseconds.
+/*	Like other stats(3) histograms, these record milliseconds,
+/*	so that the buckets cover stalls of up to half a minute.
+/*	When an iteration takes \fIstall_limit\fR milliseconds or
+/*	more, event_loop() logs the slowest call-backs of that
+/*	iteration. A call-back is identified by its symbol name when
+/*	the address resolves to an exported symbol, otherwise by
+/*	its object file name and offset, suitable for addr2line(1).
+/*	Specify a zero \fIstall_limit\fR to disable the profiler.
 /* DIAGNOSTICS
 /*	Panics: interface violations. Fatal errors: out of memory,
 /*	system call failure. Warnings: the number of available
@@ -151,12 +167,18 @@
 #include <sys/select.h>
 #endif
 
+#ifdef HAS_DLADDR
+#include <dlfcn.h>
+#endif
+
 /* Application-specific. */
 
 #include "mymalloc.h"
 #include "msg.h"
 #include "iostuff.h"
 #include "ring.h"
+#include "vstring.h"
+#include "stats.h"
 #include "events.h"
 
 #if !defined(EVENTS_STYLE)
@@ -536,6 +558,40 @@ static time_t event_present;		/* cached time of day */
 
 #define EVENT_INIT_NEEDED()	(event_present == 0)
 
+ /*
+  * Optional profiler. We time each call-back, and remember the slowest
+  * call-backs of the current event_loop() iteration so that we can name
+  * them when the iteration as a whole takes too long.
+  */
+#define EVENT_PROF_TOP	5		/* call-backs to report */
+
+typedef struct {
+    EVENT_NOTIFY_FN callback;		/* call-back routine */
+    int     event;			/* EVENT_READ etc. */
+    long    usec;			/* elapsed time */
+} EVENT_PROF;
+
+static int event_prof_limit;		/* stall threshold, milliseconds */
+static STATS_CELL *event_prof_loop_hist;	/* iteration latency */
+static STATS_CELL *event_prof_call_hist;	/* call-back duration */
+static EVENT_PROF event_prof_top[EVENT_PROF_TOP];	/* slowest first */
+static int event_prof_calls;		/* call-backs this iteration */
+
+#define EVENT_PROF_USEC(t1, t0) \
+	(((t1).tv_sec - (t0).tv_sec) * 1000000L + (t1).tv_usec - (t0).tv_usec)
+#define EVENT_PROF_MSEC(usec)	(((usec) + 500) / 1000)
+
+ /*
+  * Dispatch a call-back, with or without profiling. The profiler costs two
+  * gettimeofday() calls per call-back.
+  */
+#define EVENT_DISPATCH(fn, ev, ctx) do { \
+	if (event_prof_limit > 0) \
+	    event_prof_dispatch((fn), (ev), (ctx)); \
+	else \
+	    (fn) ((ev), (ctx)); \
+    } while (0)
+
 /* event_init - set up tables and such */
 
 static void event_init(void)
@@ -993,6 +1049,110 @@ int     event_cancel_timer(EVENT_NOTIFY_TIME_FN callback, void *context)
     return (time_left);
 }
 
+/* event_profile - enable or disable the event loop profiler */
+
+void    event_profile(int stall_limit)
+{
+    if ((event_prof_limit = stall_limit) > 0 && event_prof_loop_hist == 0) {
+	event_prof_loop_hist = stats_histogram("event_loop_milliseconds");
+	event_prof_call_hist = stats_histogram("event_callback_milliseconds");
+    }
+}
+
+/* event_prof_dispatch - time one call-back */
+
+static void event_prof_dispatch(EVENT_NOTIFY_FN callback, int event,
+				        void *context)
+{
+    struct timeval start;
+    struct timeval done;
+    EVENT_PROF *pp;
+    long    usec;
+
+    GETTIMEOFDAY(&start);
+    callback(event, context);
+    GETTIMEOFDAY(&done);
+    if ((usec = EVENT_PROF_USEC(done, start)) < 0)
+	usec = 0;
+    stats_observe(event_prof_call_hist, EVENT_PROF_MSEC(usec));
+    event_prof_calls += 1;
+
+    /*
+     * Insertion into a short list that is sorted by decreasing time.
+     */
+    for (pp = event_prof_top + EVENT_PROF_TOP - 1; pp >= event_prof_top; pp--) {
+	if (pp > event_prof_top
+	    && (pp[-1].callback == 0 || pp[-1].usec < usec)) {
+	    pp[0] = pp[-1];
+	    continue;
+	}
+	if (pp[0].callback == 0 || pp[0].usec < usec) {
+	    pp->callback = callback;
+	    pp->event = event;
+	    pp->usec = usec;
+	}
+	break;
+    }
+}
+
+/* event_prof_name - symbolic call-back name */
+
+static const char *event_prof_name(VSTRING *buf, EVENT_NOTIFY_FN callback)
+{
+#ifdef HAS_DLADDR
+    Dl_info info;
+    const char *file;
+
+    /*
+     * Static functions are not in the dynamic symbol table, and dladdr()
+     * would name the nearest exported symbol instead. Use a symbol name
+     * only if it is exact; otherwise report an object file offset that
+     * addr2line(1) can resolve.
+     */
+    if (dladdr((void *) callback, &info) != 0) {
+	if (info.dli_sname != 0 && info.dli_saddr == (void *) callback) {
+	    vstring_strcpy(buf, info.dli_sname);
+	} else {
+	    file = (info.dli_fname && strrchr(info.dli_fname, '/') ?
+		    strrchr(info.dli_fname, '/') + 1 :
+		    info.dli_fname ? info.dli_fname : "?");
+	    vstring_sprintf(buf, "%s+0x%lx", file, (unsigned long)
+			    ((char *) callback - (char *) info.dli_fbase));
+	}
+	return (vstring_str(buf));
+    }
+#endif
+    vstring_sprintf(buf, "0x%lx", (unsigned long) callback);
+    return (vstring_str(buf));
+}
+
+/* event_prof_report - log the slowest call-backs of a stalled iteration */
+
+static void event_prof_report(long usec)
+{
+    VSTRING *why = vstring_alloc(100);
+    VSTRING *name = vstring_alloc(100);
+    EVENT_PROF *pp;
+
+    for (pp = event_prof_top; pp < event_prof_top + EVENT_PROF_TOP; pp++) {
+	if (pp->callback == 0)
+	    break;
+	vstring_sprintf_append(why, "%s%s %s %ld.%03ldms",
+			       pp > event_prof_top ? ", " : "",
+			       event_prof_name(name, pp->callback),
+			       pp->event == EVENT_TIME ? "timer" :
+			       pp->event == EVENT_READ ? "read" :
+			       pp->event == EVENT_WRITE ? "write" : "other",
+			       pp->usec / 1000, pp->usec % 1000);
+    }
+    msg_warn("event loop stall: %ld.%03ldms in %d call-back%s%s%s",
+	     usec / 1000, usec % 1000, event_prof_calls,
+	     event_prof_calls == 1 ? "" : "s",
+	     VSTRING_LEN(why) ? "; slowest: " : "", vstring_str(why));
+    vstring_free(why);
+    vstring_free(name);
+}
+
 /* event_loop - wait for the next event */
 
 void    event_loop(int delay)
@@ -1018,6 +1178,10 @@ void    event_loop(int delay)
     int     fd;
     EVENT_FDTABLE *fdp;
     int     select_delay;
+    int     prof_on;
+    struct timeval prof_start;
+    struct timeval prof_done;
+    long    prof_usec;
 
     if (EVENT_INIT_NEEDED())
 	event_init();
@@ -1100,6 +1264,16 @@ void    event_loop(int delay)
     if (nested++ > 0)
 	msg_panic("event_loop: recursive call");
 
+    /*
+     * When profiling, start the clock for this iteration now that the wait
+     * is over. Time spent waiting for events is not latency.
+     */
+    if ((prof_on = (event_prof_limit > 0)) != 0) {
+	GETTIMEOFDAY(&prof_start);
+	memset((void *) event_prof_top, 0, sizeof(event_prof_top));
+	event_prof_calls = 0;
+    }
+
     /*
      * Deliver timer events. Allow the application to add/delete timer queue
      * requests while it is being called back. Requests are sorted: we keep
@@ -1134,7 +1308,7 @@ void    event_loop(int delay)
 	if (msg_verbose > 2)
 	    msg_info("%s: timer 0x%lx 0x%lx", myname,
 		     (long) timer->callback, (long) timer->context);
-	timer->callback(EVENT_TIME, timer->context);	/* then this */
+	EVENT_DISPATCH(timer->callback, EVENT_TIME, timer->context);
 	myfree((void *) timer);
     }
 
@@ -1156,17 +1330,17 @@ void    event_loop(int delay)
 		    if (msg_verbose > 2)
 			msg_info("%s: exception fd=%d act=0x%lx 0x%lx", myname,
 			     fd, (long) fdp->callback, (long) fdp->context);
-		    fdp->callback(EVENT_XCPT, fdp->context);
+		    EVENT_DISPATCH(fdp->callback, EVENT_XCPT, fdp->context);
 		} else if (FD_ISSET(fd, &wmask)) {
 		    if (msg_verbose > 2)
 			msg_info("%s: write fd=%d act=0x%lx 0x%lx", myname,
 			     fd, (long) fdp->callback, (long) fdp->context);
-		    fdp->callback(EVENT_WRITE, fdp->context);
+		    EVENT_DISPATCH(fdp->callback, EVENT_WRITE, fdp->context);
 		} else if (FD_ISSET(fd, &rmask)) {
 		    if (msg_verbose > 2)
 			msg_info("%s: read fd=%d act=0x%lx 0x%lx", myname,
 			     fd, (long) fdp->callback, (long) fdp->context);
-		    fdp->callback(EVENT_READ, fdp->context);
+		    EVENT_DISPATCH(fdp->callback, EVENT_READ, fdp->context);
 		}
 	    }
 	}
@@ -1183,22 +1357,34 @@ void    event_loop(int delay)
 		if (msg_verbose > 2)
 		    msg_info("%s: read fd=%d act=0x%lx 0x%lx", myname,
 			     fd, (long) fdp->callback, (long) fdp->context);
-		fdp->callback(EVENT_READ, fdp->context);
+		EVENT_DISPATCH(fdp->callback, EVENT_READ, fdp->context);
 	    } else if (EVENT_TEST_WRITE(bp)) {
 		if (msg_verbose > 2)
 		    msg_info("%s: write fd=%d act=0x%lx 0x%lx", myname,
 			     fd, (long) fdp->callback,
 			     (long) fdp->context);
-		fdp->callback(EVENT_WRITE, fdp->context);
+		EVENT_DISPATCH(fdp->callback, EVENT_WRITE, fdp->context);
 	    } else {
 		if (msg_verbose > 2)
 		    msg_info("%s: other fd=%d act=0x%lx 0x%lx", myname,
 			     fd, (long) fdp->callback, (long) fdp->context);
-		fdp->callback(EVENT_XCPT, fdp->context);
+		EVENT_DISPATCH(fdp->callback, EVENT_XCPT, fdp->context);
 	    }
 	}
     }
 #endif
+
+    /*
+     * Account for this iteration, and name the culprits if it took too long.
+     */
+    if (prof_on) {
+	GETTIMEOFDAY(&prof_done);
+	if ((prof_usec = EVENT_PROF_USEC(prof_done, prof_start)) < 0)
+	    prof_usec = 0;
+	stats_observe(event_prof_loop_hist, EVENT_PROF_MSEC(prof_usec));
+	if (event_prof_limit > 0 && prof_usec >= event_prof_limit * 1000L)
+	    event_prof_report(prof_usec);
+    }
     nested--;
 }
 
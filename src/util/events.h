@@ -33,6 +33,7 @@ extern int event_cancel_timer(EVENT_NOTIFY_TIME_FN, void *);
 extern void event_loop(int);
 extern void event_drain(int);
 extern void event_fork(void);
+extern void event_profile(int);
 
  /*
   * Event codes.
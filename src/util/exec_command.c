@@ -8,12 +8,20 @@
 /*
 /*	NORETURN exec_command(command)
 /*	const char *command;
+/*
+/*	ARGV	*exec_command_split(command)
+/*	const char *command;
 /* DESCRIPTION
 /*	\fIexec_command\fR() replaces the current process by an instance
 /*	of \fIcommand\fR. This routine uses a simple heuristic to avoid
 /*	the overhead of running a command shell interpreter.
+/*
+/*	exec_command_split() implements that heuristic. It returns
+/*	the command split on whitespace, or a null pointer when the
+/*	command must be passed to a shell. The result should be
+/*	destroyed with argv_free().
 /* DIAGNOSTICS
-/*	This routine never returns. All errors are fatal.
+/*	exec_command() never returns. All errors are fatal.
 /* LICENSE
 /* .ad
 /* .fi
@@ -46,11 +54,10 @@
 
 #define SPACE_TAB	" \t"
 
-/* exec_command - exec command */
+/* exec_command_split - split command that needs no shell */
 
-NORETURN exec_command(const char *command)
+ARGV   *exec_command_split(const char *command)
 {
-    ARGV   *argv;
 
     /*
      * Character filter. In this particular case, we allow space and tab in
@@ -64,14 +71,27 @@ ABCDEFGHIJKLMNOPQRSTUVWXYZ" SPACE_TAB;
      * See if this command contains any shell magic characters.
      */
     if (command[strspn(command, ok_chars)] == 0
-	&& command[strspn(command, SPACE_TAB)] != 0) {
+	&& command[strspn(command, SPACE_TAB)] != 0)
+	return (argv_split(command, SPACE_TAB));
+    return (0);
+}
+
+/* exec_command - exec command */
+
+NORETURN exec_command(const char *command)
+{
+    ARGV   *argv;
+
+    /*
+     * See if this command contains any shell magic characters.
+     */
+    if ((argv = exec_command_split(command)) != 0) {
 
 	/*
 	 * No shell meta characters found, so we can try to avoid the overhead
 	 * of running a shell. Just split the command on whitespace and exec
 	 * the result directly.
 	 */
-	argv = argv_split(command, SPACE_TAB);
 	(void) execvp(argv->argv[0], argv->argv);
 
 	/*
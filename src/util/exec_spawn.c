@@ -0,0 +1,607 @@
+/*++
+/* NAME
+/*	exec_spawn 3
+/* SUMMARY
+/*	start command without copying the parent process
+/* SYNOPSIS
+/*	#include <exec_spawn.h>
+/*
+/*	EXEC_SPAWN *exec_spawn_create(argv, command, shell, export, env)
+/*	char	**argv;
+/*	const char *command;
+/*	const char *shell;
+/*	char	**export;
+/*	char	**env;
+/*
+/*	pid_t	exec_spawn(sp)
+/*	EXEC_SPAWN *sp;
+/*
+/*	void	exec_spawn_free(sp)
+/*	EXEC_SPAWN *sp;
+/* DESCRIPTION
+/*	This module starts an external command in a child process,
+/*	like fork() followed by privilege, file descriptor and
+/*	directory changes and exec_command(), but without copying
+/*	the page tables of the parent process. This matters for
+/*	delivery agents with a large memory footprint, for example
+/*	because they have many lookup tables open.
+/*
+/*	The child process is created with vfork(), unless Postfix
+/*	is built with -DNO_VFORK. Because the child borrows the
+/*	memory of the parent until it executes the command, all
+/*	work that allocates memory or that updates library state
+/*	is done before the child is created: the argument vector,
+/*	the environment, and the candidate program pathnames. The
+/*	child makes only async-signal-safe system calls, and reports
+/*	errors to the parent over a close-on-exec pipe. The parent
+/*	logs those errors. Resource limits are inherited from the
+/*	parent, as with fork().
+/*
+/*	The parent is suspended until a vfork() child executes the
+/*	command or terminates. A child that switches to a user ID
+/*	other than the real or effective user ID of the parent can
+/*	be stopped by that user before it executes the command,
+/*	and that would suspend the parent indefinitely. Such a child
+/*	is therefore created with fork(), and the parent waits at
+/*	most 10 seconds for its error report.
+/*
+/*	exec_spawn_create() prepares a command. The arguments are
+/*	as with spawn_command() and pipe_command(): specify either
+/*	\fIargv\fR or \fIcommand\fR, and optionally a \fIshell\fR
+/*	for \fIcommand\fR; a null-terminated \fIexport\fR list of
+/*	environment variable names, or "name=value" pairs; and a
+/*	null-terminated \fIenv\fR list of name, value, ... pairs.
+/*	The command search path is always set to _PATH_DEFPATH.
+/*	Null pointer arguments are ignored. Upon return, the caller
+/*	may update the following structure members:
+/* .IP "uid, gid"
+/*	The privileges of the command. By default, the privileges
+/*	are not changed.
+/* .IP chroot
+/*	Change the process root directory before changing privileges.
+/*	This requires that the real user ID is root.
+/* .IP cwd
+/*	Change to this working directory after changing privileges.
+/* .IP "stdin_fd, stdout_fd, stderr_fd"
+/*	Standard input, output and error of the command. The file
+/*	descriptors are closed in the child after they are duplicated.
+/*	By default, the parent's standard input, output and error
+/*	are inherited.
+/* .IP fail_status
+/*	The child exit status after an error. The default is 1.
+/* .IP flags
+/*	Specify EXEC_SPAWN_FLAG_STDERR to also write the text of
+/*	an error in the child process to \fIstderr_fd\fR, where
+/*	it becomes part of the command output. The default is 0.
+/* .PP
+/*	exec_spawn() starts the command in a new process session,
+/*	and returns its process ID. The caller is responsible for
+/*	waiting for the process. File descriptors that must not
+/*	be inherited by the command must have the close-on-exec
+/*	flag set; the child process cannot close the syslog socket
+/*	as a precaution against buggy libraries.
+/*
+/*	exec_spawn_free() destroys a prepared command.
+/* DIAGNOSTICS
+/*	exec_spawn() returns -1 with errno set when no child process
+/*	could be created. Errors in the child process are logged as
+/*	warnings, and the child terminates with \fIfail_status\fR.
+/* SEE ALSO
+/*	exec_command(3), execute command
+/*	spawn_command(3), run external command
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <grp.h>
+#ifdef USE_PATHS_H
+#include <paths.h>
+#endif
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <vstring.h>
+#include <stringops.h>
+#include <iostuff.h>
+#include <safe.h>
+#include <exec_command.h>
+#include <exec_spawn.h>
+
+/* Application-specific. */
+
+#ifdef NO_VFORK
+#define EXEC_SPAWN_CAN_VFORK(sp) 0
+#else
+#define EXEC_SPAWN_CAN_VFORK(sp) ((sp)->uid == (uid_t) -1 \
+	|| (sp)->uid == getuid() || (sp)->uid == geteuid())
+#endif
+
+#define EXEC_SPAWN_ERR_WAIT	10	/* seconds, fork() child only */
+
+ /*
+  * Error report from child to parent.
+  */
+typedef struct {
+    int     stage;			/* see below */
+    int     err;			/* errno value */
+} EXEC_SPAWN_ERR;
+
+#define EXEC_SPAWN_ERR_SETEUID	1	/* seteuid(0) */
+#define EXEC_SPAWN_ERR_CHROOT	2	/* chroot(dir) */
+#define EXEC_SPAWN_ERR_CHDIR_ROOT 3	/* chdir("/") */
+#define EXEC_SPAWN_ERR_SETGID	4	/* setgid(gid) */
+#define EXEC_SPAWN_ERR_SETGROUPS 5	/* setgroups(1, &gid) */
+#define EXEC_SPAWN_ERR_SETUID	6	/* setuid(uid) */
+#define EXEC_SPAWN_ERR_DUP2	7	/* dup2(fd, n) */
+#define EXEC_SPAWN_ERR_CHDIR	8	/* chdir(cwd) */
+#define EXEC_SPAWN_ERR_EXEC	9	/* execve(command) */
+#define EXEC_SPAWN_ERR_SHELL	10	/* execve(shell) */
+
+extern char **environ;
+
+/* exec_spawn_setenv - add or replace name=value */
+
+static void exec_spawn_setenv(ARGV *env, const char *name, ssize_t len,
+			              const char *value)
+{
+    char  **cpp;
+    char   *entry;
+
+    entry = mymalloc(len + strlen(value) + 2);
+    memcpy(entry, name, len);
+    entry[len] = '=';
+    strcpy(entry + len + 1, value);
+    for (cpp = env->argv; *cpp; cpp++) {
+	if (strncmp(*cpp, entry, len + 1) == 0) {
+	    myfree(*cpp);
+	    *cpp = entry;
+	    return;
+	}
+    }
+    argv_add(env, entry, (char *) 0);
+    myfree(entry);
+}
+
+/* exec_spawn_create - prepare command */
+
+EXEC_SPAWN *exec_spawn_create(char **argv, const char *command,
+			              const char *shell, char **export,
+			              char **env)
+{
+    EXEC_SPAWN *sp = (EXEC_SPAWN *) mymalloc(sizeof(*sp));
+    VSTRING *path;
+    char  **cpp;
+    char   *value;
+    char   *eq;
+    const char *dir;
+    const char *end;
+    int     use_shell = 0;
+
+    sp->uid = (uid_t) -1;
+    sp->gid = (gid_t) -1;
+    sp->chroot = 0;
+    sp->cwd = 0;
+    sp->stdin_fd = sp->stdout_fd = sp->stderr_fd = -1;
+    sp->fail_status = 1;
+    sp->flags = 0;
+    sp->shell = 0;
+
+    /*
+     * Argument vector. Mimic exec_command() for a plain command string:
+     * avoid running a shell if possible, but fall back to a shell when the
+     * command is not found, as it may be a shell built-in.
+     */
+    if (argv) {
+	sp->argv = argv_alloc(10);
+	for (cpp = argv; *cpp; cpp++)
+	    argv_add(sp->argv, *cpp, (char *) 0);
+    } else if (shell && *shell) {
+	sp->argv = argv_split(shell, CHARS_SPACE);
+	argv_add(sp->argv, command, (char *) 0);
+    } else if ((sp->argv = exec_command_split(command)) != 0) {
+	if (strchr(sp->argv->argv[0], '/') == 0) {
+	    sp->shell = argv_alloc(3);
+	    argv_add(sp->shell, "sh", "-c", command, (char *) 0);
+	    argv_terminate(sp->shell);
+	}
+    } else {
+	sp->argv = argv_alloc(3);
+	argv_add(sp->argv, "sh", "-c", command, (char *) 0);
+	use_shell = 1;
+    }
+    argv_terminate(sp->argv);
+
+    /*
+     * Program pathname candidates, as with execvp() and the fixed command
+     * search path. The child tries them in order. The directories are
+     * looked up in the child, after it changes the root directory.
+     */
+    sp->path = argv_alloc(5);
+    if (use_shell) {
+	argv_add(sp->path, _PATH_BSHELL, (char *) 0);
+    } else if (strchr(sp->argv->argv[0], '/') != 0) {
+	argv_add(sp->path, sp->argv->argv[0], (char *) 0);
+    } else {
+	path = vstring_alloc(100);
+	for (dir = _PATH_DEFPATH; /* see below */ ; dir = end + 1) {
+	    end = dir + strcspn(dir, ":");
+	    if (end > dir) {
+		vstring_strncpy(path, dir, end - dir);
+		vstring_sprintf_append(path, "/%s", sp->argv->argv[0]);
+		argv_add(sp->path, vstring_str(path), (char *) 0);
+	    } else {
+		argv_add(sp->path, sp->argv->argv[0], (char *) 0);
+	    }
+	    if (*end == 0)
+		break;
+	}
+	vstring_free(path);
+    }
+    argv_terminate(sp->path);
+
+    /*
+     * A program without #! line is run with the shell, as with execvp().
+     * The child fills in the pathname; with vfork() that also changes our
+     * copy, so exec_spawn() puts back the placeholder.
+     */
+    sp->script = argv_alloc(sp->argv->argc + 2);
+    argv_add(sp->script, _PATH_BSHELL, "", (char *) 0);
+    for (cpp = sp->argv->argv + 1; *cpp; cpp++)
+	argv_add(sp->script, *cpp, (char *) 0);
+    argv_terminate(sp->script);
+
+    /*
+     * Environment, as with clean_env() and setenv() in the child.
+     */
+    sp->env = argv_alloc(10);
+    if (export) {
+	for (cpp = export; *cpp; cpp++)
+	    if ((eq = strchr(*cpp, '=')) != 0)
+		exec_spawn_setenv(sp->env, *cpp, eq - *cpp, eq + 1);
+	    else if ((value = safe_getenv(*cpp)) != 0)
+		exec_spawn_setenv(sp->env, *cpp, strlen(*cpp), value);
+    } else if (environ) {
+	for (cpp = environ; *cpp; cpp++)
+	    if ((eq = strchr(*cpp, '=')) != 0)
+		exec_spawn_setenv(sp->env, *cpp, eq - *cpp, eq + 1);
+    }
+    exec_spawn_setenv(sp->env, "PATH", sizeof("PATH") - 1, _PATH_DEFPATH);
+    if (env)
+	for (cpp = env; *cpp; cpp += 2)
+	    exec_spawn_setenv(sp->env, cpp[0], strlen(cpp[0]), cpp[1]);
+    argv_terminate(sp->env);
+
+    return (sp);
+}
+
+/* exec_spawn_child - child process, async-signal-safe calls only */
+
+static NORETURN exec_spawn_child(EXEC_SPAWN *sp, sigset_t *mask, int err_fd)
+{
+    EXEC_SPAWN_ERR err;
+    struct sigaction action;
+    char  **cpp;
+    int     saw_eacces = 0;
+    int     sig;
+
+#define EXEC_SPAWN_FAIL(s) do { \
+	err.stage = (s); \
+	err.err = errno; \
+	(void) write(err_fd, (void *) &err, sizeof(err)); \
+	_exit(sp->fail_status); \
+    } while (0)
+
+    /*
+     * Signal handlers belong to the parent, whose memory we are borrowing.
+     * Reset them before unblocking signals.
+     */
+    for (sig = 1; sig < NSIG; sig++) {
+	if (sigaction(sig, (struct sigaction *) 0, &action) == 0
+	    && action.sa_handler != SIG_DFL && action.sa_handler != SIG_IGN) {
+	    action.sa_handler = SIG_DFL;
+	    action.sa_flags = 0;
+	    sigemptyset(&action.sa_mask);
+	    (void) sigaction(sig, &action, (struct sigaction *) 0);
+	}
+    }
+    (void) sigprocmask(SIG_SETMASK, mask, (sigset_t *) 0);
+
+    /*
+     * Root directory and privileges, as with chroot_uid() and set_ugid().
+     */
+    if (sp->chroot) {
+	if (seteuid(0) < 0)
+	    EXEC_SPAWN_FAIL(EXEC_SPAWN_ERR_SETEUID);
+	if (chroot(sp->chroot) < 0)
+	    EXEC_SPAWN_FAIL(EXEC_SPAWN_ERR_CHROOT);
+	if (chdir("/") < 0)
+	    EXEC_SPAWN_FAIL(EXEC_SPAWN_ERR_CHDIR_ROOT);
+    }
+    if (sp->uid != (uid_t) -1 || sp->gid != (gid_t) -1) {
+	if (geteuid() != 0 && seteuid(0) < 0)
+	    EXEC_SPAWN_FAIL(EXEC_SPAWN_ERR_SETEUID);
+	if (setgid(sp->gid) < 0)
+	    EXEC_SPAWN_FAIL(EXEC_SPAWN_ERR_SETGID);
+	if (setgroups(1, &sp->gid) < 0)
+	    EXEC_SPAWN_FAIL(EXEC_SPAWN_ERR_SETGROUPS);
+	if (setuid(sp->uid) < 0)
+	    EXEC_SPAWN_FAIL(EXEC_SPAWN_ERR_SETUID);
+    }
+    (void) setsid();
+
+    /*
+     * Pipe plumbing.
+     */
+    if ((sp->stdin_fd >= 0 && DUP2(sp->stdin_fd, STDIN_FILENO) < 0)
+	|| (sp->stdout_fd >= 0 && DUP2(sp->stdout_fd, STDOUT_FILENO) < 0)
+	|| (sp->stderr_fd >= 0 && DUP2(sp->stderr_fd, STDERR_FILENO) < 0))
+	EXEC_SPAWN_FAIL(EXEC_SPAWN_ERR_DUP2);
+    if (sp->stdin_fd > STDERR_FILENO)
+	(void) close(sp->stdin_fd);
+    if (sp->stdout_fd > STDERR_FILENO)
+	(void) close(sp->stdout_fd);
+    if (sp->stderr_fd > STDERR_FILENO)
+	(void) close(sp->stderr_fd);
+
+    /*
+     * Working directory plumbing.
+     */
+    if (sp->cwd && chdir(sp->cwd) < 0)
+	EXEC_SPAWN_FAIL(EXEC_SPAWN_ERR_CHDIR);
+
+    /*
+     * Process plumbing. Search the command path as execvp() does.
+     */
+    for (cpp = sp->path->argv; *cpp; cpp++) {
+	(void) execve(*cpp, sp->argv->argv, sp->env->argv);
+	if (errno == ENOEXEC) {
+	    sp->script->argv[1] = *cpp;
+	    (void) execve(_PATH_BSHELL, sp->script->argv, sp->env->argv);
+	    break;
+	}
+	if (errno == EACCES)
+	    saw_eacces = 1;
+	else if (errno != ENOENT && errno != ENOTDIR)
+	    break;
+    }
+    if (*cpp == 0 && saw_eacces)
+	errno = EACCES;
+    if (sp->shell && errno == ENOENT) {
+	(void) execve(_PATH_BSHELL, sp->shell->argv, sp->env->argv);
+	EXEC_SPAWN_FAIL(EXEC_SPAWN_ERR_SHELL);
+    }
+    EXEC_SPAWN_FAIL(EXEC_SPAWN_ERR_EXEC);
+}
+
+/* exec_spawn_warn - report child error */
+
+static void exec_spawn_warn(EXEC_SPAWN *sp, EXEC_SPAWN_ERR *err)
+{
+    VSTRING *buf = vstring_alloc(100);
+
+    errno = err->err;
+    switch (err->stage) {
+    case EXEC_SPAWN_ERR_SETEUID:
+	vstring_sprintf(buf, "seteuid(0): %m");
+	break;
+    case EXEC_SPAWN_ERR_CHROOT:
+	vstring_sprintf(buf, "chroot(%s): %m", sp->chroot);
+	break;
+    case EXEC_SPAWN_ERR_CHDIR_ROOT:
+	vstring_sprintf(buf, "chdir(/): %m");
+	break;
+    case EXEC_SPAWN_ERR_SETGID:
+	vstring_sprintf(buf, "setgid(%ld): %m", (long) sp->gid);
+	break;
+    case EXEC_SPAWN_ERR_SETGROUPS:
+	vstring_sprintf(buf, "setgroups(1, &%ld): %m", (long) sp->gid);
+	break;
+    case EXEC_SPAWN_ERR_SETUID:
+	vstring_sprintf(buf, "setuid(%ld): %m", (long) sp->uid);
+	break;
+    case EXEC_SPAWN_ERR_DUP2:
+	vstring_sprintf(buf, "dup2: %m");
+	break;
+    case EXEC_SPAWN_ERR_CHDIR:
+	vstring_sprintf(buf, "cannot change directory to \"%s\""
+			" for uid=%lu gid=%lu: %m", sp->cwd,
+			(unsigned long) sp->uid, (unsigned long) sp->gid);
+	break;
+    case EXEC_SPAWN_ERR_EXEC:
+	vstring_sprintf(buf, "execvp %s: %m", sp->argv->argv[0]);
+	break;
+    case EXEC_SPAWN_ERR_SHELL:
+	vstring_sprintf(buf, "execl %s: %m", _PATH_BSHELL);
+	break;
+    default:
+	vstring_sprintf(buf, "unknown child error %d: %m", err->stage);
+	break;
+    }
+    msg_warn("%s", vstring_str(buf));
+    if ((sp->flags & EXEC_SPAWN_FLAG_STDERR) && sp->stderr_fd >= 0) {
+	VSTRING_ADDCH(buf, '\n');
+	(void) write(sp->stderr_fd, vstring_str(buf), VSTRING_LEN(buf));
+    }
+    vstring_free(buf);
+}
+
+/* exec_spawn - start prepared command */
+
+pid_t   exec_spawn(EXEC_SPAWN *sp)
+{
+    const char *myname = "exec_spawn";
+    EXEC_SPAWN_ERR err;
+    sigset_t block_mask;
+    sigset_t saved_mask;
+    char   *script_slot;
+    int     err_pipe[2];
+    int     saved_errno;
+    int     use_vfork;
+    ssize_t count;
+    pid_t   pid;
+
+    /*
+     * Don't use vfork() when the command's user could stop the child, and
+     * with it the parent, before the child executes the command.
+     */
+    use_vfork = EXEC_SPAWN_CAN_VFORK(sp);
+    if (pipe(err_pipe) < 0)
+	msg_fatal("%s: pipe: %m", myname);
+    close_on_exec(err_pipe[0], CLOSE_ON_EXEC);
+    close_on_exec(err_pipe[1], CLOSE_ON_EXEC);
+
+    /*
+     * Keep signal handlers from running in the child, while it shares our
+     * memory.
+     */
+    sigfillset(&block_mask);
+    (void) sigprocmask(SIG_BLOCK, &block_mask, &saved_mask);
+    script_slot = sp->script->argv[1];
+    if ((pid = (use_vfork ? vfork() : fork())) == 0)
+	exec_spawn_child(sp, &saved_mask, err_pipe[1]);
+    saved_errno = errno;
+    sp->script->argv[1] = script_slot;
+    (void) sigprocmask(SIG_SETMASK, &saved_mask, (sigset_t *) 0);
+
+    /*
+     * The write end is closed when the child executes the command. A
+     * fork() child may be stopped before it gets there, so don't wait for
+     * it forever; the caller's time limit takes care of the rest.
+     */
+    (void) close(err_pipe[1]);
+    if (pid > 0) {
+	if (use_vfork || read_wait(err_pipe[0], EXEC_SPAWN_ERR_WAIT) == 0) {
+	    while ((count = read(err_pipe[0], (void *) &err, sizeof(err))) < 0
+		   && errno == EINTR)
+		 /* void */ ;
+	    if (count == sizeof(err))
+		exec_spawn_warn(sp, &err);
+	} else {
+	    msg_warn("%s: %s: process %ld did not execute the command within "
+		     "%d seconds", myname, sp->argv->argv[0], (long) pid,
+		     EXEC_SPAWN_ERR_WAIT);
+	}
+    }
+    (void) close(err_pipe[0]);
+    errno = saved_errno;
+    return (pid);
+}
+
+/* exec_spawn_free - destroy prepared command */
+
+void    exec_spawn_free(EXEC_SPAWN *sp)
+{
+    argv_free(sp->argv);
+    argv_free(sp->path);
+    argv_free(sp->script);
+    if (sp->shell)
+	argv_free(sp->shell);
+    argv_free(sp->env);
+    myfree((void *) sp);
+}
+
+#ifdef TEST
+
+ /*
+  * Proof-of-concept test program and benchmark. Start a command repeatedly
+  * with exec_spawn(), or with fork() and exec_command() as spawn_command()
+  * used to, after growing the process by the specified number of megabytes.
+  */
+#include <stdlib.h>
+#include <sys/time.h>
+#include <vstream.h>
+#include <msg_vstream.h>
+
+int     main(int argc, char **argv)
+{
+    struct timeval start;
+    struct timeval stop;
+    WAIT_STATUS_T status;
+    EXEC_SPAWN *sp;
+    char   *command;
+    char   *mem;
+    size_t  size = 0;
+    int     use_fork = 0;
+    int     count = 1;
+    int     ch;
+    int     n;
+    double  elapsed;
+    pid_t   pid;
+
+    msg_vstream_init(argv[0], VSTREAM_ERR);
+    while ((ch = GETOPT(argc, argv, "fm:n:")) > 0) {
+	switch (ch) {
+	case 'f':
+	    use_fork = 1;
+	    break;
+	case 'm':
+	    size = (size_t) atoi(optarg) << 20;
+	    break;
+	case 'n':
+	    count = atoi(optarg);
+	    break;
+	default:
+	    msg_fatal("usage: %s [-f] [-m megabytes] [-n count] command",
+		      argv[0]);
+	}
+    }
+    if (argc != optind + 1)
+	msg_fatal("usage: %s [-f] [-m megabytes] [-n count] command", argv[0]);
+    command = argv[optind];
+
+    /*
+     * Touch every page, so that it is part of the resident set.
+     */
+    if (size > 0) {
+	mem = mymalloc(size);
+	memset(mem, 1, size);
+    }
+    GETTIMEOFDAY(&start);
+    for (n = 0; n < count; n++) {
+	if (use_fork) {
+	    if ((pid = fork()) < 0)
+		msg_fatal("fork: %m");
+	    if (pid == 0) {
+		(void) setsid();
+		exec_command(command);
+	    }
+	} else {
+	    sp = exec_spawn_create((char **) 0, command, (char *) 0,
+				   (char **) 0, (char **) 0);
+	    if ((pid = exec_spawn(sp)) < 0)
+		msg_fatal("exec_spawn: %m");
+	    exec_spawn_free(sp);
+	}
+	if (waitpid(pid, &status, 0) < 0)
+	    msg_fatal("waitpid: %m");
+	if (!NORMAL_EXIT_STATUS(status))
+	    msg_warn("command exit status %d", WEXITSTATUS(status));
+    }
+    GETTIMEOFDAY(&stop);
+    elapsed = stop.tv_sec - start.tv_sec
+	+ (stop.tv_usec - start.tv_usec) / 1000000.0;
+    vstream_printf("%s: %d commands, %lu MB, %.3f s, %.0f commands/s\n",
+		   use_fork ? "fork" : "exec_spawn", count,
+		   (unsigned long) (size >> 20), elapsed, count / elapsed);
+    vstream_fflush(VSTREAM_OUT);
+    exit(0);
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef _EXEC_SPAWN_H_INCLUDED_
+#define _EXEC_SPAWN_H_INCLUDED_
+
+/*++
+/* NAME
+/*	exec_spawn 3h
+/* SUMMARY
+/*	start command without copying the parent process
+/* SYNOPSIS
+/*	#include <exec_spawn.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * System library.
+  */
+#include <unistd.h>
+
+ /*
+  * Utility library.
+  */
+#include <argv.h>
+
+ /*
+  * External interface.
+  */
+typedef struct EXEC_SPAWN {
+    /* Public, see exec_spawn_create(). */
+    uid_t   uid;			/* privileges, or -1 */
+    gid_t   gid;			/* privileges, or -1 */
+    const char *chroot;			/* root directory, or null */
+    const char *cwd;			/* working directory, or null */
+    int     stdin_fd;			/* read stdin here, or -1 */
+    int     stdout_fd;			/* write stdout here, or -1 */
+    int     stderr_fd;			/* write stderr here, or -1 */
+    int     fail_status;		/* child exit status after error */
+    int     flags;			/* see below */
+    /* Private. */
+    ARGV   *argv;			/* command and arguments */
+    ARGV   *path;			/* program pathname candidates */
+    ARGV   *script;			/* shell with script pathname */
+    ARGV   *shell;			/* shell fallback, or null */
+    ARGV   *env;			/* name=value environment */
+} EXEC_SPAWN;
+
+#define EXEC_SPAWN_FLAG_STDERR	(1<<0)	/* report errors on stderr_fd */
+
+extern EXEC_SPAWN *exec_spawn_create(char **, const char *, const char *,
+				             char **, char **);
+extern pid_t exec_spawn(EXEC_SPAWN *);
+extern void exec_spawn_free(EXEC_SPAWN *);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+#endif
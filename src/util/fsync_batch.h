@@ -0,0 +1,30 @@
+#ifndef _FSYNC_BATCH_H_INCLUDED_
+#define _FSYNC_BATCH_H_INCLUDED_
+
+/*++
+/* NAME
+/*	fsync_batch 3h
+/* SUMMARY
+/*	flush a group of files to stable storage
+/* SYNOPSIS
+/*	#include <fsync_batch.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * External interface.
+  */
+extern ssize_t fsync_batch(const int *, int *, ssize_t);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+#endif
@@ -0,0 +1,79 @@
+/*++
+/* NAME
+/*	hash_fnv 3
+/* SUMMARY
+/*	Fowler/Noll/Vo hash function
+/* SYNOPSIS
+/*	#include <hash_fnv.h>
+/*
+/*	HASH_FNV_T hash_fnv(src, len)
+/*	const void *src;
+/*	size_t	len;
+/*
+/*	HASH_FNV_T hash_fnvz(src)
+/*	const char *src;
+/* DESCRIPTION
+/*	hash_fnv() implements the 64-bit FNV-1a hash function for
+/*	an array of bytes.
+/*
+/*	hash_fnvz() is a convenience wrapper for null-terminated
+/*	strings.
+/*
+/*	The result does not depend on the process or the host byte
+/*	order, so that it can be stored in a file and compared
+/*	later. Do not use it where an attacker can choose input
+/*	that collides on purpose.
+/* SEE ALSO
+/*	http://www.isthe.com/chongo/tech/comp/fnv/index.html
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+
+/* Utility library. */
+
+#include <hash_fnv.h>
+
+ /*
+  * FNV-1a parameters for 64-bit results.
+  */
+#define FNV_OFFSET_BASIS	((HASH_FNV_T) 0xcbf29ce484222325ULL)
+#define FNV_PRIME		((HASH_FNV_T) 0x100000001b3ULL)
+
+/* hash_fnv - hash an array of bytes */
+
+HASH_FNV_T hash_fnv(const void *src, size_t len)
+{
+    const unsigned char *cp = (const unsigned char *) src;
+    HASH_FNV_T hash = FNV_OFFSET_BASIS;
+
+    while (len-- > 0) {
+	hash ^= *cp++;
+	hash *= FNV_PRIME;
+    }
+    return (hash);
+}
+
+/* hash_fnvz - hash a null-terminated string */
+
+HASH_FNV_T hash_fnvz(const char *src)
+{
+    const unsigned char *cp = (const unsigned char *) src;
+    HASH_FNV_T hash = FNV_OFFSET_BASIS;
+
+    while (*cp) {
+	hash ^= *cp++;
+	hash *= FNV_PRIME;
+    }
+    return (hash);
+}
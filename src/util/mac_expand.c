@@ -13,6 +13,20 @@
 /*	const char *filter;
 /*	const char *lookup(const char *key, int mode, void *context)
 /*	void *context;
+/*
+/*	MAC_EXP_PROG *mac_expand_compile(pattern)
+/*	const char *pattern;
+/*
+/*	int	mac_expand_run(result, prog, flags, filter, lookup, context)
+/*	VSTRING *result;
+/*	MAC_EXP_PROG *prog;
+/*	int	flags;
+/*	const char *filter;
+/*	const char *lookup(const char *key, int mode, void *context)
+/*	void *context;
+/*
+/*	void	mac_expand_free(prog)
+/*	MAC_EXP_PROG *prog;
 /* DESCRIPTION
 /*	This module implements parameter-less named attribute
 /*	expansions, both conditional and unconditional. As of Postfix
@@ -98,6 +112,27 @@
 /*	result value means that the requested attribute was not defined.
 /* .IP context
 /*	Caller context that is passed on to the attribute lookup routine.
+/* .PP
+/*	mac_expand_compile() parses a pattern once, and returns a
+/*	list of operations (literal text, attribute lookup, relational
+/*	expression, and conditional results) that mac_expand_run()
+/*	can execute many times without parsing the pattern again.
+/*	The result is a null pointer when the pattern has a syntax
+/*	error anywhere, including in result operands that would
+/*	not be expanded; no warning is logged. mac_expand_free()
+/*	destroys a compiled pattern.
+/*
+/*	mac_expand_run() expands a compiled pattern. The arguments
+/*	and result are as with mac_expand(). The attribute character
+/*	filter, MAC_EXP_FLAG_PRINTABLE and MAC_EXP_FLAG_RECURSE are
+/*	applied when a lookup result is used, so that the same
+/*	compiled pattern can be used with different flags and
+/*	filters.
+/*
+/*	mac_expand() maintains a cache of compiled patterns, indexed
+/*	by pattern text. A pattern with a syntax error is expanded
+/*	by interpreting it as before, so that the warnings and the
+/*	partial result are unchanged.
 /* DIAGNOSTICS
 /*	Fatal errors: out of memory.  Warnings: syntax errors, unreasonable
 /*	recursion depth.
@@ -141,9 +176,46 @@
 #include <mymalloc.h>
 #include <stringops.h>
 #include <name_code.h>
+#include <ctable.h>
 #include <mac_parse.h>
 #include <mac_expand.h>
 
+ /*
+  * Compiled pattern. Each operation is literal text, or an expression: an
+  * attribute lookup or relational expression, with optional ?result and
+  * :result operands that are themselves lists of operations. The character
+  * filter is applied when an attribute value is used.
+  */
+typedef struct MAC_EXP_CODE {
+    int     type;			/* see below */
+    char   *text;			/* literal text or attribute name */
+    int     op_tokval;			/* relational operator */
+    struct MAC_EXP_CODE *left;		/* relational left operand */
+    struct MAC_EXP_CODE *rite;		/* relational right operand */
+    int     cond;			/* see below */
+    struct MAC_EXP_CODE *iftrue;	/* ?result operand */
+    struct MAC_EXP_CODE *iffalse;	/* :result operand */
+    struct MAC_EXP_CODE *next;		/* next operation */
+} MAC_EXP_CODE;
+
+#define MAC_EXP_CODE_LITERAL	1	/* literal text */
+#define MAC_EXP_CODE_EXPR	2	/* lookup or relational expression */
+
+#define MAC_EXP_COND_NONE	0	/* use value */
+#define MAC_EXP_COND_TRUE	(1<<0)	/* has ?result operand */
+#define MAC_EXP_COND_FALSE	(1<<1)	/* has :result operand */
+
+struct MAC_EXP_PROG {
+    int     refcount;			/* cache and active users */
+    MAC_EXP_CODE *code;			/* operations */
+};
+
+ /*
+  * Compiled patterns are cached by pattern text. Most patterns come from
+  * main.cf, so a small cache holds them all.
+  */
+#define MAC_EXP_CACHE_SIZE	100
+
  /*
   * Little helper structure.
   */
@@ -155,8 +227,19 @@ typedef struct {
     void   *context;			/* caller context */
     int     status;			/* findings */
     int     level;			/* nesting level */
+    MAC_EXP_CODE **tail;		/* compiler output */
 } MAC_EXP_CONTEXT;
 
+ /*
+  * Private flag: compiling, don't log warnings.
+  */
+#define MAC_EXP_FLAG_COMPILE	(1<<15)
+
+static int mac_expand_callback(int, VSTRING *, void *);
+static int mac_exp_compile_callback(int, VSTRING *, void *);
+static int mac_expand_interp(VSTRING *, const char *, int, const char *,
+			             MAC_EXP_LOOKUP_FN, void *);
+
  /*
   * Support for relational expressions.
   * 
@@ -274,9 +357,11 @@ static int PRINTFLIKE(2, 3) mac_exp_parse_error(MAC_EXP_CONTEXT *mc,
 {
     va_list ap;
 
-    va_start(ap, fmt);
-    vmsg_warn(fmt, ap);
-    va_end(ap);
+    if ((mc->flags & MAC_EXP_FLAG_COMPILE) == 0) {
+	va_start(ap, fmt);
+	vmsg_warn(fmt, ap);
+	va_end(ap);
+    }
     return (mc->status |= MAC_PARSE_ERROR);
 };
 
@@ -346,19 +431,17 @@ static char *mac_exp_extract_curly_payload(MAC_EXP_CONTEXT *mc, char **bp)
 
 /* mac_exp_parse_relational - parse relational expression, advance read ptr */
 
-static int mac_exp_parse_relational(MAC_EXP_CONTEXT *mc, const char **lookup,
+static int mac_exp_parse_relational(MAC_EXP_CONTEXT *mc, char **left_op,
+				            int *op_tok, char **rite_op,
 				            char **bp)
 {
     char   *cp = *bp;
-    VSTRING *left_op_buf;
-    VSTRING *rite_op_buf;
-    const char *left_op_strval;
-    const char *rite_op_strval;
+    char   *left_op_strval;
+    char   *rite_op_strval;
     char   *op_pos;
     char   *op_strval;
     size_t  op_len;
     int     op_tokval;
-    int     op_result;
     size_t  tmp_len;
 
     /*
@@ -391,30 +474,102 @@ static int mac_exp_parse_relational(MAC_EXP_CONTEXT *mc, const char **lookup,
     if ((rite_op_strval = mac_exp_extract_curly_payload(mc, &cp)) == 0)
 	return (mc->status);
 
-    /*
-     * Evaluate the relational expression. Todo: regexp support.
-     */
-    mc->status |=
-	mac_expand(left_op_buf = vstring_alloc(100), left_op_strval,
-		   mc->flags, mc->filter, mc->lookup, mc->context);
-    mc->status |=
-	mac_expand(rite_op_buf = vstring_alloc(100), rite_op_strval,
-		   mc->flags, mc->filter, mc->lookup, mc->context);
-    op_result = mac_exp_eval(vstring_str(left_op_buf), op_tokval,
-			     vstring_str(rite_op_buf));
-    vstring_free(left_op_buf);
-    vstring_free(rite_op_buf);
-    if (mc->status & MAC_PARSE_ERROR)
-	return (mc->status);
+    *left_op = left_op_strval;
+    *op_tok = op_tokval;
+    *rite_op = rite_op_strval;
+    *bp = cp;
+    return (0);
+}
+
+/* mac_exp_parse_name - parse attribute name and operator, advance read ptr */
+
+static int mac_exp_parse_name(MAC_EXP_CONTEXT *mc, VSTRING *buf,
+			              char **bp, char **name)
+{
+    char   *cp = *bp;
+    char   *start;
+    ssize_t tmp_len;
+    int     ch;
 
     /*
-     * Here, we fake up a non-empty or empty parameter value lookup result,
-     * for compatibility with the historical code that looks named parameter
-     * values.
+     * Look for the ? or : operator. In case of a syntax error, return
+     * without doing damage, and issue a warning instead.
      */
-    *lookup = (op_result ? MAC_EXP_BVAL_TRUE : MAC_EXP_BVAL_FALSE);
+    start = (cp += strspn(cp, MAC_EXP_WHITESPACE));
+    for ( /* void */ ; /* void */ ; cp++) {
+	if ((ch = cp[tmp_len = strspn(cp, MAC_EXP_WHITESPACE)]) == 0) {
+	    *cp = 0;
+	    break;
+	}
+	if (ch == '?' || ch == ':') {
+	    *cp++ = 0;
+	    cp += tmp_len;
+	    break;
+	}
+	ch = *cp;
+	if (!ISALNUM(ch) && ch != '_') {
+	    mac_exp_parse_error(mc, "attribute name syntax error at: "
+				"\"...%.*s>>>%.20s\"",
+				(int) (cp - vstring_str(buf)),
+				vstring_str(buf), cp);
+	    return (-1);
+	}
+    }
+    *name = start;
     *bp = cp;
-    return (0);
+    return (ch);
+}
+
+/* mac_exp_parse_result - extract ? or : result operand, advance read ptr */
+
+static char *mac_exp_parse_result(MAC_EXP_CONTEXT *mc, char **bp)
+{
+    char   *cp = *bp;
+    char   *result;
+    ssize_t tmp_len;
+
+    if (MAC_EXP_FIND_LEFT_CURLY(tmp_len, cp)) {
+	if ((result = mac_exp_extract_curly_payload(mc, &cp)) == 0)
+	    return (0);
+    } else {
+	result = cp;
+	cp = "";				/* no left-over text */
+    }
+    *bp = cp;
+    return (result);
+}
+
+/* mac_exp_use_value - append attribute value to result */
+
+static void mac_exp_use_value(MAC_EXP_CONTEXT *mc, const char *lookup,
+			              VSTRING *buf)
+{
+    VSTRING *copy;
+    ssize_t res_len;
+    char   *cp;
+
+    if (lookup == 0) {
+	mc->status |= MAC_PARSE_UNDEF;
+    } else if (*lookup == 0 || (mc->flags & MAC_EXP_FLAG_SCAN)) {
+	 /* void */ ;
+    } else if (mc->flags & MAC_EXP_FLAG_RECURSE) {
+	copy = (buf ? buf : vstring_alloc(100));
+	vstring_strcpy(copy, lookup);
+	mc->status |= mac_parse(vstring_str(copy), mac_expand_callback,
+				(void *) mc);
+	if (copy != buf)
+	    vstring_free(copy);
+    } else {
+	res_len = VSTRING_LEN(mc->result);
+	vstring_strcat(mc->result, lookup);
+	if (mc->flags & MAC_EXP_FLAG_PRINTABLE) {
+	    printable(vstring_str(mc->result) + res_len, '_');
+	} else if (mc->filter) {
+	    cp = vstring_str(mc->result) + res_len;
+	    while (*(cp += strspn(cp, mc->filter)))
+		*cp++ = '_';
+	}
+    }
 }
 
 /* mac_expand_callback - callback for mac_parse */
@@ -427,10 +582,16 @@ static int mac_expand_callback(int type, VSTRING *buf, void *ptr)
     const char *lookup;
     char   *cp;
     int     ch;
-    ssize_t res_len;
     ssize_t tmp_len;
     const char *res_iftrue;
     const char *res_iffalse;
+    char   *left_op_strval;
+    char   *rite_op_strval;
+    char   *name;
+    int     op_tokval;
+    VSTRING *left_op_buf;
+    VSTRING *rite_op_buf;
+    int     op_result;
 
     /*
      * Sanity check.
@@ -454,9 +615,35 @@ static int mac_expand_callback(int type, VSTRING *buf, void *ptr)
 	 * level of $name expansion.
 	 */
 	if (MAC_EXP_FIND_LEFT_CURLY(tmp_len, cp)) {
-	    if (mac_exp_parse_relational(mc, &lookup, &cp) != 0)
+	    if (mac_exp_parse_relational(mc, &left_op_strval, &op_tokval,
+					 &rite_op_strval, &cp) != 0)
+		return (mc->status);
+
+	    /*
+	     * Evaluate the relational expression. Todo: regexp support.
+	     */
+	    mc->status |=
+		mac_expand_interp(left_op_buf = vstring_alloc(100),
+				  left_op_strval, mc->flags, mc->filter,
+				  mc->lookup, mc->context);
+	    mc->status |=
+		mac_expand_interp(rite_op_buf = vstring_alloc(100),
+				  rite_op_strval, mc->flags, mc->filter,
+				  mc->lookup, mc->context);
+	    op_result = mac_exp_eval(vstring_str(left_op_buf), op_tokval,
+				     vstring_str(rite_op_buf));
+	    vstring_free(left_op_buf);
+	    vstring_free(rite_op_buf);
+	    if (mc->status & MAC_PARSE_ERROR)
 		return (mc->status);
 
+	    /*
+	     * Here, we fake up a non-empty or empty parameter value lookup
+	     * result, for compatibility with the historical code that looks
+	     * named parameter values.
+	     */
+	    lookup = (op_result ? MAC_EXP_BVAL_TRUE : MAC_EXP_BVAL_FALSE);
+
 	    /*
 	     * Look for the ? or : operator.
 	     */
@@ -472,39 +659,15 @@ static int mac_expand_callback(int type, VSTRING *buf, void *ptr)
 	 * Named parameter.
 	 */
 	else {
-	    char   *start;
-
-	    /*
-	     * Look for the ? or : operator. In case of a syntax error,
-	     * return without doing damage, and issue a warning instead.
-	     */
-	    start = (cp += strspn(cp, MAC_EXP_WHITESPACE));
-	    for ( /* void */ ; /* void */ ; cp++) {
-		if ((ch = cp[tmp_len = strspn(cp, MAC_EXP_WHITESPACE)]) == 0) {
-		    *cp = 0;
-		    lookup_mode = MAC_EXP_MODE_USE;
-		    break;
-		}
-		if (ch == '?' || ch == ':') {
-		    *cp++ = 0;
-		    cp += tmp_len;
-		    lookup_mode = MAC_EXP_MODE_TEST;
-		    break;
-		}
-		ch = *cp;
-		if (!ISALNUM(ch) && ch != '_') {
-		    MAC_EXP_ERR_RETURN(mc, "attribute name syntax error at: "
-				       "\"...%.*s>>>%.20s\"",
-				       (int) (cp - vstring_str(buf)),
-				       vstring_str(buf), cp);
-		}
-	    }
+	    if ((ch = mac_exp_parse_name(mc, buf, &cp, &name)) < 0)
+		return (mc->status);
+	    lookup_mode = (ch == 0 ? MAC_EXP_MODE_USE : MAC_EXP_MODE_TEST);
 
 	    /*
 	     * Look up the named parameter. Todo: allow the lookup function
 	     * to specify if the result is safe for $name expanson.
 	     */
-	    lookup = mc->lookup(start, lookup_mode, mc->context);
+	    lookup = mc->lookup(name, lookup_mode, mc->context);
 	}
 
 	/*
@@ -519,13 +682,8 @@ static int mac_expand_callback(int type, VSTRING *buf, void *ptr)
 	 */
 	switch (ch) {
 	case '?':
-	    if (MAC_EXP_FIND_LEFT_CURLY(tmp_len, cp)) {
-		if ((res_iftrue = mac_exp_extract_curly_payload(mc, &cp)) == 0)
-		    return (mc->status);
-	    } else {
-		res_iftrue = cp;
-		cp = "";			/* no left-over text */
-	    }
+	    if ((res_iftrue = mac_exp_parse_result(mc, &cp)) == 0)
+		return (mc->status);
 	    if ((lookup != 0 && *lookup != 0) || (mc->flags & MAC_EXP_FLAG_SCAN))
 		mc->status |= mac_parse(res_iftrue, mac_expand_callback,
 					(void *) mc);
@@ -537,13 +695,8 @@ static int mac_expand_callback(int type, VSTRING *buf, void *ptr)
 	    cp += 1;
 	    /* FALLTHROUGH: do not remove, see comment above. */
 	case ':':
-	    if (MAC_EXP_FIND_LEFT_CURLY(tmp_len, cp)) {
-		if ((res_iffalse = mac_exp_extract_curly_payload(mc, &cp)) == 0)
-		    return (mc->status);
-	    } else {
-		res_iffalse = cp;
-		cp = "";			/* no left-over text */
-	    }
+	    if ((res_iffalse = mac_exp_parse_result(mc, &cp)) == 0)
+		return (mc->status);
 	    if (lookup == 0 || *lookup == 0 || (mc->flags & MAC_EXP_FLAG_SCAN))
 		mc->status |= mac_parse(res_iffalse, mac_expand_callback,
 					(void *) mc);
@@ -552,25 +705,7 @@ static int mac_expand_callback(int type, VSTRING *buf, void *ptr)
 				   "\"...%s}>>>%.20s\"", res_iffalse, cp);
 	    break;
 	case 0:
-	    if (lookup == 0) {
-		mc->status |= MAC_PARSE_UNDEF;
-	    } else if (*lookup == 0 || (mc->flags & MAC_EXP_FLAG_SCAN)) {
-		 /* void */ ;
-	    } else if (mc->flags & MAC_EXP_FLAG_RECURSE) {
-		vstring_strcpy(buf, lookup);
-		mc->status |= mac_parse(vstring_str(buf), mac_expand_callback,
-					(void *) mc);
-	    } else {
-		res_len = VSTRING_LEN(mc->result);
-		vstring_strcat(mc->result, lookup);
-		if (mc->flags & MAC_EXP_FLAG_PRINTABLE) {
-		    printable(vstring_str(mc->result) + res_len, '_');
-		} else if (mc->filter) {
-		    cp = vstring_str(mc->result) + res_len;
-		    while (*(cp += strspn(cp, mc->filter)))
-			*cp++ = '_';
-		}
-	    }
+	    mac_exp_use_value(mc, lookup, buf);
 	    break;
 	default:
 	    msg_panic("%s: unknown operator code %d", myname, ch);
@@ -588,11 +723,11 @@ static int mac_expand_callback(int type, VSTRING *buf, void *ptr)
     return (mc->status);
 }
 
-/* mac_expand - expand $name instances */
+/* mac_expand_interp - expand $name instances without compiling */
 
-int     mac_expand(VSTRING *result, const char *pattern, int flags,
-		           const char *filter,
-		           MAC_EXP_LOOKUP_FN lookup, void *context)
+static int mac_expand_interp(VSTRING *result, const char *pattern, int flags,
+			             const char *filter,
+			             MAC_EXP_LOOKUP_FN lookup, void *context)
 {
     MAC_EXP_CONTEXT mc;
     int     status;
@@ -607,6 +742,7 @@ int     mac_expand(VSTRING *result, const char *pattern, int flags,
     mc.context = context;
     mc.status = 0;
     mc.level = 0;
+    mc.tail = 0;
     if ((flags & (MAC_EXP_FLAG_APPEND | MAC_EXP_FLAG_SCAN)) == 0)
 	VSTRING_RESET(result);
     status = mac_parse(pattern, mac_expand_callback, (void *) &mc);
@@ -616,16 +752,352 @@ int     mac_expand(VSTRING *result, const char *pattern, int flags,
     return (status);
 }
 
+/* mac_exp_code_free - destroy compiled operations */
+
+static void mac_exp_code_free(MAC_EXP_CODE *code)
+{
+    MAC_EXP_CODE *next;
+
+    for ( /* void */ ; code != 0; code = next) {
+	next = code->next;
+	if (code->text)
+	    myfree(code->text);
+	mac_exp_code_free(code->left);
+	mac_exp_code_free(code->rite);
+	mac_exp_code_free(code->iftrue);
+	mac_exp_code_free(code->iffalse);
+	myfree((void *) code);
+    }
+}
+
+/* mac_exp_compile_sub - compile result or operand text */
+
+static void mac_exp_compile_sub(MAC_EXP_CONTEXT *mc, const char *text,
+				        MAC_EXP_CODE **where)
+{
+    MAC_EXP_CODE **saved_tail = mc->tail;
+
+    mc->tail = where;
+    mc->status |= mac_parse_quiet(text, mac_exp_compile_callback,
+				  (void *) mc);
+    mc->tail = saved_tail;
+}
+
+/* mac_exp_compile_callback - callback for mac_parse_quiet */
+
+static int mac_exp_compile_callback(int type, VSTRING *buf, void *ptr)
+{
+    MAC_EXP_CONTEXT *mc = (MAC_EXP_CONTEXT *) ptr;
+    MAC_EXP_CODE *code;
+    char   *cp;
+    int     ch;
+    ssize_t tmp_len;
+    char   *left_op_strval;
+    char   *rite_op_strval;
+    char   *name;
+    char   *res;
+    int     saved_level;
+
+    /*
+     * Sanity check. The compiler does the same syntax checks as
+     * mac_expand_callback(), but it checks all result operands, and it
+     * logs no warnings.
+     */
+    if (mc->level++ > 100)
+	mac_exp_parse_error(mc, "unreasonable macro call nesting: \"%s\"",
+			    vstring_str(buf));
+    if (mc->status & MAC_PARSE_ERROR)
+	return (mc->status);
+
+    /*
+     * Append the operation before compiling its operands, so that a partial
+     * result is cleaned up after error.
+     */
+    code = (MAC_EXP_CODE *) mymalloc(sizeof(*code));
+    code->text = 0;
+    code->op_tokval = MAC_EXP_OP_TOK_NONE;
+    code->left = code->rite = 0;
+    code->cond = MAC_EXP_COND_NONE;
+    code->iftrue = code->iffalse = 0;
+    code->next = 0;
+    *mc->tail = code;
+    mc->tail = &code->next;
+
+    /*
+     * Literal text.
+     */
+    if (type != MAC_PARSE_EXPR) {
+	code->type = MAC_EXP_CODE_LITERAL;
+	code->text = mystrdup(vstring_str(buf));
+	mc->level--;
+	return (mc->status);
+    }
+    code->type = MAC_EXP_CODE_EXPR;
+    cp = vstring_str(buf);
+
+    /*
+     * Relational expression. Like mac_expand_interp(), start the operand
+     * nesting level count at zero.
+     */
+    if (MAC_EXP_FIND_LEFT_CURLY(tmp_len, cp)) {
+	if (mac_exp_parse_relational(mc, &left_op_strval, &code->op_tokval,
+				     &rite_op_strval, &cp) != 0)
+	    return (mc->status);
+	saved_level = mc->level;
+	mc->level = 0;
+	mac_exp_compile_sub(mc, left_op_strval, &code->left);
+	mc->level = 0;
+	mac_exp_compile_sub(mc, rite_op_strval, &code->rite);
+	mc->level = saved_level;
+	if (mc->status & MAC_PARSE_ERROR)
+	    return (mc->status);
+	if ((ch = *cp) != 0) {
+	    if (ch != '?' && ch != ':')
+		MAC_EXP_ERR_RETURN(mc, "\"?\" or \":\" expected at: "
+				   "\"...}>>>%.20s\"", cp);
+	    cp++;
+	}
+    }
+
+    /*
+     * Named parameter.
+     */
+    else {
+	if ((ch = mac_exp_parse_name(mc, buf, &cp, &name)) < 0)
+	    return (mc->status);
+	code->text = mystrdup(name);
+    }
+
+    /*
+     * Compile both result operands.
+     */
+    switch (ch) {
+    case '?':
+	if ((res = mac_exp_parse_result(mc, &cp)) == 0)
+	    return (mc->status);
+	code->cond |= MAC_EXP_COND_TRUE;
+	mac_exp_compile_sub(mc, res, &code->iftrue);
+	if (*cp == 0)
+	    break;
+	if (*cp != ':')
+	    MAC_EXP_ERR_RETURN(mc, "\":\" expected at: "
+			       "\"...%s}>>>%.20s\"", res, cp);
+	cp += 1;
+	/* FALLTHROUGH */
+    case ':':
+	if ((res = mac_exp_parse_result(mc, &cp)) == 0)
+	    return (mc->status);
+	code->cond |= MAC_EXP_COND_FALSE;
+	mac_exp_compile_sub(mc, res, &code->iffalse);
+	if (*cp != 0)
+	    MAC_EXP_ERR_RETURN(mc, "unexpected input at: "
+			       "\"...%s}>>>%.20s\"", res, cp);
+	break;
+    }
+    mc->level--;
+
+    return (mc->status);
+}
+
+/* mac_expand_compile - compile pattern */
+
+MAC_EXP_PROG *mac_expand_compile(const char *pattern)
+{
+    MAC_EXP_CONTEXT mc;
+    MAC_EXP_PROG *prog;
+
+    prog = (MAC_EXP_PROG *) mymalloc(sizeof(*prog));
+    prog->refcount = 1;
+    prog->code = 0;
+
+    mc.result = 0;
+    mc.flags = MAC_EXP_FLAG_COMPILE;
+    mc.filter = 0;
+    mc.lookup = 0;
+    mc.context = 0;
+    mc.status = 0;
+    mc.level = 0;
+    mc.tail = &prog->code;
+    if ((mac_parse_quiet(pattern, mac_exp_compile_callback, (void *) &mc)
+	 | mc.status) & MAC_PARSE_ERROR) {
+	mac_expand_free(prog);
+	return (0);
+    }
+    return (prog);
+}
+
+/* mac_exp_run_code - execute compiled operations */
+
+static void mac_exp_run_code(MAC_EXP_CONTEXT *mc, const MAC_EXP_CODE *code)
+{
+    MAC_EXP_CONTEXT operand;
+    VSTRING *left_op_buf;
+    VSTRING *rite_op_buf;
+    const char *lookup;
+    int     op_result;
+
+    for ( /* void */ ; code != 0; code = code->next) {
+	if (mc->status & MAC_PARSE_ERROR)
+	    break;
+
+	/*
+	 * Literal text.
+	 */
+	if (code->type == MAC_EXP_CODE_LITERAL) {
+	    if ((mc->flags & MAC_EXP_FLAG_SCAN) == 0)
+		vstring_strcat(mc->result, code->text);
+	    continue;
+	}
+	mc->level++;
+
+	/*
+	 * Relational expression. The operands are expanded in a fresh
+	 * context, as with mac_expand_interp().
+	 */
+	if (code->op_tokval != MAC_EXP_OP_TOK_NONE) {
+	    operand = *mc;
+	    operand.status = 0;
+	    operand.level = 0;
+	    operand.result = left_op_buf = vstring_alloc(100);
+	    mac_exp_run_code(&operand, code->left);
+	    if ((operand.flags & MAC_EXP_FLAG_SCAN) == 0)
+		VSTRING_TERMINATE(left_op_buf);
+	    mc->status |= operand.status;
+	    operand.status = 0;
+	    operand.level = 0;
+	    operand.result = rite_op_buf = vstring_alloc(100);
+	    mac_exp_run_code(&operand, code->rite);
+	    if ((operand.flags & MAC_EXP_FLAG_SCAN) == 0)
+		VSTRING_TERMINATE(rite_op_buf);
+	    mc->status |= operand.status;
+	    op_result = mac_exp_eval(vstring_str(left_op_buf), code->op_tokval,
+				     vstring_str(rite_op_buf));
+	    vstring_free(left_op_buf);
+	    vstring_free(rite_op_buf);
+	    if (mc->status & MAC_PARSE_ERROR)
+		break;
+	    lookup = (op_result ? MAC_EXP_BVAL_TRUE : MAC_EXP_BVAL_FALSE);
+	}
+
+	/*
+	 * Named parameter.
+	 */
+	else {
+	    lookup = mc->lookup(code->text, code->cond == MAC_EXP_COND_NONE ?
+				MAC_EXP_MODE_USE : MAC_EXP_MODE_TEST,
+				mc->context);
+	}
+
+	/*
+	 * Produce the requested result.
+	 */
+	if (code->cond == MAC_EXP_COND_NONE) {
+	    mac_exp_use_value(mc, lookup, (VSTRING *) 0);
+	} else {
+	    if ((code->cond & MAC_EXP_COND_TRUE)
+		&& ((lookup != 0 && *lookup != 0)
+		    || (mc->flags & MAC_EXP_FLAG_SCAN)))
+		mac_exp_run_code(mc, code->iftrue);
+	    if ((code->cond & MAC_EXP_COND_FALSE)
+		&& (lookup == 0 || *lookup == 0
+		    || (mc->flags & MAC_EXP_FLAG_SCAN)))
+		mac_exp_run_code(mc, code->iffalse);
+	}
+	mc->level--;
+    }
+}
+
+/* mac_expand_run - expand compiled pattern */
+
+int     mac_expand_run(VSTRING *result, MAC_EXP_PROG *prog, int flags,
+		               const char *filter,
+		               MAC_EXP_LOOKUP_FN lookup, void *context)
+{
+    MAC_EXP_CONTEXT mc;
+
+    /*
+     * The lookup routine may expand other patterns, and a cache update may
+     * then release this program. Hold on to it while we use it.
+     */
+    prog->refcount++;
+    mc.result = result;
+    mc.flags = flags;
+    mc.filter = filter;
+    mc.lookup = lookup;
+    mc.context = context;
+    mc.status = 0;
+    mc.level = 0;
+    mc.tail = 0;
+    if ((flags & (MAC_EXP_FLAG_APPEND | MAC_EXP_FLAG_SCAN)) == 0)
+	VSTRING_RESET(result);
+    mac_exp_run_code(&mc, prog->code);
+    if ((flags & MAC_EXP_FLAG_SCAN) == 0)
+	VSTRING_TERMINATE(result);
+    mac_expand_free(prog);
+
+    return (mc.status);
+}
+
+/* mac_expand_free - release compiled pattern */
+
+void    mac_expand_free(MAC_EXP_PROG *prog)
+{
+    if (--prog->refcount > 0)
+	return;
+    mac_exp_code_free(prog->code);
+    myfree((void *) prog);
+}
+
+/* mac_exp_cache_create - ctable call-back */
+
+static void *mac_exp_cache_create(const char *pattern, void *unused_context)
+{
+    return ((void *) mac_expand_compile(pattern));
+}
+
+/* mac_exp_cache_delete - ctable call-back */
+
+static void mac_exp_cache_delete(void *value, void *unused_context)
+{
+    if (value)
+	mac_expand_free((MAC_EXP_PROG *) value);
+}
+
+/* mac_expand - expand $name instances */
+
+int     mac_expand(VSTRING *result, const char *pattern, int flags,
+		           const char *filter,
+		           MAC_EXP_LOOKUP_FN lookup, void *context)
+{
+    static CTABLE *mac_exp_cache;
+    MAC_EXP_PROG *prog;
+
+    /*
+     * Use the compiled form of the pattern, or fall back to interpretation
+     * when the pattern has a syntax error, so that the warnings and partial
+     * results are exactly as before.
+     */
+    if (mac_exp_cache == 0)
+	mac_exp_cache = ctable_create(MAC_EXP_CACHE_SIZE, mac_exp_cache_create,
+				      mac_exp_cache_delete, (void *) 0);
+    if ((prog = (MAC_EXP_PROG *) ctable_locate(mac_exp_cache, pattern)) != 0)
+	return (mac_expand_run(result, prog, flags, filter, lookup, context));
+    return (mac_expand_interp(result, pattern, flags, filter, lookup, context));
+}
+
 #ifdef TEST
 
  /*
   * This code certainly deserves a stand-alone test program.
   */
+#include <sys/time.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stringops.h>
 #include <htable.h>
 #include <vstream.h>
 #include <vstring_vstream.h>
+#include <msg_vstream.h>
 
 static const char *lookup(const char *name, int unused_mode, void *context)
 {
@@ -634,15 +1106,173 @@ static const char *lookup(const char *name, int unused_mode, void *context)
     return (htable_find(table, name));
 }
 
-int     main(int unused_argc, char **unused_argv)
+ /*
+  * Benchmark: compare interpretation (the uncached code path) with
+  * mac_expand() and its cache of compiled patterns, using patterns like
+  * those that smtpd(8) expands for each session or recipient:
+  * 
+  * mac_expand -b [-n count] [workload...]
+  * 
+  * The smtpd_expand workload has smtpd_banner, smtpd_reject_footer and
+  * similar patterns; the milter_macros workload has milter_macro_v,
+  * milter_macro_daemon_name and conditional macro values. Each pattern is
+  * also checked for identical results with both code paths.
+  */
+typedef struct BENCH_WORKLOAD {
+    const char *name;			/* workload name */
+    const char *patterns[8];		/* null-terminated list */
+} BENCH_WORKLOAD;
+
+static const BENCH_WORKLOAD bench_workloads[] = {
+    {"smtpd_expand", {
+	    "$myhostname ESMTP $mail_name",
+	    "${client_name?{$client_name}:{unknown}}[$client_address]:$client_port",
+	    "For assistance, contact <postmaster@$mydomain>. Client: $client_address",
+	    "${{$client_port} > {1024} ? {high} : {low}} port $client_port",
+	    "$mail_name on $myhostname",
+	    0,
+    }},
+    {"milter_macros", {
+	    "$mail_name $mail_version",
+	    "$myhostname",
+	    "${queue_id?{$queue_id}:{NOQUEUE}}",
+	    "${auth_authen?{authenticated as $auth_authen}}",
+	    "${rcpt_addr:{<>}}",
+	    0,
+    }},
+    {0},
+};
+
+static const char *bench_table[] = {
+    "myhostname", "mail.example.com",
+    "mydomain", "example.com",
+    "mail_name", "Postfix",
+    "mail_version", "3.5.0",
+    "client_name", "client.example.com",
+    "client_address", "192.0.2.1",
+    "client_port", "40000",
+    "queue_id", "4ABCD1234",
+    "rcpt_addr", "user@example.com",
+    0,
+};
+
+/* bench_elapsed - seconds since start */
+
+static double bench_elapsed(struct timeval *start)
+{
+    struct timeval now;
+
+    GETTIMEOFDAY(&now);
+    return (now.tv_sec - start->tv_sec
+	    + (now.tv_usec - start->tv_usec) / 1000000.0);
+}
+
+/* bench_workload - run one workload with and without cache */
+
+static void bench_workload(const BENCH_WORKLOAD *wp, HTABLE *table,
+			           int count)
+{
+    VSTRING *interp_res = vstring_alloc(100);
+    VSTRING *cached_res = vstring_alloc(100);
+    const char *const * cpp;
+    struct timeval start;
+    double  interp_time;
+    double  cached_time;
+    int     n;
+
+    for (cpp = wp->patterns; *cpp; cpp++) {
+	mac_expand_interp(interp_res, *cpp, MAC_EXP_FLAG_NONE, (char *) 0,
+			  lookup, (void *) table);
+	mac_expand(cached_res, *cpp, MAC_EXP_FLAG_NONE, (char *) 0,
+		   lookup, (void *) table);
+	if (strcmp(vstring_str(interp_res), vstring_str(cached_res)) != 0)
+	    msg_fatal("%s: pattern \"%s\": interpreted \"%s\", cached \"%s\"",
+		      wp->name, *cpp, vstring_str(interp_res),
+		      vstring_str(cached_res));
+    }
+    GETTIMEOFDAY(&start);
+    for (n = 0; n < count; n++)
+	for (cpp = wp->patterns; *cpp; cpp++)
+	    mac_expand_interp(interp_res, *cpp, MAC_EXP_FLAG_NONE, (char *) 0,
+			      lookup, (void *) table);
+    interp_time = bench_elapsed(&start);
+    GETTIMEOFDAY(&start);
+    for (n = 0; n < count; n++)
+	for (cpp = wp->patterns; *cpp; cpp++)
+	    mac_expand(cached_res, *cpp, MAC_EXP_FLAG_NONE, (char *) 0,
+		       lookup, (void *) table);
+    cached_time = bench_elapsed(&start);
+    vstream_printf("%s: %d x %ld patterns, uncached %.3fs, cached %.3fs",
+		   wp->name, count, (long) (cpp - wp->patterns),
+		   interp_time, cached_time);
+    if (cached_time > 0)
+	vstream_printf(" (%.1fx)", interp_time / cached_time);
+    vstream_printf("\n");
+    vstream_fflush(VSTREAM_OUT);
+    vstring_free(interp_res);
+    vstring_free(cached_res);
+}
+
+/* bench - run the requested workloads */
+
+static void bench(int count, char **names)
 {
-    VSTRING *buf = vstring_alloc(100);
-    VSTRING *result = vstring_alloc(100);
+    const BENCH_WORKLOAD *wp;
+    HTABLE *table = htable_create(0);
+    const char **cpp;
+    char  **np;
+
+    for (cpp = bench_table; *cpp; cpp += 2)
+	htable_enter(table, cpp[0], (void *) cpp[1]);
+    if (*names == 0) {
+	for (wp = bench_workloads; wp->name; wp++)
+	    bench_workload(wp, table, count);
+    } else {
+	for (np = names; *np; np++) {
+	    for (wp = bench_workloads; wp->name; wp++)
+		if (strcmp(wp->name, *np) == 0)
+		    break;
+	    if (wp->name == 0)
+		msg_fatal("unknown workload: %s", *np);
+	    bench_workload(wp, table, count);
+	}
+    }
+    htable_free(table, (void (*) (void *)) 0);
+}
+
+int     main(int argc, char **argv)
+{
+    VSTRING *buf;
+    VSTRING *result;
     char   *cp;
     char   *name;
     char   *value;
     HTABLE *table;
     int     stat;
+    int     bench_flag = 0;
+    int     count = 100000;
+    int     ch;
+
+    while ((ch = GETOPT(argc, argv, "bn:")) > 0) {
+	switch (ch) {
+	case 'b':
+	    bench_flag = 1;
+	    break;
+	case 'n':
+	    if ((count = atoi(optarg)) <= 0)
+		msg_fatal("bad count: %s", optarg);
+	    break;
+	default:
+	    msg_fatal("usage: %s [-b [-n count] [workload...]]", argv[0]);
+	}
+    }
+    if (bench_flag) {
+	msg_vstream_init(argv[0], VSTREAM_ERR);
+	bench(count, argv + optind);
+	exit(0);
+    }
+    buf = vstring_alloc(100);
+    result = vstring_alloc(100);
 
     while (!vstream_feof(VSTREAM_IN)) {
 
@@ -36,6 +36,15 @@ typedef const char *(*MAC_EXP_LOOKUP_FN) (const char *, int, void *);
 
 extern int mac_expand(VSTRING *, const char *, int, const char *, MAC_EXP_LOOKUP_FN, void *);
 
+ /*
+  * Compiled patterns.
+  */
+typedef struct MAC_EXP_PROG MAC_EXP_PROG;
+
+extern MAC_EXP_PROG *mac_expand_compile(const char *);
+extern int mac_expand_run(VSTRING *, MAC_EXP_PROG *, int, const char *, MAC_EXP_LOOKUP_FN, void *);
+extern void mac_expand_free(MAC_EXP_PROG *);
+
 /* LICENSE
 /* .ad
 /* .fi
@@ -9,6 +9,10 @@
 /*	int	mac_parse(string, action, context)
 /*	const char *string;
 /*	int	(*action)(int type, VSTRING *buf, void *context);
+/*
+/*	int	mac_parse_quiet(string, action, context)
+/*	const char *string;
+/*	int	(*action)(int type, VSTRING *buf, void *context);
 /* DESCRIPTION
 /*	This module recognizes macro expressions in null-terminated
 /*	strings.  Macro expressions have the form $name, $(text) or
@@ -37,6 +41,11 @@
 /*	A macro was expanded but not defined.
 /* .PP
 /*	Use the constant MAC_PARSE_OK when no error was detected.
+/*
+/*	mac_parse_quiet() is like mac_parse(), but does not log
+/*	warnings for malformed input. This is used when a string
+/*	is examined ahead of time, so that a warning is logged
+/*	only when the string is actually used.
 /* SEE ALSO
 /*	dict(3) dictionary interface.
 /* DIAGNOSTICS
@@ -80,9 +89,10 @@
 	    VSTRING_RESET(buf); \
 	} while(0)
 
-/* mac_parse - split string into literal text and macro references */
+/* mac_parse_internal - split string into literal text and macro references */
 
-int     mac_parse(const char *value, MAC_PARSE_FN action, void *context)
+static int mac_parse_internal(const char *value, MAC_PARSE_FN action,
+			              void *context, int quiet)
 {
     const char *myname = "mac_parse";
     VSTRING *buf = vstring_alloc(1);	/* result buffer */
@@ -119,7 +129,9 @@ int     mac_parse(const char *value, MAC_PARSE_FN action, void *context)
 		vp += 1;
 		for (ep = vp; level > 0; ep++) {
 		    if (*ep == 0) {
-			msg_warn("truncated macro reference: \"%s\"", value);
+			if (!quiet)
+			    msg_warn("truncated macro reference: \"%s\"",
+				     value);
 			status |= MAC_PARSE_ERROR;
 			break;
 		    }
@@ -139,7 +151,8 @@ int     mac_parse(const char *value, MAC_PARSE_FN action, void *context)
 	    }
 	    if (VSTRING_LEN(buf) == 0) {
 		status |= MAC_PARSE_ERROR;
-		msg_warn("empty macro name: \"%s\"", value);
+		if (!quiet)
+		    msg_warn("empty macro name: \"%s\"", value);
 		break;
 	    }
 	    MAC_PARSE_ACTION(status, MAC_PARSE_EXPR, buf, context);
@@ -156,6 +169,20 @@ int     mac_parse(const char *value, MAC_PARSE_FN action, void *context)
     return (status);
 }
 
+/* mac_parse - split string into literal text and macro references */
+
+int     mac_parse(const char *value, MAC_PARSE_FN action, void *context)
+{
+    return (mac_parse_internal(value, action, context, 0));
+}
+
+/* mac_parse_quiet - mac_parse() without warnings */
+
+int     mac_parse_quiet(const char *value, MAC_PARSE_FN action, void *context)
+{
+    return (mac_parse_internal(value, action, context, 1));
+}
+
 #ifdef TEST
 
  /*
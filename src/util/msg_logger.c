@@ -62,6 +62,19 @@
 /* .IP CA_MSG_LOGGER_CTL_DISABLE
 /*	Disable the msg_logger. This remains in effect until the
 /*	next msg_logger_init() call.
+/* .IP CA_MSG_LOGGER_CTL_RING(MSG_RING *)
+/*	Append records to the specified shared-memory ring (or stop
+/*	doing so, with a null pointer), instead of sending one
+/*	datagram per record. When the ring is full, an informational
+/*	record is dropped and counted, and other records are sent
+/*	as datagrams. The ring is used only by the process that
+/*	created it, not by a child process. When the ring consumer
+/*	appears to be inactive, this module sends an empty datagram
+/*	to the logging service at most once every 10s, so that the
+/*	service is started if it is not running. The caller owns
+/*	the ring and must reset this setting before destroying it.
+/*	This remains in effect until the next msg_logger_control()
+/*	call with CA_MSG_LOGGER_CTL_RING.
 /* SEE ALSO
 /*	msg(3)  diagnostics module
 /* BUGS
@@ -118,6 +131,15 @@ static int msg_logger_enable = 0;
 
 static VSTRING *msg_logger_buf;
 static int msg_logger_sock = MSG_LOGGER_SOCK_NONE;
+static MSG_RING *msg_logger_ring;
+static time_t msg_logger_ring_announced;
+
+ /*
+  * When the ring consumer has not drained the ring in this many seconds,
+  * send a wakeup datagram, but not more often than the announce interval.
+  */
+#define MSG_LOGGER_RING_STALE		5
+#define MSG_LOGGER_RING_ANNOUNCE	10
 
  /*
   * Safety limit.
@@ -130,6 +152,35 @@ static int msg_logger_sock = MSG_LOGGER_SOCK_NONE;
 #define STR(x)	vstring_str(x)
 #define LEN(x)	VSTRING_LEN(x)
 
+/* msg_logger_connect - connect to logging service, if possible */
+
+static int msg_logger_connect(void)
+{
+
+    /*
+     * Many systems will report ENOENT if the endpoint does not exist,
+     * ECONNREFUSED if no server has opened the endpoint.
+     */
+    if (msg_logger_fallback_only_override == 0
+	&& msg_logger_sock == MSG_LOGGER_SOCK_NONE) {
+	msg_logger_sock = unix_dgram_connect(msg_logger_unix_path, BLOCKING);
+	if (msg_logger_sock >= 0)
+	    close_on_exec(msg_logger_sock, CLOSE_ON_EXEC);
+    }
+    return (msg_logger_sock != MSG_LOGGER_SOCK_NONE);
+}
+
+/* msg_logger_ring_wakeup - wake up an inactive ring consumer */
+
+static void msg_logger_ring_wakeup(time_t now)
+{
+    if (now - msg_logger_ring_announced >= MSG_LOGGER_RING_ANNOUNCE
+	&& msg_ring_stale(msg_logger_ring, now, MSG_LOGGER_RING_STALE)) {
+	msg_logger_ring_announced = now;
+	if (msg_logger_connect())
+	    (void) send(msg_logger_sock, "", 0, 0);
+    }
+}
 
 /* msg_logger_print - log info to service or file */
 
@@ -138,6 +189,7 @@ static void msg_logger_print(int level, const char *text)
     time_t  now;
     struct tm *lt;
     ssize_t len;
+    pid_t   pid;
 
     /*
      * This test is simple enough that we don't bother with unregistering the
@@ -188,28 +240,41 @@ static void msg_logger_print(int level, const char *text)
     if (level < 0 || level >= (int) (sizeof(log_level) / sizeof(log_level[0])))
 	msg_panic("msg_logger_print: invalid severity level: %d", level);
 
+    pid = getpid();
     if (level == MSG_INFO) {
 	vstring_sprintf_append(msg_logger_buf, "%s[%ld]: %.*s",
-			       msg_logger_progname, (long) getpid(),
+			       msg_logger_progname, (long) pid,
 			       (int) MSG_LOGGER_RECLEN, text);
     } else {
 	vstring_sprintf_append(msg_logger_buf, "%s[%ld]: %s: %.*s",
-			       msg_logger_progname, (long) getpid(),
+			       msg_logger_progname, (long) pid,
 		       severity_name[level], (int) MSG_LOGGER_RECLEN, text);
     }
 
     /*
-     * Connect to logging service, or fall back to direct log. Many systems
-     * will report ENOENT if the endpoint does not exist, ECONNREFUSED if no
-     * server has opened the endpoint.
+     * Append to the shared-memory ring without making a system call. If the
+     * ring is full, drop an informational record rather than block, and
+     * send other records the slow way. Wake up the logging service when it
+     * seems to have stopped draining the ring.
      */
-    if (msg_logger_fallback_only_override == 0
-	&& msg_logger_sock == MSG_LOGGER_SOCK_NONE) {
-	msg_logger_sock = unix_dgram_connect(msg_logger_unix_path, BLOCKING);
-	if (msg_logger_sock >= 0)
-	    close_on_exec(msg_logger_sock, CLOSE_ON_EXEC);
+    if (msg_logger_ring != 0 && msg_logger_fallback_only_override == 0
+	&& msg_ring_pid(msg_logger_ring) == (long) pid) {
+	if (msg_ring_put(msg_logger_ring, STR(msg_logger_buf),
+			 LEN(msg_logger_buf)) == 0) {
+	    msg_logger_ring_wakeup(now);
+	    return;
+	}
+	if (level == MSG_INFO) {
+	    msg_ring_drop(msg_logger_ring);
+	    msg_logger_ring_wakeup(now);
+	    return;
+	}
     }
-    if (msg_logger_sock != MSG_LOGGER_SOCK_NONE) {
+
+    /*
+     * Connect to logging service, or fall back to direct log.
+     */
+    if (msg_logger_connect()) {
 	send(msg_logger_sock, STR(msg_logger_buf), LEN(msg_logger_buf), 0);
     } else if (msg_logger_fallback_fn) {
 	msg_logger_fallback_fn(STR(msg_logger_buf));
@@ -297,6 +362,10 @@ void    msg_logger_control(int name,...)
 	case MSG_LOGGER_CTL_DISABLE:
 	    msg_logger_enable = 0;
 	    break;
+	case MSG_LOGGER_CTL_RING:
+	    msg_logger_ring = va_arg(ap, MSG_RING *);
+	    msg_logger_ring_announced = 0;
+	    break;
 	default:
 	    msg_panic("%s: bad name %d", myname, name);
 	}
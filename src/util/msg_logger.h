@@ -20,6 +20,7 @@
   * Utility library.
   */
 #include <check_arg.h>
+#include <msg_ring.h>
 
  /*
   * External interface.
@@ -35,6 +36,7 @@ extern void msg_logger_control(int,...);
 #define MSG_LOGGER_CTL_FALLBACK_ONLY	1
 #define MSG_LOGGER_CTL_FALLBACK_FN	2
 #define MSG_LOGGER_CTL_DISABLE		3
+#define MSG_LOGGER_CTL_RING		4
 
 /* Safer API: type-checked arguments, external use. */
 #define CA_MSG_LOGGER_CTL_END		MSG_LOGGER_CTL_END
@@ -43,8 +45,11 @@ extern void msg_logger_control(int,...);
 	MSG_LOGGER_CTL_FALLBACK_FN, CHECK_VAL(MSG_LOGGER_CTL, \
 		MSG_LOGGER_FALLBACK_FN, (v))
 #define CA_MSG_LOGGER_CTL_DISABLE	MSG_LOGGER_CTL_DISABLE
+#define CA_MSG_LOGGER_CTL_RING(v) \
+	MSG_LOGGER_CTL_RING, CHECK_PTR(MSG_LOGGER_CTL, MSG_RING, (v))
 
 CHECK_VAL_HELPER_DCL(MSG_LOGGER_CTL, MSG_LOGGER_FALLBACK_FN);
+CHECK_PTR_HELPER_DCL(MSG_LOGGER_CTL, MSG_RING);
 
 /* LICENSE
 /* .ad
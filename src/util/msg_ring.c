@@ -0,0 +1,430 @@
+/*++
+/* NAME
+/*	msg_ring 3
+/* SUMMARY
+/*	shared-memory logfile record ring
+/* SYNOPSIS
+/*	#include <msg_ring.h>
+/*
+/*	MSG_RING *msg_ring_create(path, size)
+/*	const char *path;
+/*	ssize_t	size;
+/*
+/*	MSG_RING *msg_ring_open(path)
+/*	const char *path;
+/*
+/*	void	msg_ring_free(ring)
+/*	MSG_RING *ring;
+/* PRODUCER INTERFACE
+/*	int	msg_ring_put(ring, buf, len)
+/*	MSG_RING *ring;
+/*	const char *buf;
+/*	ssize_t	len;
+/*
+/*	void	msg_ring_drop(ring)
+/*	MSG_RING *ring;
+/*
+/*	int	msg_ring_stale(ring, now, limit)
+/*	MSG_RING *ring;
+/*	time_t	now;
+/*	int	limit;
+/* CONSUMER INTERFACE
+/*	ssize_t	msg_ring_get(ring, buf)
+/*	MSG_RING *ring;
+/*	VSTRING	*buf;
+/*
+/*	unsigned long msg_ring_dropped(ring)
+/*	MSG_RING *ring;
+/*
+/*	void	msg_ring_drained(ring, now)
+/*	MSG_RING *ring;
+/*	time_t	now;
+/*
+/*	int	msg_ring_fd(ring)
+/*	MSG_RING *ring;
+/*
+/*	long	msg_ring_pid(ring)
+/*	MSG_RING *ring;
+/* DESCRIPTION
+/*	This module implements a single-producer, single-consumer
+/*	ring buffer for logfile records, in a file that is mapped
+/*	into the memory of both processes. The producer appends a
+/*	record without making system calls and without locking;
+/*	when the ring is full, the producer decides whether to drop
+/*	the record or to send it by other means. The consumer is
+/*	expected to poll the ring periodically.
+/*
+/*	The producer owns the write offset and the drop counter;
+/*	the consumer owns the read offset and the drain time stamp.
+/*	Offsets are updated with release semantics after the data
+/*	is copied, and read with acquire semantics.
+/*
+/*	msg_ring_create() creates a ring file with the specified
+/*	data size (rounded up to a power of two, and at least
+/*	MSG_RING_MIN_SIZE), replacing an existing file with the
+/*	same name. The result is a null pointer in case of error.
+/*	The ring is labeled with the process ID of the caller.
+/*
+/*	msg_ring_open() opens an existing ring file. The result is
+/*	a null pointer in case of error, including a file that is
+/*	still being initialized, or that has the wrong format or
+/*	an invalid process ID.
+/*
+/*	msg_ring_free() unmaps the ring and closes its file. The file
+/*	is not removed.
+/*
+/*	msg_ring_put() appends one record. The result is zero in
+/*	case of success, -1 when the ring has no room.
+/*
+/*	msg_ring_drop() increments the count of dropped records.
+/*
+/*	msg_ring_stale() returns non-zero when the consumer has not
+/*	drained the ring in the past \fIlimit\fR seconds.
+/*
+/*	msg_ring_get() copies the oldest record into the specified
+/*	buffer and removes it from the ring. The result is the record
+/*	length, or -1 when the ring is empty.
+/*
+/*	msg_ring_dropped() returns the number of records that the
+/*	producer dropped since the previous msg_ring_dropped() call.
+/*
+/*	msg_ring_drained() records the time of the latest drain.
+/*
+/*	msg_ring_fd() returns the ring file descriptor.
+/*
+/*	msg_ring_pid() returns the producer process ID. This is
+/*	the value that msg_ring_create() stored, or the value that
+/*	msg_ring_open() found; later changes to the shared file
+/*	are ignored. The consumer must not trust this value before
+/*	it has verified that it matches the ring file name.
+/* DIAGNOSTICS
+/*	The producer interface must not log: it is used from inside
+/*	the logging client. msg_ring_create() fails with ENOSYS on
+/*	systems without a supported compiler for atomic memory
+/*	access; msg_ring_open() works everywhere.
+/*
+/*	msg_ring_get() logs a warning and discards the ring content
+/*	when the ring state is inconsistent.
+/* SEE ALSO
+/*	msg_logger(3), logging client
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Utility library. */
+
+#include <iostuff.h>
+#include <msg.h>
+#include <mymalloc.h>
+#include <msg_ring.h>
+
+ /*
+  * Offsets are shared between processes. We need acquire/release ordering
+  * so that a reader never sees an offset before the data that it covers.
+  */
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+#define MSG_RING_LOAD(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define MSG_RING_STORE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#define MSG_RING_LOAD(p)	(*(volatile unsigned long *) (p))
+#define MSG_RING_STORE(p, v)	(*(volatile unsigned long *) (p) = (v))
+#define NO_MSG_RING_PRODUCER
+#endif
+
+ /*
+  * The shared ring header. Producer-owned and consumer-owned members are
+  * kept in different cache lines.
+  */
+#define MSG_RING_MAGIC	0x506c6f67UL		/* "Plog" */
+#define MSG_RING_PAD	64
+
+typedef struct MSG_RING_SHM {
+    unsigned long magic;		/* set last by producer */
+    unsigned long size;			/* data size, power of two */
+    unsigned long pid;			/* producer process */
+    char    pad1[MSG_RING_PAD];
+    unsigned long head;			/* producer write offset */
+    unsigned long dropped;		/* producer drop count */
+    char    pad2[MSG_RING_PAD];
+    unsigned long tail;			/* consumer read offset */
+    unsigned long drained;		/* consumer drain time */
+} MSG_RING_SHM;
+
+ /*
+  * Private state.
+  */
+struct MSG_RING {
+    char   *path;			/* ring file */
+    int     fd;				/* ring file */
+    MSG_RING_SHM *shm;			/* mapped header */
+    char   *data;			/* mapped data */
+    unsigned long size;			/* data size */
+    size_t  map_len;			/* header + data */
+    unsigned long dropped;		/* consumer: drops reported */
+    long    pid;			/* producer, private copy */
+};
+
+ /*
+  * Each record is stored as a length followed by the content, wrapping
+  * around at the end of the data area.
+  */
+typedef unsigned int MSG_RING_LEN;
+
+#define MSG_RING_MASK(ring, off)	((off) & ((ring)->size - 1))
+
+/* msg_ring_map - map ring file */
+
+static MSG_RING *msg_ring_map(const char *path, int fd, size_t map_len)
+{
+    MSG_RING *ring;
+    void   *ptr;
+
+    if ((ptr = mmap((void *) 0, map_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    fd, (off_t) 0)) == MAP_FAILED)
+	return (0);
+    ring = (MSG_RING *) mymalloc(sizeof(*ring));
+    ring->path = mystrdup(path);
+    ring->fd = fd;
+    ring->shm = (MSG_RING_SHM *) ptr;
+    ring->data = (char *) ptr + sizeof(MSG_RING_SHM);
+    ring->size = map_len - sizeof(MSG_RING_SHM);
+    ring->map_len = map_len;
+    ring->dropped = 0;
+    ring->pid = 0;
+    close_on_exec(fd, CLOSE_ON_EXEC);
+    return (ring);
+}
+
+/* msg_ring_create - create ring file */
+
+MSG_RING *msg_ring_create(const char *path, ssize_t request)
+{
+    MSG_RING *ring;
+    unsigned long size;
+    size_t  map_len;
+    int     fd;
+    int     saved_errno;
+
+#ifdef NO_MSG_RING_PRODUCER
+    errno = ENOSYS;
+    return (0);
+#endif
+
+    for (size = MSG_RING_MIN_SIZE; size < (unsigned long) request
+	 && size < (~0UL >> 2); size <<= 1)
+	 /* void */ ;
+    map_len = sizeof(MSG_RING_SHM) + size;
+    if (unlink(path) < 0 && errno != ENOENT)
+	return (0);
+    if ((fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0)
+	return (0);
+    if (ftruncate(fd, (off_t) map_len) < 0
+	|| (ring = msg_ring_map(path, fd, map_len)) == 0) {
+	saved_errno = errno;
+	(void) close(fd);
+	(void) unlink(path);
+	errno = saved_errno;
+	return (0);
+    }
+    ring->shm->size = size;
+    ring->shm->pid = ring->pid = getpid();
+    MSG_RING_STORE(&ring->shm->magic, MSG_RING_MAGIC);
+    return (ring);
+}
+
+/* msg_ring_open - open existing ring file */
+
+MSG_RING *msg_ring_open(const char *path)
+{
+    MSG_RING *ring;
+    struct stat st;
+    MSG_RING_SHM *shm;
+    int     fd;
+
+    if ((fd = open(path, O_RDWR, 0)) < 0)
+	return (0);
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)
+	|| st.st_size <= (off_t) sizeof(MSG_RING_SHM)
+	|| (ring = msg_ring_map(path, fd, (size_t) st.st_size)) == 0) {
+	(void) close(fd);
+	return (0);
+    }
+    shm = ring->shm;
+    if (MSG_RING_LOAD(&shm->magic) != MSG_RING_MAGIC
+	|| shm->size != ring->size || (ring->size & (ring->size - 1)) != 0) {
+	msg_ring_free(ring);
+	errno = EINVAL;
+	return (0);
+    }
+
+    /*
+     * The producer may scribble over the shared header at any time. Take a
+     * private copy of the process ID, and don't look at the shared copy
+     * again. The caller decides if the process ID matches the file name.
+     */
+    ring->pid = (long) shm->pid;
+    if (ring->pid <= 0 || (long) (pid_t) ring->pid != ring->pid) {
+	msg_ring_free(ring);
+	errno = EINVAL;
+	return (0);
+    }
+    ring->dropped = shm->dropped;
+    return (ring);
+}
+
+/* msg_ring_free - destroy ring handle */
+
+void    msg_ring_free(MSG_RING *ring)
+{
+    (void) munmap((void *) ring->shm, ring->map_len);
+    (void) close(ring->fd);
+    myfree(ring->path);
+    myfree((void *) ring);
+}
+
+/* msg_ring_copy_in - copy to ring data with wrap-around */
+
+static void msg_ring_copy_in(MSG_RING *ring, unsigned long off,
+			             const char *buf, size_t len)
+{
+    size_t  pos = MSG_RING_MASK(ring, off);
+    size_t  part = ring->size - pos;
+
+    if (part >= len) {
+	memcpy(ring->data + pos, buf, len);
+    } else {
+	memcpy(ring->data + pos, buf, part);
+	memcpy(ring->data, buf + part, len - part);
+    }
+}
+
+/* msg_ring_copy_out - copy from ring data with wrap-around */
+
+static void msg_ring_copy_out(MSG_RING *ring, unsigned long off,
+			              char *buf, size_t len)
+{
+    size_t  pos = MSG_RING_MASK(ring, off);
+    size_t  part = ring->size - pos;
+
+    if (part >= len) {
+	memcpy(buf, ring->data + pos, len);
+    } else {
+	memcpy(buf, ring->data + pos, part);
+	memcpy(buf + part, ring->data, len - part);
+    }
+}
+
+/* msg_ring_put - append one record */
+
+int     msg_ring_put(MSG_RING *ring, const char *buf, ssize_t len)
+{
+    MSG_RING_SHM *shm = ring->shm;
+    unsigned long head = shm->head;
+    unsigned long tail = MSG_RING_LOAD(&shm->tail);
+    MSG_RING_LEN rec_len = len;
+    size_t  need = sizeof(rec_len) + len;
+
+    if (len < 0 || need > ring->size - (head - tail))
+	return (-1);
+    msg_ring_copy_in(ring, head, (char *) &rec_len, sizeof(rec_len));
+    msg_ring_copy_in(ring, head + sizeof(rec_len), buf, len);
+    MSG_RING_STORE(&shm->head, head + need);
+    return (0);
+}
+
+/* msg_ring_drop - count dropped record */
+
+void    msg_ring_drop(MSG_RING *ring)
+{
+    MSG_RING_STORE(&ring->shm->dropped, ring->shm->dropped + 1);
+}
+
+/* msg_ring_stale - has the consumer gone away? */
+
+int     msg_ring_stale(MSG_RING *ring, time_t now, int limit)
+{
+    unsigned long drained = MSG_RING_LOAD(&ring->shm->drained);
+
+    return (drained + limit < (unsigned long) now);
+}
+
+/* msg_ring_get - remove oldest record */
+
+ssize_t msg_ring_get(MSG_RING *ring, VSTRING *buf)
+{
+    MSG_RING_SHM *shm = ring->shm;
+    unsigned long head = MSG_RING_LOAD(&shm->head);
+    unsigned long tail = shm->tail;
+    MSG_RING_LEN rec_len;
+
+    if (head == tail)
+	return (-1);
+    if (head - tail < sizeof(rec_len) || head - tail > ring->size) {
+	msg_warn("%s: bad ring offsets; discarding content", ring->path);
+	MSG_RING_STORE(&shm->tail, head);
+	return (-1);
+    }
+    msg_ring_copy_out(ring, tail, (char *) &rec_len, sizeof(rec_len));
+    if (rec_len > head - tail - sizeof(rec_len)) {
+	msg_warn("%s: bad record length %lu; discarding content",
+		 ring->path, (unsigned long) rec_len);
+	MSG_RING_STORE(&shm->tail, head);
+	return (-1);
+    }
+    VSTRING_RESET(buf);
+    VSTRING_SPACE(buf, rec_len);
+    msg_ring_copy_out(ring, tail + sizeof(rec_len), vstring_str(buf), rec_len);
+    vstring_set_payload_size(buf, rec_len);
+    VSTRING_TERMINATE(buf);
+    MSG_RING_STORE(&shm->tail, tail + sizeof(rec_len) + rec_len);
+    return (rec_len);
+}
+
+/* msg_ring_dropped - report new drops */
+
+unsigned long msg_ring_dropped(MSG_RING *ring)
+{
+    unsigned long dropped = MSG_RING_LOAD(&ring->shm->dropped);
+    unsigned long delta = dropped - ring->dropped;
+
+    ring->dropped = dropped;
+    return (delta);
+}
+
+/* msg_ring_drained - update drain time stamp */
+
+void    msg_ring_drained(MSG_RING *ring, time_t now)
+{
+    MSG_RING_STORE(&ring->shm->drained, (unsigned long) now);
+}
+
+/* msg_ring_fd - ring file descriptor */
+
+int     msg_ring_fd(MSG_RING *ring)
+{
+    return (ring->fd);
+}
+
+/* msg_ring_pid - producer process ID */
+
+long    msg_ring_pid(MSG_RING *ring)
+{
+    return (ring->pid);
+}
@@ -0,0 +1,54 @@
+#ifndef _MSG_RING_H_INCLUDED_
+#define _MSG_RING_H_INCLUDED_
+
+/*++
+/* NAME
+/*	msg_ring 3h
+/* SUMMARY
+/*	shared-memory logfile record ring
+/* SYNOPSIS
+/*	#include <msg_ring.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * System library.
+  */
+#include <time.h>
+
+ /*
+  * Utility library.
+  */
+#include <vstring.h>
+
+ /*
+  * External interface.
+  */
+typedef struct MSG_RING MSG_RING;
+
+extern MSG_RING *msg_ring_create(const char *, ssize_t);
+extern MSG_RING *msg_ring_open(const char *);
+extern void msg_ring_free(MSG_RING *);
+extern int msg_ring_put(MSG_RING *, const char *, ssize_t);
+extern void msg_ring_drop(MSG_RING *);
+extern int msg_ring_stale(MSG_RING *, time_t, int);
+extern ssize_t msg_ring_get(MSG_RING *, VSTRING *);
+extern unsigned long msg_ring_dropped(MSG_RING *);
+extern void msg_ring_drained(MSG_RING *, time_t);
+extern int msg_ring_fd(MSG_RING *);
+extern long msg_ring_pid(MSG_RING *);
+
+#define MSG_RING_MIN_SIZE	(16 * 1024)
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+#endif
@@ -70,7 +70,10 @@
 /*
 /*	slmdb_get() is an mdb_get() wrapper with automatic error
 /*	recovery.  The result value is an LMDB status code (zero
-/*	in case of success).
+/*	in case of success). With a database that is opened with
+/*	MDB_RDONLY, slmdb_get() recycles one read transaction handle
+/*	with mdb_txn_reset() and mdb_txn_renew(), instead of creating
+/*	and destroying a transaction for each lookup.
 /*
 /*	slmdb_put() is an mdb_put() wrapper with automatic error
 /*	recovery.  The result value is an LMDB status code (zero
@@ -319,6 +322,16 @@ static void slmdb_cursor_close(SLMDB *slmdb)
     mdb_txn_abort(txn);
 }
 
+/* slmdb_read_txn_free - destroy recycled read transaction */
+
+static void slmdb_read_txn_free(SLMDB *slmdb)
+{
+    if (slmdb->read_txn != 0) {
+	mdb_txn_abort(slmdb->read_txn);
+	slmdb->read_txn = 0;
+    }
+}
+
 /* slmdb_saved_key_init - initialize saved key info */
 
 static void slmdb_saved_key_init(SLMDB *slmdb)
@@ -414,6 +427,7 @@ static int slmdb_recover(SLMDB *slmdb, int status)
      */
     if (slmdb->cursor != 0)
 	slmdb_cursor_close(slmdb);
+    slmdb_read_txn_free(slmdb);
 
     /*
      * Recover bulk transactions only if they can be restarted. Limit the
@@ -535,12 +549,21 @@ int     slmdb_get(SLMDB *slmdb, MDB_val *mdb_key, MDB_val *mdb_value)
     int     status;
 
     /*
-     * Start a read transaction if there's no bulk-mode txn.
+     * Start a read transaction if there's no bulk-mode txn. A read-only
+     * database recycles the transaction handle of the previous lookup. The
+     * handle holds no snapshot between calls, so the caller may still
+     * release its external lock after we return.
      */
     if (slmdb->txn)
 	txn = slmdb->txn;
-    else if ((status = slmdb_txn_begin(slmdb, MDB_RDONLY, &txn)) != 0)
-	SLMDB_API_RETURN(slmdb, status);
+    else if (slmdb->read_txn != 0
+	     && mdb_txn_renew(slmdb->read_txn) == 0)
+	txn = slmdb->read_txn;
+    else {
+	slmdb_read_txn_free(slmdb);
+	if ((status = slmdb_txn_begin(slmdb, MDB_RDONLY, &txn)) != 0)
+	    SLMDB_API_RETURN(slmdb, status);
+    }
 
     /*
      * Do the lookup.
@@ -548,17 +571,25 @@ int     slmdb_get(SLMDB *slmdb, MDB_val *mdb_key, MDB_val *mdb_value)
     if ((status = mdb_get(txn, slmdb->dbi, mdb_key, mdb_value)) != 0
 	&& status != MDB_NOTFOUND) {
 	mdb_txn_abort(txn);
+	if (txn == slmdb->read_txn)
+	    slmdb->read_txn = 0;
 	if ((status = slmdb_recover(slmdb, status)) == 0)
 	    status = slmdb_get(slmdb, mdb_key, mdb_value);
 	SLMDB_API_RETURN(slmdb, status);
     }
 
     /*
-     * Close the read txn if it's not the bulk-mode txn.
+     * Close the read txn if it's not the bulk-mode txn, or keep its handle
+     * for the next lookup.
      */
-    if (slmdb->txn == 0)
-	mdb_txn_abort(txn);
-
+    if (slmdb->txn == 0) {
+	if (slmdb->lmdb_flags & MDB_RDONLY) {
+	    mdb_txn_reset(txn);
+	    slmdb->read_txn = txn;
+	} else {
+	    mdb_txn_abort(txn);
+	}
+    }
     SLMDB_API_RETURN(slmdb, status);
 }
 
@@ -776,6 +807,7 @@ int     slmdb_close(SLMDB *slmdb)
      */
     if (slmdb->cursor != 0)
 	slmdb_cursor_close(slmdb);
+    slmdb_read_txn_free(slmdb);
 
     mdb_env_close(slmdb->env);
 
@@ -877,6 +909,7 @@ int     slmdb_open(SLMDB *slmdb, const char *path, int open_flags,
     slmdb->assert_fn = 0;
     slmdb->cb_context = 0;
     slmdb->txn = txn;
+    slmdb->read_txn = 0;
 
     if ((status = slmdb_prepare(slmdb)) != 0)
 	mdb_env_close(env);
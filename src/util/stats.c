@@ -0,0 +1,838 @@
+/*++
+/* NAME
+/*	stats 3
+/* SUMMARY
+/*	shared-memory counter and histogram registry
+/* SYNOPSIS
+/*	#include <stats.h>
+/*
+/*	int	stats_attach(path, label)
+/*	const char *path;
+/*	const char *label;
+/*
+/*	STATS_CELL *stats_counter(name)
+/*	const char *name;
+/*
+/*	STATS_CELL *stats_gauge(name)
+/*	const char *name;
+/*
+/*	STATS_CELL *stats_histogram(name)
+/*	const char *name;
+/*
+/*	void	STATS_INC(cell)
+/*	STATS_CELL *cell;
+/*
+/*	void	STATS_ADD(cell, value)
+/*	STATS_CELL *cell;
+/*	unsigned long value;
+/*
+/*	void	STATS_SET(cell, value)
+/*	STATS_CELL *cell;
+/*	unsigned long value;
+/*
+/*	void	stats_observe(cells, value)
+/*	STATS_CELL *cells;
+/*	unsigned long value;
+/*
+/*	int	stats_quantile(cells, percent)
+/*	const STATS_CELL *cells;
+/*	int	percent;
+/* SEGMENT MANAGEMENT
+/*	STATS_SEG *stats_seg_create(path, slots)
+/*	const char *path;
+/*	int	slots;
+/*
+/*	STATS_SEG *stats_seg_open(path, open_flags)
+/*	const char *path;
+/*	int	open_flags;
+/*
+/*	void	stats_seg_retire(seg, pid)
+/*	STATS_SEG *seg;
+/*	long	pid;
+/*
+/*	void	stats_seg_walk(seg, action, context)
+/*	STATS_SEG *seg;
+/*	void	(*action)(const char *label, const char *name,
+/*			int type, const STATS_CELL *cells,
+/*			void *context);
+/*	void	*context;
+/*
+/*	void	stats_seg_free(seg)
+/*	STATS_SEG *seg;
+/* DESCRIPTION
+/*	This module maintains named counters, gauges and histograms
+/*	in a memory-mapped file that is shared by many processes.
+/*	Each process owns one slot in the file, and updates its own
+/*	cells without locking and without system calls. Readers
+/*	aggregate the cells of all slots. The segment owner, usually
+/*	a parent process, folds the cells of a terminated process
+/*	into one "retired" slot per label, so that totals survive
+/*	process turnover.
+/*
+/*	Names and cell offsets are shared by all slots: a name that
+/*	is registered by one process has the same cells in every
+/*	slot. Registration is serialized with a lock on the file.
+/*	Each slot records which names its owner has registered, so
+/*	that readers report only those.
+/*
+/*	stats_attach() maps an existing segment and claims a free
+/*	slot for the calling process, with the specified label
+/*	(typically, a service name). The result is zero in case of
+/*	success, -1 in case of error (no segment, or no free slot).
+/*	Processes that don't attach can still use the functions
+/*	below; their counters are private.
+/*
+/*	stats_counter(), stats_gauge() and stats_histogram() look
+/*	up or register the named metric and return a pointer to
+/*	its cells. Use STATS_INC() or STATS_ADD() to update a counter,
+/*	STATS_SET() to update a gauge, and stats_observe() to add
+/*	an observation to a histogram. Metrics that are registered
+/*	before stats_attach(), or that don't fit in the segment,
+/*	are private to the process. A name may contain Prometheus-style
+/*	labels, as in name{label="value"}.
+/*
+/*	stats_quantile() returns the histogram bucket that contains
+/*	the specified percentile of the observations. The bucket
+/*	upper bound is 1 << result, except for the last bucket
+/*	(STATS_HIST_BUCKETS - 1), which has no upper bound. The
+/*	cells may also be a private array of STATS_HIST_CELLS
+/*	elements that is updated with stats_observe().
+/*
+/*	stats_seg_create() creates a segment with the specified
+/*	number of slots, replacing an existing file. The result is
+/*	a null pointer in case of error.
+/*
+/*	stats_seg_open() maps an existing segment. Specify O_RDONLY
+/*	or O_RDWR. The result is a null pointer in case of error.
+/*
+/*	stats_seg_retire() folds the cells of the specified process
+/*	into the retired totals with the same label, and frees the
+/*	process slot. Gauge values of the process are discarded.
+/*	This must be called only after the process has terminated,
+/*	and only for a segment that was created with stats_seg_create().
+/*	The totals are kept in private memory, and are copied to
+/*	the retired slot for readers; a process that writes to the
+/*	segment cannot change them, and cannot make the caller
+/*	access memory outside the segment.
+/*
+/*	stats_seg_walk() calls the action function for every metric
+/*	in every slot that is in use. The result is not a consistent
+/*	snapshot, as processes continue to update their cells.
+/*	Name table entries with an invalid type or cell offset are
+/*	skipped.
+/*
+/*	stats_seg_free() unmaps the segment.
+/* DIAGNOSTICS
+/*	Panic: interface violations.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Utility library. */
+
+#include <htable.h>
+#include <iostuff.h>
+#include <msg.h>
+#include <myflock.h>
+#include <mymalloc.h>
+#include <stats.h>
+
+ /*
+  * Segment layout: a header with the name table, followed by slots.
+  */
+#define STATS_MAGIC		0x50737461UL	/* "Psta" */
+#define STATS_MAX_NAMES		256
+#define STATS_MAX_CELLS		512
+
+#define STATS_PID_FREE		0
+#define STATS_PID_RETIRED	(-1L)
+
+typedef struct STATS_SHM_NAME {
+    char    name[STATS_NAME_LEN];	/* metric name */
+    int     type;			/* STATS_TYPE_XXX */
+    int     cell;			/* first cell */
+} STATS_SHM_NAME;
+
+typedef struct STATS_SHM_HDR {
+    unsigned long magic;		/* set last by creator */
+    int     slot_count;			/* number of slots */
+    int     name_count;			/* names in use */
+    int     cell_count;			/* cells in use */
+    STATS_SHM_NAME names[STATS_MAX_NAMES];
+} STATS_SHM_HDR;
+
+typedef struct STATS_SHM_SLOT {
+    long    pid;			/* owner, free or retired */
+    char    label[STATS_LABEL_LEN];	/* service name */
+    unsigned char used[STATS_MAX_NAMES];	/* names registered by owner */
+    STATS_CELL cells[STATS_MAX_CELLS];
+} STATS_SHM_SLOT;
+
+typedef struct STATS_RETIRED STATS_RETIRED;
+
+struct STATS_SEG {
+    int     fd;				/* segment file */
+    void   *map;			/* mapped segment */
+    size_t  map_len;			/* mapped length */
+    STATS_SHM_HDR *hdr;			/* header */
+    STATS_SHM_SLOT *slots;		/* slot array */
+    int     slot_count;			/* private copy */
+    HTABLE *retired;			/* owner: totals by label */
+    STATS_RETIRED **owner;		/* owner: retired slot owners */
+};
+
+ /*
+  * The segment owner keeps retired totals in private memory, and copies
+  * them to a shared slot for readers. Attached processes can write the
+  * entire segment; the owner never adds to a shared value, and never uses
+  * a shared value as an array index without checking it first.
+  */
+struct STATS_RETIRED {
+    int     slot;			/* shared copy, or -1 */
+    unsigned char used[STATS_MAX_NAMES];
+    STATS_CELL cells[STATS_MAX_CELLS];
+};
+
+#define STATS_NCELLS(type) \
+	((type) == STATS_TYPE_HISTOGRAM ? STATS_HIST_CELLS : 1)
+#define STATS_TYPE_OK(type) \
+	((type) == STATS_TYPE_COUNTER || (type) == STATS_TYPE_GAUGE \
+	 || (type) == STATS_TYPE_HISTOGRAM)
+#define STATS_CELL_OK(cell, type) \
+	((cell) >= 0 && (cell) <= STATS_MAX_CELLS - STATS_NCELLS(type))
+
+#define STATS_SEG_LEN(n) \
+	(sizeof(STATS_SHM_HDR) + (size_t) (n) * sizeof(STATS_SHM_SLOT))
+
+ /*
+  * Make a new name table entry visible only after it is complete.
+  */
+#if defined(__GNUC__)
+#define STATS_BARRIER()	__sync_synchronize()
+#else
+#define STATS_BARRIER()	/* void */
+#endif
+
+ /*
+  * Per-process state.
+  */
+static STATS_SEG *stats_seg;		/* attached segment */
+static STATS_SHM_SLOT *stats_slot;	/* our slot */
+static HTABLE *stats_table;		/* name to cells */
+
+/* stats_seg_map - map segment file */
+
+static STATS_SEG *stats_seg_map(int fd, int prot, size_t map_len)
+{
+    STATS_SEG *seg;
+    void   *ptr;
+
+    if ((ptr = mmap((void *) 0, map_len, prot, MAP_SHARED, fd,
+		    (off_t) 0)) == MAP_FAILED)
+	return (0);
+    seg = (STATS_SEG *) mymalloc(sizeof(*seg));
+    seg->fd = fd;
+    seg->map = ptr;
+    seg->map_len = map_len;
+    seg->hdr = (STATS_SHM_HDR *) ptr;
+    seg->slots = (STATS_SHM_SLOT *) ((char *) ptr + sizeof(STATS_SHM_HDR));
+    seg->slot_count = 0;
+    seg->retired = 0;
+    seg->owner = 0;
+    close_on_exec(fd, CLOSE_ON_EXEC);
+    return (seg);
+}
+
+/* stats_seg_create - create segment */
+
+STATS_SEG *stats_seg_create(const char *path, int slots)
+{
+    STATS_SEG *seg;
+    int     fd;
+    int     saved_errno;
+
+    if (slots <= 0)
+	msg_panic("stats_seg_create: bad slot count %d", slots);
+    if (unlink(path) < 0 && errno != ENOENT)
+	return (0);
+    if ((fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0)
+	return (0);
+    if (ftruncate(fd, (off_t) STATS_SEG_LEN(slots)) < 0
+	|| (seg = stats_seg_map(fd, PROT_READ | PROT_WRITE,
+				STATS_SEG_LEN(slots))) == 0) {
+	saved_errno = errno;
+	(void) close(fd);
+	(void) unlink(path);
+	errno = saved_errno;
+	return (0);
+    }
+    seg->hdr->slot_count = seg->slot_count = slots;
+    seg->owner = (STATS_RETIRED **) mymalloc(slots * sizeof(*seg->owner));
+    memset((void *) seg->owner, 0, slots * sizeof(*seg->owner));
+    STATS_BARRIER();
+    seg->hdr->magic = STATS_MAGIC;
+    return (seg);
+}
+
+/* stats_seg_open - map existing segment */
+
+STATS_SEG *stats_seg_open(const char *path, int open_flags)
+{
+    STATS_SEG *seg;
+    struct stat st;
+    int     fd;
+
+    if ((fd = open(path, open_flags, 0)) < 0)
+	return (0);
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)
+	|| st.st_size < (off_t) sizeof(STATS_SHM_HDR)
+	|| (seg = stats_seg_map(fd, (open_flags & O_ACCMODE) == O_RDONLY ?
+				PROT_READ : PROT_READ | PROT_WRITE,
+				(size_t) st.st_size)) == 0) {
+	(void) close(fd);
+	return (0);
+    }
+    seg->slot_count = seg->hdr->slot_count;
+    if (seg->hdr->magic != STATS_MAGIC || seg->slot_count <= 0
+	|| STATS_SEG_LEN(seg->slot_count) != (size_t) st.st_size) {
+	stats_seg_free(seg);
+	errno = EINVAL;
+	return (0);
+    }
+    return (seg);
+}
+
+/* stats_seg_free - unmap segment */
+
+void    stats_seg_free(STATS_SEG *seg)
+{
+    (void) munmap(seg->map, seg->map_len);
+    (void) close(seg->fd);
+    if (seg->retired)
+	htable_free(seg->retired, myfree);
+    if (seg->owner)
+	myfree((void *) seg->owner);
+    myfree((void *) seg);
+}
+
+/* stats_seg_release - free a shared slot */
+
+static void stats_seg_release(STATS_SEG *seg, STATS_SHM_SLOT *sp)
+{
+    STATS_RETIRED *rp;
+
+    if ((rp = seg->owner[sp - seg->slots]) != 0) {
+	rp->slot = -1;
+	seg->owner[sp - seg->slots] = 0;
+    }
+    memset((void *) sp->used, 0, sizeof(sp->used));
+    memset((void *) sp->cells, 0, sizeof(sp->cells));
+    STATS_BARRIER();
+    sp->pid = STATS_PID_FREE;
+}
+
+/* stats_seg_retire - fold terminated process into retired totals */
+
+void    stats_seg_retire(STATS_SEG *seg, long pid)
+{
+    STATS_SHM_HDR *hdr = seg->hdr;
+    STATS_SHM_SLOT *sp;
+    STATS_SHM_SLOT *dead = 0;
+    STATS_SHM_SLOT *target;
+    STATS_RETIRED *rp;
+    char    label[STATS_LABEL_LEN];
+    int     name_count;
+    int     type;
+    int     cell;
+    int     ncells;
+    int     i;
+    int     n;
+
+    if (pid == STATS_PID_FREE || pid == STATS_PID_RETIRED)
+	msg_panic("stats_seg_retire: bad process ID %ld", pid);
+    if (seg->owner == 0)
+	msg_panic("stats_seg_retire: segment was not created by this process");
+
+    for (sp = seg->slots; sp < seg->slots + seg->slot_count; sp++)
+	if (sp->pid == pid)
+	    dead = sp;
+    if (dead == 0)
+	return;
+    memcpy(label, dead->label, sizeof(label));
+    label[sizeof(label) - 1] = 0;
+
+    /*
+     * Find the private totals for this label. There can be no more labels
+     * than slots, unless a process messed with the segment.
+     */
+    if (seg->retired == 0)
+	seg->retired = htable_create(10);
+    if ((rp = (STATS_RETIRED *) htable_find(seg->retired, label)) == 0) {
+	if (seg->retired->used >= seg->slot_count) {
+	    stats_seg_release(seg, dead);
+	    return;
+	}
+	rp = (STATS_RETIRED *) mymalloc(sizeof(*rp));
+	memset((void *) rp, 0, sizeof(*rp));
+	rp->slot = -1;
+	htable_enter(seg->retired, label, (void *) rp);
+    }
+
+    /*
+     * Discard gauge values; they describe a process that no longer exists.
+     * Add everything else to the private totals for this label. Copy each
+     * name table entry before checking it; it may change under our feet.
+     */
+    name_count = hdr->name_count;
+    STATS_BARRIER();
+    if (name_count < 0 || name_count > STATS_MAX_NAMES)
+	name_count = name_count < 0 ? 0 : STATS_MAX_NAMES;
+    for (i = 0; i < name_count; i++) {
+	type = hdr->names[i].type;
+	cell = hdr->names[i].cell;
+	if (type == STATS_TYPE_GAUGE || !STATS_TYPE_OK(type)
+	    || !STATS_CELL_OK(cell, type) || dead->used[i] == 0)
+	    continue;
+	ncells = STATS_NCELLS(type);
+	for (n = 0; n < ncells; n++)
+	    rp->cells[cell + n] += dead->cells[cell + n];
+	rp->used[i] = 1;
+    }
+
+    /*
+     * Publish the totals in the retired slot for this label, or turn this
+     * slot into the retired slot when there is none (or when a process
+     * took it over).
+     */
+    if (rp->slot >= 0 && seg->owner[rp->slot] == rp
+	&& seg->slots[rp->slot].pid == STATS_PID_RETIRED) {
+	target = seg->slots + rp->slot;
+	stats_seg_release(seg, dead);
+    } else {
+	target = dead;
+	if (seg->owner[target - seg->slots] != 0)
+	    seg->owner[target - seg->slots]->slot = -1;
+	rp->slot = target - seg->slots;
+	seg->owner[rp->slot] = rp;
+    }
+    memset(target->label, 0, sizeof(target->label));
+    strncpy(target->label, label, sizeof(target->label) - 1);
+    memcpy((void *) target->used, (void *) rp->used, sizeof(target->used));
+    memcpy((void *) target->cells, (void *) rp->cells, sizeof(target->cells));
+    STATS_BARRIER();
+    target->pid = STATS_PID_RETIRED;
+}
+
+/* stats_seg_walk - iterate over metrics */
+
+void    stats_seg_walk(STATS_SEG *seg, STATS_WALK_FN action, void *context)
+{
+    STATS_SHM_HDR *hdr = seg->hdr;
+    STATS_SHM_SLOT *sp;
+    STATS_SHM_NAME *np;
+    char    label[STATS_LABEL_LEN];
+    char    name[STATS_NAME_LEN];
+    int     name_count = hdr->name_count;
+    int     type;
+    int     cell;
+
+    STATS_BARRIER();
+    if (name_count < 0 || name_count > STATS_MAX_NAMES)
+	name_count = name_count < 0 ? 0 : STATS_MAX_NAMES;
+    for (sp = seg->slots; sp < seg->slots + seg->slot_count; sp++) {
+	if (sp->pid == STATS_PID_FREE)
+	    continue;
+	memcpy(label, sp->label, sizeof(label));
+	label[sizeof(label) - 1] = 0;
+	for (np = hdr->names; np < hdr->names + name_count; np++) {
+	    if (sp->used[np - hdr->names] == 0)
+		continue;
+	    type = np->type;
+	    cell = np->cell;
+	    if (!STATS_TYPE_OK(type) || !STATS_CELL_OK(cell, type))
+		continue;
+	    memcpy(name, np->name, sizeof(name));
+	    name[sizeof(name) - 1] = 0;
+	    action(label, name, type, sp->cells + cell, context);
+	}
+    }
+}
+
+/* stats_attach - claim a slot in an existing segment */
+
+int     stats_attach(const char *path, const char *label)
+{
+    STATS_SEG *seg;
+    STATS_SHM_SLOT *sp;
+    long    pid = getpid();
+
+    if (stats_slot != 0 && stats_slot->pid == pid)
+	return (0);
+    if ((seg = stats_seg_open(path, O_RDWR)) == 0)
+	return (-1);
+    if (myflock(seg->fd, INTERNAL_LOCK, MYFLOCK_OP_EXCLUSIVE) < 0) {
+	stats_seg_free(seg);
+	return (-1);
+    }
+    for (sp = seg->slots; sp < seg->slots + seg->slot_count; sp++) {
+	if (sp->pid == STATS_PID_FREE) {
+	    memset((void *) sp->used, 0, sizeof(sp->used));
+	    memset((void *) sp->cells, 0, sizeof(sp->cells));
+	    memset(sp->label, 0, sizeof(sp->label));
+	    strncpy(sp->label, label, sizeof(sp->label) - 1);
+	    STATS_BARRIER();
+	    sp->pid = pid;
+	    break;
+	}
+    }
+    if (myflock(seg->fd, INTERNAL_LOCK, MYFLOCK_OP_NONE) < 0)
+	msg_fatal("stats_attach: unlock segment: %m");
+    if (sp >= seg->slots + seg->hdr->slot_count) {
+	stats_seg_free(seg);
+	errno = ENOSPC;
+	return (-1);
+    }
+    if (stats_seg)
+	stats_seg_free(stats_seg);
+    stats_seg = seg;
+    stats_slot = sp;
+    return (0);
+}
+
+/* stats_register - look up or register metric */
+
+static STATS_CELL *stats_register(const char *name, int type, int ncells)
+{
+    STATS_SHM_HDR *hdr;
+    STATS_SHM_NAME *np;
+    STATS_CELL *cells = 0;
+    int     name_count;
+
+    if (stats_table == 0)
+	stats_table = htable_create(100);
+    if ((cells = (STATS_CELL *) htable_find(stats_table, name)) != 0)
+	return (cells);
+
+    /*
+     * Share the name with other processes if we can.
+     */
+    if (stats_slot != 0 && stats_slot->pid == getpid()
+	&& strlen(name) < STATS_NAME_LEN
+	&& myflock(stats_seg->fd, INTERNAL_LOCK, MYFLOCK_OP_EXCLUSIVE) == 0) {
+	hdr = stats_seg->hdr;
+	if ((name_count = hdr->name_count) < 0 || name_count > STATS_MAX_NAMES)
+	    name_count = STATS_MAX_NAMES;
+	for (np = hdr->names; np < hdr->names + name_count; np++) {
+	    if (strncmp(np->name, name, sizeof(np->name)) == 0) {
+		if (np->type == type && STATS_CELL_OK(np->cell, type))
+		    cells = stats_slot->cells + np->cell;
+		break;
+	    }
+	}
+	if (np == hdr->names + name_count
+	    && name_count < STATS_MAX_NAMES && hdr->cell_count >= 0
+	    && hdr->cell_count <= STATS_MAX_CELLS - ncells) {
+	    strncpy(np->name, name, sizeof(np->name));
+	    np->type = type;
+	    np->cell = hdr->cell_count;
+	    hdr->cell_count += ncells;
+	    STATS_BARRIER();
+	    hdr->name_count += 1;
+	    cells = stats_slot->cells + np->cell;
+	}
+	if (cells != 0)
+	    stats_slot->used[np - hdr->names] = 1;
+	if (myflock(stats_seg->fd, INTERNAL_LOCK, MYFLOCK_OP_NONE) < 0)
+	    msg_fatal("stats_register: unlock segment: %m");
+    }
+
+    /*
+     * Otherwise, keep the metric private.
+     */
+    if (cells == 0) {
+	cells = (STATS_CELL *) mymalloc(ncells * sizeof(*cells));
+	memset((void *) cells, 0, ncells * sizeof(*cells));
+    }
+    htable_enter(stats_table, name, (void *) cells);
+    return (cells);
+}
+
+/* stats_counter - look up or register counter */
+
+STATS_CELL *stats_counter(const char *name)
+{
+    return (stats_register(name, STATS_TYPE_COUNTER, 1));
+}
+
+/* stats_gauge - look up or register gauge */
+
+STATS_CELL *stats_gauge(const char *name)
+{
+    return (stats_register(name, STATS_TYPE_GAUGE, 1));
+}
+
+/* stats_histogram - look up or register histogram */
+
+STATS_CELL *stats_histogram(const char *name)
+{
+    return (stats_register(name, STATS_TYPE_HISTOGRAM, STATS_HIST_CELLS));
+}
+
+/* stats_observe - add histogram observation */
+
+void    stats_observe(STATS_CELL *cells, unsigned long value)
+{
+    int     n;
+
+    for (n = 0; n < STATS_HIST_BUCKETS - 1 && value > (1UL << n); n++)
+	 /* void */ ;
+    STATS_HIST_COUNT(cells) += 1;
+    STATS_HIST_SUM(cells) += value;
+    STATS_HIST_BUCKET(cells, n) += 1;
+}
+
+/* stats_quantile - approximate histogram quantile */
+
+int     stats_quantile(const STATS_CELL *cells, int percent)
+{
+    unsigned long want;
+    unsigned long seen = 0;
+    int     n;
+
+    want = (STATS_HIST_COUNT(cells) * percent + 99) / 100;
+    for (n = 0; n < STATS_HIST_BUCKETS - 1; n++)
+	if ((seen += STATS_HIST_BUCKET(cells, n)) >= want)
+	    break;
+    return (n);
+}
+
+#ifdef TEST
+
+ /*
+  * Self-test. Child processes attach to a segment, register and update
+  * metrics, and terminate; the parent retires them and checks what a
+  * reader would see. The last test lets a child scribble over the shared
+  * header, and verifies that the parent and readers are not misled.
+  */
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <vstream.h>
+#include <vstring.h>
+#include <msg_vstream.h>
+
+#define TEST_PATH	"stats_test.seg"
+#define TEST_SLOTS	4
+
+typedef struct {
+    const char *label;			/* in */
+    const char *name;			/* in */
+    int     type;			/* out */
+    unsigned long value;		/* out */
+    int     found;			/* out */
+    int     names;			/* out */
+} TEST_FIND;
+
+static int failures;
+
+/* find - walk callback */
+
+static void find(const char *label, const char *name, int type,
+		         const STATS_CELL *cells, void *context)
+{
+    TEST_FIND *fp = (TEST_FIND *) context;
+
+    if (strcmp(label, fp->label) != 0)
+	return;
+    fp->names += 1;
+    if (strcmp(name, fp->name) == 0) {
+	fp->found += 1;
+	fp->type = type;
+	fp->value = (type == STATS_TYPE_HISTOGRAM ?
+		     STATS_HIST_COUNT(cells) : cells[0]);
+    }
+}
+
+/* expect - check one metric as a reader would see it */
+
+static void expect(STATS_SEG *seg, const char *test, const char *label,
+		           const char *name, int found, unsigned long value)
+{
+    TEST_FIND f;
+
+    f.label = label;
+    f.name = name;
+    f.found = f.names = 0;
+    f.value = 0;
+    stats_seg_walk(seg, find, (void *) &f);
+    if (f.found != found || (found && f.value != value)) {
+	msg_warn("%s: %s %s: want %d x %lu, got %d x %lu",
+		 test, label, name, found, value, f.found, f.value);
+	failures++;
+    } else {
+	msg_info("%s: %s %s: ok", test, label, name);
+    }
+}
+
+/* count_names - count metrics of one label */
+
+static int count_names(STATS_SEG *seg, const char *label)
+{
+    TEST_FIND f;
+
+    f.label = label;
+    f.name = "";
+    f.found = f.names = 0;
+    stats_seg_walk(seg, find, (void *) &f);
+    return (f.names);
+}
+
+/* run - run child and retire it */
+
+static void run(STATS_SEG *seg, const char *label, void (*action) (void))
+{
+    WAIT_STATUS_T status;
+    pid_t   pid;
+
+    if ((pid = fork()) < 0)
+	msg_fatal("fork: %m");
+    if (pid == 0) {
+	if (stats_attach(TEST_PATH, label) < 0)
+	    msg_fatal("stats_attach: %m");
+	action();
+	_exit(0);
+    }
+    if (waitpid(pid, &status, 0) < 0)
+	msg_fatal("waitpid: %m");
+    if (!NORMAL_EXIT_STATUS(status)) {
+	msg_warn("%s: child failed", label);
+	failures++;
+    }
+    stats_seg_retire(seg, (long) pid);
+}
+
+/* child_basic - register and update one of each */
+
+static void child_basic(void)
+{
+    STATS_ADD(stats_counter("requests_total"), 3);
+    STATS_SET(stats_gauge("active"), 7);
+    stats_observe(stats_histogram("delay_milliseconds"), 5);
+}
+
+/* child_overflow - register more names than fit */
+
+static void child_overflow(void)
+{
+    VSTRING *buf = vstring_alloc(100);
+    STATS_CELL *cells;
+    char   *lo = (char *) stats_seg->slots;
+    char   *hi = (char *) (stats_seg->slots + stats_seg->slot_count);
+    int     nprivate = 0;
+    int     n;
+
+    for (n = 0; n < STATS_MAX_NAMES + 10; n++) {
+	vstring_sprintf(buf, "overflow_%d_total", n);
+	cells = stats_counter(vstring_str(buf));
+	STATS_INC(cells);
+	if ((char *) cells < lo || (char *) cells >= hi)
+	    nprivate++;
+    }
+
+    /*
+     * The other tests registered three names; the rest don't fit.
+     */
+    if (nprivate != 3 + 10)
+	msg_fatal("child_overflow: %d private counters", nprivate);
+    vstring_free(buf);
+}
+
+/* child_scribble - corrupt the shared header */
+
+static void child_scribble(void)
+{
+    STATS_INC(stats_counter("requests_total"));
+    stats_seg->hdr->slot_count = 1000000;
+    stats_seg->hdr->name_count = -1;
+    stats_seg->hdr->names[0].cell = STATS_MAX_CELLS;
+    stats_seg->hdr->names[1].cell = -1;
+    stats_seg->hdr->names[2].type = 42;
+}
+
+int     main(int argc, char **argv)
+{
+    STATS_SEG *seg;
+    STATS_SEG *reader;
+
+    msg_vstream_init(argv[0], VSTREAM_ERR);
+    if ((seg = stats_seg_create(TEST_PATH, TEST_SLOTS)) == 0)
+	msg_fatal("create %s: %m", TEST_PATH);
+
+    /*
+     * Register, attach, retire, and walk.
+     */
+    run(seg, "basic", child_basic);
+    expect(seg, "retire", "basic", "requests_total", 1, 3);
+    expect(seg, "retire", "basic", "delay_milliseconds", 1, 1);
+    expect(seg, "retire", "basic", "active", 0, 0);
+
+    /*
+     * Fold into the existing retired slot.
+     */
+    run(seg, "basic", child_basic);
+    expect(seg, "fold", "basic", "requests_total", 1, 6);
+    expect(seg, "fold", "basic", "delay_milliseconds", 1, 2);
+    expect(seg, "fold", "basic", "active", 0, 0);
+
+    /*
+     * Name table overflow: the excess names are private.
+     */
+    run(seg, "overflow", child_overflow);
+    if (count_names(seg, "overflow") != STATS_MAX_NAMES - 3) {
+	msg_warn("overflow: %d names", count_names(seg, "overflow"));
+	failures++;
+    }
+    expect(seg, "overflow", "overflow", "overflow_0_total", 1, 1);
+    expect(seg, "overflow", "overflow", "overflow_260_total", 0, 0);
+    expect(seg, "overflow", "basic", "requests_total", 1, 6);
+
+    /*
+     * A process that corrupts the header.
+     */
+    run(seg, "basic", child_scribble);
+    if ((reader = stats_seg_open(TEST_PATH, O_RDONLY)) != 0) {
+	msg_warn("scribble: opened corrupted segment");
+	stats_seg_free(reader);
+	failures++;
+    }
+    expect(seg, "scribble", "basic", "requests_total", 0, 0);
+    expect(seg, "scribble", "basic", "active", 0, 0);
+    seg->hdr->slot_count = TEST_SLOTS;
+    seg->hdr->name_count = STATS_MAX_NAMES;
+    seg->hdr->names[0].cell = 0;
+    expect(seg, "scribble", "basic", "requests_total", 1, 6);
+
+    stats_seg_free(seg);
+    (void) unlink(TEST_PATH);
+    if (failures)
+	msg_fatal("%d failures", failures);
+    return (0);
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef _STATS_H_INCLUDED_
+#define _STATS_H_INCLUDED_
+
+/*++
+/* NAME
+/*	stats 3h
+/* SUMMARY
+/*	shared-memory counter and histogram registry
+/* SYNOPSIS
+/*	#include <stats.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * Process interface.
+  */
+typedef unsigned long STATS_CELL;
+
+extern int stats_attach(const char *, const char *);
+extern STATS_CELL *stats_counter(const char *);
+extern STATS_CELL *stats_gauge(const char *);
+extern STATS_CELL *stats_histogram(const char *);
+extern void stats_observe(STATS_CELL *, unsigned long);
+extern int stats_quantile(const STATS_CELL *, int);
+
+#define STATS_ADD(c, n)		((c)[0] += (n))
+#define STATS_INC(c)		((c)[0] += 1)
+#define STATS_SET(c, v)		((c)[0] = (v))
+
+ /*
+  * Metric types.
+  */
+#define STATS_TYPE_COUNTER	1
+#define STATS_TYPE_GAUGE	2
+#define STATS_TYPE_HISTOGRAM	3
+
+ /*
+  * Histogram cells: observation count, sum, and buckets with upper bounds
+  * 1, 2, 4, ..., 2^(STATS_HIST_BUCKETS-2), followed by an overflow bucket.
+  * Buckets are not cumulative.
+  */
+#define STATS_HIST_BUCKETS	17
+#define STATS_HIST_CELLS	(2 + STATS_HIST_BUCKETS)
+#define STATS_HIST_COUNT(c)	((c)[0])
+#define STATS_HIST_SUM(c)	((c)[1])
+#define STATS_HIST_BUCKET(c, i)	((c)[2 + (i)])
+
+ /*
+  * Segment interface, for the segment owner and for readers.
+  */
+typedef struct STATS_SEG STATS_SEG;
+typedef void (*STATS_WALK_FN) (const char *, const char *, int,
+			               const STATS_CELL *, void *);
+
+extern STATS_SEG *stats_seg_create(const char *, int);
+extern STATS_SEG *stats_seg_open(const char *, int);
+extern void stats_seg_retire(STATS_SEG *, long);
+extern void stats_seg_walk(STATS_SEG *, STATS_WALK_FN, void *);
+extern void stats_seg_free(STATS_SEG *);
+
+#define STATS_NAME_LEN		80
+#define STATS_LABEL_LEN		32
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+#endif
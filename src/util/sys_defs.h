@@ -22,6 +22,10 @@
 #ifdef SUNOS5
 #define _SVID_GETTOD			/* Solaris 2.5, XSH4.2 versus SVID */
 #endif
+#if (defined(LINUX2) || defined(LINUX3) || defined(LINUX4) \
+	|| defined(LINUX5)) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE			/* HAS_DLADDR */
+#endif
 #include <sys/types.h>
 
  /*
@@ -73,6 +77,12 @@
 #define HAS_POSIX_REGEXP
 #define HAS_ST_GEN			/* struct stat contains inode
 					 * generation number */
+#if (defined(__FreeBSD_version) && __FreeBSD_version >= 460102) \
+    || (defined(OpenBSD) && OpenBSD >= 200311) \
+    || (defined(__NetBSD_Version__) && __NetBSD_Version__ >= 599002100) \
+    || defined(DRAGONFLY)
+#define HAS_GETPEEREID
+#endif
 #define NATIVE_SENDMAIL_PATH "/usr/sbin/sendmail"
 #define NATIVE_MAILQ_PATH "/usr/bin/mailq"
 #define NATIVE_NEWALIAS_PATH "/usr/bin/newaliases"
@@ -247,6 +257,7 @@
 #define HAVE_GETIFADDRS
 #endif
 #define HAS_FUTIMES			/* XXX Guessing */
+#define HAS_GETPEEREID
 #define NATIVE_SENDMAIL_PATH "/usr/sbin/sendmail"
 #define NATIVE_MAILQ_PATH "/usr/bin/mailq"
 #define NATIVE_NEWALIAS_PATH "/usr/bin/newaliases"
@@ -774,6 +785,7 @@ extern int initgroups(const char *, int);
 #define PREPEND_PLUS_TO_OPTSTRING
 #define HAS_POSIX_REGEXP
 #define HAS_DLOPEN
+#define HAS_DLADDR				/* see _GNU_SOURCE above */
 #define NATIVE_SENDMAIL_PATH "/usr/sbin/sendmail"
 #define NATIVE_MAILQ_PATH "/usr/bin/mailq"
 #define NATIVE_NEWALIAS_PATH "/usr/bin/newaliases"
@@ -792,6 +804,13 @@ extern int initgroups(const char *, int);
 #else
 #define NO_SNPRINTF
 #endif
+#if HAVE_GLIBC_API_VERSION_SUPPORT(2, 6)
+#define HAS_SYNC_FILE_RANGE		/* introduced in kernel 2.6.17 */
+#endif
+#if HAVE_GLIBC_API_VERSION_SUPPORT(2, 4)
+#define HAS_INOTIFY			/* introduced in kernel 2.6.13 */
+#endif
+#define HAS_SO_PEERCRED
 #ifndef NO_IPV6
 #define HAS_IPV6
 #if HAVE_GLIBC_API_VERSION_SUPPORT(2, 4)
@@ -0,0 +1,84 @@
+/*++
+/* NAME
+/*	unix_peer_cred 3
+/* SUMMARY
+/*	get UNIX-domain peer credentials
+/* SYNOPSIS
+/*	#include <unix_peer_cred.h>
+/*
+/*	int	unix_peer_cred(fd, uidp, gidp)
+/*	int	fd;
+/*	uid_t	*uidp;
+/*	gid_t	*gidp;
+/* DESCRIPTION
+/*	unix_peer_cred() looks up the effective user and group ID
+/*	of the process at the other end of a connected UNIX-domain
+/*	stream socket. The information is provided by the kernel,
+/*	and reflects the peer's credentials at the time that the
+/*	connection was established.
+/*
+/*	Arguments:
+/* .IP fd
+/*	File descriptor for a connected UNIX-domain stream socket.
+/* .IP uidp
+/*	Pointer to storage for the peer's effective user ID.
+/* .IP gidp
+/*	Null pointer, or pointer to storage for the peer's effective
+/*	group ID.
+/* DIAGNOSTICS
+/*	The result is zero in case of success, -1 in case of error
+/*	(errno is set to ENOSYS on systems without support for this
+/*	operation).
+/* SEE ALSO
+/*	getsockopt(2), SO_PEERCRED
+/*	getpeereid(3), BSD peer credentials
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#define _GNU_SOURCE			/* struct ucred */
+#include <sys_defs.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+
+/* Utility library. */
+
+#include <unix_peer_cred.h>
+
+/* unix_peer_cred - get peer credentials */
+
+int     unix_peer_cred(int fd, uid_t *uidp, gid_t *gidp)
+{
+#if defined(HAS_SO_PEERCRED)
+    struct ucred cred;
+    SOCKOPT_SIZE len = sizeof(cred);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, (void *) &cred, &len) < 0)
+	return (-1);
+    *uidp = cred.uid;
+    if (gidp)
+	*gidp = cred.gid;
+    return (0);
+#elif defined(HAS_GETPEEREID)
+    gid_t   gid;
+
+    if (getpeereid(fd, uidp, &gid) < 0)
+	return (-1);
+    if (gidp)
+	*gidp = gid;
+    return (0);
+#else
+    errno = ENOSYS;
+    return (-1);
+#endif
+}
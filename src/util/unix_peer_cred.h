@@ -0,0 +1,30 @@
+#ifndef _UNIX_PEER_CRED_H_INCLUDED_
+#define _UNIX_PEER_CRED_H_INCLUDED_
+
+/*++
+/* NAME
+/*	unix_peer_cred 3h
+/* SUMMARY
+/*	get UNIX-domain peer credentials
+/* SYNOPSIS
+/*	#include <unix_peer_cred.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * External interface.
+  */
+extern int unix_peer_cred(int, uid_t *, gid_t *);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+#endif
@@ -0,0 +1,254 @@
+/*++
+/* NAME
+/*	work_pool 3
+/* SUMMARY
+/*	ordered request/reply pool of worker processes
+/* SYNOPSIS
+/*	#include <work_pool.h>
+/*
+/*	WORK_POOL *work_pool_create(count, service, context)
+/*	int	count;
+/*	void	(*service)(VSTRING *request, VSTRING *reply,
+/*				void *context);
+/*	void	*context;
+/*
+/*	void	work_pool_request(pool, data, len)
+/*	WORK_POOL *pool;
+/*	const char *data;
+/*	ssize_t	len;
+/*
+/*	int	work_pool_full(pool)
+/*	WORK_POOL *pool;
+/*
+/*	int	work_pool_reply(pool, reply)
+/*	WORK_POOL *pool;
+/*	VSTRING	*reply;
+/*
+/*	void	work_pool_free(pool)
+/*	WORK_POOL *pool;
+/* DESCRIPTION
+/*	This module runs a blocking service function in several
+/*	child processes at the same time, for programs that must
+/*	make many slow requests, such as table lookups over the
+/*	network. Replies are returned in the order of the requests.
+/*
+/*	work_pool_create() forks the specified number of worker
+/*	processes. Each worker calls the service function once for
+/*	each request, with the request data, a buffer for the reply,
+/*	and the application context. A worker terminates when the
+/*	pool is destroyed. Workers inherit the parent's state at
+/*	the time of the call; for example, they must open their own
+/*	network connections.
+/*
+/*	work_pool_request() sends a request to the next worker
+/*	process. The request and reply data may contain null bytes.
+/*	This must not be called when work_pool_full() returns true.
+/*
+/*	work_pool_full() returns true when each worker has a request
+/*	outstanding.
+/*
+/*	work_pool_reply() waits for the reply to the oldest outstanding
+/*	request. The result is zero when no request is outstanding.
+/*
+/*	work_pool_free() terminates the worker processes, and waits
+/*	for them to exit.
+/* DIAGNOSTICS
+/*	Fatal errors: out of resources, a worker process terminates
+/*	unexpectedly. Problems in a worker process are reported by
+/*	the worker itself.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <errno.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <iostuff.h>
+#include <vstream.h>
+#include <vstring.h>
+#include <vstring_vstream.h>
+#include <work_pool.h>
+
+ /*
+  * Each worker has at most one request outstanding. Requests go to workers
+  * in round-robin order, so that the oldest outstanding request is always
+  * that of worker (next - busy) modulo count.
+  */
+typedef struct {
+    pid_t   pid;			/* worker process */
+    VSTREAM *stream;			/* duplex pipe */
+} WORK_POOL_WORKER;
+
+struct WORK_POOL {
+    WORK_POOL_WORKER *workers;		/* worker processes */
+    int     count;			/* number of workers */
+    int     next;			/* next worker for a request */
+    int     busy;			/* outstanding requests */
+};
+
+/* work_pool_send - send length-prefixed message */
+
+static int work_pool_send(VSTREAM *stream, const char *data, ssize_t len)
+{
+    vstream_fprintf(stream, "%ld\n", (long) len);
+    if (len > 0)
+	vstream_fwrite(stream, data, len);
+    return (vstream_fflush(stream));
+}
+
+/* work_pool_recv - receive length-prefixed message */
+
+static int work_pool_recv(VSTREAM *stream, VSTRING *buf)
+{
+    char   *end;
+    long    len;
+
+    if (vstring_get_nonl(buf, stream) == VSTREAM_EOF)
+	return (-1);
+    len = strtol(vstring_str(buf), &end, 10);
+    if (*end != 0 || len < 0)
+	return (-1);
+    if (vstream_fread_buf(stream, buf, len) != len)
+	return (-1);
+    VSTRING_TERMINATE(buf);
+    return (0);
+}
+
+/* work_pool_worker - worker process main loop */
+
+static NORETURN work_pool_worker(VSTREAM *stream, WORK_POOL_FN service,
+				         void *context)
+{
+    VSTRING *request = vstring_alloc(100);
+    VSTRING *reply = vstring_alloc(100);
+
+    while (work_pool_recv(stream, request) == 0) {
+	VSTRING_RESET(reply);
+	service(request, reply, context);
+	if (work_pool_send(stream, vstring_str(reply), VSTRING_LEN(reply)) != 0)
+	    break;
+    }
+    vstream_fflush(VSTREAM_OUT);
+    _exit(0);
+}
+
+/* work_pool_create - fork worker processes */
+
+WORK_POOL *work_pool_create(int count, WORK_POOL_FN service, void *context)
+{
+    WORK_POOL *pool;
+    WORK_POOL_WORKER *wp;
+    int     sock[2];
+    int     n;
+
+    if (count <= 0)
+	msg_panic("work_pool_create: bad worker count: %d", count);
+
+    pool = (WORK_POOL *) mymalloc(sizeof(*pool));
+    pool->workers = (WORK_POOL_WORKER *) mymalloc(sizeof(*wp) * count);
+    pool->count = count;
+    pool->next = 0;
+    pool->busy = 0;
+
+    /*
+     * Flush output before fork(), so that it is not duplicated by a child.
+     */
+    vstream_fflush(VSTREAM_OUT);
+    for (n = 0; n < count; n++) {
+	wp = pool->workers + n;
+	if (duplex_pipe(sock) < 0)
+	    msg_fatal("duplex_pipe: %m");
+	switch (wp->pid = fork()) {
+	case -1:
+	    msg_fatal("fork: %m");
+	case 0:
+	    /* Don't hold on to our siblings' pipes. */
+	    while (--n >= 0)
+		(void) vstream_fclose(pool->workers[n].stream);
+	    (void) close(sock[0]);
+	    work_pool_worker(vstream_fdopen(sock[1], O_RDWR), service, context);
+	    /* NOTREACHED */
+	default:
+	    (void) close(sock[1]);
+	    wp->stream = vstream_fdopen(sock[0], O_RDWR);
+	    close_on_exec(sock[0], CLOSE_ON_EXEC);
+	    break;
+	}
+    }
+    return (pool);
+}
+
+/* work_pool_full - all workers are busy */
+
+int     work_pool_full(WORK_POOL *pool)
+{
+    return (pool->busy >= pool->count);
+}
+
+/* work_pool_request - send request to next worker */
+
+void    work_pool_request(WORK_POOL *pool, const char *data, ssize_t len)
+{
+    WORK_POOL_WORKER *wp;
+
+    if (work_pool_full(pool))
+	msg_panic("work_pool_request: all workers are busy");
+    wp = pool->workers + pool->next;
+    if (work_pool_send(wp->stream, data, len) != 0)
+	msg_fatal("worker process %ld: send request: %m", (long) wp->pid);
+    pool->next = (pool->next + 1) % pool->count;
+    pool->busy += 1;
+}
+
+/* work_pool_reply - receive oldest reply */
+
+int     work_pool_reply(WORK_POOL *pool, VSTRING *reply)
+{
+    WORK_POOL_WORKER *wp;
+
+    if (pool->busy == 0)
+	return (0);
+    wp = pool->workers
+	+ (pool->next - pool->busy + pool->count) % pool->count;
+    if (work_pool_recv(wp->stream, reply) != 0)
+	msg_fatal("worker process %ld terminated unexpectedly", (long) wp->pid);
+    pool->busy -= 1;
+    return (1);
+}
+
+/* work_pool_free - terminate workers */
+
+void    work_pool_free(WORK_POOL *pool)
+{
+    WORK_POOL_WORKER *wp;
+    VSTRING *junk = vstring_alloc(100);
+    int     status;
+
+    while (work_pool_reply(pool, junk))
+	 /* void */ ;
+    for (wp = pool->workers; wp < pool->workers + pool->count; wp++)
+	(void) vstream_fclose(wp->stream);
+    for (wp = pool->workers; wp < pool->workers + pool->count; wp++)
+	while (waitpid(wp->pid, &status, 0) < 0 && errno == EINTR)
+	     /* void */ ;
+    myfree((void *) pool->workers);
+    myfree((void *) pool);
+    vstring_free(junk);
+}
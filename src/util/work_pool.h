@@ -0,0 +1,42 @@
+#ifndef _WORK_POOL_H_INCLUDED_
+#define _WORK_POOL_H_INCLUDED_
+
+/*++
+/* NAME
+/*	work_pool 3h
+/* SUMMARY
+/*	ordered request/reply pool of worker processes
+/* SYNOPSIS
+/*	#include <work_pool.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * Utility library.
+  */
+#include <vstring.h>
+
+ /*
+  * External interface.
+  */
+typedef struct WORK_POOL WORK_POOL;
+typedef void (*WORK_POOL_FN) (VSTRING *, VSTRING *, void *);
+
+extern WORK_POOL *work_pool_create(int, WORK_POOL_FN, void *);
+extern void work_pool_request(WORK_POOL *, const char *, ssize_t);
+extern int work_pool_reply(WORK_POOL *, VSTRING *);
+extern int work_pool_full(WORK_POOL *);
+extern void work_pool_free(WORK_POOL *);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+#endif
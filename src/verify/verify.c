@@ -115,6 +115,12 @@
 /* .IP "\fBaddress_verify_cache_cleanup_interval (12h)\fR"
 /*	The amount of time between \fBverify\fR(8) address verification
 /*	database cleanup runs.
+/* .PP
+/*	Available in Postfix 3.5 and later:
+/* .IP "\fBaddress_verify_cache_cleanup_budget (10)\fR"
+/*	The amount of time in milliseconds that an address verification
+/*	database cleanup run may spend before \fBverify\fR(8) handles
+/*	other requests.
 /* PROBE MESSAGE ROUTING CONTROLS
 /* .ad
 /* .fi
@@ -270,6 +276,7 @@ int     var_verify_pos_try;
 int     var_verify_neg_exp;
 int     var_verify_neg_try;
 int     var_verify_scan_cache;
+int     var_verify_scan_budget;
 
  /*
   * State.
@@ -656,6 +663,7 @@ static void post_jail_init(char *unused_name, char **unused_argv)
 	dict_cache_control(verify_map,
 			   CA_DICT_CACHE_CTL_FLAGS(cache_flags),
 			   CA_DICT_CACHE_CTL_INTERVAL(var_verify_scan_cache),
+			   CA_DICT_CACHE_CTL_BUDGET(var_verify_scan_budget),
 			CA_DICT_CACHE_CTL_VALIDATOR(verify_cache_validator),
 		     CA_DICT_CACHE_CTL_CONTEXT((void *) vstring_alloc(100)),
 			   CA_DICT_CACHE_CTL_END);
@@ -742,6 +750,10 @@ int     main(int argc, char **argv)
 	VAR_VERIFY_SENDER_TTL, DEF_VERIFY_SENDER_TTL, &var_verify_sender_ttl, 0, 0,
 	0,
     };
+    static const CONFIG_INT_TABLE int_table[] = {
+	VAR_VERIFY_SCAN_BUDGET, DEF_VERIFY_SCAN_BUDGET, &var_verify_scan_budget, 0, 0,
+	0,
+    };
 
     /*
      * Fingerprint executables and core dumps.
@@ -750,6 +762,7 @@ int     main(int argc, char **argv)
 
     multi_server_main(argc, argv, verify_service,
 		      CA_MAIL_SERVER_STR_TABLE(str_table),
+		      CA_MAIL_SERVER_INT_TABLE(int_table),
 		      CA_MAIL_SERVER_TIME_TABLE(time_table),
 		      CA_MAIL_SERVER_PRE_INIT(pre_jail_init),
 		      CA_MAIL_SERVER_POST_INIT(post_jail_init),
@@ -9,18 +9,46 @@
 /*	int	deliver_maildir(state, usr_attr)
 /*	LOCAL_STATE state;
 /*	USER_ATTR usr_attr;
+/*
+/*	void	maildir_batch_init(limit)
+/*	int	limit;
+/*
+/*	int	maildir_batch_queued()
+/*
+/*	int	maildir_batch_finish()
 /* DESCRIPTION
 /*	deliver_maildir() delivers a message to a qmail-style maildir.
 /*
+/*	maildir_batch_init() enables batch mode for the current
+/*	delivery request. In this mode, deliver_maildir() writes the
+/*	message to a maildir tmp/ file, and postpones the fsync() and
+/*	the move into new/ until up to \fIlimit\fR files are pending.
+/*	Those files are then flushed to stable storage as a group,
+/*	moved into place, and only then are their delivery status
+/*	reports sent and their recipients marked as done in the queue
+/*	file. The durability guarantees are therefore the same as
+/*	without batch mode.
+/*
+/*	maildir_batch_queued() returns the number of deliveries that
+/*	were postponed since maildir_batch_init(). A caller can use
+/*	this to find out if the status of a recipient is still pending.
+/*
+/*	maildir_batch_finish() completes all pending deliveries,
+/*	disables batch mode, and returns the combined delivery status
+/*	of all postponed deliveries.
+/*
 /*	Arguments:
 /* .IP state
 /*	The attributes that specify the message, recipient and more.
 /* .IP usr_attr
 /*	Attributes describing user rights and environment information.
+/* .IP limit
+/*	The maximal number of pending deliveries.
 /* DIAGNOSTICS
 /*	deliver_maildir() always succeeds or it bounces the message.
 /* SEE ALSO
 /*	bounce(3)
+/*	fsync_batch(3)
 /* LICENSE
 /* .ad
 /* .fi
@@ -53,6 +81,7 @@
 #include <get_hostname.h>
 #include <sane_fsops.h>
 #include <warn_stat.h>
+#include <fsync_batch.h>
 
 /* Global library. */
 
@@ -63,11 +92,209 @@
 #include <mail_params.h>
 #include <mbox_open.h>
 #include <dsn_util.h>
+#include <deliver_completed.h>
+#include <sys_exits.h>
 
 /* Application-specific. */
 
 #include "virtual.h"
 
+ /*
+  * A maildir delivery whose fsync() and status report are postponed. All
+  * the DELIVER_ATTR string attributes point into the delivery request, so
+  * they remain valid until the request is finished.
+  */
+typedef struct {
+    DELIVER_ATTR msg_attr;		/* message/recipient attributes */
+    DELIVER_REQUEST *request;		/* as from queue manager */
+    USER_ATTR usr_attr;			/* maildir owner */
+    char   *tmpfile;			/* tmp/ pathname */
+    char   *newfile;			/* new/ pathname */
+    char   *newdir;			/* for make_dirs() */
+    char   *curdir;			/* for make_dirs() */
+    int     fd;				/* still open tmp/ file */
+} MAILDIR_PENDING;
+
+static MAILDIR_PENDING *maildir_pending;
+static int maildir_batch_limit;		/* zero: no batch mode */
+static int maildir_batch_len;		/* pending deliveries */
+static int maildir_batch_count;		/* postponed since init */
+static int maildir_batch_status;	/* combined status */
+
+/* maildir_link - move file from tmp/ to new/ */
+
+static int maildir_link(const char *tmpfile, const char *newfile,
+			        const char *newdir, const char *curdir,
+			        DSN_BUF *why)
+{
+    if (sane_link(tmpfile, newfile) < 0
+	&& (errno != ENOENT
+	    || (make_dirs(curdir, 0700), make_dirs(newdir, 0700)) < 0
+	    || sane_link(tmpfile, newfile) < 0)) {
+	dsb_simple(why, mbox_dsn(errno, "4.2.0"),
+		   "create maildir file %s: %m", newfile);
+	return (MAIL_COPY_STAT_WRITE);
+    }
+    return (0);
+}
+
+/* maildir_status - bounce, defer, or report success */
+
+static int maildir_status(DELIVER_ATTR msg_attr, DELIVER_REQUEST *request,
+			          USER_ATTR usr_attr, int mail_copy_status)
+{
+    DSN_BUF *why = msg_attr.why;
+
+    /*
+     * The maildir location is controlled by the mail administrator. If
+     * delivery fails, try again later. We would just bounce when the maildir
+     * location possibly under user control.
+     */
+    if (mail_copy_status & MAIL_COPY_STAT_CORRUPT) {
+	return (DEL_STAT_DEFER);
+    } else if (mail_copy_status != 0) {
+	if (errno == EACCES) {
+	    msg_warn("maildir access problem for UID/GID=%lu/%lu: %s",
+		     (long) usr_attr.uid, (long) usr_attr.gid,
+		     STR(why->reason));
+	    msg_warn("perhaps you need to create the maildirs in advance");
+	}
+	vstring_sprintf_prepend(why->reason, "maildir delivery failed: ");
+	return ((STR(why->status)[0] == '4' ?
+		 defer_append : bounce_append)
+		(BOUNCE_FLAGS(request), BOUNCE_ATTR(msg_attr)));
+    } else {
+	dsb_simple(why, "2.0.0", "delivered to maildir");
+	return (sent(BOUNCE_FLAGS(request), SENT_ATTR(msg_attr)));
+    }
+}
+
+/* maildir_batch_flush - complete all pending deliveries */
+
+static void maildir_batch_flush(void)
+{
+    MAILDIR_PENDING *mp;
+    int    *fds;
+    int    *errs;
+    int     mail_copy_status;
+    int     rcpt_stat;
+    int     saved_errno;
+    int     n;
+
+    if (maildir_batch_len == 0)
+	return;
+
+    /*
+     * Flush all tmp/ files to stable storage in one go.
+     */
+    fds = (int *) mymalloc(sizeof(*fds) * maildir_batch_len);
+    errs = (int *) mymalloc(sizeof(*errs) * maildir_batch_len);
+    for (n = 0; n < maildir_batch_len; n++)
+	fds[n] = maildir_pending[n].fd;
+    (void) fsync_batch(fds, errs, maildir_batch_len);
+
+    /*
+     * Move each file into place, and only then report its delivery status.
+     * Mark a recipient as done only after its status is known.
+     */
+    for (n = 0; n < maildir_batch_len; n++) {
+	mp = maildir_pending + n;
+	if (close(mp->fd) < 0 && errs[n] == 0)
+	    errs[n] = errno;
+	set_eugid(mp->usr_attr.uid, mp->usr_attr.gid);
+	if (errs[n] != 0) {
+	    errno = errs[n];
+	    dsb_unix(mp->msg_attr.why, mbox_dsn(errno, "5.3.0"),
+		     sys_exits_detail(EX_IOERR)->text,
+		     "error writing message: %m");
+	    mail_copy_status = MAIL_COPY_STAT_WRITE;
+	} else {
+	    mail_copy_status = maildir_link(mp->tmpfile, mp->newfile,
+					    mp->newdir, mp->curdir,
+					    mp->msg_attr.why);
+	}
+	saved_errno = errno;
+	if (unlink(mp->tmpfile) < 0)
+	    msg_warn("remove %s: %m", mp->tmpfile);
+	set_eugid(var_owner_uid, var_owner_gid);
+	errno = saved_errno;
+	rcpt_stat = maildir_status(mp->msg_attr, mp->request, mp->usr_attr,
+				   mail_copy_status);
+	if (rcpt_stat == 0 && (mp->request->flags & DEL_REQ_FLAG_SUCCESS))
+	    deliver_completed(mp->msg_attr.fp, mp->msg_attr.rcpt.offset);
+	maildir_batch_status |= rcpt_stat;
+	myfree(mp->tmpfile);
+	myfree(mp->newfile);
+	myfree(mp->newdir);
+	myfree(mp->curdir);
+    }
+    myfree((void *) fds);
+    myfree((void *) errs);
+    maildir_batch_len = 0;
+}
+
+/* maildir_batch_append - postpone fsync() and status report */
+
+static void maildir_batch_append(LOCAL_STATE state, USER_ATTR usr_attr,
+			             char *tmpfile, char *newfile,
+				         char *newdir, char *curdir, int fd)
+{
+    MAILDIR_PENDING *mp;
+
+    if (maildir_batch_len >= maildir_batch_limit)
+	maildir_batch_flush();
+    mp = maildir_pending + maildir_batch_len++;
+    mp->msg_attr = state.msg_attr;
+    mp->msg_attr.user = 0;			/* not saved */
+    mp->request = state.request;
+    mp->usr_attr = usr_attr;
+    mp->usr_attr.mailbox = 0;			/* not saved */
+    mp->tmpfile = tmpfile;
+    mp->newfile = newfile;
+    mp->newdir = newdir;
+    mp->curdir = curdir;
+    mp->fd = fd;
+    maildir_batch_count++;
+}
+
+/* maildir_batch_init - enable batch mode */
+
+void    maildir_batch_init(int limit)
+{
+    const char *myname = "maildir_batch_init";
+
+    if (maildir_batch_limit != 0)
+	msg_panic("%s: missing maildir_batch_finish() call", myname);
+    if (limit <= 0)
+	msg_panic("%s: bad limit: %d", myname, limit);
+    maildir_pending = (MAILDIR_PENDING *)
+	mymalloc(sizeof(*maildir_pending) * limit);
+    maildir_batch_limit = limit;
+    maildir_batch_len = 0;
+    maildir_batch_count = 0;
+    maildir_batch_status = 0;
+}
+
+/* maildir_batch_queued - number of postponed deliveries */
+
+int     maildir_batch_queued(void)
+{
+    return (maildir_batch_count);
+}
+
+/* maildir_batch_finish - complete pending deliveries, disable batch mode */
+
+int     maildir_batch_finish(void)
+{
+    if (maildir_batch_limit == 0)
+	return (0);
+    maildir_batch_flush();
+    myfree((void *) maildir_pending);
+    maildir_pending = 0;
+    maildir_batch_limit = 0;
+    return (maildir_batch_status);
+}
+
 /* deliver_maildir - delivery to maildir-style mailbox */
 
 int     deliver_maildir(LOCAL_STATE state, USER_ATTR usr_attr)
@@ -84,6 +311,7 @@ int     deliver_maildir(LOCAL_STATE state, USER_ATTR usr_attr)
     int     mail_copy_status;
     int     deliver_status;
     int     copy_flags;
+    int     fd;
     struct stat st;
     struct timeval starttime;
 
@@ -175,7 +403,12 @@ int     deliver_maildir(LOCAL_STATE state, USER_ATTR usr_attr)
      * [...]
      */
     set_eugid(usr_attr.uid, usr_attr.gid);
-    vstring_sprintf(buf, "%lu.P%d.%s",
+    if (maildir_batch_limit > 0)
+	vstring_sprintf(buf, "%lu.P%dQ%d.%s",
+			(unsigned long) starttime.tv_sec, var_pid,
+			maildir_batch_count, get_hostname());
+    else
+	vstring_sprintf(buf, "%lu.P%d.%s",
 		 (unsigned long) starttime.tv_sec, var_pid, get_hostname());
     tmpfile = concatenate(tmpdir, STR(buf), (char *) 0);
     newfile = 0;
@@ -201,48 +434,37 @@ int     deliver_maildir(LOCAL_STATE state, USER_ATTR usr_attr)
 			(unsigned long) starttime.tv_usec,
 			get_hostname());
 	newfile = concatenate(newdir, STR(buf), (char *) 0);
-	if ((mail_copy_status = mail_copy(COPY_ATTR(state.msg_attr),
-					  dst, copy_flags, "\n",
-					  why)) == 0) {
-	    if (sane_link(tmpfile, newfile) < 0
-		&& (errno != ENOENT
-		    || (make_dirs(curdir, 0700), make_dirs(newdir, 0700)) < 0
-		    || sane_link(tmpfile, newfile) < 0)) {
-		dsb_simple(why, mbox_dsn(errno, "4.2.0"),
-			   "create maildir file %s: %m", newfile);
-		mail_copy_status = MAIL_COPY_STAT_WRITE;
+
+	/*
+	 * In batch mode, keep the file open for fsync_batch(), and leave
+	 * the move into new/ and the status report to maildir_batch_flush().
+	 */
+	if (maildir_batch_limit > 0) {
+	    if ((fd = dup(vstream_fileno(dst))) < 0)
+		msg_fatal("dup: %m");
+	    if ((mail_copy_status = mail_copy(COPY_ATTR(state.msg_attr),
+					      dst, copy_flags & ~MAIL_COPY_TOFILE,
+					      "\n", why)) == 0) {
+		set_eugid(var_owner_uid, var_owner_gid);
+		maildir_batch_append(state, usr_attr, tmpfile, newfile,
+				     newdir, curdir, fd);
+		vstring_free(buf);
+		return (0);
 	    }
+	    (void) close(fd);
+	} else if ((mail_copy_status = mail_copy(COPY_ATTR(state.msg_attr),
+						 dst, copy_flags, "\n",
+						 why)) == 0) {
+	    mail_copy_status = maildir_link(tmpfile, newfile, newdir,
+					    curdir, why);
 	}
 	if (unlink(tmpfile) < 0)
 	    msg_warn("remove %s: %m", tmpfile);
     }
     set_eugid(var_owner_uid, var_owner_gid);
 
-    /*
-     * The maildir location is controlled by the mail administrator. If
-     * delivery fails, try again later. We would just bounce when the maildir
-     * location possibly under user control.
-     */
-    if (mail_copy_status & MAIL_COPY_STAT_CORRUPT) {
-	deliver_status = DEL_STAT_DEFER;
-    } else if (mail_copy_status != 0) {
-	if (errno == EACCES) {
-	    msg_warn("maildir access problem for UID/GID=%lu/%lu: %s",
-		     (long) usr_attr.uid, (long) usr_attr.gid,
-		     STR(why->reason));
-	    msg_warn("perhaps you need to create the maildirs in advance");
-	}
-	vstring_sprintf_prepend(why->reason, "maildir delivery failed: ");
-	deliver_status =
-	    (STR(why->status)[0] == '4' ?
-	     defer_append : bounce_append)
-	    (BOUNCE_FLAGS(state.request),
-	     BOUNCE_ATTR(state.msg_attr));
-    } else {
-	dsb_simple(why, "2.0.0", "delivered to maildir");
-	deliver_status = sent(BOUNCE_FLAGS(state.request),
-			      SENT_ATTR(state.msg_attr));
-    }
+    deliver_status = maildir_status(state.msg_attr, state.request,
+				    usr_attr, mail_copy_status);
     vstring_free(buf);
     myfree(newdir);
     myfree(tmpdir);
@@ -216,6 +216,12 @@
 /* .IP "\fBvirtual_destination_recipient_limit ($default_destination_recipient_limit)\fR"
 /*	The maximal number of recipients per message for the virtual
 /*	message delivery transport.
+/* .PP
+/*	Available in Postfix version 3.5 and later:
+/* .IP "\fBvirtual_maildir_sync_batch_limit (1)\fR"
+/*	The maximal number of maildir files that the \fBvirtual\fR(8)
+/*	delivery agent flushes to stable storage as a group, when a
+/*	delivery request has multiple recipients.
 /* MISCELLANEOUS CONTROLS
 /* .ad
 /* .fi
@@ -355,6 +361,7 @@ int     var_virt_minimum_uid;
 char   *var_virt_mailbox_base;
 char   *var_virt_mailbox_lock;
 long    var_virt_mailbox_limit;
+int     var_virt_maildir_batch;
 char   *var_mail_spool_dir;		/* XXX dependency fix */
 bool    var_strict_mbox_owner;
 char   *var_virt_dsn_filter;
@@ -380,6 +387,7 @@ static int local_deliver(DELIVER_REQUEST *rqst, char *service)
     RECIPIENT *rcpt;
     int     rcpt_stat;
     int     msg_stat;
+    int     queued;
     LOCAL_STATE state;
     USER_ATTR usr_attr;
 
@@ -403,19 +411,30 @@ static int local_deliver(DELIVER_REQUEST *rqst, char *service)
     RESET_USER_ATTR(usr_attr, state.level);
     state.request = rqst;
 
+    /*
+     * With multiple recipients, optionally postpone the fsync() calls for
+     * maildir deliveries, so that they can be done as a group.
+     */
+    if (var_virt_maildir_batch > 1 && rqst->rcpt_list.len > 1)
+	maildir_batch_init(var_virt_maildir_batch);
+
     /*
      * Iterate over each recipient named in the delivery request. When the
      * mail delivery status for a given recipient is definite (i.e. bounced
      * or delivered), update the message queue file and cross off the
-     * recipient. Update the per-message delivery status.
+     * recipient. Update the per-message delivery status. When a maildir
+     * delivery was postponed, maildir_batch_finish() will do this.
      */
     for (msg_stat = 0, rcpt = rqst->rcpt_list.info; rcpt < rcpt_end; rcpt++) {
 	state.msg_attr.rcpt = *rcpt;
+	queued = maildir_batch_queued();
 	rcpt_stat = deliver_recipient(state, usr_attr);
-	if (rcpt_stat == 0 && (rqst->flags & DEL_REQ_FLAG_SUCCESS))
+	if (rcpt_stat == 0 && (rqst->flags & DEL_REQ_FLAG_SUCCESS)
+	    && maildir_batch_queued() == queued)
 	    deliver_completed(state.msg_attr.fp, rcpt->offset);
 	msg_stat |= rcpt_stat;
     }
+    msg_stat |= maildir_batch_finish();
 
     deliver_attr_free(&state.msg_attr);
     return (msg_stat);
@@ -524,6 +543,7 @@ int     main(int argc, char **argv)
 {
     static const CONFIG_INT_TABLE int_table[] = {
 	VAR_VIRT_MINUID, DEF_VIRT_MINUID, &var_virt_minimum_uid, 1, 0,
+	VAR_VIRT_MAILDIR_BATCH, DEF_VIRT_MAILDIR_BATCH, &var_virt_maildir_batch, 1, 0,
 	0,
     };
     static const CONFIG_LONG_TABLE long_table[] = {
@@ -128,6 +128,13 @@ extern int deliver_file(LOCAL_STATE, USER_ATTR, char *);
 extern int deliver_maildir(LOCAL_STATE, USER_ATTR);
 extern int deliver_unknown(LOCAL_STATE);
 
+ /*
+  * Batched maildir delivery.
+  */
+extern void maildir_batch_init(int);
+extern int maildir_batch_queued(void);
+extern int maildir_batch_finish(void);
+
  /*
   * Mailbox lock protocol.
   */